@@ -42,6 +42,7 @@
 #include "i965_encoder_api.h"
 #include "gen10_hcp_common.h"
 #include "gen10_hevc_enc_common.h"
+#include "i965_byte_scan.h"
 
 static const unsigned char default_scaling16[16] = {
     16, 16, 16, 16,
@@ -396,21 +397,19 @@ gen10_hevc_enc_init_frame_info(VADriverContextP ctx,
 static int
 hevc_find_skipemulcnt(uint8_t *buf, int bits_length)
 {
-    int skip_cnt = 0, i = 0;
+    int zero_byte;
 
     if ((bits_length >> 3) < 6)
         return 0;
 
-    for (i = 0; i < 3; i++)
-        if (buf[i] != 0)
-            break;
+    /* Only a start code at the very beginning of the header is skipped */
+    if (i965_byte_scan_start_code(buf, 1) != 0)
+        return 0;
 
-    if (i > 1) {
-        if (buf[i] == 1)
-            skip_cnt = i + 3;
-    }
+    zero_byte = (buf[2] != 1);
 
-    return skip_cnt;
+    /* the start code and the two bytes of the NAL unit header */
+    return zero_byte + 3 + 2;
 }
 
 static void
@@ -1139,7 +1139,7 @@ gen10_hevc_allocate_enc_resources(VADriverContextP ctx,
     if (!allocate_flag)
         goto FAIL;
 
-    i965_zero_gpe_resource(&vme_context->res_brc_history_buffer);
+    i965_zero_gpe_resource(ctx, &vme_context->res_brc_history_buffer);
 
     i965_free_gpe_resource(&vme_context->res_brc_intra_dist_surface);
     dw_width = ALIGN(hevc_state->frame_width_4x / 2, 64);
@@ -1151,7 +1151,7 @@ gen10_hevc_allocate_enc_resources(VADriverContextP ctx,
     if (!allocate_flag)
         goto FAIL;
 
-    i965_zero_gpe_resource(&vme_context->res_brc_intra_dist_surface);
+    i965_zero_gpe_resource(ctx, &vme_context->res_brc_intra_dist_surface);
 
     for (i = 0; i < 2; i++) {
         i965_free_gpe_resource(&vme_context->res_brc_pak_statistics_buffer[i]);
@@ -1201,7 +1201,7 @@ gen10_hevc_allocate_enc_resources(VADriverContextP ctx,
     if (!allocate_flag)
         goto FAIL;
 
-    i965_zero_gpe_resource(&vme_context->res_brc_lcu_const_data_buffer);
+    i965_zero_gpe_resource(ctx, &vme_context->res_brc_lcu_const_data_buffer);
 
     i965_free_gpe_resource(&vme_context->res_brc_mb_qp_surface);
     dw_width = ALIGN(hevc_state->frame_width_4x * 4, 64) >> 4;
@@ -1216,7 +1216,7 @@ gen10_hevc_allocate_enc_resources(VADriverContextP ctx,
     if (!allocate_flag)
         goto FAIL;
 
-    i965_zero_gpe_resource(&vme_context->res_brc_mb_qp_surface);
+    i965_zero_gpe_resource(ctx, &vme_context->res_brc_mb_qp_surface);
 
     return VA_STATUS_SUCCESS;
 
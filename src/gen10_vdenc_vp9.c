@@ -1622,7 +1622,7 @@ gen10_vdenc_vp9_update_streamin_state(VADriverContextP ctx,
     if (!vdenc_context->segment_param && !vdenc_context->hme_enabled)
         return;
 
-    i965_zero_gpe_resource(&vdenc_context->vdenc_streamin_buffer_res);
+    i965_zero_gpe_resource_cpu(ctx, &vdenc_context->vdenc_streamin_buffer_res);
 
     if (!vdenc_context->segment_param)
         return;
@@ -1735,14 +1735,14 @@ gen10_vdenc_vp9_allocate_resources_once(VADriverContextP ctx,
     ALLOC_VDENC_BUFFER_RESOURCE(vdenc_context->vdenc_brc_pak_stat_buffer_res,
                                 res_size,
                                 "VDEnc brc pak statistics buffer");
-    i965_zero_gpe_resource(&vdenc_context->vdenc_brc_pak_stat_buffer_res);
+    i965_zero_gpe_resource(ctx, &vdenc_context->vdenc_brc_pak_stat_buffer_res);
 
     res_size = vdenc_context->frame_width_in_sbs * vdenc_context->frame_height_in_sbs * 64;
     ALLOC_VDENC_BUFFER_RESOURCE(vdenc_context->segmentid_buffer_res,
                                 res_size,
                                 "VP9 segment id");
 
-    i965_zero_gpe_resource(&vdenc_context->segmentid_buffer_res);
+    i965_zero_gpe_resource(ctx, &vdenc_context->segmentid_buffer_res);
 
     vdenc_context->allocate_once_done = 1;
 
@@ -2034,19 +2034,19 @@ gen10_vdenc_vp9_allocate_resources(VADriverContextP ctx,
     ALLOC_VDENC_BUFFER_RESOURCE(vdenc_context->vdenc_sse_src_pixel_row_store_buffer_res,
                                 (frame_width_in_sbs + 2) * 32 * 64,
                                 "VDEnc sse src pixel row store");
-    i965_zero_gpe_resource(&vdenc_context->vdenc_sse_src_pixel_row_store_buffer_res);
+    i965_zero_gpe_resource(ctx, &vdenc_context->vdenc_sse_src_pixel_row_store_buffer_res);
 
     i965_free_gpe_resource(&vdenc_context->vdenc_data_extension_buffer_res);
     ALLOC_VDENC_BUFFER_RESOURCE(vdenc_context->vdenc_data_extension_buffer_res,
                                 VDENC_VP9_HUC_DATA_EXTENSION_SIZE,
                                 "VDEnc data extension buffer");
-    i965_zero_gpe_resource(&vdenc_context->vdenc_data_extension_buffer_res);
+    i965_zero_gpe_resource(ctx, &vdenc_context->vdenc_data_extension_buffer_res);
 
     i965_free_gpe_resource(&vdenc_context->vdenc_streamin_buffer_res);
     ALLOC_VDENC_BUFFER_RESOURCE(vdenc_context->vdenc_streamin_buffer_res,
                                 (ALIGN(vdenc_context->frame_width, VP9_SUPER_BLOCK_WIDTH) / 32) * (ALIGN(vdenc_context->frame_height, VP9_SUPER_BLOCK_HEIGHT) / 32) * 64,
                                 "VDEnc stream in");
-    i965_zero_gpe_resource(&vdenc_context->vdenc_streamin_buffer_res);
+    i965_zero_gpe_resource(ctx, &vdenc_context->vdenc_streamin_buffer_res);
 
     i965_free_gpe_resource(&vdenc_context->huc_status2_buffer_res);
     ALLOC_VDENC_BUFFER_RESOURCE(vdenc_context->huc_status2_buffer_res,
@@ -2063,26 +2063,26 @@ gen10_vdenc_vp9_allocate_resources(VADriverContextP ctx,
         ALLOC_VDENC_BUFFER_RESOURCE(vdenc_context->huc_initializer_dmem_buffer_res[i],
                                     ALIGN(sizeof(struct huc_initializer_dmem), 64),
                                     "HuC Initializer DMEM buffer");
-        i965_zero_gpe_resource(&vdenc_context->huc_initializer_dmem_buffer_res[i]);
+        i965_zero_gpe_resource(ctx, &vdenc_context->huc_initializer_dmem_buffer_res[i]);
 
         i965_free_gpe_resource(&vdenc_context->huc_initializer_data_buffer_res[i]);
         ALLOC_VDENC_BUFFER_RESOURCE(vdenc_context->huc_initializer_data_buffer_res[i],
                                     ALIGN(sizeof(struct huc_initializer_data), 0x1000),
                                     "HuC Initializer Data buffer");
-        i965_zero_gpe_resource(&vdenc_context->huc_initializer_data_buffer_res[i]);
+        i965_zero_gpe_resource(ctx, &vdenc_context->huc_initializer_data_buffer_res[i]);
     }
 
     i965_free_gpe_resource(&vdenc_context->huc_initializer_dys_dmem_buffer_res);
     ALLOC_VDENC_BUFFER_RESOURCE(vdenc_context->huc_initializer_dys_dmem_buffer_res,
                                 ALIGN(sizeof(struct huc_initializer_dmem), 64),
                                 "HuC Initializer DYS DMEM buffer");
-    i965_zero_gpe_resource(&vdenc_context->huc_initializer_dys_dmem_buffer_res);
+    i965_zero_gpe_resource(ctx, &vdenc_context->huc_initializer_dys_dmem_buffer_res);
 
     i965_free_gpe_resource(&vdenc_context->huc_initializer_dys_data_buffer_res);
     ALLOC_VDENC_BUFFER_RESOURCE(vdenc_context->huc_initializer_dys_data_buffer_res,
                                 ALIGN(sizeof(struct huc_initializer_data), 0x1000),
                                 "HuC Initializer DYS data buffer");
-    i965_zero_gpe_resource(&vdenc_context->huc_initializer_dys_data_buffer_res);
+    i965_zero_gpe_resource(ctx, &vdenc_context->huc_initializer_dys_data_buffer_res);
 
     if (!vdenc_context->frame_header_data) {
         /* allocate 512 bytes for generating the uncompressed header */
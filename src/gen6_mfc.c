@@ -688,37 +688,37 @@ gen6_mfc_avc_pak_object_intra(VADriverContextP ctx, int x, int y, int end_mb, in
                               struct intel_batchbuffer *batch)
 {
     int len_in_dwords = 11;
+    unsigned int *dw;
 
     if (batch == NULL)
         batch = encoder_context->base.batch;
 
-    BEGIN_BCS_BATCH(batch, len_in_dwords);
+    BEGIN_BCS_BATCH_SPAN(batch, len_in_dwords, dw);
 
-    OUT_BCS_BATCH(batch, MFC_AVC_PAK_OBJECT | (len_in_dwords - 2));
-    OUT_BCS_BATCH(batch, 0);
-    OUT_BCS_BATCH(batch, 0);
-    OUT_BCS_BATCH(batch,
-                  (0 << 24) |       /* PackedMvNum, Debug*/
-                  (0 << 20) |       /* No motion vector */
-                  (1 << 19) |       /* CbpDcY */
-                  (1 << 18) |       /* CbpDcU */
-                  (1 << 17) |       /* CbpDcV */
-                  (msg[0] & 0xFFFF));
+    *dw++ = MFC_AVC_PAK_OBJECT | (len_in_dwords - 2);
+    *dw++ = 0;
+    *dw++ = 0;
+    *dw++ = (0 << 24) |       /* PackedMvNum, Debug*/
+            (0 << 20) |       /* No motion vector */
+            (1 << 19) |       /* CbpDcY */
+            (1 << 18) |       /* CbpDcU */
+            (1 << 17) |       /* CbpDcV */
+            (msg[0] & 0xFFFF);
 
-    OUT_BCS_BATCH(batch, (0xFFFF << 16) | (y << 8) | x);        /* Code Block Pattern for Y*/
-    OUT_BCS_BATCH(batch, 0x000F000F);                           /* Code Block Pattern */
-    OUT_BCS_BATCH(batch, (0 << 27) | (end_mb << 26) | qp);  /* Last MB */
+    *dw++ = (0xFFFF << 16) | (y << 8) | x;        /* Code Block Pattern for Y*/
+    *dw++ = 0x000F000F;                           /* Code Block Pattern */
+    *dw++ = (0 << 27) | (end_mb << 26) | qp;  /* Last MB */
 
     /*Stuff for Intra MB*/
-    OUT_BCS_BATCH(batch, msg[1]);           /* We using Intra16x16 no 4x4 predmode*/
-    OUT_BCS_BATCH(batch, msg[2]);
-    OUT_BCS_BATCH(batch, msg[3] & 0xFC);
+    *dw++ = msg[1];           /* We using Intra16x16 no 4x4 predmode*/
+    *dw++ = msg[2];
+    *dw++ = msg[3] & 0xFC;
 
     /*MaxSizeInWord and TargetSzieInWord*/
-    OUT_BCS_BATCH(batch, (max_mb_size << 24) |
-                  (target_mb_size << 16));
+    *dw++ = (max_mb_size << 24) |
+            (target_mb_size << 16);
 
-    ADVANCE_BCS_BATCH(batch);
+    ADVANCE_BCS_BATCH_SPAN(batch, dw);
 
     return len_in_dwords;
 }
@@ -732,47 +732,48 @@ gen6_mfc_avc_pak_object_inter(VADriverContextP ctx, int x, int y, int end_mb, in
 {
     struct gen6_vme_context *vme_context = encoder_context->vme_context;
     int len_in_dwords = 11;
+    unsigned int *dw;
 
     if (batch == NULL)
         batch = encoder_context->base.batch;
 
-    BEGIN_BCS_BATCH(batch, len_in_dwords);
+    BEGIN_BCS_BATCH_SPAN(batch, len_in_dwords, dw);
 
-    OUT_BCS_BATCH(batch, MFC_AVC_PAK_OBJECT | (len_in_dwords - 2));
+    *dw++ = MFC_AVC_PAK_OBJECT | (len_in_dwords - 2);
 
-    OUT_BCS_BATCH(batch, msg[2]);         /* 32 MV*/
-    OUT_BCS_BATCH(batch, offset);
+    *dw++ = msg[2];         /* 32 MV*/
+    *dw++ = offset;
 
-    OUT_BCS_BATCH(batch, msg[0]);
+    *dw++ = msg[0];
 
-    OUT_BCS_BATCH(batch, (0xFFFF << 16) | (y << 8) | x);      /* Code Block Pattern for Y*/
-    OUT_BCS_BATCH(batch, 0x000F000F);                         /* Code Block Pattern */
+    *dw++ = (0xFFFF << 16) | (y << 8) | x;      /* Code Block Pattern for Y*/
+    *dw++ = 0x000F000F;                         /* Code Block Pattern */
 #if 0
     if (slice_type == SLICE_TYPE_B) {
-        OUT_BCS_BATCH(batch, (0xF << 28) | (end_mb << 26) | qp); /* Last MB */
+        *dw++ = (0xF << 28) | (end_mb << 26) | qp; /* Last MB */
     } else {
-        OUT_BCS_BATCH(batch, (end_mb << 26) | qp);  /* Last MB */
+        *dw++ = (end_mb << 26) | qp;  /* Last MB */
     }
 #else
-    OUT_BCS_BATCH(batch, (end_mb << 26) | qp);  /* Last MB */
+    *dw++ = (end_mb << 26) | qp;  /* Last MB */
 #endif
 
 
     /*Stuff for Inter MB*/
-    OUT_BCS_BATCH(batch, msg[1]);
-    OUT_BCS_BATCH(batch, vme_context->ref_index_in_mb[0]);
-    OUT_BCS_BATCH(batch, vme_context->ref_index_in_mb[1]);
+    *dw++ = msg[1];
+    *dw++ = vme_context->ref_index_in_mb[0];
+    *dw++ = vme_context->ref_index_in_mb[1];
 
     /*MaxSizeInWord and TargetSzieInWord*/
-    OUT_BCS_BATCH(batch, (max_mb_size << 24) |
-                  (target_mb_size << 16));
+    *dw++ = (max_mb_size << 24) |
+            (target_mb_size << 16);
 
-    ADVANCE_BCS_BATCH(batch);
+    ADVANCE_BCS_BATCH_SPAN(batch, dw);
 
     return len_in_dwords;
 }
 
-static void
+void
 gen6_mfc_avc_pipeline_slice_programing(VADriverContextP ctx,
                                        struct encode_state *encode_state,
                                        struct intel_encoder_context *encoder_context,
@@ -887,14 +888,13 @@ gen6_mfc_avc_software_batchbuffer(VADriverContextP ctx,
     struct gen6_mfc_context *mfc_context = encoder_context->mfc_context;
     struct intel_batchbuffer *batch;;
     dri_bo *batch_bo;
-    int i;
 
     batch = mfc_context->aux_batchbuffer;
     batch_bo = batch->buffer;
+    intel_batchbuffer_start_atomic_bcs(batch, 0x1000);
 
-    for (i = 0; i < encode_state->num_slice_params_ext; i++) {
-        gen6_mfc_avc_pipeline_slice_programing(ctx, encode_state, encoder_context, i, batch);
-    }
+    intel_encoder_slice_programing(ctx, encode_state, encoder_context,
+                                   gen6_mfc_avc_pipeline_slice_programing, batch);
 
     intel_batchbuffer_align(batch, 8);
 
@@ -903,6 +903,9 @@ gen6_mfc_avc_software_batchbuffer(VADriverContextP ctx,
     OUT_BCS_BATCH(batch, MI_BATCH_BUFFER_END);
     ADVANCE_BCS_BATCH(batch);
 
+    intel_batchbuffer_end_atomic(batch);
+
+    intel_batchbuffer_record_second_level(batch);
     dri_bo_reference(batch_bo);
 
     intel_batchbuffer_free(batch);
@@ -1456,6 +1459,7 @@ gen6_mfc_context_destroy(void *context)
     }
 
     i965_gpe_context_destroy(&mfc_context->gpe_context);
+    i965_complexity_context_fini(&mfc_context->complexity);
 
     dri_bo_unreference(mfc_context->mfc_batchbuffer_surface.bo);
     mfc_context->mfc_batchbuffer_surface.bo = NULL;
@@ -35,6 +35,8 @@
 
 #include "i965_encoder.h"
 #include "i965_gpe_utils.h"
+#include "i965_brc_model.h"
+#include "i965_complexity.h"
 
 struct encode_state;
 
@@ -61,25 +63,6 @@ struct encode_state;
 
 #define CMD_LEN_IN_OWORD        4
 
-#define BRC_CLIP(x, min, max)                                   \
-    {                                                           \
-        x = ((x > (max)) ? (max) : ((x < (min)) ? (min) : x));  \
-    }
-
-#define BRC_P_B_QP_DIFF 4
-#define BRC_I_P_QP_DIFF 2
-#define BRC_I_B_QP_DIFF (BRC_I_P_QP_DIFF + BRC_P_B_QP_DIFF)
-
-#define BRC_PWEIGHT 0.6  /* weight if P slice with comparison to I slice */
-#define BRC_BWEIGHT 0.25 /* weight if B slice with comparison to I slice */
-
-#define BRC_QP_MAX_CHANGE 5 /* maximum qp modification */
-#define BRC_CY 0.1 /* weight for */
-#define BRC_CX_UNDERFLOW 5.
-#define BRC_CX_OVERFLOW -4.
-
-#define BRC_PI_0_5 1.5707963267948966192313216916398
-
 typedef enum {
     VME_V_PRED = 0,
     VME_H_PRED = 1,
@@ -137,14 +120,6 @@ typedef struct {
     int vp8_pak_intra_block_mode;
 } vp8_intra_block_mode_map_t;
 
-typedef enum _gen6_brc_status {
-    BRC_NO_HRD_VIOLATION = 0,
-    BRC_UNDERFLOW = 1,
-    BRC_OVERFLOW = 2,
-    BRC_UNDERFLOW_WITH_MAX_QP = 3,
-    BRC_OVERFLOW_WITH_MIN_QP = 4,
-} gen6_brc_status;
-
 struct gen6_mfc_avc_surface_aux {
     dri_bo *dmv_top;
     dri_bo *dmv_bottom;
@@ -219,24 +194,9 @@ struct gen6_mfc_context {
         unsigned char ShrinkResistance;
     } bit_rate_control_context[3];      //INTERNAL: for I, P, B frames
 
-    struct {
-        int mode;
-        int gop_nums[MAX_MFC_REFERENCE_SURFACES][3];
-        int target_frame_size[MAX_TEMPORAL_LAYERS][3]; // I,P,B
-        int qp_prime_y[MAX_TEMPORAL_LAYERS][3];
-        double bits_per_frame[MAX_TEMPORAL_LAYERS];
-        double qpf_rounding_accumulator[MAX_TEMPORAL_LAYERS];
-        int bits_prev_frame[MAX_TEMPORAL_LAYERS];
-        int prev_slice_type[MAX_TEMPORAL_LAYERS];
-    } brc;
-
-    struct {
-        double current_buffer_fullness[MAX_TEMPORAL_LAYERS];
-        double target_buffer_fullness[MAX_TEMPORAL_LAYERS];
-        double buffer_capacity[MAX_TEMPORAL_LAYERS];
-        unsigned int buffer_size[MAX_TEMPORAL_LAYERS];
-        unsigned int violation_noted;
-    } hrd;
+    struct i965_brc_rate_state brc;
+    struct i965_brc_hrd_state hrd;
+    struct i965_complexity_context complexity;  /* lookahead BRC */
 
     //HRD control context
     struct {
@@ -391,4 +351,47 @@ intel_avc_slice_insert_packed_data(VADriverContextP ctx,
 extern
 Bool gen9_mfc_context_init(VADriverContextP ctx, struct intel_encoder_context *encoder_context);
 
+/* The software PAK slice generators, see intel_encoder_slice_programing() */
+extern void
+gen6_mfc_avc_pipeline_slice_programing(VADriverContextP ctx,
+                                       struct encode_state *encode_state,
+                                       struct intel_encoder_context *encoder_context,
+                                       int slice_index,
+                                       struct intel_batchbuffer *slice_batch);
+
+extern void
+gen75_mfc_avc_pipeline_slice_programing(VADriverContextP ctx,
+                                        struct encode_state *encode_state,
+                                        struct intel_encoder_context *encoder_context,
+                                        int slice_index,
+                                        struct intel_batchbuffer *slice_batch);
+
+extern void
+gen8_mfc_avc_pipeline_slice_programing(VADriverContextP ctx,
+                                       struct encode_state *encode_state,
+                                       struct intel_encoder_context *encoder_context,
+                                       int slice_index,
+                                       struct intel_batchbuffer *slice_batch);
+
+extern void
+gen7_mfc_mpeg2_slice_programing(VADriverContextP ctx,
+                                struct encode_state *encode_state,
+                                struct intel_encoder_context *encoder_context,
+                                int slice_index,
+                                struct intel_batchbuffer *slice_batch);
+
+extern void
+gen75_mfc_mpeg2_slice_programing(VADriverContextP ctx,
+                                 struct encode_state *encode_state,
+                                 struct intel_encoder_context *encoder_context,
+                                 int slice_index,
+                                 struct intel_batchbuffer *slice_batch);
+
+extern void
+gen8_mfc_mpeg2_slice_programing(VADriverContextP ctx,
+                                struct encode_state *encode_state,
+                                struct intel_encoder_context *encoder_context,
+                                int slice_index,
+                                struct intel_batchbuffer *slice_batch);
+
 #endif  /* _GEN6_MFC_BCS_H_ */
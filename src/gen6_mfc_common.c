@@ -39,6 +39,7 @@
 #include "i965_drv_video.h"
 #include "i965_encoder.h"
 #include "i965_encoder_utils.h"
+#include "i965_tiled_copy.h"
 #include "gen6_mfc.h"
 #include "gen6_vme.h"
 #include "gen9_mfc.h"
@@ -90,116 +91,43 @@ intel_mfc_bit_rate_control_context_init(struct encode_state *encode_state,
     }
 }
 
-static void intel_mfc_brc_init(struct encode_state *encode_state,
-                               struct intel_encoder_context* encoder_context)
+static void
+intel_mfc_brc_model_params(struct intel_encoder_context *encoder_context,
+                           struct i965_brc_model_params *params)
 {
-    struct gen6_mfc_context *mfc_context = encoder_context->mfc_context;
-    double bitrate, framerate;
-    double frame_per_bits = 8 * 3 * encoder_context->frame_width_in_pixel * encoder_context->frame_height_in_pixel / 2;
-    double qp1_size = 0.1 * frame_per_bits;
-    double qp51_size = 0.001 * frame_per_bits;
-    int min_qp = MAX(1, encoder_context->brc.min_qp);
-    double bpf, factor, hrd_factor;
-    int inum = encoder_context->brc.num_iframes_in_gop,
-        pnum = encoder_context->brc.num_pframes_in_gop,
-        bnum = encoder_context->brc.num_bframes_in_gop; /* Gop structure: number of I, P, B frames in the Gop. */
-    int intra_period = encoder_context->brc.gop_size;
     int i;
-    int tmp_min_qp = 0;
-
-    if (encoder_context->layer.num_layers > 1)
-        qp1_size = 0.15 * frame_per_bits;
-
-    mfc_context->brc.mode = encoder_context->rate_control_mode;
-
-    mfc_context->hrd.violation_noted = 0;
-
-    for (i = 0; i < encoder_context->layer.num_layers; i++) {
-        mfc_context->brc.qp_prime_y[i][SLICE_TYPE_I] = 26;
-        mfc_context->brc.qp_prime_y[i][SLICE_TYPE_P] = 26;
-        mfc_context->brc.qp_prime_y[i][SLICE_TYPE_B] = 26;
-
-        if (i == 0) {
-            bitrate = encoder_context->brc.bits_per_second[0];
-            framerate = (double)encoder_context->brc.framerate[0].num / (double)encoder_context->brc.framerate[0].den;
-        } else {
-            bitrate = (encoder_context->brc.bits_per_second[i] - encoder_context->brc.bits_per_second[i - 1]);
-            framerate = ((double)encoder_context->brc.framerate[i].num / (double)encoder_context->brc.framerate[i].den) -
-                        ((double)encoder_context->brc.framerate[i - 1].num / (double)encoder_context->brc.framerate[i - 1].den);
-        }
-
-        if (mfc_context->brc.mode == VA_RC_VBR && encoder_context->brc.target_percentage[i])
-            bitrate = bitrate * encoder_context->brc.target_percentage[i] / 100;
-
-        if (i == encoder_context->layer.num_layers - 1)
-            factor = 1.0;
-        else {
-            factor = ((double)encoder_context->brc.framerate[i].num / (double)encoder_context->brc.framerate[i].den) /
-                     ((double)encoder_context->brc.framerate[i - 1].num / (double)encoder_context->brc.framerate[i - 1].den);
-        }
 
-        hrd_factor = (double)bitrate / encoder_context->brc.bits_per_second[encoder_context->layer.num_layers - 1];
-
-        mfc_context->hrd.buffer_size[i] = (unsigned int)(encoder_context->brc.hrd_buffer_size * hrd_factor);
-        mfc_context->hrd.current_buffer_fullness[i] =
-            (double)(encoder_context->brc.hrd_initial_buffer_fullness < encoder_context->brc.hrd_buffer_size) ?
-            encoder_context->brc.hrd_initial_buffer_fullness : encoder_context->brc.hrd_buffer_size / 2.;
-        mfc_context->hrd.current_buffer_fullness[i] *= hrd_factor;
-        mfc_context->hrd.target_buffer_fullness[i] = (double)encoder_context->brc.hrd_buffer_size * hrd_factor / 2.;
-        mfc_context->hrd.buffer_capacity[i] = (double)encoder_context->brc.hrd_buffer_size * hrd_factor / qp1_size;
-
-        if (encoder_context->layer.num_layers > 1) {
-            if (i == 0) {
-                intra_period = (int)(encoder_context->brc.gop_size * factor);
-                inum = 1;
-                pnum = (int)(encoder_context->brc.num_pframes_in_gop * factor);
-                bnum = intra_period - inum - pnum;
-            } else {
-                intra_period = (int)(encoder_context->brc.gop_size * factor) - intra_period;
-                inum = 0;
-                pnum = (int)(encoder_context->brc.num_pframes_in_gop * factor) - pnum;
-                bnum = intra_period - inum - pnum;
-            }
-        }
-
-        mfc_context->brc.gop_nums[i][SLICE_TYPE_I] = inum;
-        mfc_context->brc.gop_nums[i][SLICE_TYPE_P] = pnum;
-        mfc_context->brc.gop_nums[i][SLICE_TYPE_B] = bnum;
-
-        mfc_context->brc.target_frame_size[i][SLICE_TYPE_I] = (int)((double)((bitrate * intra_period) / framerate) /
-                                                                    (double)(inum + BRC_PWEIGHT * pnum + BRC_BWEIGHT * bnum));
-        mfc_context->brc.target_frame_size[i][SLICE_TYPE_P] = BRC_PWEIGHT * mfc_context->brc.target_frame_size[i][SLICE_TYPE_I];
-        mfc_context->brc.target_frame_size[i][SLICE_TYPE_B] = BRC_BWEIGHT * mfc_context->brc.target_frame_size[i][SLICE_TYPE_I];
-
-        bpf = mfc_context->brc.bits_per_frame[i] = bitrate / framerate;
+    memset(params, 0, sizeof(*params));
+    params->mode = encoder_context->rate_control_mode;
+    params->frame_width = encoder_context->frame_width_in_pixel;
+    params->frame_height = encoder_context->frame_height_in_pixel;
+    params->num_layers = encoder_context->layer.num_layers;
+    params->gop_size = encoder_context->brc.gop_size;
+    params->num_iframes_in_gop = encoder_context->brc.num_iframes_in_gop;
+    params->num_pframes_in_gop = encoder_context->brc.num_pframes_in_gop;
+    params->num_bframes_in_gop = encoder_context->brc.num_bframes_in_gop;
+    params->hrd_buffer_size = encoder_context->brc.hrd_buffer_size;
+    params->hrd_initial_buffer_fullness = encoder_context->brc.hrd_initial_buffer_fullness;
+    params->initial_qp = encoder_context->brc.initial_qp;
+    params->min_qp = encoder_context->brc.min_qp;
+    params->lookahead_depth = encoder_context->brc.lookahead_depth;
+
+    for (i = 0; i < encoder_context->layer.num_layers && i < I965_BRC_MAX_LAYERS; i++) {
+        params->bits_per_second[i] = encoder_context->brc.bits_per_second[i];
+        params->framerate_num[i] = encoder_context->brc.framerate[i].num;
+        params->framerate_den[i] = encoder_context->brc.framerate[i].den;
+        params->target_percentage[i] = encoder_context->brc.target_percentage[i];
+    }
+}
 
-        if (encoder_context->brc.initial_qp) {
-            mfc_context->brc.qp_prime_y[i][SLICE_TYPE_I] = encoder_context->brc.initial_qp;
-            mfc_context->brc.qp_prime_y[i][SLICE_TYPE_P] = encoder_context->brc.initial_qp;
-            mfc_context->brc.qp_prime_y[i][SLICE_TYPE_B] = encoder_context->brc.initial_qp;
+static void intel_mfc_brc_init(struct encode_state *encode_state,
+                               struct intel_encoder_context* encoder_context)
+{
+    struct gen6_mfc_context *mfc_context = encoder_context->mfc_context;
+    struct i965_brc_model_params params;
 
-            BRC_CLIP(mfc_context->brc.qp_prime_y[i][SLICE_TYPE_I], min_qp, 51);
-            BRC_CLIP(mfc_context->brc.qp_prime_y[i][SLICE_TYPE_P], min_qp, 51);
-            BRC_CLIP(mfc_context->brc.qp_prime_y[i][SLICE_TYPE_B], min_qp, 51);
-        } else {
-            if ((bpf > qp51_size) && (bpf < qp1_size)) {
-                mfc_context->brc.qp_prime_y[i][SLICE_TYPE_P] = 51 - 50 * (bpf - qp51_size) / (qp1_size - qp51_size);
-            } else if (bpf >= qp1_size)
-                mfc_context->brc.qp_prime_y[i][SLICE_TYPE_P] = 1;
-            else if (bpf <= qp51_size)
-                mfc_context->brc.qp_prime_y[i][SLICE_TYPE_P] = 51;
-
-            mfc_context->brc.qp_prime_y[i][SLICE_TYPE_I] = mfc_context->brc.qp_prime_y[i][SLICE_TYPE_P];
-            mfc_context->brc.qp_prime_y[i][SLICE_TYPE_B] = mfc_context->brc.qp_prime_y[i][SLICE_TYPE_I];
-
-            tmp_min_qp = (min_qp < 36) ? min_qp : 36;
-            BRC_CLIP(mfc_context->brc.qp_prime_y[i][SLICE_TYPE_I], tmp_min_qp, 36);
-            tmp_min_qp = (min_qp < 40) ? min_qp : 40;
-            BRC_CLIP(mfc_context->brc.qp_prime_y[i][SLICE_TYPE_P], tmp_min_qp, 40);
-            tmp_min_qp = (min_qp < 45) ? min_qp : 45;
-            BRC_CLIP(mfc_context->brc.qp_prime_y[i][SLICE_TYPE_B], tmp_min_qp, 45);
-        }
-    }
+    intel_mfc_brc_model_params(encoder_context, &params);
+    i965_brc_model_init(&params, &mfc_context->brc, &mfc_context->hrd);
 }
 
 int intel_mfc_update_hrd(struct encode_state *encode_state,
@@ -207,290 +135,96 @@ int intel_mfc_update_hrd(struct encode_state *encode_state,
                          int frame_bits)
 {
     struct gen6_mfc_context *mfc_context = encoder_context->mfc_context;
-    int layer_id = encoder_context->layer.curr_frame_layer_id;
-    double prev_bf = mfc_context->hrd.current_buffer_fullness[layer_id];
-
-    mfc_context->hrd.current_buffer_fullness[layer_id] -= frame_bits;
-
-    if (mfc_context->hrd.buffer_size[layer_id] > 0 && mfc_context->hrd.current_buffer_fullness[layer_id] <= 0.) {
-        mfc_context->hrd.current_buffer_fullness[layer_id] = prev_bf;
-        return BRC_UNDERFLOW;
-    }
 
-    mfc_context->hrd.current_buffer_fullness[layer_id] += mfc_context->brc.bits_per_frame[layer_id];
-    if (mfc_context->hrd.buffer_size[layer_id] > 0 && mfc_context->hrd.current_buffer_fullness[layer_id] > mfc_context->hrd.buffer_size[layer_id]) {
-        if (mfc_context->brc.mode == VA_RC_VBR)
-            mfc_context->hrd.current_buffer_fullness[layer_id] = mfc_context->hrd.buffer_size[layer_id];
-        else {
-            mfc_context->hrd.current_buffer_fullness[layer_id] = prev_bf;
-            return BRC_OVERFLOW;
-        }
-    }
-    return BRC_NO_HRD_VIOLATION;
+    return i965_brc_model_update_hrd(&mfc_context->brc, &mfc_context->hrd,
+                                     encoder_context->layer.curr_frame_layer_id,
+                                     frame_bits);
 }
 
-static int intel_mfc_brc_postpack_cbr(struct encode_state *encode_state,
-                                      struct intel_encoder_context *encoder_context,
-                                      int frame_bits)
+static void
+intel_mfc_brc_model_frame(struct encode_state *encode_state,
+                          struct intel_encoder_context *encoder_context,
+                          struct i965_brc_model_frame *frame)
 {
-    struct gen6_mfc_context *mfc_context = encoder_context->mfc_context;
-    gen6_brc_status sts = BRC_NO_HRD_VIOLATION;
     VAEncSliceParameterBufferH264 *pSliceParameter = (VAEncSliceParameterBufferH264 *)encode_state->slice_params_ext[0]->buffer;
-    int slicetype = intel_avc_enc_slice_type_fixup(pSliceParameter->slice_type);
-    int curr_frame_layer_id, next_frame_layer_id;
-    int qpi, qpp, qpb;
-    int qp; // quantizer of previously encoded slice of current type
-    int qpn; // predicted quantizer for next frame of current type in integer format
-    double qpf; // predicted quantizer for next frame of current type in float format
-    double delta_qp; // QP correction
-    int min_qp = MAX(1, encoder_context->brc.min_qp);
-    int target_frame_size, frame_size_next;
-    /* Notes:
-     *  x - how far we are from HRD buffer borders
-     *  y - how far we are from target HRD buffer fullness
-     */
-    double x, y;
-    double frame_size_alpha;
+
+    memset(frame, 0, sizeof(*frame));
+    frame->slice_type = intel_avc_enc_slice_type_fixup(pSliceParameter->slice_type);
 
     if (encoder_context->layer.num_layers < 2 || encoder_context->layer.size_frame_layer_ids == 0) {
-        curr_frame_layer_id = 0;
-        next_frame_layer_id = 0;
+        frame->layer_id = 0;
+        frame->next_layer_id = 0;
     } else {
-        curr_frame_layer_id = encoder_context->layer.curr_frame_layer_id;
-        next_frame_layer_id = encoder_context->layer.frame_layer_ids[encoder_context->num_frames_in_sequence % encoder_context->layer.size_frame_layer_ids];
+        frame->layer_id = encoder_context->layer.curr_frame_layer_id;
+        frame->next_layer_id = encoder_context->layer.frame_layer_ids[encoder_context->num_frames_in_sequence % encoder_context->layer.size_frame_layer_ids];
     }
+}
 
-    /* checking wthether HRD compliance first */
-    sts = intel_mfc_update_hrd(encode_state, encoder_context, frame_bits);
-
-    if (sts == BRC_NO_HRD_VIOLATION) { // no HRD violation
-        /* nothing */
-    } else {
-        next_frame_layer_id = curr_frame_layer_id;
-    }
+int intel_mfc_brc_postpack(struct encode_state *encode_state,
+                           struct intel_encoder_context *encoder_context,
+                           int frame_bits)
+{
+    struct gen6_mfc_context *mfc_context = encoder_context->mfc_context;
+    struct i965_brc_model_params params;
+    struct i965_brc_model_frame frame;
 
-    mfc_context->brc.bits_prev_frame[curr_frame_layer_id] = frame_bits;
-    frame_bits = mfc_context->brc.bits_prev_frame[next_frame_layer_id];
+    intel_mfc_brc_model_params(encoder_context, &params);
+    intel_mfc_brc_model_frame(encode_state, encoder_context, &frame);
+    frame.frame_bits = frame_bits;
 
-    mfc_context->brc.prev_slice_type[curr_frame_layer_id] = slicetype;
-    slicetype = mfc_context->brc.prev_slice_type[next_frame_layer_id];
+    return i965_brc_model_postpack(&params, &mfc_context->brc, &mfc_context->hrd, &frame);
+}
 
-    /* 0 means the next frame is the first frame of next layer */
-    if (frame_bits == 0)
-        return sts;
+/*
+ * Downscales the luma of the input surface band by band through a CPU
+ * mapping and returns its complexity, 0 if it can't be estimated
+ */
+static unsigned int
+intel_mfc_brc_lookahead_complexity(struct encode_state *encode_state,
+                                   struct intel_encoder_context *encoder_context)
+{
+    struct gen6_mfc_context *mfc_context = encoder_context->mfc_context;
+    struct i965_complexity_context *complexity = &mfc_context->complexity;
+    struct object_surface *obj_surface = encode_state->input_yuv_object;
+    unsigned int width = encoder_context->frame_width_in_pixel;
+    unsigned int height = encoder_context->frame_height_in_pixel;
+    unsigned int y, band_height;
+    I965TiledSurface surface;
+
+    if (!obj_surface || !obj_surface->bo || obj_surface->fourcc != VA_FOURCC_NV12)
+        return 0;
 
-    qpi = mfc_context->brc.qp_prime_y[next_frame_layer_id][SLICE_TYPE_I];
-    qpp = mfc_context->brc.qp_prime_y[next_frame_layer_id][SLICE_TYPE_P];
-    qpb = mfc_context->brc.qp_prime_y[next_frame_layer_id][SLICE_TYPE_B];
+    if (!i965_complexity_context_init(complexity, width, height))
+        return 0;
 
-    qp = mfc_context->brc.qp_prime_y[next_frame_layer_id][slicetype];
+    if (!i965_map_surface_for_copy(obj_surface, 0, &surface))
+        return 0;
 
-    target_frame_size = mfc_context->brc.target_frame_size[next_frame_layer_id][slicetype];
-    if (mfc_context->hrd.buffer_capacity[next_frame_layer_id] < 5)
-        frame_size_alpha = 0;
-    else
-        frame_size_alpha = (double)mfc_context->brc.gop_nums[next_frame_layer_id][slicetype];
-    if (frame_size_alpha > 30) frame_size_alpha = 30;
-    frame_size_next = target_frame_size + (double)(target_frame_size - frame_bits) /
-                      (double)(frame_size_alpha + 1.);
-
-    /* frame_size_next: avoiding negative number and too small value */
-    if ((double)frame_size_next < (double)(target_frame_size * 0.25))
-        frame_size_next = (int)((double)target_frame_size * 0.25);
-
-    qpf = (double)qp * target_frame_size / frame_size_next;
-    qpn = (int)(qpf + 0.5);
-
-    if (qpn == qp) {
-        /* setting qpn we round qpf making mistakes: now we are trying to compensate this */
-        mfc_context->brc.qpf_rounding_accumulator[next_frame_layer_id] += qpf - qpn;
-        if (mfc_context->brc.qpf_rounding_accumulator[next_frame_layer_id] > 1.0) {
-            qpn++;
-            mfc_context->brc.qpf_rounding_accumulator[next_frame_layer_id] = 0.;
-        } else if (mfc_context->brc.qpf_rounding_accumulator[next_frame_layer_id] < -1.0) {
-            qpn--;
-            mfc_context->brc.qpf_rounding_accumulator[next_frame_layer_id] = 0.;
-        }
-    }
-    /* making sure that QP is not changing too fast */
-    if ((qpn - qp) > BRC_QP_MAX_CHANGE) qpn = qp + BRC_QP_MAX_CHANGE;
-    else if ((qpn - qp) < -BRC_QP_MAX_CHANGE) qpn = qp - BRC_QP_MAX_CHANGE;
-    /* making sure that with QP predictions we did do not leave QPs range */
-    BRC_CLIP(qpn, 1, 51);
-
-    /* calculating QP delta as some function*/
-    x = mfc_context->hrd.target_buffer_fullness[next_frame_layer_id] - mfc_context->hrd.current_buffer_fullness[next_frame_layer_id];
-    if (x > 0) {
-        x /= mfc_context->hrd.target_buffer_fullness[next_frame_layer_id];
-        y = mfc_context->hrd.current_buffer_fullness[next_frame_layer_id];
-    } else {
-        x /= (mfc_context->hrd.buffer_size[next_frame_layer_id] - mfc_context->hrd.target_buffer_fullness[next_frame_layer_id]);
-        y = mfc_context->hrd.buffer_size[next_frame_layer_id] - mfc_context->hrd.current_buffer_fullness[next_frame_layer_id];
-    }
-    if (y < 0.01) y = 0.01;
-    if (x > 1) x = 1;
-    else if (x < -1) x = -1;
-
-    delta_qp = BRC_QP_MAX_CHANGE * exp(-1 / y) * sin(BRC_PI_0_5 * x);
-    qpn = (int)(qpn + delta_qp + 0.5);
-
-    /* making sure that with QP predictions we did do not leave QPs range */
-    BRC_CLIP(qpn, min_qp, 51);
-
-    if (sts == BRC_NO_HRD_VIOLATION) { // no HRD violation
-        /* correcting QPs of slices of other types */
-        if (slicetype == SLICE_TYPE_P) {
-            if (abs(qpn + BRC_P_B_QP_DIFF - qpb) > 2)
-                mfc_context->brc.qp_prime_y[next_frame_layer_id][SLICE_TYPE_B] += (qpn + BRC_P_B_QP_DIFF - qpb) >> 1;
-            if (abs(qpn - BRC_I_P_QP_DIFF - qpi) > 2)
-                mfc_context->brc.qp_prime_y[next_frame_layer_id][SLICE_TYPE_I] += (qpn - BRC_I_P_QP_DIFF - qpi) >> 1;
-        } else if (slicetype == SLICE_TYPE_I) {
-            if (abs(qpn + BRC_I_B_QP_DIFF - qpb) > 4)
-                mfc_context->brc.qp_prime_y[next_frame_layer_id][SLICE_TYPE_B] += (qpn + BRC_I_B_QP_DIFF - qpb) >> 2;
-            if (abs(qpn + BRC_I_P_QP_DIFF - qpp) > 2)
-                mfc_context->brc.qp_prime_y[next_frame_layer_id][SLICE_TYPE_P] += (qpn + BRC_I_P_QP_DIFF - qpp) >> 2;
-        } else { // SLICE_TYPE_B
-            if (abs(qpn - BRC_P_B_QP_DIFF - qpp) > 2)
-                mfc_context->brc.qp_prime_y[next_frame_layer_id][SLICE_TYPE_P] += (qpn - BRC_P_B_QP_DIFF - qpp) >> 1;
-            if (abs(qpn - BRC_I_B_QP_DIFF - qpi) > 4)
-                mfc_context->brc.qp_prime_y[next_frame_layer_id][SLICE_TYPE_I] += (qpn - BRC_I_B_QP_DIFF - qpi) >> 2;
-        }
-        BRC_CLIP(mfc_context->brc.qp_prime_y[next_frame_layer_id][SLICE_TYPE_I], min_qp, 51);
-        BRC_CLIP(mfc_context->brc.qp_prime_y[next_frame_layer_id][SLICE_TYPE_P], min_qp, 51);
-        BRC_CLIP(mfc_context->brc.qp_prime_y[next_frame_layer_id][SLICE_TYPE_B], min_qp, 51);
-    } else if (sts == BRC_UNDERFLOW) { // underflow
-        if (qpn <= qp) qpn = qp + 1;
-        if (qpn > 51) {
-            qpn = 51;
-            sts = BRC_UNDERFLOW_WITH_MAX_QP; //underflow with maxQP
-        }
-    } else if (sts == BRC_OVERFLOW) {
-        if (qpn >= qp) qpn = qp - 1;
-        if (qpn < min_qp) { // overflow with minQP
-            qpn = min_qp;
-            sts = BRC_OVERFLOW_WITH_MIN_QP; // bit stuffing to be done
-        }
+    for (y = 0; y < height; y += band_height) {
+        band_height = MIN(height - y, I965_COMPLEXITY_BAND_HEIGHT);
+        i965_tiled_copy_to_linear(complexity->band, width, &surface,
+                                  0, y, width, band_height);
+        i965_complexity_add_rows(complexity, complexity->band, width, y, band_height);
     }
 
-    mfc_context->brc.qp_prime_y[next_frame_layer_id][slicetype] = qpn;
+    i965_unmap_surface_for_copy(obj_surface, &surface);
 
-    return sts;
+    return i965_complexity_end_frame(complexity);
 }
 
-static int intel_mfc_brc_postpack_vbr(struct encode_state *encode_state,
-                                      struct intel_encoder_context *encoder_context,
-                                      int frame_bits)
+static void
+intel_mfc_brc_prepack(struct encode_state *encode_state,
+                      struct intel_encoder_context *encoder_context)
 {
     struct gen6_mfc_context *mfc_context = encoder_context->mfc_context;
-    gen6_brc_status sts;
-    VAEncSliceParameterBufferH264 *pSliceParameter = (VAEncSliceParameterBufferH264 *)encode_state->slice_params_ext[0]->buffer;
-    int slice_type = intel_avc_enc_slice_type_fixup(pSliceParameter->slice_type);
-    int *qp = mfc_context->brc.qp_prime_y[0];
-    int min_qp = MAX(1, encoder_context->brc.min_qp);
-    int qp_delta, large_frame_adjustment;
-
-    // This implements a simple reactive VBR rate control mode for single-layer H.264.  The primary
-    // aim here is to avoid the problematic behaviour that the CBR rate controller displays on
-    // scene changes, where the QP can get pushed up by a large amount in a short period and
-    // compromise the quality of following frames to a very visible degree.
-    // The main idea, then, is to try to keep the HRD buffering above the target level most of the
-    // time, so that when a large frame is generated (on a scene change or when the stream
-    // complexity increases) we have plenty of slack to be able to encode the more difficult region
-    // without compromising quality immediately on the following frames.   It is optimistic about
-    // the complexity of future frames, so even after generating one or more large frames on a
-    // significant change it will try to keep the QP at its current level until the HRD buffer
-    // bounds force a change to maintain the intended rate.
-
-    sts = intel_mfc_update_hrd(encode_state, encoder_context, frame_bits);
-
-    // This adjustment is applied to increase the QP by more than we normally would if a very
-    // large frame is encountered and we are in danger of running out of slack.
-    large_frame_adjustment = rint(2.0 * log(frame_bits / mfc_context->brc.target_frame_size[0][slice_type]));
-
-    if (sts == BRC_UNDERFLOW) {
-        // The frame is far too big and we don't have the bits available to send it, so it will
-        // have to be re-encoded at a higher QP.
-        qp_delta = +2;
-        if (frame_bits > mfc_context->brc.target_frame_size[0][slice_type])
-            qp_delta += large_frame_adjustment;
-    } else if (sts == BRC_OVERFLOW) {
-        // The frame is very small and we are now overflowing the HRD buffer.  Currently this case
-        // does not occur because we ignore overflow in VBR mode.
-        assert(0 && "Overflow in VBR mode");
-    } else if (frame_bits <= mfc_context->brc.target_frame_size[0][slice_type]) {
-        // The frame is smaller than the average size expected for this frame type.
-        if (mfc_context->hrd.current_buffer_fullness[0] >
-            (mfc_context->hrd.target_buffer_fullness[0] + mfc_context->hrd.buffer_size[0]) / 2.0) {
-            // We currently have lots of bits available, so decrease the QP slightly for the next
-            // frame.
-            qp_delta = -1;
-        } else {
-            // The HRD buffer fullness is increasing, so do nothing.  (We may be under the target
-            // level here, but are moving in the right direction.)
-            qp_delta = 0;
-        }
-    } else {
-        // The frame is larger than the average size expected for this frame type.
-        if (mfc_context->hrd.current_buffer_fullness[0] > mfc_context->hrd.target_buffer_fullness[0]) {
-            // We are currently over the target level, so do nothing.
-            qp_delta = 0;
-        } else if (mfc_context->hrd.current_buffer_fullness[0] > mfc_context->hrd.target_buffer_fullness[0] / 2.0) {
-            // We are under the target level, but not critically.  Increase the QP by one step if
-            // continuing like this would underflow soon (currently within one second).
-            if (mfc_context->hrd.current_buffer_fullness[0] /
-                (double)(frame_bits - mfc_context->brc.target_frame_size[0][slice_type] + 1) <
-                ((double)encoder_context->brc.framerate[0].num / (double)encoder_context->brc.framerate[0].den))
-                qp_delta = +1;
-            else
-                qp_delta = 0;
-        } else {
-            // We are a long way under the target level.  Always increase the QP, possibly by a
-            // larger amount dependent on how big the frame we just made actually was.
-            qp_delta = +1 + large_frame_adjustment;
-        }
-    }
+    struct i965_brc_model_params params;
+    struct i965_brc_model_frame frame;
 
-    switch (slice_type) {
-    case SLICE_TYPE_I:
-        qp[SLICE_TYPE_I] += qp_delta;
-        qp[SLICE_TYPE_P]  = qp[SLICE_TYPE_I] + BRC_I_P_QP_DIFF;
-        qp[SLICE_TYPE_B]  = qp[SLICE_TYPE_I] + BRC_I_B_QP_DIFF;
-        break;
-    case SLICE_TYPE_P:
-        qp[SLICE_TYPE_P] += qp_delta;
-        qp[SLICE_TYPE_I]  = qp[SLICE_TYPE_P] - BRC_I_P_QP_DIFF;
-        qp[SLICE_TYPE_B]  = qp[SLICE_TYPE_P] + BRC_P_B_QP_DIFF;
-        break;
-    case SLICE_TYPE_B:
-        qp[SLICE_TYPE_B] += qp_delta;
-        qp[SLICE_TYPE_I]  = qp[SLICE_TYPE_B] - BRC_I_B_QP_DIFF;
-        qp[SLICE_TYPE_P]  = qp[SLICE_TYPE_B] - BRC_P_B_QP_DIFF;
-        break;
-    }
-    BRC_CLIP(mfc_context->brc.qp_prime_y[0][SLICE_TYPE_I], min_qp, 51);
-    BRC_CLIP(mfc_context->brc.qp_prime_y[0][SLICE_TYPE_P], min_qp, 51);
-    BRC_CLIP(mfc_context->brc.qp_prime_y[0][SLICE_TYPE_B], min_qp, 51);
+    intel_mfc_brc_model_params(encoder_context, &params);
+    intel_mfc_brc_model_frame(encode_state, encoder_context, &frame);
+    frame.complexity = intel_mfc_brc_lookahead_complexity(encode_state, encoder_context);
 
-    if (sts == BRC_UNDERFLOW && qp[slice_type] == 51)
-        sts = BRC_UNDERFLOW_WITH_MAX_QP;
-    if (sts == BRC_OVERFLOW && qp[slice_type] == min_qp)
-        sts = BRC_OVERFLOW_WITH_MIN_QP;
-
-    return sts;
-}
-
-int intel_mfc_brc_postpack(struct encode_state *encode_state,
-                           struct intel_encoder_context *encoder_context,
-                           int frame_bits)
-{
-    switch (encoder_context->rate_control_mode) {
-    case VA_RC_CBR:
-        return intel_mfc_brc_postpack_cbr(encode_state, encoder_context, frame_bits);
-    case VA_RC_VBR:
-        return intel_mfc_brc_postpack_vbr(encode_state, encoder_context, frame_bits);
-    }
-    assert(0 && "Invalid RC mode");
-    return 1;
+    i965_brc_model_prepack(&params, &mfc_context->brc, &mfc_context->hrd, &frame);
 }
 
 static void intel_mfc_hrd_context_init(struct encode_state *encode_state,
@@ -562,6 +296,10 @@ void intel_mfc_brc_prepare(struct encode_state *encode_state,
         /*Programing HRD control */
         if (encoder_context->brc.need_reset)
             intel_mfc_hrd_context_init(encode_state, encoder_context);
+
+        if (encoder_context->brc.lookahead_depth &&
+            (rate_control_mode == VA_RC_CBR || rate_control_mode == VA_RC_VBR))
+            intel_mfc_brc_prepack(encode_state, encoder_context);
     }
 }
 
@@ -1358,7 +1096,7 @@ intel_mfc_avc_ref_idx_state(VADriverContextP ctx,
     for (i = 0; i < 7; i++) {
         OUT_BCS_BATCH(batch, 0x80808080);
     }
-    ADVANCE_BCS_BATCH(batch);
+    ADVANCE_BCS_BATCH_STATE(batch, 0, 0);
 
     BEGIN_BCS_BATCH(batch, 10);
     OUT_BCS_BATCH(batch, MFX_AVC_REF_IDX_STATE | 8);
@@ -1367,7 +1105,7 @@ intel_mfc_avc_ref_idx_state(VADriverContextP ctx,
     for (i = 0; i < 7; i++) {
         OUT_BCS_BATCH(batch, 0x80808080);
     }
-    ADVANCE_BCS_BATCH(batch);
+    ADVANCE_BCS_BATCH_STATE(batch, 1, 0);
 }
 
 
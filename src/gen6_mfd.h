@@ -72,6 +72,10 @@ struct gen6_mfd_context {
     GenBuffer           bsd_mpc_row_store_scratch_buffer;
     GenBuffer           mpr_row_store_scratch_buffer;
     GenBuffer           bitplane_read_buffer;
+    GenBuffer           bitplane_spare_buffer;  /* bitplane of the previous picture, see intel_ensure_bitplane_buffer() */
+    dri_bo             *skipped_bitplane_bo;    /* bitplane_read_buffer.bo, if filled for a skipped picture */
+    int                 skipped_bitplane_width;
+    int                 skipped_bitplane_height;
 
     int                 wa_mpeg2_slice_vertical_position;
 };
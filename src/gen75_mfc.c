@@ -1006,44 +1006,44 @@ gen75_mfc_avc_pak_object_intra(VADriverContextP ctx, int x, int y, int end_mb,
                                struct intel_batchbuffer *batch)
 {
     int len_in_dwords = 12;
+    unsigned int *dw;
     unsigned int intra_msg;
 #define     INTRA_MSG_FLAG      (1 << 13)
 #define     INTRA_MBTYPE_MASK   (0x1F0000)
     if (batch == NULL)
         batch = encoder_context->base.batch;
 
-    BEGIN_BCS_BATCH(batch, len_in_dwords);
+    BEGIN_BCS_BATCH_SPAN(batch, len_in_dwords, dw);
 
     intra_msg = msg[0] & 0xC0FF;
     intra_msg |= INTRA_MSG_FLAG;
     intra_msg |= ((msg[0] & INTRA_MBTYPE_MASK) >> 8);
-    OUT_BCS_BATCH(batch, MFC_AVC_PAK_OBJECT | (len_in_dwords - 2));
-    OUT_BCS_BATCH(batch, 0);
-    OUT_BCS_BATCH(batch, 0);
-    OUT_BCS_BATCH(batch,
-                  (0 << 24) |       /* PackedMvNum, Debug*/
-                  (0 << 20) |       /* No motion vector */
-                  (1 << 19) |       /* CbpDcY */
-                  (1 << 18) |       /* CbpDcU */
-                  (1 << 17) |       /* CbpDcV */
-                  intra_msg);
-
-    OUT_BCS_BATCH(batch, (0xFFFF << 16) | (y << 8) | x);        /* Code Block Pattern for Y*/
-    OUT_BCS_BATCH(batch, 0x000F000F);                           /* Code Block Pattern */
-    OUT_BCS_BATCH(batch, (0 << 27) | (end_mb << 26) | qp);  /* Last MB */
+    *dw++ = MFC_AVC_PAK_OBJECT | (len_in_dwords - 2);
+    *dw++ = 0;
+    *dw++ = 0;
+    *dw++ = (0 << 24) |       /* PackedMvNum, Debug*/
+            (0 << 20) |       /* No motion vector */
+            (1 << 19) |       /* CbpDcY */
+            (1 << 18) |       /* CbpDcU */
+            (1 << 17) |       /* CbpDcV */
+            intra_msg;
+
+    *dw++ = (0xFFFF << 16) | (y << 8) | x;        /* Code Block Pattern for Y*/
+    *dw++ = 0x000F000F;                           /* Code Block Pattern */
+    *dw++ = (0 << 27) | (end_mb << 26) | qp;  /* Last MB */
 
     /*Stuff for Intra MB*/
-    OUT_BCS_BATCH(batch, msg[1]);           /* We using Intra16x16 no 4x4 predmode*/
-    OUT_BCS_BATCH(batch, msg[2]);
-    OUT_BCS_BATCH(batch, msg[3] & 0xFF);
+    *dw++ = msg[1];           /* We using Intra16x16 no 4x4 predmode*/
+    *dw++ = msg[2];
+    *dw++ = msg[3] & 0xFF;
 
     /*MaxSizeInWord and TargetSzieInWord*/
-    OUT_BCS_BATCH(batch, (max_mb_size << 24) |
-                  (target_mb_size << 16));
+    *dw++ = (max_mb_size << 24) |
+            (target_mb_size << 16);
 
-    OUT_BCS_BATCH(batch, 0);
+    *dw++ = 0;
 
-    ADVANCE_BCS_BATCH(batch);
+    ADVANCE_BCS_BATCH_SPAN(batch, dw);
 
     return len_in_dwords;
 }
@@ -1057,6 +1057,7 @@ gen75_mfc_avc_pak_object_inter(VADriverContextP ctx, int x, int y, int end_mb, i
 {
     struct gen6_vme_context *vme_context = encoder_context->vme_context;
     int len_in_dwords = 12;
+    unsigned int *dw;
     unsigned int inter_msg = 0;
     if (batch == NULL)
         batch = encoder_context->base.batch;
@@ -1096,9 +1097,9 @@ gen75_mfc_avc_pak_object_inter(VADriverContextP ctx, int x, int y, int end_mb, i
         }
     }
 
-    BEGIN_BCS_BATCH(batch, len_in_dwords);
+    BEGIN_BCS_BATCH_SPAN(batch, len_in_dwords, dw);
 
-    OUT_BCS_BATCH(batch, MFC_AVC_PAK_OBJECT | (len_in_dwords - 2));
+    *dw++ = MFC_AVC_PAK_OBJECT | (len_in_dwords - 2);
 
     inter_msg = 32;
     /* MV quantity */
@@ -1106,8 +1107,8 @@ gen75_mfc_avc_pak_object_inter(VADriverContextP ctx, int x, int y, int end_mb, i
         if (msg[1] & SUBMB_SHAPE_MASK)
             inter_msg = 128;
     }
-    OUT_BCS_BATCH(batch, inter_msg);         /* 32 MV*/
-    OUT_BCS_BATCH(batch, offset);
+    *dw++ = inter_msg;         /* 32 MV*/
+    *dw++ = offset;
     inter_msg = msg[0] & (0x1F00FFFF);
     inter_msg |= INTER_MV8;
     inter_msg |= ((1 << 19) | (1 << 18) | (1 << 17));
@@ -1116,38 +1117,38 @@ gen75_mfc_avc_pak_object_inter(VADriverContextP ctx, int x, int y, int end_mb, i
         inter_msg |= INTER_MV32;
     }
 
-    OUT_BCS_BATCH(batch, inter_msg);
+    *dw++ = inter_msg;
 
-    OUT_BCS_BATCH(batch, (0xFFFF << 16) | (y << 8) | x);      /* Code Block Pattern for Y*/
-    OUT_BCS_BATCH(batch, 0x000F000F);                         /* Code Block Pattern */
+    *dw++ = (0xFFFF << 16) | (y << 8) | x;      /* Code Block Pattern for Y*/
+    *dw++ = 0x000F000F;                         /* Code Block Pattern */
 #if 0
     if (slice_type == SLICE_TYPE_B) {
-        OUT_BCS_BATCH(batch, (0xF << 28) | (end_mb << 26) | qp); /* Last MB */
+        *dw++ = (0xF << 28) | (end_mb << 26) | qp; /* Last MB */
     } else {
-        OUT_BCS_BATCH(batch, (end_mb << 26) | qp);  /* Last MB */
+        *dw++ = (end_mb << 26) | qp;  /* Last MB */
     }
 #else
-    OUT_BCS_BATCH(batch, (end_mb << 26) | qp);  /* Last MB */
+    *dw++ = (end_mb << 26) | qp;  /* Last MB */
 #endif
 
     inter_msg = msg[1] >> 8;
     /*Stuff for Inter MB*/
-    OUT_BCS_BATCH(batch, inter_msg);
-    OUT_BCS_BATCH(batch, vme_context->ref_index_in_mb[0]);
-    OUT_BCS_BATCH(batch, vme_context->ref_index_in_mb[1]);
+    *dw++ = inter_msg;
+    *dw++ = vme_context->ref_index_in_mb[0];
+    *dw++ = vme_context->ref_index_in_mb[1];
 
     /*MaxSizeInWord and TargetSzieInWord*/
-    OUT_BCS_BATCH(batch, (max_mb_size << 24) |
-                  (target_mb_size << 16));
+    *dw++ = (max_mb_size << 24) |
+            (target_mb_size << 16);
 
-    OUT_BCS_BATCH(batch, 0x0);
+    *dw++ = 0x0;
 
-    ADVANCE_BCS_BATCH(batch);
+    ADVANCE_BCS_BATCH_SPAN(batch, dw);
 
     return len_in_dwords;
 }
 
-static void
+void
 gen75_mfc_avc_pipeline_slice_programing(VADriverContextP ctx,
                                         struct encode_state *encode_state,
                                         struct intel_encoder_context *encoder_context,
@@ -1258,13 +1259,13 @@ gen75_mfc_avc_software_batchbuffer(VADriverContextP ctx,
     struct gen6_mfc_context *mfc_context = encoder_context->mfc_context;
     struct intel_batchbuffer *batch;
     dri_bo *batch_bo;
-    int i;
 
     batch = mfc_context->aux_batchbuffer;
     batch_bo = batch->buffer;
-    for (i = 0; i < encode_state->num_slice_params_ext; i++) {
-        gen75_mfc_avc_pipeline_slice_programing(ctx, encode_state, encoder_context, i, batch);
-    }
+    intel_batchbuffer_start_atomic_bcs(batch, 0x1000);
+
+    intel_encoder_slice_programing(ctx, encode_state, encoder_context,
+                                   gen75_mfc_avc_pipeline_slice_programing, batch);
 
     intel_batchbuffer_align(batch, 8);
 
@@ -1273,6 +1274,9 @@ gen75_mfc_avc_software_batchbuffer(VADriverContextP ctx,
     OUT_BCS_BATCH(batch, MI_BATCH_BUFFER_END);
     ADVANCE_BCS_BATCH(batch);
 
+    intel_batchbuffer_end_atomic(batch);
+
+    intel_batchbuffer_record_second_level(batch);
     dri_bo_reference(batch_bo);
 
     intel_batchbuffer_free(batch);
@@ -1913,46 +1917,44 @@ gen75_mfc_mpeg2_pak_object_intra(VADriverContextP ctx,
                                  struct intel_batchbuffer *batch)
 {
     int len_in_dwords = 9;
+    unsigned int *dw;
 
     if (batch == NULL)
         batch = encoder_context->base.batch;
 
-    BEGIN_BCS_BATCH(batch, len_in_dwords);
-
-    OUT_BCS_BATCH(batch, MFC_MPEG2_PAK_OBJECT | (len_in_dwords - 2));
-    OUT_BCS_BATCH(batch,
-                  0 << 24 |     /* PackedMvNum */
-                  0 << 20 |     /* MvFormat */
-                  7 << 17 |     /* CbpDcY/CbpDcU/CbpDcV */
-                  0 << 15 |     /* TransformFlag: frame DCT */
-                  0 << 14 |     /* FieldMbFlag */
-                  1 << 13 |     /* IntraMbFlag */
-                  mb_type << 8 |   /* MbType: Intra */
-                  0 << 2 |      /* SkipMbFlag */
-                  0 << 0 |      /* InterMbMode */
-                  0);
-    OUT_BCS_BATCH(batch, y << 16 | x);
-    OUT_BCS_BATCH(batch,
-                  max_size_in_word << 24 |
-                  target_size_in_word << 16 |
-                  coded_block_pattern << 6 |      /* CBP */
-                  0);
-    OUT_BCS_BATCH(batch,
-                  last_mb_in_slice << 31 |
-                  first_mb_in_slice << 30 |
-                  0 << 27 |     /* EnableCoeffClamp */
-                  last_mb_in_slice_group << 26 |
-                  0 << 25 |     /* MbSkipConvDisable */
-                  first_mb_in_slice_group << 24 |
-                  0 << 16 |     /* MvFieldSelect */
-                  qp_scale_code << 0 |
-                  0);
-    OUT_BCS_BATCH(batch, 0);    /* MV[0][0] */
-    OUT_BCS_BATCH(batch, 0);    /* MV[1][0] */
-    OUT_BCS_BATCH(batch, 0);    /* MV[0][1] */
-    OUT_BCS_BATCH(batch, 0);    /* MV[1][1] */
-
-    ADVANCE_BCS_BATCH(batch);
+    BEGIN_BCS_BATCH_SPAN(batch, len_in_dwords, dw);
+
+    *dw++ = MFC_MPEG2_PAK_OBJECT | (len_in_dwords - 2);
+    *dw++ = 0 << 24 |     /* PackedMvNum */
+            0 << 20 |     /* MvFormat */
+            7 << 17 |     /* CbpDcY/CbpDcU/CbpDcV */
+            0 << 15 |     /* TransformFlag: frame DCT */
+            0 << 14 |     /* FieldMbFlag */
+            1 << 13 |     /* IntraMbFlag */
+            mb_type << 8 |   /* MbType: Intra */
+            0 << 2 |      /* SkipMbFlag */
+            0 << 0 |      /* InterMbMode */
+            0;
+    *dw++ = y << 16 | x;
+    *dw++ = max_size_in_word << 24 |
+            target_size_in_word << 16 |
+            coded_block_pattern << 6 |      /* CBP */
+            0;
+    *dw++ = last_mb_in_slice << 31 |
+            first_mb_in_slice << 30 |
+            0 << 27 |     /* EnableCoeffClamp */
+            last_mb_in_slice_group << 26 |
+            0 << 25 |     /* MbSkipConvDisable */
+            first_mb_in_slice_group << 24 |
+            0 << 16 |     /* MvFieldSelect */
+            qp_scale_code << 0 |
+            0;
+    *dw++ = 0;    /* MV[0][0] */
+    *dw++ = 0;    /* MV[1][0] */
+    *dw++ = 0;    /* MV[0][1] */
+    *dw++ = 0;    /* MV[1][1] */
+
+    ADVANCE_BCS_BATCH_SPAN(batch, dw);
 
     return len_in_dwords;
 }
@@ -2011,6 +2013,7 @@ gen75_mfc_mpeg2_pak_object_inter(VADriverContextP ctx,
 {
     VAEncPictureParameterBufferMPEG2 *pic_param = (VAEncPictureParameterBufferMPEG2 *)encode_state->pic_param_ext->buffer;
     int len_in_dwords = 9;
+    unsigned int *dw;
     short *mvptr, mvx0, mvy0, mvx1, mvy1;
 
     if (batch == NULL)
@@ -2022,43 +2025,40 @@ gen75_mfc_mpeg2_pak_object_inter(VADriverContextP ctx,
     mvx1 = mpeg2_motion_vector(mvptr[2] / 2, x, width_in_mbs * 16, pic_param->f_code[1][0]);
     mvy1 = mpeg2_motion_vector(mvptr[3] / 2, y, height_in_mbs * 16, pic_param->f_code[1][0]);
 
-    BEGIN_BCS_BATCH(batch, len_in_dwords);
-
-    OUT_BCS_BATCH(batch, MFC_MPEG2_PAK_OBJECT | (len_in_dwords - 2));
-    OUT_BCS_BATCH(batch,
-                  2 << 24 |     /* PackedMvNum */
-                  7 << 20 |     /* MvFormat */
-                  7 << 17 |     /* CbpDcY/CbpDcU/CbpDcV */
-                  0 << 15 |     /* TransformFlag: frame DCT */
-                  0 << 14 |     /* FieldMbFlag */
-                  0 << 13 |     /* IntraMbFlag */
-                  1 << 8 |      /* MbType: Frame-based */
-                  0 << 2 |      /* SkipMbFlag */
-                  0 << 0 |      /* InterMbMode */
-                  0);
-    OUT_BCS_BATCH(batch, y << 16 | x);
-    OUT_BCS_BATCH(batch,
-                  max_size_in_word << 24 |
-                  target_size_in_word << 16 |
-                  0x3f << 6 |   /* CBP */
-                  0);
-    OUT_BCS_BATCH(batch,
-                  last_mb_in_slice << 31 |
-                  first_mb_in_slice << 30 |
-                  0 << 27 |     /* EnableCoeffClamp */
-                  last_mb_in_slice_group << 26 |
-                  0 << 25 |     /* MbSkipConvDisable */
-                  first_mb_in_slice_group << 24 |
-                  0 << 16 |     /* MvFieldSelect */
-                  qp_scale_code << 0 |
-                  0);
-
-    OUT_BCS_BATCH(batch, (mvx0 & 0xFFFF) | mvy0 << 16);    /* MV[0][0] */
-    OUT_BCS_BATCH(batch, (mvx1 & 0xFFFF) | mvy1 << 16);    /* MV[1][0] */
-    OUT_BCS_BATCH(batch, 0);    /* MV[0][1] */
-    OUT_BCS_BATCH(batch, 0);    /* MV[1][1] */
-
-    ADVANCE_BCS_BATCH(batch);
+    BEGIN_BCS_BATCH_SPAN(batch, len_in_dwords, dw);
+
+    *dw++ = MFC_MPEG2_PAK_OBJECT | (len_in_dwords - 2);
+    *dw++ = 2 << 24 |     /* PackedMvNum */
+            7 << 20 |     /* MvFormat */
+            7 << 17 |     /* CbpDcY/CbpDcU/CbpDcV */
+            0 << 15 |     /* TransformFlag: frame DCT */
+            0 << 14 |     /* FieldMbFlag */
+            0 << 13 |     /* IntraMbFlag */
+            1 << 8 |      /* MbType: Frame-based */
+            0 << 2 |      /* SkipMbFlag */
+            0 << 0 |      /* InterMbMode */
+            0;
+    *dw++ = y << 16 | x;
+    *dw++ = max_size_in_word << 24 |
+            target_size_in_word << 16 |
+            0x3f << 6 |   /* CBP */
+            0;
+    *dw++ = last_mb_in_slice << 31 |
+            first_mb_in_slice << 30 |
+            0 << 27 |     /* EnableCoeffClamp */
+            last_mb_in_slice_group << 26 |
+            0 << 25 |     /* MbSkipConvDisable */
+            first_mb_in_slice_group << 24 |
+            0 << 16 |     /* MvFieldSelect */
+            qp_scale_code << 0 |
+            0;
+
+    *dw++ = (mvx0 & 0xFFFF) | mvy0 << 16;    /* MV[0][0] */
+    *dw++ = (mvx1 & 0xFFFF) | mvy1 << 16;    /* MV[1][0] */
+    *dw++ = 0;    /* MV[0][1] */
+    *dw++ = 0;    /* MV[1][1] */
+
+    ADVANCE_BCS_BATCH_SPAN(batch, dw);
 
     return len_in_dwords;
 }
@@ -2276,6 +2276,21 @@ gen75_mfc_mpeg2_pipeline_slice_group(VADriverContextP ctx,
     }
 }
 
+void
+gen75_mfc_mpeg2_slice_programing(VADriverContextP ctx,
+                                 struct encode_state *encode_state,
+                                 struct intel_encoder_context *encoder_context,
+                                 int slice_index,
+                                 struct intel_batchbuffer *slice_batch)
+{
+    VAEncSliceParameterBufferMPEG2 *next_slice_group_param = NULL;
+
+    if (slice_index < encode_state->num_slice_params_ext - 1)
+        next_slice_group_param = (VAEncSliceParameterBufferMPEG2 *)encode_state->slice_params_ext[slice_index + 1]->buffer;
+
+    gen75_mfc_mpeg2_pipeline_slice_group(ctx, encode_state, encoder_context, slice_index, next_slice_group_param, slice_batch);
+}
+
 /*
  * A batch buffer for all slices, including slice state,
  * slice insert object and slice pak object commands
@@ -2288,21 +2303,14 @@ gen75_mfc_mpeg2_software_slice_batchbuffer(VADriverContextP ctx,
 {
     struct gen6_mfc_context *mfc_context = encoder_context->mfc_context;
     struct intel_batchbuffer *batch;
-    VAEncSliceParameterBufferMPEG2 *next_slice_group_param = NULL;
     dri_bo *batch_bo;
-    int i;
 
     batch = mfc_context->aux_batchbuffer;
     batch_bo = batch->buffer;
+    intel_batchbuffer_start_atomic_bcs(batch, 0x1000);
 
-    for (i = 0; i < encode_state->num_slice_params_ext; i++) {
-        if (i == encode_state->num_slice_params_ext - 1)
-            next_slice_group_param = NULL;
-        else
-            next_slice_group_param = (VAEncSliceParameterBufferMPEG2 *)encode_state->slice_params_ext[i + 1]->buffer;
-
-        gen75_mfc_mpeg2_pipeline_slice_group(ctx, encode_state, encoder_context, i, next_slice_group_param, batch);
-    }
+    intel_encoder_slice_programing(ctx, encode_state, encoder_context,
+                                   gen75_mfc_mpeg2_slice_programing, batch);
 
     intel_batchbuffer_align(batch, 8);
 
@@ -2311,6 +2319,9 @@ gen75_mfc_mpeg2_software_slice_batchbuffer(VADriverContextP ctx,
     OUT_BCS_BATCH(batch, MI_BATCH_BUFFER_END);
     ADVANCE_BCS_BATCH(batch);
 
+    intel_batchbuffer_end_atomic(batch);
+
+    intel_batchbuffer_record_second_level(batch);
     dri_bo_reference(batch_bo);
     intel_batchbuffer_free(batch);
     mfc_context->aux_batchbuffer = NULL;
@@ -2496,6 +2507,7 @@ gen75_mfc_context_destroy(void *context)
     }
 
     i965_gpe_context_destroy(&mfc_context->gpe_context);
+    i965_complexity_context_fini(&mfc_context->complexity);
 
     dri_bo_unreference(mfc_context->mfc_batchbuffer_surface.bo);
     mfc_context->mfc_batchbuffer_surface.bo = NULL;
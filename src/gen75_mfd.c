@@ -35,6 +35,7 @@
 #include "i965_defines.h"
 #include "i965_drv_video.h"
 #include "i965_decoder_utils.h"
+#include "i965_vc1_bitplane.h"
 #include "gen7_mfd.h"
 #include "intel_media.h"
 
@@ -1005,7 +1006,7 @@ gen75_mfd_avc_bsd_object(VADriverContextP ctx,
     BEGIN_BCS_BATCH(batch, 6);
     OUT_BCS_BATCH(batch, MFD_AVC_BSD_OBJECT | (6 - 2));
     OUT_BCS_BATCH(batch,
-                  (slice_param->slice_data_size - slice_param->slice_data_offset));
+                  (slice_param->slice_data_size));
     OUT_BCS_BATCH(batch, slice_param->slice_data_offset);
     OUT_BCS_BATCH(batch,
                   (0 << 31) |
@@ -1041,9 +1042,7 @@ gen75_mfd_avc_decode_init(VADriverContextP ctx,
 {
     VAPictureParameterBufferH264 *pic_param;
     VASliceParameterBufferH264 *slice_param;
-    struct i965_driver_data *i965 = i965_driver_data(ctx);
     struct object_surface *obj_surface;
-    dri_bo *bo;
     int i, j, enable_avc_ildb = 0;
     unsigned int width_in_mbs, height_in_mbs;
 
@@ -1097,41 +1096,17 @@ gen75_mfd_avc_decode_init(VADriverContextP ctx,
     dri_bo_reference(gen7_mfd_context->pre_deblocking_output.bo);
     gen7_mfd_context->pre_deblocking_output.valid = !enable_avc_ildb;
 
-    dri_bo_unreference(gen7_mfd_context->intra_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "intra row store",
-                      width_in_mbs * 64,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->intra_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->intra_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->intra_row_store_scratch_buffer,
+                                "intra row store", width_in_mbs * 64);
 
-    dri_bo_unreference(gen7_mfd_context->deblocking_filter_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "deblocking filter row store",
-                      width_in_mbs * 64 * 4,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->deblocking_filter_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->deblocking_filter_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->deblocking_filter_row_store_scratch_buffer,
+                                "deblocking filter row store", width_in_mbs * 64 * 4);
 
-    dri_bo_unreference(gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "bsd mpc row store",
-                      width_in_mbs * 64 * 2,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->bsd_mpc_row_store_scratch_buffer,
+                                "bsd mpc row store", width_in_mbs * 64 * 2);
 
-    dri_bo_unreference(gen7_mfd_context->mpr_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "mpr row store",
-                      width_in_mbs * 64 * 2,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->mpr_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->mpr_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->mpr_row_store_scratch_buffer,
+                                "mpr row store", width_in_mbs * 64 * 2);
 
     gen7_mfd_context->bitplane_read_buffer.valid = 0;
 }
@@ -1144,7 +1119,7 @@ gen75_mfd_avc_decode_picture(VADriverContextP ctx,
     struct intel_batchbuffer *batch = gen7_mfd_context->base.batch;
     VAPictureParameterBufferH264 *pic_param;
     VASliceParameterBufferH264 *slice_param, *next_slice_param, *next_slice_group_param;
-    dri_bo *slice_data_bo;
+    dri_bo *slice_data_bo, *last_slice_data_bo = NULL;
     int i, j;
 
     assert(decode_state->pic_param && decode_state->pic_param->buffer);
@@ -1165,7 +1140,11 @@ gen75_mfd_avc_decode_picture(VADriverContextP ctx,
         assert(decode_state->slice_params && decode_state->slice_params[j]->buffer);
         slice_param = (VASliceParameterBufferH264 *)decode_state->slice_params[j]->buffer;
         slice_data_bo = decode_state->slice_datas[j]->bo;
-        gen75_mfd_ind_obj_base_addr_state(ctx, slice_data_bo, MFX_FORMAT_AVC, gen7_mfd_context);
+
+        /* Slice data packed into one buffer object shares the base address */
+        if (slice_data_bo != last_slice_data_bo)
+            gen75_mfd_ind_obj_base_addr_state(ctx, slice_data_bo, MFX_FORMAT_AVC, gen7_mfd_context);
+        last_slice_data_bo = slice_data_bo;
 
         if (j == decode_state->num_slice_params - 1)
             next_slice_group_param = NULL;
@@ -1207,9 +1186,7 @@ gen75_mfd_mpeg2_decode_init(VADriverContextP ctx,
                             struct gen7_mfd_context *gen7_mfd_context)
 {
     VAPictureParameterBufferMPEG2 *pic_param;
-    struct i965_driver_data *i965 = i965_driver_data(ctx);
     struct object_surface *obj_surface;
-    dri_bo *bo;
     unsigned int width_in_mbs;
 
     assert(decode_state->pic_param && decode_state->pic_param->buffer);
@@ -1232,14 +1209,8 @@ gen75_mfd_mpeg2_decode_init(VADriverContextP ctx,
     dri_bo_reference(gen7_mfd_context->pre_deblocking_output.bo);
     gen7_mfd_context->pre_deblocking_output.valid = 1;
 
-    dri_bo_unreference(gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "bsd mpc row store",
-                      width_in_mbs * 96,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->bsd_mpc_row_store_scratch_buffer,
+                                "bsd mpc row store", width_in_mbs * 96);
 
     gen7_mfd_context->post_deblocking_output.valid = 0;
     gen7_mfd_context->intra_row_store_scratch_buffer.valid = 0;
@@ -1412,7 +1383,7 @@ gen75_mfd_mpeg2_decode_picture(VADriverContextP ctx,
     struct intel_batchbuffer *batch = gen7_mfd_context->base.batch;
     VAPictureParameterBufferMPEG2 *pic_param;
     VASliceParameterBufferMPEG2 *slice_param, *next_slice_param, *next_slice_group_param;
-    dri_bo *slice_data_bo;
+    dri_bo *slice_data_bo, *last_slice_data_bo = NULL;
     int i, j;
 
     assert(decode_state->pic_param && decode_state->pic_param->buffer);
@@ -1436,7 +1407,11 @@ gen75_mfd_mpeg2_decode_picture(VADriverContextP ctx,
         assert(decode_state->slice_params && decode_state->slice_params[j]->buffer);
         slice_param = (VASliceParameterBufferMPEG2 *)decode_state->slice_params[j]->buffer;
         slice_data_bo = decode_state->slice_datas[j]->bo;
-        gen75_mfd_ind_obj_base_addr_state(ctx, slice_data_bo, MFX_FORMAT_MPEG2, gen7_mfd_context);
+
+        /* Slice data packed into one buffer object shares the base address */
+        if (slice_data_bo != last_slice_data_bo)
+            gen75_mfd_ind_obj_base_addr_state(ctx, slice_data_bo, MFX_FORMAT_MPEG2, gen7_mfd_context);
+        last_slice_data_bo = slice_data_bo;
 
         if (j == decode_state->num_slice_params - 1)
             next_slice_group_param = NULL;
@@ -1590,7 +1565,6 @@ gen75_mfd_vc1_decode_init(VADriverContextP ctx,
                           struct gen7_mfd_context *gen7_mfd_context)
 {
     VAPictureParameterBufferVC1 *pic_param;
-    struct i965_driver_data *i965 = i965_driver_data(ctx);
     struct object_surface *obj_surface;
     struct gen7_vc1_surface *gen7_vc1_current_surface;
     struct gen7_vc1_surface *gen7_vc1_forward_surface;
@@ -1763,32 +1737,14 @@ gen75_mfd_vc1_decode_init(VADriverContextP ctx,
         }
     }
 
-    dri_bo_unreference(gen7_mfd_context->intra_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "intra row store",
-                      width_in_mbs * 64,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->intra_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->intra_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->intra_row_store_scratch_buffer,
+                                "intra row store", width_in_mbs * 64);
 
-    dri_bo_unreference(gen7_mfd_context->deblocking_filter_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "deblocking filter row store",
-                      width_in_mbs * 7 * 64,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->deblocking_filter_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->deblocking_filter_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->deblocking_filter_row_store_scratch_buffer,
+                                "deblocking filter row store", width_in_mbs * 7 * 64);
 
-    dri_bo_unreference(gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "bsd mpc row store",
-                      width_in_mbs * 96,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->bsd_mpc_row_store_scratch_buffer,
+                                "bsd mpc row store", width_in_mbs * 96);
 
     gen7_mfd_context->mpr_row_store_scratch_buffer.valid = 0;
 
@@ -1796,14 +1752,11 @@ gen75_mfd_vc1_decode_init(VADriverContextP ctx,
         gen7_mfd_context->bitplane_read_buffer.valid = 1;
     else
         gen7_mfd_context->bitplane_read_buffer.valid = !!(pic_param->bitplane_present.value & 0x7f);
-    dri_bo_unreference(gen7_mfd_context->bitplane_read_buffer.bo);
 
     if (gen7_mfd_context->bitplane_read_buffer.valid) {
         int width_in_mbs = ALIGN(pic_param->coded_width, 16) / 16;
         int height_in_mbs;
         int bitplane_width = ALIGN(width_in_mbs, 2) / 2;
-        int src_w, src_h;
-        uint8_t *src = NULL, *dst = NULL;
 
         if (!pic_param->sequence_fields.bits.interlace ||
             (pic_param->picture_fields.bits.frame_coding_mode < 2)) /* Progressive or Frame-Interlace */
@@ -1811,60 +1764,38 @@ gen75_mfd_vc1_decode_init(VADriverContextP ctx,
         else /* Field-Interlace */
             height_in_mbs = ALIGN(pic_param->coded_height, 32) / 32;
 
-        bo = dri_bo_alloc(i965->intel.bufmgr,
-                          "VC-1 Bitplane",
-                          bitplane_width * height_in_mbs,
-                          0x1000);
-        assert(bo);
-        gen7_mfd_context->bitplane_read_buffer.bo = bo;
-
-        dri_bo_map(bo, True);
-        assert(bo->virtual);
-        dst = bo->virtual;
-
-        if (picture_type == GEN7_VC1_SKIPPED_PICTURE) {
-            for (src_h = 0; src_h < height_in_mbs; src_h++) {
-                for (src_w = 0; src_w < width_in_mbs; src_w++) {
-                    int dst_index;
-                    uint8_t src_value = 0x2;
-
-                    dst_index = src_w / 2;
-                    dst[dst_index] = ((dst[dst_index] >> 4) | (src_value << 4));
-                }
-
-                if (src_w & 1)
-                    dst[src_w / 2] >>= 4;
-
-                dst += bitplane_width;
+        /* The plane of a skipped picture is only read by the GPU, so it
+           stays valid for the next skipped pictures */
+        if (picture_type != GEN7_VC1_SKIPPED_PICTURE ||
+            !gen7_mfd_context->skipped_bitplane_bo ||
+            gen7_mfd_context->skipped_bitplane_bo != gen7_mfd_context->bitplane_read_buffer.bo ||
+            gen7_mfd_context->skipped_bitplane_width != width_in_mbs ||
+            gen7_mfd_context->skipped_bitplane_height != height_in_mbs) {
+            intel_ensure_bitplane_buffer(ctx, &gen7_mfd_context->bitplane_read_buffer,
+                                         &gen7_mfd_context->bitplane_spare_buffer,
+                                         bitplane_width * height_in_mbs);
+            bo = gen7_mfd_context->bitplane_read_buffer.bo;
+
+            dri_bo_map(bo, True);
+            assert(bo->virtual);
+
+            if (picture_type == GEN7_VC1_SKIPPED_PICTURE) {
+                i965_vc1_bitplane_fill_skipped(bo->virtual, bitplane_width,
+                                               width_in_mbs, height_in_mbs);
+                gen7_mfd_context->skipped_bitplane_bo = bo;
+                gen7_mfd_context->skipped_bitplane_width = width_in_mbs;
+                gen7_mfd_context->skipped_bitplane_height = height_in_mbs;
+            } else {
+                assert(decode_state->bit_plane->buffer);
+                i965_vc1_bitplane_convert(bo->virtual, bitplane_width,
+                                          decode_state->bit_plane->buffer,
+                                          width_in_mbs, height_in_mbs);
+                gen7_mfd_context->skipped_bitplane_bo = NULL;
             }
-        } else {
-            assert(decode_state->bit_plane->buffer);
-            src = decode_state->bit_plane->buffer;
-
-            for (src_h = 0; src_h < height_in_mbs; src_h++) {
-                for (src_w = 0; src_w < width_in_mbs; src_w++) {
-                    int src_index, dst_index;
-                    int src_shift;
-                    uint8_t src_value;
 
-                    src_index = (src_h * width_in_mbs + src_w) / 2;
-                    src_shift = !((src_h * width_in_mbs + src_w) & 1) * 4;
-                    src_value = ((src[src_index] >> src_shift) & 0xf);
-
-                    dst_index = src_w / 2;
-                    dst[dst_index] = ((dst[dst_index] >> 4) | (src_value << 4));
-                }
-
-                if (src_w & 1)
-                    dst[src_w / 2] >>= 4;
-
-                dst += bitplane_width;
-            }
+            dri_bo_unmap(bo);
         }
-
-        dri_bo_unmap(bo);
-    } else
-        gen7_mfd_context->bitplane_read_buffer.bo = NULL;
+    }
 }
 
 static void
@@ -2590,7 +2521,7 @@ gen75_mfd_vc1_decode_picture(VADriverContextP ctx,
     struct intel_batchbuffer *batch = gen7_mfd_context->base.batch;
     VAPictureParameterBufferVC1 *pic_param;
     VASliceParameterBufferVC1 *slice_param, *next_slice_param, *next_slice_group_param;
-    dri_bo *slice_data_bo;
+    dri_bo *slice_data_bo, *last_slice_data_bo = NULL;
     int i, j;
 
     assert(decode_state->pic_param && decode_state->pic_param->buffer);
@@ -2611,7 +2542,11 @@ gen75_mfd_vc1_decode_picture(VADriverContextP ctx,
         assert(decode_state->slice_params && decode_state->slice_params[j]->buffer);
         slice_param = (VASliceParameterBufferVC1 *)decode_state->slice_params[j]->buffer;
         slice_data_bo = decode_state->slice_datas[j]->bo;
-        gen75_mfd_ind_obj_base_addr_state(ctx, slice_data_bo, MFX_FORMAT_VC1, gen7_mfd_context);
+
+        /* Slice data packed into one buffer object shares the base address */
+        if (slice_data_bo != last_slice_data_bo)
+            gen75_mfd_ind_obj_base_addr_state(ctx, slice_data_bo, MFX_FORMAT_VC1, gen7_mfd_context);
+        last_slice_data_bo = slice_data_bo;
 
         if (j == decode_state->num_slice_params - 1)
             next_slice_group_param = NULL;
@@ -2710,6 +2645,9 @@ gen75_mfd_jpeg_decode_init(VADriverContextP ctx,
 
     gen7_mfd_context->bitplane_read_buffer.bo = NULL;
     gen7_mfd_context->bitplane_read_buffer.valid = 0;
+
+    gen7_mfd_context->bitplane_spare_buffer.bo = NULL;
+    gen7_mfd_context->bitplane_spare_buffer.valid = 0;
 }
 
 static const int va_to_gen7_jpeg_rotation[4] = {
@@ -3701,6 +3639,9 @@ gen75_mfd_context_destroy(void *hw_context)
     dri_bo_unreference(gen7_mfd_context->bitplane_read_buffer.bo);
     gen7_mfd_context->bitplane_read_buffer.bo = NULL;
 
+    dri_bo_unreference(gen7_mfd_context->bitplane_spare_buffer.bo);
+    gen7_mfd_context->bitplane_spare_buffer.bo = NULL;
+
     dri_bo_unreference(gen7_mfd_context->jpeg_wa_slice_data_bo);
 
     if (gen7_mfd_context->jpeg_wa_surface_id != VA_INVALID_SURFACE) {
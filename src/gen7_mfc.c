@@ -559,46 +559,44 @@ gen7_mfc_mpeg2_pak_object_intra(VADriverContextP ctx,
                                 struct intel_batchbuffer *batch)
 {
     int len_in_dwords = 9;
+    unsigned int *dw;
 
     if (batch == NULL)
         batch = encoder_context->base.batch;
 
-    BEGIN_BCS_BATCH(batch, len_in_dwords);
-
-    OUT_BCS_BATCH(batch, MFC_MPEG2_PAK_OBJECT | (len_in_dwords - 2));
-    OUT_BCS_BATCH(batch,
-                  0 << 24 |     /* PackedMvNum */
-                  0 << 20 |     /* MvFormat */
-                  7 << 17 |     /* CbpDcY/CbpDcU/CbpDcV */
-                  0 << 15 |     /* TransformFlag: frame DCT */
-                  0 << 14 |     /* FieldMbFlag */
-                  1 << 13 |     /* IntraMbFlag */
-                  mb_type << 8 |   /* MbType: Intra */
-                  0 << 2 |      /* SkipMbFlag */
-                  0 << 0 |      /* InterMbMode */
-                  0);
-    OUT_BCS_BATCH(batch, y << 16 | x);
-    OUT_BCS_BATCH(batch,
-                  max_size_in_word << 24 |
-                  target_size_in_word << 16 |
-                  coded_block_pattern << 6 |      /* CBP */
-                  0);
-    OUT_BCS_BATCH(batch,
-                  last_mb_in_slice << 31 |
-                  first_mb_in_slice << 30 |
-                  0 << 27 |     /* EnableCoeffClamp */
-                  last_mb_in_slice_group << 26 |
-                  0 << 25 |     /* MbSkipConvDisable */
-                  first_mb_in_slice_group << 24 |
-                  0 << 16 |     /* MvFieldSelect */
-                  qp_scale_code << 0 |
-                  0);
-    OUT_BCS_BATCH(batch, 0);    /* MV[0][0] */
-    OUT_BCS_BATCH(batch, 0);    /* MV[1][0] */
-    OUT_BCS_BATCH(batch, 0);    /* MV[0][1] */
-    OUT_BCS_BATCH(batch, 0);    /* MV[1][1] */
-
-    ADVANCE_BCS_BATCH(batch);
+    BEGIN_BCS_BATCH_SPAN(batch, len_in_dwords, dw);
+
+    *dw++ = MFC_MPEG2_PAK_OBJECT | (len_in_dwords - 2);
+    *dw++ = 0 << 24 |     /* PackedMvNum */
+            0 << 20 |     /* MvFormat */
+            7 << 17 |     /* CbpDcY/CbpDcU/CbpDcV */
+            0 << 15 |     /* TransformFlag: frame DCT */
+            0 << 14 |     /* FieldMbFlag */
+            1 << 13 |     /* IntraMbFlag */
+            mb_type << 8 |   /* MbType: Intra */
+            0 << 2 |      /* SkipMbFlag */
+            0 << 0 |      /* InterMbMode */
+            0;
+    *dw++ = y << 16 | x;
+    *dw++ = max_size_in_word << 24 |
+            target_size_in_word << 16 |
+            coded_block_pattern << 6 |      /* CBP */
+            0;
+    *dw++ = last_mb_in_slice << 31 |
+            first_mb_in_slice << 30 |
+            0 << 27 |     /* EnableCoeffClamp */
+            last_mb_in_slice_group << 26 |
+            0 << 25 |     /* MbSkipConvDisable */
+            first_mb_in_slice_group << 24 |
+            0 << 16 |     /* MvFieldSelect */
+            qp_scale_code << 0 |
+            0;
+    *dw++ = 0;    /* MV[0][0] */
+    *dw++ = 0;    /* MV[1][0] */
+    *dw++ = 0;    /* MV[0][1] */
+    *dw++ = 0;    /* MV[1][1] */
+
+    ADVANCE_BCS_BATCH_SPAN(batch, dw);
 
     return len_in_dwords;
 }
@@ -657,6 +655,7 @@ gen7_mfc_mpeg2_pak_object_inter(VADriverContextP ctx,
 {
     VAEncPictureParameterBufferMPEG2 *pic_param = (VAEncPictureParameterBufferMPEG2 *)encode_state->pic_param_ext->buffer;
     int len_in_dwords = 9;
+    unsigned int *dw;
     short *mvptr, mvx0, mvy0, mvx1, mvy1;
 
     if (batch == NULL)
@@ -668,43 +667,40 @@ gen7_mfc_mpeg2_pak_object_inter(VADriverContextP ctx,
     mvx1 = mpeg2_motion_vector(mvptr[2] / 2, x, width_in_mbs * 16, pic_param->f_code[1][0]);
     mvy1 = mpeg2_motion_vector(mvptr[3] / 2, y, height_in_mbs * 16, pic_param->f_code[1][0]);
 
-    BEGIN_BCS_BATCH(batch, len_in_dwords);
-
-    OUT_BCS_BATCH(batch, MFC_MPEG2_PAK_OBJECT | (len_in_dwords - 2));
-    OUT_BCS_BATCH(batch,
-                  2 << 24 |     /* PackedMvNum */
-                  7 << 20 |     /* MvFormat */
-                  7 << 17 |     /* CbpDcY/CbpDcU/CbpDcV */
-                  0 << 15 |     /* TransformFlag: frame DCT */
-                  0 << 14 |     /* FieldMbFlag */
-                  0 << 13 |     /* IntraMbFlag */
-                  1 << 8 |      /* MbType: Frame-based */
-                  0 << 2 |      /* SkipMbFlag */
-                  0 << 0 |      /* InterMbMode */
-                  0);
-    OUT_BCS_BATCH(batch, y << 16 | x);
-    OUT_BCS_BATCH(batch,
-                  max_size_in_word << 24 |
-                  target_size_in_word << 16 |
-                  0x3f << 6 |   /* CBP */
-                  0);
-    OUT_BCS_BATCH(batch,
-                  last_mb_in_slice << 31 |
-                  first_mb_in_slice << 30 |
-                  0 << 27 |     /* EnableCoeffClamp */
-                  last_mb_in_slice_group << 26 |
-                  0 << 25 |     /* MbSkipConvDisable */
-                  first_mb_in_slice_group << 24 |
-                  0 << 16 |     /* MvFieldSelect */
-                  qp_scale_code << 0 |
-                  0);
-
-    OUT_BCS_BATCH(batch, (mvx0 & 0xFFFF) | mvy0 << 16);    /* MV[0][0] */
-    OUT_BCS_BATCH(batch, (mvx1 & 0xFFFF) | mvy1 << 16);    /* MV[1][0] */
-    OUT_BCS_BATCH(batch, 0);    /* MV[0][1] */
-    OUT_BCS_BATCH(batch, 0);    /* MV[1][1] */
-
-    ADVANCE_BCS_BATCH(batch);
+    BEGIN_BCS_BATCH_SPAN(batch, len_in_dwords, dw);
+
+    *dw++ = MFC_MPEG2_PAK_OBJECT | (len_in_dwords - 2);
+    *dw++ = 2 << 24 |     /* PackedMvNum */
+            7 << 20 |     /* MvFormat */
+            7 << 17 |     /* CbpDcY/CbpDcU/CbpDcV */
+            0 << 15 |     /* TransformFlag: frame DCT */
+            0 << 14 |     /* FieldMbFlag */
+            0 << 13 |     /* IntraMbFlag */
+            1 << 8 |      /* MbType: Frame-based */
+            0 << 2 |      /* SkipMbFlag */
+            0 << 0 |      /* InterMbMode */
+            0;
+    *dw++ = y << 16 | x;
+    *dw++ = max_size_in_word << 24 |
+            target_size_in_word << 16 |
+            0x3f << 6 |   /* CBP */
+            0;
+    *dw++ = last_mb_in_slice << 31 |
+            first_mb_in_slice << 30 |
+            0 << 27 |     /* EnableCoeffClamp */
+            last_mb_in_slice_group << 26 |
+            0 << 25 |     /* MbSkipConvDisable */
+            first_mb_in_slice_group << 24 |
+            0 << 16 |     /* MvFieldSelect */
+            qp_scale_code << 0 |
+            0;
+
+    *dw++ = (mvx0 & 0xFFFF) | mvy0 << 16;    /* MV[0][0] */
+    *dw++ = (mvx1 & 0xFFFF) | mvy1 << 16;    /* MV[1][0] */
+    *dw++ = 0;    /* MV[0][1] */
+    *dw++ = 0;    /* MV[1][1] */
+
+    ADVANCE_BCS_BATCH_SPAN(batch, dw);
 
     return len_in_dwords;
 }
@@ -920,6 +916,21 @@ gen7_mfc_mpeg2_pipeline_slice_group(VADriverContextP ctx,
     }
 }
 
+void
+gen7_mfc_mpeg2_slice_programing(VADriverContextP ctx,
+                                struct encode_state *encode_state,
+                                struct intel_encoder_context *encoder_context,
+                                int slice_index,
+                                struct intel_batchbuffer *slice_batch)
+{
+    VAEncSliceParameterBufferMPEG2 *next_slice_group_param = NULL;
+
+    if (slice_index < encode_state->num_slice_params_ext - 1)
+        next_slice_group_param = (VAEncSliceParameterBufferMPEG2 *)encode_state->slice_params_ext[slice_index + 1]->buffer;
+
+    gen7_mfc_mpeg2_pipeline_slice_group(ctx, encode_state, encoder_context, slice_index, next_slice_group_param, slice_batch);
+}
+
 /*
  * A batch buffer for all slices, including slice state,
  * slice insert object and slice pak object commands
@@ -932,21 +943,14 @@ gen7_mfc_mpeg2_software_slice_batchbuffer(VADriverContextP ctx,
 {
     struct gen6_mfc_context *mfc_context = encoder_context->mfc_context;
     struct intel_batchbuffer *batch;
-    VAEncSliceParameterBufferMPEG2 *next_slice_group_param = NULL;
     dri_bo *batch_bo;
-    int i;
 
     batch = mfc_context->aux_batchbuffer;
     batch_bo = batch->buffer;
+    intel_batchbuffer_start_atomic_bcs(batch, 0x1000);
 
-    for (i = 0; i < encode_state->num_slice_params_ext; i++) {
-        if (i == encode_state->num_slice_params_ext - 1)
-            next_slice_group_param = NULL;
-        else
-            next_slice_group_param = (VAEncSliceParameterBufferMPEG2 *)encode_state->slice_params_ext[i + 1]->buffer;
-
-        gen7_mfc_mpeg2_pipeline_slice_group(ctx, encode_state, encoder_context, i, next_slice_group_param, batch);
-    }
+    intel_encoder_slice_programing(ctx, encode_state, encoder_context,
+                                   gen7_mfc_mpeg2_slice_programing, batch);
 
     intel_batchbuffer_align(batch, 8);
 
@@ -955,6 +959,9 @@ gen7_mfc_mpeg2_software_slice_batchbuffer(VADriverContextP ctx,
     OUT_BCS_BATCH(batch, MI_BATCH_BUFFER_END);
     ADVANCE_BCS_BATCH(batch);
 
+    intel_batchbuffer_end_atomic(batch);
+
+    intel_batchbuffer_record_second_level(batch);
     dri_bo_reference(batch_bo);
     intel_batchbuffer_free(batch);
     mfc_context->aux_batchbuffer = NULL;
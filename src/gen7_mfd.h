@@ -92,7 +92,12 @@ struct gen7_mfd_context {
     GenBuffer           bsd_mpc_row_store_scratch_buffer;
     GenBuffer           mpr_row_store_scratch_buffer;
     GenBuffer           bitplane_read_buffer;
+    GenBuffer           bitplane_spare_buffer;  /* bitplane of the previous picture, see intel_ensure_bitplane_buffer() */
+    dri_bo             *skipped_bitplane_bo;    /* bitplane_read_buffer.bo, if filled for a skipped picture */
+    int                 skipped_bitplane_width;
+    int                 skipped_bitplane_height;
     GenBuffer           segmentation_buffer;
+    GenDmvPool          dmv_pool;       /* AVC, gen8 and later */
 
     VASurfaceID jpeg_wa_surface_id;
     struct object_surface *jpeg_wa_surface_object;
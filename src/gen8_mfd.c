@@ -41,6 +41,7 @@
 #include "i965_defines.h"
 #include "i965_drv_video.h"
 #include "i965_decoder_utils.h"
+#include "i965_vc1_bitplane.h"
 
 #include "gen7_mfd.h"
 #include "intel_media.h"
@@ -62,9 +63,9 @@ static const uint32_t zigzag_direct[64] = {
 static void
 gen8_mfd_init_avc_surface(VADriverContextP ctx,
                           VAPictureParameterBufferH264 *pic_param,
-                          struct object_surface *obj_surface)
+                          struct object_surface *obj_surface,
+                          struct gen7_mfd_context *gen7_mfd_context)
 {
-    struct i965_driver_data *i965 = i965_driver_data(ctx);
     GenAvcSurface *gen7_avc_surface = obj_surface->private_data;
     int width_in_mbs, height_in_mbs;
 
@@ -84,14 +85,11 @@ gen8_mfd_init_avc_surface(VADriverContextP ctx,
     }
 
     /* DMV buffers now relate to the whole frame, irrespective of
-       field coding modes */
-    if (gen7_avc_surface->dmv_top == NULL) {
-        gen7_avc_surface->dmv_top = dri_bo_alloc(i965->intel.bufmgr,
-                                                 "direct mv w/r buffer",
-                                                 width_in_mbs * height_in_mbs * 128,
-                                                 0x1000);
-        assert(gen7_avc_surface->dmv_top);
-    }
+       field coding modes. They come from the pool of the context, so
+       only the surfaces still in the DPB hold one */
+    intel_dmv_pool_bind_avc(ctx, &gen7_mfd_context->dmv_pool,
+                            gen7_mfd_context->reference_surface, obj_surface,
+                            width_in_mbs * height_in_mbs * 128);
 }
 
 static void
@@ -817,9 +815,7 @@ gen8_mfd_avc_decode_init(VADriverContextP ctx,
 {
     VAPictureParameterBufferH264 *pic_param;
     VASliceParameterBufferH264 *slice_param;
-    struct i965_driver_data *i965 = i965_driver_data(ctx);
     struct object_surface *obj_surface;
-    dri_bo *bo;
     int i, j, enable_avc_ildb = 0;
     unsigned int width_in_mbs, height_in_mbs;
 
@@ -861,7 +857,7 @@ gen8_mfd_avc_decode_init(VADriverContextP ctx,
         obj_surface->flags &= ~SURFACE_REFERENCED;
 
     avc_ensure_surface_bo(ctx, decode_state, obj_surface, pic_param);
-    gen8_mfd_init_avc_surface(ctx, pic_param, obj_surface);
+    gen8_mfd_init_avc_surface(ctx, pic_param, obj_surface, gen7_mfd_context);
 
     dri_bo_unreference(gen7_mfd_context->post_deblocking_output.bo);
     gen7_mfd_context->post_deblocking_output.bo = obj_surface->bo;
@@ -873,41 +869,17 @@ gen8_mfd_avc_decode_init(VADriverContextP ctx,
     dri_bo_reference(gen7_mfd_context->pre_deblocking_output.bo);
     gen7_mfd_context->pre_deblocking_output.valid = !enable_avc_ildb;
 
-    dri_bo_unreference(gen7_mfd_context->intra_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "intra row store",
-                      width_in_mbs * 64,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->intra_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->intra_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->intra_row_store_scratch_buffer,
+                                "intra row store", width_in_mbs * 64);
 
-    dri_bo_unreference(gen7_mfd_context->deblocking_filter_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "deblocking filter row store",
-                      width_in_mbs * 64 * 4,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->deblocking_filter_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->deblocking_filter_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->deblocking_filter_row_store_scratch_buffer,
+                                "deblocking filter row store", width_in_mbs * 64 * 4);
 
-    dri_bo_unreference(gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "bsd mpc row store",
-                      width_in_mbs * 64 * 2,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->bsd_mpc_row_store_scratch_buffer,
+                                "bsd mpc row store", width_in_mbs * 64 * 2);
 
-    dri_bo_unreference(gen7_mfd_context->mpr_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "mpr row store",
-                      width_in_mbs * 64 * 2,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->mpr_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->mpr_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->mpr_row_store_scratch_buffer,
+                                "mpr row store", width_in_mbs * 64 * 2);
 
     gen7_mfd_context->bitplane_read_buffer.valid = 0;
 }
@@ -920,7 +892,7 @@ gen8_mfd_avc_decode_picture(VADriverContextP ctx,
     struct intel_batchbuffer *batch = gen7_mfd_context->base.batch;
     VAPictureParameterBufferH264 *pic_param;
     VASliceParameterBufferH264 *slice_param, *next_slice_param, *next_slice_group_param;
-    dri_bo *slice_data_bo;
+    dri_bo *slice_data_bo, *last_slice_data_bo = NULL;
     int i, j;
 
     assert(decode_state->pic_param && decode_state->pic_param->buffer);
@@ -941,7 +913,11 @@ gen8_mfd_avc_decode_picture(VADriverContextP ctx,
         assert(decode_state->slice_params && decode_state->slice_params[j]->buffer);
         slice_param = (VASliceParameterBufferH264 *)decode_state->slice_params[j]->buffer;
         slice_data_bo = decode_state->slice_datas[j]->bo;
-        gen8_mfd_ind_obj_base_addr_state(ctx, slice_data_bo, MFX_FORMAT_AVC, gen7_mfd_context);
+
+        /* Slice data packed into one buffer object shares the base address */
+        if (slice_data_bo != last_slice_data_bo)
+            gen8_mfd_ind_obj_base_addr_state(ctx, slice_data_bo, MFX_FORMAT_AVC, gen7_mfd_context);
+        last_slice_data_bo = slice_data_bo;
 
         if (j == decode_state->num_slice_params - 1)
             next_slice_group_param = NULL;
@@ -983,9 +959,7 @@ gen8_mfd_mpeg2_decode_init(VADriverContextP ctx,
                            struct gen7_mfd_context *gen7_mfd_context)
 {
     VAPictureParameterBufferMPEG2 *pic_param;
-    struct i965_driver_data *i965 = i965_driver_data(ctx);
     struct object_surface *obj_surface;
-    dri_bo *bo;
     unsigned int width_in_mbs;
 
     assert(decode_state->pic_param && decode_state->pic_param->buffer);
@@ -1008,14 +982,8 @@ gen8_mfd_mpeg2_decode_init(VADriverContextP ctx,
     dri_bo_reference(gen7_mfd_context->pre_deblocking_output.bo);
     gen7_mfd_context->pre_deblocking_output.valid = 1;
 
-    dri_bo_unreference(gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "bsd mpc row store",
-                      width_in_mbs * 96,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->bsd_mpc_row_store_scratch_buffer,
+                                "bsd mpc row store", width_in_mbs * 96);
 
     gen7_mfd_context->post_deblocking_output.valid = 0;
     gen7_mfd_context->intra_row_store_scratch_buffer.valid = 0;
@@ -1188,7 +1156,7 @@ gen8_mfd_mpeg2_decode_picture(VADriverContextP ctx,
     struct intel_batchbuffer *batch = gen7_mfd_context->base.batch;
     VAPictureParameterBufferMPEG2 *pic_param;
     VASliceParameterBufferMPEG2 *slice_param, *next_slice_param, *next_slice_group_param;
-    dri_bo *slice_data_bo;
+    dri_bo *slice_data_bo, *last_slice_data_bo = NULL;
     int i, j;
 
     assert(decode_state->pic_param && decode_state->pic_param->buffer);
@@ -1212,7 +1180,11 @@ gen8_mfd_mpeg2_decode_picture(VADriverContextP ctx,
         assert(decode_state->slice_params && decode_state->slice_params[j]->buffer);
         slice_param = (VASliceParameterBufferMPEG2 *)decode_state->slice_params[j]->buffer;
         slice_data_bo = decode_state->slice_datas[j]->bo;
-        gen8_mfd_ind_obj_base_addr_state(ctx, slice_data_bo, MFX_FORMAT_MPEG2, gen7_mfd_context);
+
+        /* Slice data packed into one buffer object shares the base address */
+        if (slice_data_bo != last_slice_data_bo)
+            gen8_mfd_ind_obj_base_addr_state(ctx, slice_data_bo, MFX_FORMAT_MPEG2, gen7_mfd_context);
+        last_slice_data_bo = slice_data_bo;
 
         if (j == decode_state->num_slice_params - 1)
             next_slice_group_param = NULL;
@@ -1369,7 +1341,6 @@ gen8_mfd_vc1_decode_init(VADriverContextP ctx,
                          struct gen7_mfd_context *gen7_mfd_context)
 {
     VAPictureParameterBufferVC1 *pic_param;
-    struct i965_driver_data *i965 = i965_driver_data(ctx);
     struct object_surface *obj_surface;
     struct gen7_vc1_surface *gen7_vc1_current_surface;
     struct gen7_vc1_surface *gen7_vc1_forward_surface;
@@ -1542,32 +1513,14 @@ gen8_mfd_vc1_decode_init(VADriverContextP ctx,
         }
     }
 
-    dri_bo_unreference(gen7_mfd_context->intra_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "intra row store",
-                      width_in_mbs * 64,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->intra_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->intra_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->intra_row_store_scratch_buffer,
+                                "intra row store", width_in_mbs * 64);
 
-    dri_bo_unreference(gen7_mfd_context->deblocking_filter_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "deblocking filter row store",
-                      width_in_mbs * 7 * 64,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->deblocking_filter_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->deblocking_filter_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->deblocking_filter_row_store_scratch_buffer,
+                                "deblocking filter row store", width_in_mbs * 7 * 64);
 
-    dri_bo_unreference(gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "bsd mpc row store",
-                      width_in_mbs * 96,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->bsd_mpc_row_store_scratch_buffer,
+                                "bsd mpc row store", width_in_mbs * 96);
 
     gen7_mfd_context->mpr_row_store_scratch_buffer.valid = 0;
 
@@ -1575,14 +1528,11 @@ gen8_mfd_vc1_decode_init(VADriverContextP ctx,
         gen7_mfd_context->bitplane_read_buffer.valid = 1;
     else
         gen7_mfd_context->bitplane_read_buffer.valid = !!(pic_param->bitplane_present.value & 0x7f);
-    dri_bo_unreference(gen7_mfd_context->bitplane_read_buffer.bo);
 
     if (gen7_mfd_context->bitplane_read_buffer.valid) {
         int width_in_mbs = ALIGN(pic_param->coded_width, 16) / 16;
         int height_in_mbs;
         int bitplane_width = ALIGN(width_in_mbs, 2) / 2;
-        int src_w, src_h;
-        uint8_t *src = NULL, *dst = NULL;
 
         if (!pic_param->sequence_fields.bits.interlace ||
             (pic_param->picture_fields.bits.frame_coding_mode < 2)) /* Progressive or Frame-Interlace */
@@ -1590,60 +1540,38 @@ gen8_mfd_vc1_decode_init(VADriverContextP ctx,
         else /* Field-Interlace */
             height_in_mbs = ALIGN(pic_param->coded_height, 32) / 32;
 
-        bo = dri_bo_alloc(i965->intel.bufmgr,
-                          "VC-1 Bitplane",
-                          bitplane_width * height_in_mbs,
-                          0x1000);
-        assert(bo);
-        gen7_mfd_context->bitplane_read_buffer.bo = bo;
-
-        dri_bo_map(bo, True);
-        assert(bo->virtual);
-        dst = bo->virtual;
-
-        if (picture_type == GEN7_VC1_SKIPPED_PICTURE) {
-            for (src_h = 0; src_h < height_in_mbs; src_h++) {
-                for (src_w = 0; src_w < width_in_mbs; src_w++) {
-                    int dst_index;
-                    uint8_t src_value = 0x2;
-
-                    dst_index = src_w / 2;
-                    dst[dst_index] = ((dst[dst_index] >> 4) | (src_value << 4));
-                }
-
-                if (src_w & 1)
-                    dst[src_w / 2] >>= 4;
-
-                dst += bitplane_width;
+        /* The plane of a skipped picture is only read by the GPU, so it
+           stays valid for the next skipped pictures */
+        if (picture_type != GEN7_VC1_SKIPPED_PICTURE ||
+            !gen7_mfd_context->skipped_bitplane_bo ||
+            gen7_mfd_context->skipped_bitplane_bo != gen7_mfd_context->bitplane_read_buffer.bo ||
+            gen7_mfd_context->skipped_bitplane_width != width_in_mbs ||
+            gen7_mfd_context->skipped_bitplane_height != height_in_mbs) {
+            intel_ensure_bitplane_buffer(ctx, &gen7_mfd_context->bitplane_read_buffer,
+                                         &gen7_mfd_context->bitplane_spare_buffer,
+                                         bitplane_width * height_in_mbs);
+            bo = gen7_mfd_context->bitplane_read_buffer.bo;
+
+            dri_bo_map(bo, True);
+            assert(bo->virtual);
+
+            if (picture_type == GEN7_VC1_SKIPPED_PICTURE) {
+                i965_vc1_bitplane_fill_skipped(bo->virtual, bitplane_width,
+                                               width_in_mbs, height_in_mbs);
+                gen7_mfd_context->skipped_bitplane_bo = bo;
+                gen7_mfd_context->skipped_bitplane_width = width_in_mbs;
+                gen7_mfd_context->skipped_bitplane_height = height_in_mbs;
+            } else {
+                assert(decode_state->bit_plane->buffer);
+                i965_vc1_bitplane_convert(bo->virtual, bitplane_width,
+                                          decode_state->bit_plane->buffer,
+                                          width_in_mbs, height_in_mbs);
+                gen7_mfd_context->skipped_bitplane_bo = NULL;
             }
-        } else {
-            assert(decode_state->bit_plane->buffer);
-            src = decode_state->bit_plane->buffer;
-
-            for (src_h = 0; src_h < height_in_mbs; src_h++) {
-                for (src_w = 0; src_w < width_in_mbs; src_w++) {
-                    int src_index, dst_index;
-                    int src_shift;
-                    uint8_t src_value;
 
-                    src_index = (src_h * width_in_mbs + src_w) / 2;
-                    src_shift = !((src_h * width_in_mbs + src_w) & 1) * 4;
-                    src_value = ((src[src_index] >> src_shift) & 0xf);
-
-                    dst_index = src_w / 2;
-                    dst[dst_index] = ((dst[dst_index] >> 4) | (src_value << 4));
-                }
-
-                if (src_w & 1)
-                    dst[src_w / 2] >>= 4;
-
-                dst += bitplane_width;
-            }
+            dri_bo_unmap(bo);
         }
-
-        dri_bo_unmap(bo);
-    } else
-        gen7_mfd_context->bitplane_read_buffer.bo = NULL;
+    }
 }
 
 static void
@@ -2298,7 +2226,7 @@ gen8_mfd_vc1_decode_picture(VADriverContextP ctx,
     struct intel_batchbuffer *batch = gen7_mfd_context->base.batch;
     VAPictureParameterBufferVC1 *pic_param;
     VASliceParameterBufferVC1 *slice_param, *next_slice_param, *next_slice_group_param;
-    dri_bo *slice_data_bo;
+    dri_bo *slice_data_bo, *last_slice_data_bo = NULL;
     int i, j;
 
     assert(decode_state->pic_param && decode_state->pic_param->buffer);
@@ -2319,7 +2247,11 @@ gen8_mfd_vc1_decode_picture(VADriverContextP ctx,
         assert(decode_state->slice_params && decode_state->slice_params[j]->buffer);
         slice_param = (VASliceParameterBufferVC1 *)decode_state->slice_params[j]->buffer;
         slice_data_bo = decode_state->slice_datas[j]->bo;
-        gen8_mfd_ind_obj_base_addr_state(ctx, slice_data_bo, MFX_FORMAT_VC1, gen7_mfd_context);
+
+        /* Slice data packed into one buffer object shares the base address */
+        if (slice_data_bo != last_slice_data_bo)
+            gen8_mfd_ind_obj_base_addr_state(ctx, slice_data_bo, MFX_FORMAT_VC1, gen7_mfd_context);
+        last_slice_data_bo = slice_data_bo;
 
         if (j == decode_state->num_slice_params - 1)
             next_slice_group_param = NULL;
@@ -2418,6 +2350,9 @@ gen8_mfd_jpeg_decode_init(VADriverContextP ctx,
 
     gen7_mfd_context->bitplane_read_buffer.bo = NULL;
     gen7_mfd_context->bitplane_read_buffer.valid = 0;
+
+    gen7_mfd_context->bitplane_spare_buffer.bo = NULL;
+    gen7_mfd_context->bitplane_spare_buffer.valid = 0;
 }
 
 static const int va_to_gen7_jpeg_rotation[4] = {
@@ -3200,8 +3135,6 @@ gen8_mfd_vp8_decode_init(VADriverContextP ctx,
                          struct gen7_mfd_context *gen7_mfd_context)
 {
     struct object_surface *obj_surface;
-    struct i965_driver_data *i965 = i965_driver_data(ctx);
-    dri_bo *bo;
     VAPictureParameterBufferVP8 *pic_param = (VAPictureParameterBufferVP8 *)decode_state->pic_param->buffer;
     int width_in_mbs = (pic_param->frame_width + 15) / 16;
     int height_in_mbs = (pic_param->frame_height + 15) / 16;
@@ -3232,41 +3165,17 @@ gen8_mfd_vp8_decode_init(VADriverContextP ctx,
                                          &gen7_mfd_context->segmentation_buffer, width_in_mbs, height_in_mbs);
 
     /* The same as AVC */
-    dri_bo_unreference(gen7_mfd_context->intra_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "intra row store",
-                      width_in_mbs * 64,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->intra_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->intra_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->intra_row_store_scratch_buffer,
+                                "intra row store", width_in_mbs * 64);
 
-    dri_bo_unreference(gen7_mfd_context->deblocking_filter_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "deblocking filter row store",
-                      width_in_mbs * 64 * 4,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->deblocking_filter_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->deblocking_filter_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->deblocking_filter_row_store_scratch_buffer,
+                                "deblocking filter row store", width_in_mbs * 64 * 4);
 
-    dri_bo_unreference(gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "bsd mpc row store",
-                      width_in_mbs * 64 * 2,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->bsd_mpc_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->bsd_mpc_row_store_scratch_buffer,
+                                "bsd mpc row store", width_in_mbs * 64 * 2);
 
-    dri_bo_unreference(gen7_mfd_context->mpr_row_store_scratch_buffer.bo);
-    bo = dri_bo_alloc(i965->intel.bufmgr,
-                      "mpr row store",
-                      width_in_mbs * 64 * 2,
-                      0x1000);
-    assert(bo);
-    gen7_mfd_context->mpr_row_store_scratch_buffer.bo = bo;
-    gen7_mfd_context->mpr_row_store_scratch_buffer.valid = 1;
+    intel_ensure_scratch_buffer(ctx, &gen7_mfd_context->mpr_row_store_scratch_buffer,
+                                "mpr row store", width_in_mbs * 64 * 2);
 
     gen7_mfd_context->bitplane_read_buffer.valid = 0;
 }
@@ -3608,9 +3517,14 @@ gen8_mfd_context_destroy(void *hw_context)
     dri_bo_unreference(gen7_mfd_context->bitplane_read_buffer.bo);
     gen7_mfd_context->bitplane_read_buffer.bo = NULL;
 
+    dri_bo_unreference(gen7_mfd_context->bitplane_spare_buffer.bo);
+    gen7_mfd_context->bitplane_spare_buffer.bo = NULL;
+
     dri_bo_unreference(gen7_mfd_context->segmentation_buffer.bo);
     gen7_mfd_context->segmentation_buffer.bo = NULL;
 
+    intel_dmv_pool_terminate(&gen7_mfd_context->dmv_pool);
+
     dri_bo_unreference(gen7_mfd_context->jpeg_wa_slice_data_bo);
 
     if (gen7_mfd_context->jpeg_wa_surface_id != VA_INVALID_SURFACE) {
@@ -3654,6 +3568,7 @@ gen8_dec_hw_context_init(VADriverContextP ctx, struct object_config *obj_config)
 
     gen7_mfd_context->jpeg_wa_surface_id = VA_INVALID_SURFACE;
     gen7_mfd_context->segmentation_buffer.valid = 0;
+    intel_dmv_pool_init(&gen7_mfd_context->dmv_pool);
 
     switch (obj_config->profile) {
     case VAProfileMPEG2Simple:
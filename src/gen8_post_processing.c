@@ -688,7 +688,8 @@ pp_null_y_steps(void *private_context)
 }
 
 static int
-pp_null_set_block_parameter(struct i965_post_processing_context *pp_context, int x, int y)
+pp_null_set_block_parameter(const struct i965_post_processing_context *pp_context,
+                            void *inline_parameter, int x, int y)
 {
     return 0;
 }
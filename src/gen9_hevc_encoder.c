@@ -48,6 +48,7 @@
 #include "gen9_hevc_enc_utils.h"
 #include "gen9_hevc_encoder.h"
 #include "gen9_hevc_enc_const_def.h"
+#include "i965_byte_scan.h"
 
 static void *hevc_enc_kernel_ptr = NULL;
 static int hevc_enc_kernel_size = 0;
@@ -5850,9 +5851,9 @@ gen9_hevc_vme_gpe_init(VADriverContextP ctx,
     priv_ctx = (struct gen9_hevc_encoder_context *)vme_context->private_enc_ctx;
     priv_state = (struct gen9_hevc_encoder_state *)vme_context->private_enc_state;
 
-    i965_zero_gpe_resource(&priv_ctx->res_mb_code_surface);
+    i965_zero_gpe_resource(ctx, &priv_ctx->res_mb_code_surface);
 
-    i965_zero_gpe_resource(&priv_ctx->res_slice_map_buffer);
+    i965_zero_gpe_resource_cpu(ctx, &priv_ctx->res_slice_map_buffer);
     if (encode_state->num_slice_params_ext > 1) {
         struct gen9_hevc_slice_map *pslice_map = NULL;
         int width = priv_state->width_in_lcu;
@@ -6716,21 +6717,19 @@ gen9_hevc_pak_add_slice_state(VADriverContextP ctx,
 static int
 gen9_hevc_find_skipemulcnt(unsigned char *buf, unsigned int bits_length)
 {
-    int skip_cnt = 0, i = 0;
+    int zero_byte;
 
     if ((bits_length >> 3) < 6)
         return 0;
 
-    for (i = 0; i < 3; i++)
-        if (buf[i] != 0)
-            break;
+    /* Only a start code at the very beginning of the header is skipped */
+    if (i965_byte_scan_start_code(buf, 1) != 0)
+        return 0;
 
-    if (i > 1) {
-        if (buf[i] == 1)
-            skip_cnt = i + 3;
-    }
+    zero_byte = (buf[2] != 1);
 
-    return skip_cnt;
+    /* the start code and the two bytes of the NAL unit header */
+    return zero_byte + 3 + 2;
 }
 
 static void
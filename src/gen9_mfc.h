@@ -279,4 +279,12 @@ Bool gen9_hcpe_context_init(VADriverContextP ctx, struct intel_encoder_context *
 
 void gen9_hcpe_context_destroy(void *context);
 
+/* The software PAK slice generator, see intel_encoder_slice_programing() */
+extern void
+gen9_hcpe_hevc_pipeline_slice_programing(VADriverContextP ctx,
+                                         struct encode_state *encode_state,
+                                         struct intel_encoder_context *encoder_context,
+                                         int slice_index,
+                                         struct intel_batchbuffer *slice_batch);
+
 #endif  /* GEN9_MFC_H */
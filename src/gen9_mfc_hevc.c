@@ -41,6 +41,7 @@
 #include "gen9_mfc.h"
 #include "gen6_vme.h"
 #include "intel_media.h"
+#include "i965_byte_scan.h"
 
 typedef enum _gen6_brc_status {
     BRC_NO_HRD_VIOLATION = 0,
@@ -1106,7 +1107,7 @@ gen9_hcpe_stop(VADriverContextP ctx,
 int intel_hevc_find_skipemulcnt(unsigned char *buf, int bits_length)
 {
     /* to do */
-    int i, found;
+    int i;
     int leading_zero_cnt, byte_length, zero_byte;
     int nal_unit_type;
     int skip_cnt = 0;
@@ -1117,17 +1118,8 @@ int intel_hevc_find_skipemulcnt(unsigned char *buf, int bits_length)
     byte_length = ALIGN(bits_length, 32) >> 3;
 
 
-    leading_zero_cnt = 0;
-    found = 0;
-    for (i = 0; i < byte_length - 4; i++) {
-        if (((buf[i] == 0) && (buf[i + 1] == 0) && (buf[i + 2] == 1)) ||
-            ((buf[i] == 0) && (buf[i + 1] == 0) && (buf[i + 2] == 0) && (buf[i + 3] == 1))) {
-            found = 1;
-            break;
-        }
-        leading_zero_cnt++;
-    }
-    if (!found) {
+    leading_zero_cnt = i965_byte_scan_start_code(buf, byte_length - 4);
+    if (leading_zero_cnt >= byte_length - 4) {
         /* warning message is complained. But anyway it will be inserted. */
         WARN_ONCE("Invalid packed header data. "
                   "Can't find the 000001 start_prefix code\n");
@@ -1643,7 +1635,7 @@ intel_hevc_slice_insert_packed_data(VADriverContextP ctx,
     return;
 }
 
-static void
+void
 gen9_hcpe_hevc_pipeline_slice_programing(VADriverContextP ctx,
                                          struct encode_state *encode_state,
                                          struct intel_encoder_context *encoder_context,
@@ -1892,14 +1884,13 @@ gen9_hcpe_hevc_software_batchbuffer(VADriverContextP ctx,
     struct gen9_hcpe_context *mfc_context = encoder_context->mfc_context;
     struct intel_batchbuffer *batch;
     dri_bo *batch_bo;
-    int i;
 
     batch = mfc_context->aux_batchbuffer;
     batch_bo = batch->buffer;
+    intel_batchbuffer_start_atomic_bcs(batch, 0x1000);
 
-    for (i = 0; i < encode_state->num_slice_params_ext; i++) {
-        gen9_hcpe_hevc_pipeline_slice_programing(ctx, encode_state, encoder_context, i, batch);
-    }
+    intel_encoder_slice_programing(ctx, encode_state, encoder_context,
+                                   gen9_hcpe_hevc_pipeline_slice_programing, batch);
 
     intel_batchbuffer_align(batch, 8);
 
@@ -1908,6 +1899,9 @@ gen9_hcpe_hevc_software_batchbuffer(VADriverContextP ctx,
     OUT_BCS_BATCH(batch, MI_BATCH_BUFFER_END);
     ADVANCE_BCS_BATCH(batch);
 
+    intel_batchbuffer_end_atomic(batch);
+
+    intel_batchbuffer_record_second_level(batch);
     dri_bo_reference(batch_bo);
     intel_batchbuffer_free(batch);
     mfc_context->aux_batchbuffer = NULL;
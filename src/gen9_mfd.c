@@ -976,7 +976,7 @@ gen9_hcpd_hevc_decode_picture(VADriverContextP ctx,
     struct intel_batchbuffer *batch = gen9_hcpd_context->base.batch;
     VAPictureParameterBufferHEVC *pic_param;
     VASliceParameterBufferHEVC *slice_param, *next_slice_param, *next_slice_group_param;
-    dri_bo *slice_data_bo;
+    dri_bo *slice_data_bo, *last_slice_data_bo = NULL;
     int i, j;
 
     vaStatus = gen9_hcpd_hevc_decode_init(ctx, decode_state, gen9_hcpd_context);
@@ -1008,10 +1008,14 @@ gen9_hcpd_hevc_decode_picture(VADriverContextP ctx,
         slice_param = (VASliceParameterBufferHEVC *)decode_state->slice_params[j]->buffer;
         slice_data_bo = decode_state->slice_datas[j]->bo;
 
-        if (IS_GEN10(i965->intel.device_info))
-            gen10_hcpd_ind_obj_base_addr_state(ctx, slice_data_bo, gen9_hcpd_context);
-        else
-            gen9_hcpd_ind_obj_base_addr_state(ctx, slice_data_bo, gen9_hcpd_context);
+        /* Slice data packed into one buffer object shares the base address */
+        if (slice_data_bo != last_slice_data_bo) {
+            if (IS_GEN10(i965->intel.device_info))
+                gen10_hcpd_ind_obj_base_addr_state(ctx, slice_data_bo, gen9_hcpd_context);
+            else
+                gen9_hcpd_ind_obj_base_addr_state(ctx, slice_data_bo, gen9_hcpd_context);
+        }
+        last_slice_data_bo = slice_data_bo;
 
         if (j == decode_state->num_slice_params - 1)
             next_slice_group_param = NULL;
@@ -1102,10 +1106,8 @@ vp9_update_segmentId_buffer(VADriverContextP ctx,
         pic_param->pic_fields.bits.error_resilient_mode ||
         pic_param->pic_fields.bits.intra_only || is_scaling) {
 
-        //VP9 Segment ID buffer needs to be zero
-        dri_bo_map(gen9_hcpd_context->vp9_segment_id_buffer.bo, 1);
-        memset((unsigned char *)gen9_hcpd_context->vp9_segment_id_buffer.bo->virtual, 0, size);
-        dri_bo_unmap(gen9_hcpd_context->vp9_segment_id_buffer.bo);
+        //VP9 Segment ID buffer needs to be zero, without waiting for the previous picture
+        i965_fill_buffer(&i965->fill, gen9_hcpd_context->vp9_segment_id_buffer.bo, 0, size, 0);
     }
 }
 
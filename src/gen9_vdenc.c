@@ -3949,7 +3949,7 @@ gen9_vdenc_allocate_resources(VADriverContextP ctx,
         ALLOC_VDENC_BUFFER_RESOURCE(vdenc_context->brc_update_dmem_res[i],
                                     ALIGN(sizeof(struct huc_brc_update_dmem), 64),
                                     "HuC BRC Update buffer");
-        i965_zero_gpe_resource(&vdenc_context->brc_update_dmem_res[i]);
+        i965_zero_gpe_resource(ctx, &vdenc_context->brc_update_dmem_res[i]);
     }
 
     ALLOC_VDENC_BUFFER_RESOURCE(vdenc_context->vdenc_statistics_res,
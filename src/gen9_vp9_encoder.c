@@ -608,7 +608,7 @@ gen9_vp9_allocate_resources(VADriverContextP ctx,
     if (!allocate_flag)
         goto failed_allocation;
 
-    i965_zero_gpe_resource(&vme_context->res_segmentid_buffer);
+    i965_zero_gpe_resource(ctx, &vme_context->res_segmentid_buffer);
 
     i965_free_gpe_resource(&vme_context->res_prob_delta_buffer);
     res_size = 29 * 64;
@@ -619,7 +619,7 @@ gen9_vp9_allocate_resources(VADriverContextP ctx,
     if (!allocate_flag)
         goto failed_allocation;
 
-    i965_zero_gpe_resource(&vme_context->res_segmentid_buffer);
+    i965_zero_gpe_resource(ctx, &vme_context->res_segmentid_buffer);
 
     i965_free_gpe_resource(&vme_context->res_prob_delta_buffer);
     res_size = 29 * 64;
@@ -1361,7 +1361,7 @@ gen9_vp9_brc_intra_dist_kernel(VADriverContextP ctx,
                                    &brc_intra_dist_curbe);
 
     /* zero distortion buffer */
-    i965_zero_gpe_resource(&vme_context->s4x_memv_distortion_buffer);
+    i965_zero_gpe_resource(ctx, &vme_context->s4x_memv_distortion_buffer);
 
     gen9_brc_intra_dist_add_surfaces_vp9(ctx, encode_state, encoder_context, gpe_context);
     gen8_gpe_setup_interface_data(ctx, gpe_context);
@@ -4093,7 +4093,7 @@ gen9_vme_gpe_kernel_run_vp9(VADriverContextP ctx,
 
     if (vp9_state->picture_coding_type == KEY_FRAME) {
         for (i = 0; i < 2; i++)
-            i965_zero_gpe_resource(&vme_context->res_mode_decision[i]);
+            i965_zero_gpe_resource(ctx, &vme_context->res_mode_decision[i]);
     }
 
     if (vp9_state->hme_supported) {
@@ -4589,7 +4589,7 @@ intel_vp9enc_refresh_frame_internal_buffers(VADriverContextP ctx,
         vp9_state->frame_ctx_idx = pic_param->pic_flags.bits.frame_context_idx;
     }
 
-    i965_zero_gpe_resource(&pak_context->res_compressed_input_buffer);
+    i965_zero_gpe_resource_cpu(ctx, &pak_context->res_compressed_input_buffer);
     buffer = i965_map_gpe_resource(&pak_context->res_compressed_input_buffer);
 
     if (!buffer)
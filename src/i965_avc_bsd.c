@@ -524,7 +524,7 @@ g4x_avc_bsd_object(VADriverContextP ctx,
 
 
         slice_data_bit_offset = avc_get_first_mb_bit_offset_with_epb(
-                                    decode_state->slice_datas[slice_index]->bo,
+                                    decode_state->slice_datas[slice_index],
                                     slice_param,
                                     pic_param->pic_fields.bits.entropy_coding_mode_flag
                                 );
@@ -650,7 +650,7 @@ ironlake_avc_bsd_object(VADriverContextP ctx,
             counter_value = 0;
 
         slice_data_bit_offset = avc_get_first_mb_bit_offset_with_epb(
-                                    decode_state->slice_datas[slice_index]->bo,
+                                    decode_state->slice_datas[slice_index],
                                     slice_param,
                                     pic_param->pic_fields.bits.entropy_coding_mode_flag
                                 );
@@ -1033,7 +1033,7 @@ gen9_avc_generate_slice_map(VADriverContextP ctx,
     gpe_resource = &(avc_ctx->res_mbenc_slice_map_surface);
     assert(gpe_resource);
 
-    i965_zero_gpe_resource(gpe_resource);
+    i965_zero_gpe_resource_cpu(ctx, gpe_resource);
 
     data_row = (unsigned int *)i965_map_gpe_resource(gpe_resource);
     assert(data_row);
@@ -1095,7 +1095,7 @@ gen9_avc_allocate_resources(VADriverContextP ctx,
                                                    "MB statistics output buffer");
         if (!allocate_flag)
             goto failed_allocation;
-        i965_zero_gpe_resource(&avc_ctx->res_mb_status_buffer);
+        i965_zero_gpe_resource(ctx, &avc_ctx->res_mb_status_buffer);
     }
 
     if (avc_state->flatness_check_supported) {
@@ -1121,7 +1121,7 @@ gen9_avc_allocate_resources(VADriverContextP ctx,
                                                   "4x MEMV distortion buffer");
     if (!allocate_flag)
         goto failed_allocation;
-    i965_zero_gpe_resource(&avc_ctx->s4x_memv_distortion_buffer);
+    i965_zero_gpe_resource(ctx, &avc_ctx->s4x_memv_distortion_buffer);
 
     width = (generic_state->downscaled_width_4x_in_mb + 7) / 8 * 64;
     height = (generic_state->downscaled_height_4x_in_mb + 1) / 2 * 8;
@@ -1133,7 +1133,7 @@ gen9_avc_allocate_resources(VADriverContextP ctx,
                                                   "4x MEMV min distortion brc buffer");
     if (!allocate_flag)
         goto failed_allocation;
-    i965_zero_gpe_resource(&avc_ctx->s4x_memv_min_distortion_brc_buffer);
+    i965_zero_gpe_resource(ctx, &avc_ctx->s4x_memv_min_distortion_brc_buffer);
 
 
     width = ALIGN(generic_state->downscaled_width_4x_in_mb * 32, 64);
@@ -1146,7 +1146,7 @@ gen9_avc_allocate_resources(VADriverContextP ctx,
                                                   "4x MEMV data buffer");
     if (!allocate_flag)
         goto failed_allocation;
-    i965_zero_gpe_resource(&avc_ctx->s4x_memv_data_buffer);
+    i965_zero_gpe_resource(ctx, &avc_ctx->s4x_memv_data_buffer);
 
 
     width = ALIGN(generic_state->downscaled_width_16x_in_mb * 32, 64);
@@ -1159,7 +1159,7 @@ gen9_avc_allocate_resources(VADriverContextP ctx,
                                                   "16x MEMV data buffer");
     if (!allocate_flag)
         goto failed_allocation;
-    i965_zero_gpe_resource(&avc_ctx->s16x_memv_data_buffer);
+    i965_zero_gpe_resource(ctx, &avc_ctx->s16x_memv_data_buffer);
 
 
     width = ALIGN(generic_state->downscaled_width_32x_in_mb * 32, 64);
@@ -1172,7 +1172,7 @@ gen9_avc_allocate_resources(VADriverContextP ctx,
                                                   "32x MEMV data buffer");
     if (!allocate_flag)
         goto failed_allocation;
-    i965_zero_gpe_resource(&avc_ctx->s32x_memv_data_buffer);
+    i965_zero_gpe_resource(ctx, &avc_ctx->s32x_memv_data_buffer);
 
 
     if (!generic_state->brc_allocated) {
@@ -1223,7 +1223,7 @@ gen9_avc_allocate_resources(VADriverContextP ctx,
                                                       "brc const data buffer");
         if (!allocate_flag)
             goto failed_allocation;
-        i965_zero_gpe_resource(&avc_ctx->res_brc_const_data_buffer);
+        i965_zero_gpe_resource(ctx, &avc_ctx->res_brc_const_data_buffer);
 
         if (generic_state->brc_distortion_buffer_supported) {
             width = ALIGN(generic_state->downscaled_width_4x_in_mb * 8, 64);
@@ -1238,7 +1238,7 @@ gen9_avc_allocate_resources(VADriverContextP ctx,
                                                           "brc dist data buffer");
             if (!allocate_flag)
                 goto failed_allocation;
-            i965_zero_gpe_resource(&avc_ctx->res_brc_dist_data_surface);
+            i965_zero_gpe_resource(ctx, &avc_ctx->res_brc_dist_data_surface);
         }
 
         if (generic_state->brc_roi_enable) {
@@ -1252,7 +1252,7 @@ gen9_avc_allocate_resources(VADriverContextP ctx,
                                                           "mbbrc roi buffer");
             if (!allocate_flag)
                 goto failed_allocation;
-            i965_zero_gpe_resource(&avc_ctx->res_mbbrc_roi_surface);
+            i965_zero_gpe_resource(ctx, &avc_ctx->res_mbbrc_roi_surface);
         }
 
         /*mb qp in mb brc*/
@@ -1285,7 +1285,7 @@ gen9_avc_allocate_resources(VADriverContextP ctx,
                                                        "mbenc brc buffer");
             if (!allocate_flag)
                 goto failed_allocation;
-            i965_zero_gpe_resource(&avc_ctx->res_mbenc_brc_buffer);
+            i965_zero_gpe_resource(ctx, &avc_ctx->res_mbenc_brc_buffer);
         }
         generic_state->brc_allocated = 1;
     }
@@ -1316,7 +1316,7 @@ gen9_avc_allocate_resources(VADriverContextP ctx,
                                                       "slice map buffer");
         if (!allocate_flag)
             goto failed_allocation;
-        i965_zero_gpe_resource(&avc_ctx->res_mbenc_slice_map_surface);
+        i965_zero_gpe_resource(ctx, &avc_ctx->res_mbenc_slice_map_surface);
 
         /*generate slice map,default one slice per frame.*/
     }
@@ -1331,7 +1331,7 @@ gen9_avc_allocate_resources(VADriverContextP ctx,
                                                    "sfd output buffer");
         if (!allocate_flag)
             goto failed_allocation;
-        i965_zero_gpe_resource(&avc_ctx->res_sfd_output_buffer);
+        i965_zero_gpe_resource(ctx, &avc_ctx->res_sfd_output_buffer);
 
         i965_free_gpe_resource(&avc_ctx->res_sfd_cost_table_p_frame_buffer);
         size = ALIGN(52, 64);
@@ -2381,7 +2381,7 @@ gen9_avc_init_brc_const_data(VADriverContextP ctx,
     gpe_resource = &(avc_ctx->res_brc_const_data_buffer);
     assert(gpe_resource);
 
-    i965_zero_gpe_resource(gpe_resource);
+    i965_zero_gpe_resource_cpu(ctx, gpe_resource);
 
     data = i965_map_gpe_resource(gpe_resource);
     assert(data);
@@ -2534,7 +2534,7 @@ gen9_avc_init_brc_const_data_old(VADriverContextP ctx,
     gpe_resource = &(avc_ctx->res_brc_const_data_buffer);
     assert(gpe_resource);
 
-    i965_zero_gpe_resource(gpe_resource);
+    i965_zero_gpe_resource_cpu(ctx, gpe_resource);
 
     data = i965_map_gpe_resource(gpe_resource);
     assert(data);
@@ -4792,7 +4792,7 @@ gen9_avc_send_surface_mbenc(VADriverContextP ctx,
                                     size / 4,
                                     0,
                                     GEN9_AVC_MBENC_MAD_DATA_INDEX);
-        i965_zero_gpe_resource(gpe_resource);
+        i965_zero_gpe_resource(ctx, gpe_resource);
     }
 
     /*brc updated mbenc curbe data buffer,it is ignored by gen9 and used in gen95*/
@@ -5320,7 +5320,7 @@ gen9_avc_kernel_mbenc(VADriverContextP ctx,
 
     /*clear the mad buffer*/
     if (mad_enable) {
-        i965_zero_gpe_resource(&(avc_ctx->res_mad_data_buffer));
+        i965_zero_gpe_resource(ctx, &(avc_ctx->res_mad_data_buffer));
     }
     /*send surface*/
     generic_ctx->pfn_send_mbenc_surface(ctx, encode_state, gpe_context, encoder_context, &param);
@@ -8916,7 +8916,7 @@ gen9_avc_preenc_allocate_internal_resources(VADriverContextP ctx,
                                                   "4x MEMV data buffer");
     if (!allocate_flag)
         goto failed_allocation;
-    i965_zero_gpe_resource(&avc_ctx->s4x_memv_data_buffer);
+    i965_zero_gpe_resource(ctx, &avc_ctx->s4x_memv_data_buffer);
 
     /*  Output DISTORTION surface from 4x ME */
     width = generic_state->downscaled_width_4x_in_mb * 8;
@@ -8929,7 +8929,7 @@ gen9_avc_preenc_allocate_internal_resources(VADriverContextP ctx,
                                                   "4x MEMV distortion buffer");
     if (!allocate_flag)
         goto failed_allocation;
-    i965_zero_gpe_resource(&avc_ctx->s4x_memv_distortion_buffer);
+    i965_zero_gpe_resource(ctx, &avc_ctx->s4x_memv_distortion_buffer);
 
     /* output BRC DISTORTION surface from 4x ME  */
     width = (generic_state->downscaled_width_4x_in_mb + 7) / 8 * 64;
@@ -8942,7 +8942,7 @@ gen9_avc_preenc_allocate_internal_resources(VADriverContextP ctx,
                                                   "brc dist data buffer");
     if (!allocate_flag)
         goto failed_allocation;
-    i965_zero_gpe_resource(&avc_ctx->res_brc_dist_data_surface);
+    i965_zero_gpe_resource(ctx, &avc_ctx->res_brc_dist_data_surface);
 
 
     /* FTQ Lut buffer,whichs is the mbbrc_const_data_buffer */
@@ -8954,7 +8954,7 @@ gen9_avc_preenc_allocate_internal_resources(VADriverContextP ctx,
                                                "mbbrc const data buffer");
     if (!allocate_flag)
         goto failed_allocation;
-    i965_zero_gpe_resource(&avc_ctx->res_mbbrc_const_data_buffer);
+    i965_zero_gpe_resource(ctx, &avc_ctx->res_mbbrc_const_data_buffer);
 
     /* 4x downscaled surface  */
     if (!avc_ctx->preenc_scaled_4x_surface_obj) {
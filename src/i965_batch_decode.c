@@ -0,0 +1,131 @@
+/*
+ * i965_batch_decode.c - Prints statistics of a batchbuffer trace
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Usage: i965_batch_decode [-f] [-q] trace-file
+ *
+ * Decodes a trace recorded with VA_INTEL_BATCH_RECORD=trace-file and
+ * prints, per picture (-f) and for the whole trace, how many times each
+ * command was emitted and how many DWORDs it took. -q only prints the
+ * per-picture summary lines.
+ */
+
+#include "sysdeps.h"
+#include <unistd.h>
+#include "intel_batchbuffer_decode.h"
+
+static void
+usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-f] [-q] trace-file\n", name);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct intel_batch_trace_reader reader;
+    struct intel_batch_decode_stats *frame, *total;
+    unsigned int num_frames = 0;
+    int per_frame = 0, quiet = 0;
+    int opt, type;
+
+    while ((opt = getopt(argc, argv, "fq")) != -1) {
+        switch (opt) {
+        case 'f':
+            per_frame = 1;
+            break;
+        case 'q':
+            quiet = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (intel_batch_trace_open(&reader, argv[optind])) {
+        fprintf(stderr, "%s: not a batch trace\n", argv[optind]);
+        return 1;
+    }
+
+    frame = malloc(sizeof(*frame));
+    total = malloc(sizeof(*total));
+    if (!frame || !total) {
+        intel_batch_trace_close(&reader);
+        return 1;
+    }
+
+    intel_batch_decode_stats_reset(frame);
+    intel_batch_decode_stats_reset(total);
+
+    printf("device 0x%04x, gen %u\n", reader.header.device_id, reader.header.gen);
+
+    while ((type = intel_batch_trace_next(&reader)) > 0) {
+        if (type == INTEL_BATCH_TRACE_BATCH) {
+            intel_batch_decode_batch(reader.header.gen, reader.record.ring_flag,
+                                     reader.dwords, reader.record.num_dwords,
+                                     frame);
+            intel_batch_decode_batch(reader.header.gen, reader.record.ring_flag,
+                                     reader.dwords, reader.record.num_dwords,
+                                     total);
+            frame->num_relocs += reader.record.num_relocs;
+            total->num_relocs += reader.record.num_relocs;
+            continue;
+        }
+
+        if (per_frame) {
+            printf("frame %u:\n", num_frames);
+            if (quiet) {
+                printf("  %lu batches, %lu dwords, %lu relocations\n",
+                       frame->num_batches, frame->num_dwords, frame->num_relocs);
+            } else {
+                intel_batch_decode_stats_sort(frame);
+                intel_batch_decode_stats_print(stdout, frame);
+            }
+        }
+
+        intel_batch_decode_stats_reset(frame);
+        num_frames++;
+    }
+
+    if (type < 0)
+        fprintf(stderr, "%s: truncated or corrupted trace\n", argv[optind]);
+
+    printf("total, %u frames:\n", num_frames);
+    intel_batch_decode_stats_sort(total);
+    intel_batch_decode_stats_print(stdout, total);
+
+    free(frame);
+    free(total);
+    intel_batch_trace_close(&reader);
+
+    return type < 0;
+}
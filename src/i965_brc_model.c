@@ -0,0 +1,684 @@
+/*
+ * i965_brc_model.c - Host-side AVC bit rate controller of the MFC encoders
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sysdeps.h"
+
+#include <ctype.h>
+#include <float.h>
+#include <math.h>
+#include <va/va.h>
+
+#include "i965_defines.h"
+#include "i965_brc_model.h"
+
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+static double
+brc_model_framerate(const struct i965_brc_model_params *params, int layer_id)
+{
+    return (double)params->framerate_num[layer_id] / (double)params->framerate_den[layer_id];
+}
+
+void
+i965_brc_model_init(const struct i965_brc_model_params *params,
+                    struct i965_brc_rate_state *brc,
+                    struct i965_brc_hrd_state *hrd)
+{
+    double bitrate, framerate;
+    double frame_per_bits = 8 * 3 * params->frame_width * params->frame_height / 2;
+    double qp1_size = 0.1 * frame_per_bits;
+    double qp51_size = 0.001 * frame_per_bits;
+    int min_qp = MAX(1, params->min_qp);
+    int num_layers = params->num_layers;
+    double bpf, factor, hrd_factor;
+    int inum = params->num_iframes_in_gop,
+        pnum = params->num_pframes_in_gop,
+        bnum = params->num_bframes_in_gop; /* Gop structure: number of I, P, B frames in the Gop. */
+    int intra_period = params->gop_size;
+    int i;
+    int tmp_min_qp = 0;
+
+    if (num_layers > 1)
+        qp1_size = 0.15 * frame_per_bits;
+
+    brc->mode = params->mode;
+    memset(&brc->lookahead, 0, sizeof(brc->lookahead));
+
+    hrd->violation_noted = 0;
+
+    for (i = 0; i < num_layers; i++) {
+        brc->qp_prime_y[i][SLICE_TYPE_I] = 26;
+        brc->qp_prime_y[i][SLICE_TYPE_P] = 26;
+        brc->qp_prime_y[i][SLICE_TYPE_B] = 26;
+
+        if (i == 0) {
+            bitrate = params->bits_per_second[0];
+            framerate = brc_model_framerate(params, 0);
+        } else {
+            bitrate = (params->bits_per_second[i] - params->bits_per_second[i - 1]);
+            framerate = brc_model_framerate(params, i) - brc_model_framerate(params, i - 1);
+        }
+
+        if (brc->mode == VA_RC_VBR && params->target_percentage[i])
+            bitrate = bitrate * params->target_percentage[i] / 100;
+
+        /* Share of the frames of the whole stream up to this layer */
+        if (i == num_layers - 1)
+            factor = 1.0;
+        else
+            factor = brc_model_framerate(params, i) / brc_model_framerate(params, num_layers - 1);
+
+        hrd_factor = (double)bitrate / params->bits_per_second[num_layers - 1];
+
+        hrd->buffer_size[i] = (unsigned int)(params->hrd_buffer_size * hrd_factor);
+        hrd->current_buffer_fullness[i] =
+            (double)(params->hrd_initial_buffer_fullness < params->hrd_buffer_size) ?
+            params->hrd_initial_buffer_fullness : params->hrd_buffer_size / 2.;
+        hrd->current_buffer_fullness[i] *= hrd_factor;
+        hrd->target_buffer_fullness[i] = (double)params->hrd_buffer_size * hrd_factor / 2.;
+        hrd->buffer_capacity[i] = (double)params->hrd_buffer_size * hrd_factor / qp1_size;
+
+        if (num_layers > 1) {
+            if (i == 0) {
+                intra_period = (int)(params->gop_size * factor);
+                inum = 1;
+                pnum = (int)(params->num_pframes_in_gop * factor);
+                bnum = intra_period - inum - pnum;
+            } else {
+                intra_period = (int)(params->gop_size * factor) - intra_period;
+                inum = 0;
+                pnum = (int)(params->num_pframes_in_gop * factor) - pnum;
+                bnum = intra_period - inum - pnum;
+            }
+        }
+
+        brc->gop_nums[i][SLICE_TYPE_I] = inum;
+        brc->gop_nums[i][SLICE_TYPE_P] = pnum;
+        brc->gop_nums[i][SLICE_TYPE_B] = bnum;
+
+        brc->target_frame_size[i][SLICE_TYPE_I] = (int)((double)((bitrate * intra_period) / framerate) /
+                                                        (double)(inum + BRC_PWEIGHT * pnum + BRC_BWEIGHT * bnum));
+        brc->target_frame_size[i][SLICE_TYPE_P] = BRC_PWEIGHT * brc->target_frame_size[i][SLICE_TYPE_I];
+        brc->target_frame_size[i][SLICE_TYPE_B] = BRC_BWEIGHT * brc->target_frame_size[i][SLICE_TYPE_I];
+
+        bpf = brc->bits_per_frame[i] = bitrate / framerate;
+
+        if (params->initial_qp) {
+            brc->qp_prime_y[i][SLICE_TYPE_I] = params->initial_qp;
+            brc->qp_prime_y[i][SLICE_TYPE_P] = params->initial_qp;
+            brc->qp_prime_y[i][SLICE_TYPE_B] = params->initial_qp;
+
+            BRC_CLIP(brc->qp_prime_y[i][SLICE_TYPE_I], min_qp, 51);
+            BRC_CLIP(brc->qp_prime_y[i][SLICE_TYPE_P], min_qp, 51);
+            BRC_CLIP(brc->qp_prime_y[i][SLICE_TYPE_B], min_qp, 51);
+        } else {
+            if ((bpf > qp51_size) && (bpf < qp1_size)) {
+                brc->qp_prime_y[i][SLICE_TYPE_P] = 51 - 50 * (bpf - qp51_size) / (qp1_size - qp51_size);
+            } else if (bpf >= qp1_size)
+                brc->qp_prime_y[i][SLICE_TYPE_P] = 1;
+            else if (bpf <= qp51_size)
+                brc->qp_prime_y[i][SLICE_TYPE_P] = 51;
+
+            brc->qp_prime_y[i][SLICE_TYPE_I] = brc->qp_prime_y[i][SLICE_TYPE_P];
+            brc->qp_prime_y[i][SLICE_TYPE_B] = brc->qp_prime_y[i][SLICE_TYPE_I];
+
+            tmp_min_qp = (min_qp < 36) ? min_qp : 36;
+            BRC_CLIP(brc->qp_prime_y[i][SLICE_TYPE_I], tmp_min_qp, 36);
+            tmp_min_qp = (min_qp < 40) ? min_qp : 40;
+            BRC_CLIP(brc->qp_prime_y[i][SLICE_TYPE_P], tmp_min_qp, 40);
+            tmp_min_qp = (min_qp < 45) ? min_qp : 45;
+            BRC_CLIP(brc->qp_prime_y[i][SLICE_TYPE_B], tmp_min_qp, 45);
+        }
+    }
+}
+
+int
+i965_brc_model_update_hrd(struct i965_brc_rate_state *brc,
+                          struct i965_brc_hrd_state *hrd,
+                          int layer_id,
+                          int frame_bits)
+{
+    double prev_bf = hrd->current_buffer_fullness[layer_id];
+
+    hrd->current_buffer_fullness[layer_id] -= frame_bits;
+
+    if (hrd->buffer_size[layer_id] > 0 && hrd->current_buffer_fullness[layer_id] <= 0.) {
+        hrd->current_buffer_fullness[layer_id] = prev_bf;
+        return BRC_UNDERFLOW;
+    }
+
+    hrd->current_buffer_fullness[layer_id] += brc->bits_per_frame[layer_id];
+    if (hrd->buffer_size[layer_id] > 0 && hrd->current_buffer_fullness[layer_id] > hrd->buffer_size[layer_id]) {
+        if (brc->mode == VA_RC_VBR)
+            hrd->current_buffer_fullness[layer_id] = hrd->buffer_size[layer_id];
+        else {
+            hrd->current_buffer_fullness[layer_id] = prev_bf;
+            return BRC_OVERFLOW;
+        }
+    }
+    return BRC_NO_HRD_VIOLATION;
+}
+
+static int
+brc_model_postpack_cbr(const struct i965_brc_model_params *params,
+                       struct i965_brc_rate_state *brc,
+                       struct i965_brc_hrd_state *hrd,
+                       const struct i965_brc_model_frame *frame)
+{
+    gen6_brc_status sts = BRC_NO_HRD_VIOLATION;
+    int slicetype = frame->slice_type;
+    int frame_bits = frame->frame_bits;
+    int curr_frame_layer_id = frame->layer_id;
+    int next_frame_layer_id = frame->next_layer_id;
+    int qpi, qpp, qpb;
+    int qp; // quantizer of previously encoded slice of current type
+    int qpn; // predicted quantizer for next frame of current type in integer format
+    double qpf; // predicted quantizer for next frame of current type in float format
+    double delta_qp; // QP correction
+    int min_qp = MAX(1, params->min_qp);
+    int target_frame_size, frame_size_next;
+    /* Notes:
+     *  x - how far we are from HRD buffer borders
+     *  y - how far we are from target HRD buffer fullness
+     */
+    double x, y;
+    double frame_size_alpha;
+
+    /* checking wthether HRD compliance first */
+    sts = i965_brc_model_update_hrd(brc, hrd, curr_frame_layer_id, frame_bits);
+
+    if (sts == BRC_NO_HRD_VIOLATION) { // no HRD violation
+        /* nothing */
+    } else {
+        next_frame_layer_id = curr_frame_layer_id;
+    }
+
+    brc->bits_prev_frame[curr_frame_layer_id] = frame_bits;
+    frame_bits = brc->bits_prev_frame[next_frame_layer_id];
+
+    brc->prev_slice_type[curr_frame_layer_id] = slicetype;
+    slicetype = brc->prev_slice_type[next_frame_layer_id];
+
+    /* 0 means the next frame is the first frame of next layer */
+    if (frame_bits == 0)
+        return sts;
+
+    qpi = brc->qp_prime_y[next_frame_layer_id][SLICE_TYPE_I];
+    qpp = brc->qp_prime_y[next_frame_layer_id][SLICE_TYPE_P];
+    qpb = brc->qp_prime_y[next_frame_layer_id][SLICE_TYPE_B];
+
+    qp = brc->qp_prime_y[next_frame_layer_id][slicetype];
+
+    target_frame_size = brc->target_frame_size[next_frame_layer_id][slicetype];
+    if (hrd->buffer_capacity[next_frame_layer_id] < 5)
+        frame_size_alpha = 0;
+    else
+        frame_size_alpha = (double)brc->gop_nums[next_frame_layer_id][slicetype];
+    if (frame_size_alpha > 30) frame_size_alpha = 30;
+    frame_size_next = target_frame_size + (double)(target_frame_size - frame_bits) /
+                      (double)(frame_size_alpha + 1.);
+
+    /* frame_size_next: avoiding negative number and too small value */
+    if ((double)frame_size_next < (double)(target_frame_size * 0.25))
+        frame_size_next = (int)((double)target_frame_size * 0.25);
+
+    qpf = (double)qp * target_frame_size / frame_size_next;
+    qpn = (int)(qpf + 0.5);
+
+    if (qpn == qp) {
+        /* setting qpn we round qpf making mistakes: now we are trying to compensate this */
+        brc->qpf_rounding_accumulator[next_frame_layer_id] += qpf - qpn;
+        if (brc->qpf_rounding_accumulator[next_frame_layer_id] > 1.0) {
+            qpn++;
+            brc->qpf_rounding_accumulator[next_frame_layer_id] = 0.;
+        } else if (brc->qpf_rounding_accumulator[next_frame_layer_id] < -1.0) {
+            qpn--;
+            brc->qpf_rounding_accumulator[next_frame_layer_id] = 0.;
+        }
+    }
+    /* making sure that QP is not changing too fast */
+    if ((qpn - qp) > BRC_QP_MAX_CHANGE) qpn = qp + BRC_QP_MAX_CHANGE;
+    else if ((qpn - qp) < -BRC_QP_MAX_CHANGE) qpn = qp - BRC_QP_MAX_CHANGE;
+    /* making sure that with QP predictions we did do not leave QPs range */
+    BRC_CLIP(qpn, 1, 51);
+
+    /* calculating QP delta as some function*/
+    x = hrd->target_buffer_fullness[next_frame_layer_id] - hrd->current_buffer_fullness[next_frame_layer_id];
+    if (x > 0) {
+        x /= hrd->target_buffer_fullness[next_frame_layer_id];
+        y = hrd->current_buffer_fullness[next_frame_layer_id];
+    } else {
+        x /= (hrd->buffer_size[next_frame_layer_id] - hrd->target_buffer_fullness[next_frame_layer_id]);
+        y = hrd->buffer_size[next_frame_layer_id] - hrd->current_buffer_fullness[next_frame_layer_id];
+    }
+    if (y < 0.01) y = 0.01;
+    if (x > 1) x = 1;
+    else if (x < -1) x = -1;
+
+    delta_qp = BRC_QP_MAX_CHANGE * exp(-1 / y) * sin(BRC_PI_0_5 * x);
+    qpn = (int)(qpn + delta_qp + 0.5);
+
+    /* making sure that with QP predictions we did do not leave QPs range */
+    BRC_CLIP(qpn, min_qp, 51);
+
+    if (sts == BRC_NO_HRD_VIOLATION) { // no HRD violation
+        /* correcting QPs of slices of other types */
+        if (slicetype == SLICE_TYPE_P) {
+            if (abs(qpn + BRC_P_B_QP_DIFF - qpb) > 2)
+                brc->qp_prime_y[next_frame_layer_id][SLICE_TYPE_B] += (qpn + BRC_P_B_QP_DIFF - qpb) >> 1;
+            if (abs(qpn - BRC_I_P_QP_DIFF - qpi) > 2)
+                brc->qp_prime_y[next_frame_layer_id][SLICE_TYPE_I] += (qpn - BRC_I_P_QP_DIFF - qpi) >> 1;
+        } else if (slicetype == SLICE_TYPE_I) {
+            if (abs(qpn + BRC_I_B_QP_DIFF - qpb) > 4)
+                brc->qp_prime_y[next_frame_layer_id][SLICE_TYPE_B] += (qpn + BRC_I_B_QP_DIFF - qpb) >> 2;
+            if (abs(qpn + BRC_I_P_QP_DIFF - qpp) > 2)
+                brc->qp_prime_y[next_frame_layer_id][SLICE_TYPE_P] += (qpn + BRC_I_P_QP_DIFF - qpp) >> 2;
+        } else { // SLICE_TYPE_B
+            if (abs(qpn - BRC_P_B_QP_DIFF - qpp) > 2)
+                brc->qp_prime_y[next_frame_layer_id][SLICE_TYPE_P] += (qpn - BRC_P_B_QP_DIFF - qpp) >> 1;
+            if (abs(qpn - BRC_I_B_QP_DIFF - qpi) > 4)
+                brc->qp_prime_y[next_frame_layer_id][SLICE_TYPE_I] += (qpn - BRC_I_B_QP_DIFF - qpi) >> 2;
+        }
+        BRC_CLIP(brc->qp_prime_y[next_frame_layer_id][SLICE_TYPE_I], min_qp, 51);
+        BRC_CLIP(brc->qp_prime_y[next_frame_layer_id][SLICE_TYPE_P], min_qp, 51);
+        BRC_CLIP(brc->qp_prime_y[next_frame_layer_id][SLICE_TYPE_B], min_qp, 51);
+    } else if (sts == BRC_UNDERFLOW) { // underflow
+        if (qpn <= qp) qpn = qp + 1;
+        if (qpn > 51) {
+            qpn = 51;
+            sts = BRC_UNDERFLOW_WITH_MAX_QP; //underflow with maxQP
+        }
+    } else if (sts == BRC_OVERFLOW) {
+        if (qpn >= qp) qpn = qp - 1;
+        if (qpn < min_qp) { // overflow with minQP
+            qpn = min_qp;
+            sts = BRC_OVERFLOW_WITH_MIN_QP; // bit stuffing to be done
+        }
+    }
+
+    brc->qp_prime_y[next_frame_layer_id][slicetype] = qpn;
+
+    return sts;
+}
+
+static int
+brc_model_postpack_vbr(const struct i965_brc_model_params *params,
+                       struct i965_brc_rate_state *brc,
+                       struct i965_brc_hrd_state *hrd,
+                       const struct i965_brc_model_frame *frame)
+{
+    gen6_brc_status sts;
+    int slice_type = frame->slice_type;
+    int frame_bits = frame->frame_bits;
+    int *qp = brc->qp_prime_y[0];
+    int min_qp = MAX(1, params->min_qp);
+    int qp_delta, large_frame_adjustment;
+
+    // This implements a simple reactive VBR rate control mode for single-layer H.264.  The primary
+    // aim here is to avoid the problematic behaviour that the CBR rate controller displays on
+    // scene changes, where the QP can get pushed up by a large amount in a short period and
+    // compromise the quality of following frames to a very visible degree.
+    // The main idea, then, is to try to keep the HRD buffering above the target level most of the
+    // time, so that when a large frame is generated (on a scene change or when the stream
+    // complexity increases) we have plenty of slack to be able to encode the more difficult region
+    // without compromising quality immediately on the following frames.   It is optimistic about
+    // the complexity of future frames, so even after generating one or more large frames on a
+    // significant change it will try to keep the QP at its current level until the HRD buffer
+    // bounds force a change to maintain the intended rate.
+
+    sts = i965_brc_model_update_hrd(brc, hrd, frame->layer_id, frame_bits);
+
+    // This adjustment is applied to increase the QP by more than we normally would if a very
+    // large frame is encountered and we are in danger of running out of slack.
+    large_frame_adjustment = rint(2.0 * log(frame_bits / brc->target_frame_size[0][slice_type]));
+
+    if (sts == BRC_UNDERFLOW) {
+        // The frame is far too big and we don't have the bits available to send it, so it will
+        // have to be re-encoded at a higher QP.
+        qp_delta = +2;
+        if (frame_bits > brc->target_frame_size[0][slice_type])
+            qp_delta += large_frame_adjustment;
+    } else if (sts == BRC_OVERFLOW) {
+        // The frame is very small and we are now overflowing the HRD buffer.  Currently this case
+        // does not occur because we ignore overflow in VBR mode.
+        assert(0 && "Overflow in VBR mode");
+    } else if (frame_bits <= brc->target_frame_size[0][slice_type]) {
+        // The frame is smaller than the average size expected for this frame type.
+        if (hrd->current_buffer_fullness[0] >
+            (hrd->target_buffer_fullness[0] + hrd->buffer_size[0]) / 2.0) {
+            // We currently have lots of bits available, so decrease the QP slightly for the next
+            // frame.
+            qp_delta = -1;
+        } else {
+            // The HRD buffer fullness is increasing, so do nothing.  (We may be under the target
+            // level here, but are moving in the right direction.)
+            qp_delta = 0;
+        }
+    } else {
+        // The frame is larger than the average size expected for this frame type.
+        if (hrd->current_buffer_fullness[0] > hrd->target_buffer_fullness[0]) {
+            // We are currently over the target level, so do nothing.
+            qp_delta = 0;
+        } else if (hrd->current_buffer_fullness[0] > hrd->target_buffer_fullness[0] / 2.0) {
+            // We are under the target level, but not critically.  Increase the QP by one step if
+            // continuing like this would underflow soon (currently within one second).
+            if (hrd->current_buffer_fullness[0] /
+                (double)(frame_bits - brc->target_frame_size[0][slice_type] + 1) <
+                brc_model_framerate(params, 0))
+                qp_delta = +1;
+            else
+                qp_delta = 0;
+        } else {
+            // We are a long way under the target level.  Always increase the QP, possibly by a
+            // larger amount dependent on how big the frame we just made actually was.
+            qp_delta = +1 + large_frame_adjustment;
+        }
+    }
+
+    switch (slice_type) {
+    case SLICE_TYPE_I:
+        qp[SLICE_TYPE_I] += qp_delta;
+        qp[SLICE_TYPE_P]  = qp[SLICE_TYPE_I] + BRC_I_P_QP_DIFF;
+        qp[SLICE_TYPE_B]  = qp[SLICE_TYPE_I] + BRC_I_B_QP_DIFF;
+        break;
+    case SLICE_TYPE_P:
+        qp[SLICE_TYPE_P] += qp_delta;
+        qp[SLICE_TYPE_I]  = qp[SLICE_TYPE_P] - BRC_I_P_QP_DIFF;
+        qp[SLICE_TYPE_B]  = qp[SLICE_TYPE_P] + BRC_P_B_QP_DIFF;
+        break;
+    case SLICE_TYPE_B:
+        qp[SLICE_TYPE_B] += qp_delta;
+        qp[SLICE_TYPE_I]  = qp[SLICE_TYPE_B] - BRC_I_B_QP_DIFF;
+        qp[SLICE_TYPE_P]  = qp[SLICE_TYPE_B] - BRC_P_B_QP_DIFF;
+        break;
+    }
+    BRC_CLIP(brc->qp_prime_y[0][SLICE_TYPE_I], min_qp, 51);
+    BRC_CLIP(brc->qp_prime_y[0][SLICE_TYPE_P], min_qp, 51);
+    BRC_CLIP(brc->qp_prime_y[0][SLICE_TYPE_B], min_qp, 51);
+
+    if (sts == BRC_UNDERFLOW && qp[slice_type] == 51)
+        sts = BRC_UNDERFLOW_WITH_MAX_QP;
+    if (sts == BRC_OVERFLOW && qp[slice_type] == min_qp)
+        sts = BRC_OVERFLOW_WITH_MIN_QP;
+
+    return sts;
+}
+
+void
+i965_brc_model_prepack(const struct i965_brc_model_params *params,
+                       struct i965_brc_rate_state *brc,
+                       const struct i965_brc_hrd_state *hrd,
+                       const struct i965_brc_model_frame *frame)
+{
+    struct i965_brc_lookahead_state *lookahead = &brc->lookahead;
+    unsigned int depth = MIN(params->lookahead_depth, I965_BRC_LOOKAHEAD_MAX_DEPTH);
+    int slicetype = frame->slice_type;
+    int layer_id = frame->layer_id;
+    int min_qp = MAX(1, params->min_qp);
+    int qp, offset = 0;
+    unsigned int i, num_frames;
+    double sum = 0., ratio, frame_size;
+
+    /* The previous frame wasn't followed by a postpack */
+    if (lookahead->qp_offset) {
+        brc->qp_prime_y[lookahead->layer_id][lookahead->slice_type] = lookahead->base_qp;
+        lookahead->qp_offset = 0;
+    }
+
+    if (!depth || !frame->complexity)
+        return;
+
+    num_frames = MIN(lookahead->num_frames[slicetype], depth);
+    for (i = 0; i < num_frames; i++)
+        sum += lookahead->complexity[slicetype][i];
+
+    if (sum > 0.) {
+        ratio = frame->complexity * num_frames / sum;
+        offset = (int)floor(6. * log2(ratio) + 0.5);
+
+        /* A QP step is within the noise of the estimate */
+        if (abs(offset) <= 1)
+            offset = 0;
+
+        BRC_CLIP(offset, -BRC_QP_MAX_CHANGE, BRC_QP_MAX_CHANGE);
+
+        /* Don't let the expected size of the frame drain the HRD buffer */
+        frame_size = brc->target_frame_size[layer_id][slicetype] * ratio * pow(2., -offset / 6.);
+        while (offset < BRC_QP_MAX_CHANGE && frame_size > hrd->current_buffer_fullness[layer_id]) {
+            offset++;
+            frame_size /= pow(2., 1. / 6.);
+        }
+    }
+
+    lookahead->complexity[slicetype][lookahead->next[slicetype]] = frame->complexity;
+    lookahead->next[slicetype] = (lookahead->next[slicetype] + 1) % depth;
+    if (lookahead->num_frames[slicetype] < depth)
+        lookahead->num_frames[slicetype]++;
+
+    qp = brc->qp_prime_y[layer_id][slicetype];
+    lookahead->layer_id = layer_id;
+    lookahead->slice_type = slicetype;
+    lookahead->base_qp = qp;
+
+    qp += offset;
+    BRC_CLIP(qp, min_qp, 51);
+    lookahead->qp_offset = qp - lookahead->base_qp;
+    brc->qp_prime_y[layer_id][slicetype] = qp;
+}
+
+int
+i965_brc_model_postpack(const struct i965_brc_model_params *params,
+                        struct i965_brc_rate_state *brc,
+                        struct i965_brc_hrd_state *hrd,
+                        const struct i965_brc_model_frame *frame)
+{
+    struct i965_brc_lookahead_state *lookahead = &brc->lookahead;
+    int offset = lookahead->qp_offset;
+    int *qp = &brc->qp_prime_y[lookahead->layer_id][lookahead->slice_type];
+    int min_qp = MAX(1, params->min_qp);
+    int sts, base_qp;
+
+    /* The controller works from its own QP, not from the prepack one */
+    if (offset) {
+        *qp = lookahead->base_qp;
+        lookahead->qp_offset = 0;
+    }
+
+    switch (params->mode) {
+    case VA_RC_CBR:
+        sts = brc_model_postpack_cbr(params, brc, hrd, frame);
+        break;
+    case VA_RC_VBR:
+        sts = brc_model_postpack_vbr(params, brc, hrd, frame);
+        break;
+    default:
+        assert(0 && "Invalid RC mode");
+        return 1;
+    }
+
+    /* The frame is coded again, keep the offset on top of the corrected QP */
+    if (offset && (sts == BRC_UNDERFLOW || sts == BRC_OVERFLOW)) {
+        base_qp = *qp;
+        *qp += offset;
+        BRC_CLIP(*qp, min_qp, 51);
+        lookahead->base_qp = base_qp;
+        lookahead->qp_offset = *qp - base_qp;
+    }
+
+    return sts;
+}
+
+int
+i965_brc_trace_load(FILE *fp, struct i965_brc_trace_frame **frames)
+{
+    struct i965_brc_trace_frame *array = NULL, *frame;
+    unsigned int num_frames = 0, max_frames = 0;
+    char line[256], type;
+    char *p;
+
+    *frames = NULL;
+
+    while (fgets(line, sizeof(line), fp)) {
+        p = strchr(line, '#');
+        if (p)
+            *p = '\0';
+
+        for (p = line; isspace((unsigned char)*p); p++)
+            ;
+
+        if (*p == '\0')
+            continue;
+
+        if (num_frames == max_frames) {
+            max_frames = max_frames ? max_frames * 2 : 256;
+            frame = realloc(array, max_frames * sizeof(*array));
+            if (!frame)
+                goto error;
+            array = frame;
+        }
+
+        frame = &array[num_frames];
+        frame->complexity = 0;
+        if (sscanf(p, "%c %d %d %u", &type, &frame->qp, &frame->frame_bits, &frame->complexity) < 3 ||
+            frame->qp < 1 || frame->qp > 51 || frame->frame_bits <= 0)
+            goto error;
+
+        switch (toupper((unsigned char)type)) {
+        case 'I':
+            frame->slice_type = SLICE_TYPE_I;
+            break;
+        case 'P':
+            frame->slice_type = SLICE_TYPE_P;
+            break;
+        case 'B':
+            frame->slice_type = SLICE_TYPE_B;
+            break;
+        default:
+            goto error;
+        }
+
+        num_frames++;
+    }
+
+    *frames = array;
+    return num_frames;
+
+error:
+    free(array);
+    return -1;
+}
+
+/* The classic rate model: the coded size halves every 6 QP steps */
+static int
+brc_model_estimate_bits(const struct i965_brc_trace_frame *frame, int qp)
+{
+    double bits = frame->frame_bits * pow(2.0, (frame->qp - qp) / 6.0);
+
+    return bits < 1. ? 1 : (int)(bits + 0.5);
+}
+
+void
+i965_brc_model_replay(const struct i965_brc_model_params *params,
+                      const struct i965_brc_trace_frame *frames,
+                      unsigned int num_frames,
+                      i965_brc_replay_func func,
+                      void *data,
+                      struct i965_brc_replay_stats *stats)
+{
+    struct i965_brc_rate_state brc;
+    struct i965_brc_hrd_state hrd;
+    struct i965_brc_model_frame frame;
+    struct i965_brc_trace_frame coded;
+    int last_qp[3] = { -1, -1, -1 };
+    unsigned int i, pass;
+    int sts;
+
+    memset(&brc, 0, sizeof(brc));
+    memset(&hrd, 0, sizeof(hrd));
+    memset(stats, 0, sizeof(*stats));
+    stats->min_buffer_fullness = DBL_MAX;
+    stats->max_buffer_fullness = -DBL_MAX;
+
+    i965_brc_model_init(params, &brc, &hrd);
+
+    memset(&frame, 0, sizeof(frame));
+
+    for (i = 0; i < num_frames; i++) {
+        coded.slice_type = frames[i].slice_type;
+
+        frame.slice_type = coded.slice_type;
+        frame.complexity = frames[i].complexity;
+        i965_brc_model_prepack(params, &brc, &hrd, &frame);
+
+        /* The QP always moves on a violation, so this terminates within 52 passes */
+        for (pass = 0; pass < 52; pass++) {
+            coded.qp = brc.qp_prime_y[0][coded.slice_type];
+            coded.frame_bits = brc_model_estimate_bits(&frames[i], coded.qp);
+
+            frame.slice_type = coded.slice_type;
+            frame.frame_bits = coded.frame_bits;
+            sts = i965_brc_model_postpack(params, &brc, &hrd, &frame);
+            stats->num_passes++;
+
+            if (sts == BRC_NO_HRD_VIOLATION)
+                break;
+
+            if (sts == BRC_UNDERFLOW_WITH_MAX_QP) {
+                stats->num_underflows++;
+                break;
+            }
+
+            if (sts == BRC_OVERFLOW_WITH_MIN_QP) {
+                stats->num_overflows++;
+                break;
+            }
+        }
+
+        stats->num_frames++;
+        stats->qp_histogram[coded.qp]++;
+        stats->total_bits += coded.frame_bits;
+
+        if (last_qp[coded.slice_type] >= 0)
+            stats->qp_swing += abs(coded.qp - last_qp[coded.slice_type]);
+
+        last_qp[coded.slice_type] = coded.qp;
+
+        if (hrd.current_buffer_fullness[0] < stats->min_buffer_fullness)
+            stats->min_buffer_fullness = hrd.current_buffer_fullness[0];
+
+        if (hrd.current_buffer_fullness[0] > stats->max_buffer_fullness)
+            stats->max_buffer_fullness = hrd.current_buffer_fullness[0];
+
+        if (func)
+            func(data, i, &coded, &hrd);
+    }
+}
@@ -0,0 +1,209 @@
+/*
+ * i965_brc_model.h - Host-side AVC bit rate controller of the MFC encoders
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef I965_BRC_MODEL_H
+#define I965_BRC_MODEL_H
+
+#include <stdio.h>
+
+/*
+ * The CBR/VBR controller of the gen6-gen8 MFC AVC encoders. Everything in
+ * here only depends on the sequence parameters and on the size of the coded
+ * frames, so it can be replayed from a trace without any hardware.
+ */
+
+#define I965_BRC_MAX_LAYERS     4
+#define I965_BRC_LOOKAHEAD_MAX_DEPTH    16
+
+#define BRC_CLIP(x, min, max)                                   \
+    {                                                           \
+        x = ((x > (max)) ? (max) : ((x < (min)) ? (min) : x));  \
+    }
+
+#define BRC_P_B_QP_DIFF 4
+#define BRC_I_P_QP_DIFF 2
+#define BRC_I_B_QP_DIFF (BRC_I_P_QP_DIFF + BRC_P_B_QP_DIFF)
+
+#define BRC_PWEIGHT 0.6  /* weight if P slice with comparison to I slice */
+#define BRC_BWEIGHT 0.25 /* weight if B slice with comparison to I slice */
+
+#define BRC_QP_MAX_CHANGE 5 /* maximum qp modification */
+#define BRC_CY 0.1 /* weight for */
+#define BRC_CX_UNDERFLOW 5.
+#define BRC_CX_OVERFLOW -4.
+
+#define BRC_PI_0_5 1.5707963267948966192313216916398
+
+typedef enum _gen6_brc_status {
+    BRC_NO_HRD_VIOLATION = 0,
+    BRC_UNDERFLOW = 1,
+    BRC_OVERFLOW = 2,
+    BRC_UNDERFLOW_WITH_MAX_QP = 3,
+    BRC_OVERFLOW_WITH_MIN_QP = 4,
+} gen6_brc_status;
+
+/* The subset of the encoder context the controller works from */
+struct i965_brc_model_params {
+    unsigned int mode;                  /* VA_RC_CBR or VA_RC_VBR */
+    unsigned int frame_width;
+    unsigned int frame_height;
+    unsigned int num_layers;
+    unsigned int gop_size;
+    unsigned int num_iframes_in_gop;
+    unsigned int num_pframes_in_gop;
+    unsigned int num_bframes_in_gop;
+    unsigned int bits_per_second[I965_BRC_MAX_LAYERS];
+    unsigned int framerate_num[I965_BRC_MAX_LAYERS];
+    unsigned int framerate_den[I965_BRC_MAX_LAYERS];
+    unsigned int target_percentage[I965_BRC_MAX_LAYERS];
+    unsigned int hrd_buffer_size;
+    unsigned int hrd_initial_buffer_fullness;
+    unsigned int initial_qp;
+    unsigned int min_qp;
+    unsigned int lookahead_depth;       /* frames of complexity history, 0 disables the prepack */
+};
+
+/* Complexity history of the lookahead mode, per slice type */
+struct i965_brc_lookahead_state {
+    unsigned int complexity[3][I965_BRC_LOOKAHEAD_MAX_DEPTH];
+    unsigned int num_frames[3];
+    unsigned int next[3];
+    int layer_id;                       /* of the frame being coded */
+    int slice_type;
+    int base_qp;                        /* QP of the controller for that frame */
+    int qp_offset;                      /* added by the prepack */
+};
+
+struct i965_brc_rate_state {
+    int mode;
+    int gop_nums[I965_BRC_MAX_LAYERS][3];
+    int target_frame_size[I965_BRC_MAX_LAYERS][3]; // I,P,B
+    int qp_prime_y[I965_BRC_MAX_LAYERS][3];
+    double bits_per_frame[I965_BRC_MAX_LAYERS];
+    double qpf_rounding_accumulator[I965_BRC_MAX_LAYERS];
+    int bits_prev_frame[I965_BRC_MAX_LAYERS];
+    int prev_slice_type[I965_BRC_MAX_LAYERS];
+    struct i965_brc_lookahead_state lookahead;
+};
+
+struct i965_brc_hrd_state {
+    double current_buffer_fullness[I965_BRC_MAX_LAYERS];
+    double target_buffer_fullness[I965_BRC_MAX_LAYERS];
+    double buffer_capacity[I965_BRC_MAX_LAYERS];
+    unsigned int buffer_size[I965_BRC_MAX_LAYERS];
+    unsigned int violation_noted;
+};
+
+/* A coded frame as seen by the controller */
+struct i965_brc_model_frame {
+    int slice_type;                     /* SLICE_TYPE_I, _P or _B */
+    int layer_id;                       /* temporal layer of this frame */
+    int next_layer_id;                  /* temporal layer of the next frame */
+    int frame_bits;
+    unsigned int complexity;            /* i965_complexity_end_frame(), for the prepack */
+};
+
+void
+i965_brc_model_init(const struct i965_brc_model_params *params,
+                    struct i965_brc_rate_state *brc,
+                    struct i965_brc_hrd_state *hrd);
+
+int
+i965_brc_model_update_hrd(struct i965_brc_rate_state *brc,
+                          struct i965_brc_hrd_state *hrd,
+                          int layer_id,
+                          int frame_bits);
+
+/*
+ * Offsets the QP of the frame about to be coded by how much its complexity
+ * differs from the average of the last lookahead_depth frames of the same
+ * type, so that a scene cut is coded close to the target size instead of
+ * being corrected after the fact. The offset only applies to this frame,
+ * i965_brc_model_postpack() goes on from the QP of the controller.
+ */
+void
+i965_brc_model_prepack(const struct i965_brc_model_params *params,
+                       struct i965_brc_rate_state *brc,
+                       const struct i965_brc_hrd_state *hrd,
+                       const struct i965_brc_model_frame *frame);
+
+/* Returns a gen6_brc_status and updates the QPs of the next frame */
+int
+i965_brc_model_postpack(const struct i965_brc_model_params *params,
+                        struct i965_brc_rate_state *brc,
+                        struct i965_brc_hrd_state *hrd,
+                        const struct i965_brc_model_frame *frame);
+
+/* One frame of a trace, as coded at @qp */
+struct i965_brc_trace_frame {
+    int slice_type;
+    int qp;
+    int frame_bits;
+    unsigned int complexity;            /* 0 if the trace has none */
+};
+
+struct i965_brc_replay_stats {
+    unsigned int num_frames;
+    unsigned int num_passes;            /* including re-encodes */
+    unsigned int num_underflows;        /* unrepairable, at the max QP */
+    unsigned int num_overflows;         /* unrepairable, at the min QP */
+    unsigned int qp_histogram[52];
+    unsigned int qp_swing;              /* sum of |QP change| between frames of the same type */
+    double min_buffer_fullness;
+    double max_buffer_fullness;
+    double total_bits;
+};
+
+/* Called once per replayed frame with the final QP and HRD state */
+typedef void (*i965_brc_replay_func)(void *data,
+                                     unsigned int frame_index,
+                                     const struct i965_brc_trace_frame *coded,
+                                     const struct i965_brc_hrd_state *hrd);
+
+/*
+ * Parses a text trace with one "<I|P|B> <qp> <bits> [complexity]" tuple per
+ * line, '#' starting a comment. Returns the number of frames or -1 on a syntax error,
+ * *frames must be released with free().
+ */
+int
+i965_brc_trace_load(FILE *fp, struct i965_brc_trace_frame **frames);
+
+/*
+ * Replays a single layer trace through the controller. The size of a frame
+ * coded at a different QP than in the trace is estimated by halving the
+ * bits for every 6 QP steps, and frames are re-encoded on an HRD violation
+ * like the MFC encoders do. The complexity of the frames drives the
+ * prepack when params->lookahead_depth is set.
+ */
+void
+i965_brc_model_replay(const struct i965_brc_model_params *params,
+                      const struct i965_brc_trace_frame *frames,
+                      unsigned int num_frames,
+                      i965_brc_replay_func func,
+                      void *data,
+                      struct i965_brc_replay_stats *stats);
+
+#endif /* I965_BRC_MODEL_H */
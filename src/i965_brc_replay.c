@@ -0,0 +1,193 @@
+/*
+ * i965_brc_replay.c - Replays a frame size trace through the AVC bit rate controller
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Usage: i965_brc_replay [-v] [-r cbr|vbr] [-b bitrate] [-f fps] [-g gop,p,b]
+ *                        [-s width,height] [-c hrd-size] [-q min-qp]
+ *                        trace-file
+ *
+ * Replays a text trace of "<I|P|B> <qp> <bits>" frames through the host
+ * side CBR/VBR controller of the MFC AVC encoders and prints the HRD
+ * buffer fullness and QP of every frame (-v) plus a QP histogram.
+ */
+
+#include "sysdeps.h"
+#include <unistd.h>
+#include <va/va.h>
+#include "i965_defines.h"
+#include "i965_brc_model.h"
+
+static void
+usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-v] [-r cbr|vbr] [-b bitrate] [-f fps] [-g gop,p,b]\n"
+            "          [-s width,height] [-c hrd-size] [-q min-qp] [-l lookahead]\n"
+            "          trace-file\n",
+            name);
+}
+
+static void
+print_frame(void *data, unsigned int frame_index,
+            const struct i965_brc_trace_frame *coded,
+            const struct i965_brc_hrd_state *hrd)
+{
+    static const char types[] = { 'P', 'B', 'I' };
+
+    printf("%6u %c qp %2d bits %9d fullness %10.0f (%5.1f%%)\n",
+           frame_index, types[coded->slice_type], coded->qp, coded->frame_bits,
+           hrd->current_buffer_fullness[0],
+           hrd->buffer_size[0] ? 100. * hrd->current_buffer_fullness[0] / hrd->buffer_size[0] : 0.);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct i965_brc_model_params params;
+    struct i965_brc_replay_stats stats;
+    struct i965_brc_trace_frame *frames;
+    unsigned int max_count = 0;
+    int num_frames, verbose = 0;
+    FILE *fp;
+    int opt, i;
+
+    memset(&params, 0, sizeof(params));
+    params.mode = VA_RC_CBR;
+    params.frame_width = 1920;
+    params.frame_height = 1080;
+    params.num_layers = 1;
+    params.gop_size = 30;
+    params.num_iframes_in_gop = 1;
+    params.num_pframes_in_gop = 29;
+    params.bits_per_second[0] = 4000000;
+    params.framerate_num[0] = 30;
+    params.framerate_den[0] = 1;
+
+    while ((opt = getopt(argc, argv, "vr:b:f:g:s:c:q:l:")) != -1) {
+        switch (opt) {
+        case 'v':
+            verbose = 1;
+            break;
+        case 'r':
+            if (!strcmp(optarg, "cbr"))
+                params.mode = VA_RC_CBR;
+            else if (!strcmp(optarg, "vbr"))
+                params.mode = VA_RC_VBR;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'b':
+            params.bits_per_second[0] = strtoul(optarg, NULL, 0);
+            break;
+        case 'f':
+            params.framerate_num[0] = strtoul(optarg, NULL, 0);
+            break;
+        case 'g':
+            if (sscanf(optarg, "%u,%u,%u", &params.gop_size,
+                       &params.num_pframes_in_gop, &params.num_bframes_in_gop) != 3) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 's':
+            if (sscanf(optarg, "%u,%u", &params.frame_width, &params.frame_height) != 2) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'c':
+            params.hrd_buffer_size = strtoul(optarg, NULL, 0);
+            break;
+        case 'q':
+            params.min_qp = strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            params.lookahead_depth = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind != argc - 1 || !params.bits_per_second[0] || !params.framerate_num[0] ||
+        params.gop_size < params.num_iframes_in_gop + params.num_pframes_in_gop + params.num_bframes_in_gop) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* The encoders' defaults when the application has no HRD parameters */
+    if (!params.hrd_buffer_size)
+        params.hrd_buffer_size = params.bits_per_second[0] << 1;
+
+    params.hrd_initial_buffer_fullness = params.hrd_buffer_size / 2;
+
+    fp = fopen(argv[optind], "r");
+    if (!fp) {
+        fprintf(stderr, "%s: can't open\n", argv[optind]);
+        return 1;
+    }
+
+    num_frames = i965_brc_trace_load(fp, &frames);
+    fclose(fp);
+
+    if (num_frames < 0) {
+        fprintf(stderr, "%s: malformed trace\n", argv[optind]);
+        return 1;
+    }
+
+    i965_brc_model_replay(&params, frames, num_frames,
+                          verbose ? print_frame : NULL, NULL, &stats);
+
+    printf("%u frames, %u passes, %.0f bits/s, %u underflows, %u overflows\n",
+           stats.num_frames, stats.num_passes,
+           stats.num_frames ? stats.total_bits * params.framerate_num[0] / params.framerate_den[0] / stats.num_frames : 0.,
+           stats.num_underflows, stats.num_overflows);
+    printf("buffer fullness %.0f - %.0f of %u, QP swing %u\n",
+           stats.num_frames ? stats.min_buffer_fullness : 0.,
+           stats.num_frames ? stats.max_buffer_fullness : 0.,
+           params.hrd_buffer_size, stats.qp_swing);
+
+    for (i = 0; i < 52; i++) {
+        if (stats.qp_histogram[i] > max_count)
+            max_count = stats.qp_histogram[i];
+    }
+
+    for (i = 0; i < 52; i++) {
+        if (!stats.qp_histogram[i])
+            continue;
+
+        printf("qp %2d %6u %.*s\n", i, stats.qp_histogram[i],
+               (int)(50 * stats.qp_histogram[i] / max_count),
+               "##################################################");
+    }
+
+    free(frames);
+
+    return 0;
+}
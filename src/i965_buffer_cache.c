@@ -0,0 +1,192 @@
+/*
+ * i965_buffer_cache.c - Recycling of host-side VA buffer allocations
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sysdeps.h"
+#include "i965_buffer_cache.h"
+
+#define CACHE_INC(counter) \
+    __atomic_fetch_add(&(counter), 1, __ATOMIC_RELAXED)
+
+/* Starting slot of the calling thread */
+static __thread unsigned int g_cache_slot_hint;
+static unsigned int g_cache_next_hint;
+
+static inline unsigned int
+cache_slot_hint(void)
+{
+    if (!g_cache_slot_hint)
+        g_cache_slot_hint = __atomic_add_fetch(&g_cache_next_hint, 1,
+                                               __ATOMIC_RELAXED);
+    return g_cache_slot_hint;
+}
+
+/* Claims any entry of the pool, returns NULL if the pool is empty */
+static void *
+cache_pool_get(void **pool)
+{
+    unsigned int i, hint = cache_slot_hint();
+    void *entry;
+
+    for (i = 0; i < I965_BUFFER_CACHE_NUM_SLOTS; i++) {
+        void **slot = &pool[(hint + i) % I965_BUFFER_CACHE_NUM_SLOTS];
+
+        if (!__atomic_load_n(slot, __ATOMIC_RELAXED))
+            continue;
+
+        entry = __atomic_exchange_n(slot, NULL, __ATOMIC_ACQUIRE);
+        if (entry)
+            return entry;
+    }
+    return NULL;
+}
+
+/* Stores the entry into a free slot, returns false if the pool is full */
+static bool
+cache_pool_put(void **pool, void *entry)
+{
+    unsigned int i, hint = cache_slot_hint();
+
+    for (i = 0; i < I965_BUFFER_CACHE_NUM_SLOTS; i++) {
+        void **slot = &pool[(hint + i) % I965_BUFFER_CACHE_NUM_SLOTS];
+        void *expected = NULL;
+
+        if (__atomic_load_n(slot, __ATOMIC_RELAXED))
+            continue;
+
+        if (__atomic_compare_exchange_n(slot, &expected, entry, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            return true;
+    }
+    return false;
+}
+
+static void
+cache_pool_flush(void **pool)
+{
+    unsigned int i;
+
+    for (i = 0; i < I965_BUFFER_CACHE_NUM_SLOTS; i++) {
+        free(pool[i]);
+        pool[i] = NULL;
+    }
+}
+
+/* Returns the smallest size class that holds size bytes */
+static int
+cache_size_class(size_t size)
+{
+    int size_class = 0;
+
+    if (size > I965_BUFFER_CACHE_MAX_SIZE)
+        return I965_BUFFER_CACHE_NO_CLASS;
+
+    while (size > ((size_t)1 << (I965_BUFFER_CACHE_MIN_SHIFT + size_class)))
+        size_class++;
+    return size_class;
+}
+
+void
+i965_buffer_cache_init(I965BufferCache *cache, size_t record_size)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache->record_size = record_size;
+}
+
+void
+i965_buffer_cache_terminate(I965BufferCache *cache)
+{
+    int i;
+
+    cache_pool_flush(cache->records);
+    for (i = 0; i < I965_BUFFER_CACHE_NUM_CLASSES; i++)
+        cache_pool_flush(cache->data[i]);
+}
+
+void *
+i965_buffer_cache_get_record(I965BufferCache *cache)
+{
+    void *record = cache_pool_get(cache->records);
+
+    if (record) {
+        CACHE_INC(cache->stats.record_hits);
+        memset(record, 0, cache->record_size);
+    } else {
+        CACHE_INC(cache->stats.record_misses);
+        record = calloc(1, cache->record_size);
+    }
+    return record;
+}
+
+void
+i965_buffer_cache_put_record(I965BufferCache *cache, void *record)
+{
+    if (record && !cache_pool_put(cache->records, record))
+        free(record);
+}
+
+void *
+i965_buffer_cache_get_data(I965BufferCache *cache, size_t size,
+                           int *size_class)
+{
+    void *data;
+
+    *size_class = cache_size_class(size);
+    if (*size_class == I965_BUFFER_CACHE_NO_CLASS) {
+        CACHE_INC(cache->stats.data_misses);
+        return malloc(size);
+    }
+
+    data = cache_pool_get(cache->data[*size_class]);
+    if (data) {
+        CACHE_INC(cache->stats.data_hits);
+        return data;
+    }
+
+    CACHE_INC(cache->stats.data_misses);
+    return malloc((size_t)1 << (I965_BUFFER_CACHE_MIN_SHIFT + *size_class));
+}
+
+void
+i965_buffer_cache_put_data(I965BufferCache *cache, void *data,
+                           int size_class)
+{
+    if (!data)
+        return;
+
+    if (size_class == I965_BUFFER_CACHE_NO_CLASS ||
+        !cache_pool_put(cache->data[size_class], data))
+        free(data);
+}
+
+void
+i965_buffer_cache_get_stats(I965BufferCache *cache,
+                            I965BufferCacheStats *stats)
+{
+    stats->record_hits = __atomic_load_n(&cache->stats.record_hits, __ATOMIC_RELAXED);
+    stats->record_misses = __atomic_load_n(&cache->stats.record_misses, __ATOMIC_RELAXED);
+    stats->data_hits = __atomic_load_n(&cache->stats.data_hits, __ATOMIC_RELAXED);
+    stats->data_misses = __atomic_load_n(&cache->stats.data_misses, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,107 @@
+/*
+ * i965_buffer_cache.h - Recycling of host-side VA buffer allocations
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef I965_BUFFER_CACHE_H
+#define I965_BUFFER_CACHE_H
+
+#include <stddef.h>
+
+/** Smallest cached data block is (1 << I965_BUFFER_CACHE_MIN_SHIFT) bytes */
+#define I965_BUFFER_CACHE_MIN_SHIFT     8
+/** Number of power-of-two size classes, i.e. blocks up to 16KB are cached */
+#define I965_BUFFER_CACHE_NUM_CLASSES   7
+/** Number of cached entries per record pool and per size class */
+#define I965_BUFFER_CACHE_NUM_SLOTS     16
+
+#define I965_BUFFER_CACHE_MAX_SIZE \
+    (1 << (I965_BUFFER_CACHE_MIN_SHIFT + I965_BUFFER_CACHE_NUM_CLASSES - 1))
+
+/** Size class of a data block which is not owned by the cache */
+#define I965_BUFFER_CACHE_NO_CLASS      -1
+
+typedef struct i965_buffer_cache        I965BufferCache;
+typedef struct i965_buffer_cache_stats  I965BufferCacheStats;
+
+/** Cache hit/miss counters */
+struct i965_buffer_cache_stats {
+    unsigned long record_hits;
+    unsigned long record_misses;
+    unsigned long data_hits;
+    unsigned long data_misses;
+};
+
+/**
+ * Cache of fixed-size records (struct buffer_store) and of host-side
+ * parameter buffers, binned in power-of-two size classes.
+ *
+ * Each pool is a small array of slots that are claimed and released with
+ * atomic exchanges, so no lock is taken on the create/destroy path. Each
+ * thread starts scanning at its own slot, which keeps concurrent threads
+ * mostly on distinct cache lines.
+ */
+struct i965_buffer_cache {
+    size_t record_size;
+    void *records[I965_BUFFER_CACHE_NUM_SLOTS];
+    void *data[I965_BUFFER_CACHE_NUM_CLASSES][I965_BUFFER_CACHE_NUM_SLOTS];
+    struct i965_buffer_cache_stats stats;
+};
+
+/** Initializes the cache for records of record_size bytes */
+void
+i965_buffer_cache_init(I965BufferCache *cache, size_t record_size);
+
+/** Releases all cached records and data blocks */
+void
+i965_buffer_cache_terminate(I965BufferCache *cache);
+
+/** Returns a zero-initialized record, or NULL if out of memory */
+void *
+i965_buffer_cache_get_record(I965BufferCache *cache);
+
+/** Returns a record obtained from i965_buffer_cache_get_record() */
+void
+i965_buffer_cache_put_record(I965BufferCache *cache, void *record);
+
+/**
+ * Returns an uninitialized data block of at least size bytes, or NULL if
+ * out of memory. The size class to pass back on release is stored in
+ * size_class.
+ */
+void *
+i965_buffer_cache_get_data(I965BufferCache *cache, size_t size,
+                           int *size_class);
+
+/** Returns a data block obtained from i965_buffer_cache_get_data() */
+void
+i965_buffer_cache_put_data(I965BufferCache *cache, void *data,
+                           int size_class);
+
+/** Retrieves a snapshot of the hit/miss counters */
+void
+i965_buffer_cache_get_stats(I965BufferCache *cache,
+                            I965BufferCacheStats *stats);
+
+#endif /* I965_BUFFER_CACHE_H */
@@ -0,0 +1,195 @@
+/*
+ * i965_byte_scan.c - Byte pattern scanning helpers
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sysdeps.h"
+#include "i965_byte_scan.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define I965_BYTE_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+typedef int (*ByteScanFunc)(const uint8_t *buf, int size,
+                            const uint8_t *pattern, int pattern_len);
+
+int
+i965_byte_scan_pattern_c(const uint8_t *buf, int size,
+                         const uint8_t *pattern, int pattern_len)
+{
+    int i;
+
+    for (i = 0; i < size; i++) {
+        if (buf[i] == pattern[0] &&
+            !memcmp(buf + i + 1, pattern + 1, pattern_len - 1))
+            return i;
+    }
+    return size;
+}
+
+#ifdef I965_BYTE_SCAN_X86
+/*
+ * Both SIMD variants compare a block of candidates against the first and
+ * the last byte of the pattern at once, then only check the inner bytes
+ * of the candidates where both ends match.
+ */
+__attribute__((target("sse2")))
+static int
+byte_scan_pattern_sse2(const uint8_t *buf, int size,
+                       const uint8_t *pattern, int pattern_len)
+{
+    const __m128i first = _mm_set1_epi8(pattern[0]);
+    const __m128i last = _mm_set1_epi8(pattern[pattern_len - 1]);
+    int i;
+
+    for (i = 0; i + 16 <= size; i += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i *)(buf + i));
+        const __m128i b = _mm_loadu_si128((const __m128i *)(buf + i + pattern_len - 1));
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+                                                            _mm_cmpeq_epi8(b, last)));
+
+        while (mask) {
+            const int j = __builtin_ctz(mask);
+
+            if (!memcmp(buf + i + j + 1, pattern + 1, pattern_len - 2))
+                return i + j;
+            mask &= mask - 1;
+        }
+    }
+    return i + i965_byte_scan_pattern_c(buf + i, size - i, pattern, pattern_len);
+}
+
+__attribute__((target("avx2")))
+static int
+byte_scan_pattern_avx2(const uint8_t *buf, int size,
+                       const uint8_t *pattern, int pattern_len)
+{
+    const __m256i first = _mm256_set1_epi8(pattern[0]);
+    const __m256i last = _mm256_set1_epi8(pattern[pattern_len - 1]);
+    int i;
+
+    for (i = 0; i + 32 <= size; i += 32) {
+        const __m256i a = _mm256_loadu_si256((const __m256i *)(buf + i));
+        const __m256i b = _mm256_loadu_si256((const __m256i *)(buf + i + pattern_len - 1));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first),
+                                                                  _mm256_cmpeq_epi8(b, last)));
+
+        while (mask) {
+            const int j = __builtin_ctz(mask);
+
+            if (!memcmp(buf + i + j + 1, pattern + 1, pattern_len - 2))
+                return i + j;
+            mask &= mask - 1;
+        }
+    }
+    return i + byte_scan_pattern_sse2(buf + i, size - i, pattern, pattern_len);
+}
+#endif
+
+static ByteScanFunc
+byte_scan_get_func(void)
+{
+    static ByteScanFunc scan_func;
+    ByteScanFunc func = __atomic_load_n(&scan_func, __ATOMIC_RELAXED);
+
+    if (func)
+        return func;
+
+    func = i965_byte_scan_pattern_c;
+#ifdef I965_BYTE_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        func = byte_scan_pattern_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+        func = byte_scan_pattern_sse2;
+#endif
+
+    __atomic_store_n(&scan_func, func, __ATOMIC_RELAXED);
+    return func;
+}
+
+int
+i965_byte_scan_pattern(const uint8_t *buf, int size,
+                       const uint8_t *pattern, int pattern_len)
+{
+    const uint8_t *match;
+
+    if (size <= 0)
+        return 0;
+
+    if (pattern_len < 2) {
+        match = memchr(buf, pattern[0], size);
+        return match ? match - buf : size;
+    }
+
+    return byte_scan_get_func()(buf, size, pattern, pattern_len);
+}
+
+int
+i965_byte_scan_start_code(const uint8_t *buf, int size)
+{
+    static const uint8_t start_code[] = { 0x00, 0x00, 0x01 };
+    int pos;
+
+    if (size <= 0)
+        return 0;
+
+    /* A four byte start code ending at pos + 2 begins one byte earlier */
+    pos = i965_byte_scan_pattern(buf, size + 1, start_code, 3);
+    if (pos > 0 && pos <= size && buf[pos - 1] == 0x00)
+        return pos - 1;
+
+    return pos < size ? pos : size;
+}
+
+int
+i965_byte_scan_epb_count(const uint8_t *buf, int size, int rbsp_size)
+{
+    static const uint8_t epb[] = { 0x00, 0x00, 0x03 };
+    int i = 2, j = 2, n = 0, count, pos;
+
+    /*
+     * i is the offset of the byte checked in buf, j the matching offset
+     * in the payload, which does not count the prevention bytes. The two
+     * bytes following a prevention byte are not checked again.
+     */
+    while (1) {
+        count = size - i;
+        if (count > rbsp_size - j)
+            count = rbsp_size - j;
+        if (count <= 0)
+            break;
+
+        pos = i965_byte_scan_pattern(buf + i - 2, count, epb, 3);
+        if (pos == count)
+            break;
+
+        n++;
+        i += pos + 3;
+        j += pos + 2;
+    }
+
+    return n;
+}
@@ -0,0 +1,70 @@
+/*
+ * i965_byte_scan.h - Byte pattern scanning helpers
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef I965_BYTE_SCAN_H
+#define I965_BYTE_SCAN_H
+
+#include <stdint.h>
+
+/**
+ * Finds the first occurrence of the pattern in buf, starting at any
+ * offset below size. Returns the offset of the match, or size if there is
+ * none.
+ *
+ * The caller must make buf readable up to size + pattern_len - 1 bytes,
+ * i.e. a match starting at the last offset is fully checked. SSE2 or AVX2
+ * code is selected at runtime when the CPU supports it.
+ */
+int
+i965_byte_scan_pattern(const uint8_t *buf, int size,
+                       const uint8_t *pattern, int pattern_len);
+
+/** Portable implementation of i965_byte_scan_pattern(), for reference */
+int
+i965_byte_scan_pattern_c(const uint8_t *buf, int size,
+                         const uint8_t *pattern, int pattern_len);
+
+/**
+ * Finds the first Annex B start code, 00 00 01 or 00 00 00 01, starting
+ * at an offset below size. Returns the offset of its first byte, or size
+ * if there is none.
+ *
+ * The caller must make buf readable up to size + 3 bytes.
+ */
+int
+i965_byte_scan_start_code(const uint8_t *buf, int size);
+
+/**
+ * Counts the emulation prevention bytes (the 03 of 00 00 03) found in the
+ * first rbsp_size bytes of payload of a NAL unit, without reading beyond
+ * size bytes of buf. This is the slice header walk of the AVC decoders,
+ * with the search between two prevention bytes done by
+ * i965_byte_scan_pattern().
+ */
+int
+i965_byte_scan_epb_count(const uint8_t *buf, int size, int rbsp_size);
+
+#endif /* I965_BYTE_SCAN_H */
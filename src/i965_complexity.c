@@ -0,0 +1,460 @@
+/*
+ * i965_complexity.c - CPU estimate of the coding complexity of frames
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sysdeps.h"
+#include "i965_complexity.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define I965_COMPLEXITY_X86 1
+#include <immintrin.h>
+#endif
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+typedef void (*DownscaleFunc)(uint8_t *dst, unsigned int dst_pitch,
+                              const uint8_t *src, unsigned int src_pitch,
+                              unsigned int width, unsigned int height);
+
+typedef unsigned int (*EstimateFunc)(const uint8_t *cur, const uint8_t *prev,
+                                     unsigned int pitch,
+                                     unsigned int width, unsigned int height);
+
+/* Rounds up like the SIMD average instructions */
+#define AVG2(a, b)      (((a) + (b) + 1) >> 1)
+
+static inline uint8_t
+downscale_pixel_c(const uint8_t *src, unsigned int src_pitch)
+{
+    unsigned int sum = 0;
+    int i;
+
+    /* Vertical pairs first, so that the rounding matches the SIMD code */
+    for (i = 0; i < 4; i++)
+        sum += AVG2(AVG2(src[i], src[src_pitch + i]),
+                    AVG2(src[2 * src_pitch + i], src[3 * src_pitch + i]));
+
+    return (sum + 2) >> 2;
+}
+
+void
+i965_complexity_downscale_c(uint8_t *dst, unsigned int dst_pitch,
+                            const uint8_t *src, unsigned int src_pitch,
+                            unsigned int width, unsigned int height)
+{
+    unsigned int x, y;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++)
+            dst[x] = downscale_pixel_c(src + 4 * x, src_pitch);
+
+        dst += dst_pitch;
+        src += 4 * src_pitch;
+    }
+}
+
+static inline unsigned int
+block_cost_c(const uint8_t *cur, const uint8_t *prev, unsigned int pitch)
+{
+    unsigned int sum = 0, intra = 0, inter = 0, mean;
+    int x, y;
+
+    for (y = 0; y < 8; y++)
+        for (x = 0; x < 8; x++)
+            sum += cur[y * pitch + x];
+
+    mean = (sum + 32) >> 6;
+
+    for (y = 0; y < 8; y++)
+        for (x = 0; x < 8; x++)
+            intra += abs(cur[y * pitch + x] - (int)mean);
+
+    if (!prev)
+        return intra;
+
+    for (y = 0; y < 8; y++)
+        for (x = 0; x < 8; x++)
+            inter += abs(cur[y * pitch + x] - prev[y * pitch + x]);
+
+    return MIN(intra, inter);
+}
+
+unsigned int
+i965_complexity_estimate_c(const uint8_t *cur, const uint8_t *prev,
+                           unsigned int pitch,
+                           unsigned int width, unsigned int height)
+{
+    unsigned int x, y, offset, cost = 0;
+
+    for (y = 0; y + 8 <= height; y += 8) {
+        for (x = 0; x + 8 <= width; x += 8) {
+            offset = y * pitch + x;
+            cost += block_cost_c(cur + offset, prev ? prev + offset : NULL, pitch);
+        }
+    }
+    return cost;
+}
+
+#ifdef I965_COMPLEXITY_X86
+/*
+ * 16 source bytes of 4 rows to 4 downscaled pixels: the rows are averaged
+ * pairwise, then the horizontal groups of 4 summed through 16 bit pairs.
+ */
+__attribute__((target("sse2")))
+static inline __m128i
+downscale_16_sse2(const uint8_t *src, unsigned int src_pitch)
+{
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i two = _mm_set1_epi32(2);
+    __m128i r0 = _mm_loadu_si128((const __m128i *)src);
+    __m128i r1 = _mm_loadu_si128((const __m128i *)(src + src_pitch));
+    __m128i r2 = _mm_loadu_si128((const __m128i *)(src + 2 * src_pitch));
+    __m128i r3 = _mm_loadu_si128((const __m128i *)(src + 3 * src_pitch));
+    __m128i v = _mm_avg_epu8(_mm_avg_epu8(r0, r1), _mm_avg_epu8(r2, r3));
+    __m128i pairs = _mm_add_epi16(_mm_and_si128(v, mask), _mm_srli_epi16(v, 8));
+    __m128i sums = _mm_madd_epi16(pairs, ones);
+
+    return _mm_srli_epi32(_mm_add_epi32(sums, two), 2);
+}
+
+__attribute__((target("sse2")))
+static void
+complexity_downscale_sse2(uint8_t *dst, unsigned int dst_pitch,
+                          const uint8_t *src, unsigned int src_pitch,
+                          unsigned int width, unsigned int height)
+{
+    unsigned int x, y;
+    __m128i lo, hi;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x + 16 <= width; x += 16) {
+            const uint8_t *s = src + 4 * x;
+
+            lo = _mm_packs_epi32(downscale_16_sse2(s, src_pitch),
+                                 downscale_16_sse2(s + 16, src_pitch));
+            hi = _mm_packs_epi32(downscale_16_sse2(s + 32, src_pitch),
+                                 downscale_16_sse2(s + 48, src_pitch));
+            _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(lo, hi));
+        }
+
+        for (; x < width; x++)
+            dst[x] = downscale_pixel_c(src + 4 * x, src_pitch);
+
+        dst += dst_pitch;
+        src += 4 * src_pitch;
+    }
+}
+
+__attribute__((target("sse2")))
+static inline __m128i
+load_2x8_sse2(const uint8_t *p, unsigned int pitch)
+{
+    return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)p),
+                              _mm_loadl_epi64((const __m128i *)(p + pitch)));
+}
+
+__attribute__((target("sse2")))
+static inline unsigned int
+hsum_sad_sse2(__m128i sad)
+{
+    return _mm_cvtsi128_si32(sad) + _mm_cvtsi128_si32(_mm_srli_si128(sad, 8));
+}
+
+__attribute__((target("sse2")))
+static inline unsigned int
+block_cost_sse2(const uint8_t *cur, const uint8_t *prev, unsigned int pitch)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i c[4], m, sad;
+    unsigned int intra, inter;
+    int i;
+
+    sad = zero;
+    for (i = 0; i < 4; i++) {
+        c[i] = load_2x8_sse2(cur + 2 * i * pitch, pitch);
+        sad = _mm_add_epi64(sad, _mm_sad_epu8(c[i], zero));
+    }
+
+    m = _mm_set1_epi8((hsum_sad_sse2(sad) + 32) >> 6);
+
+    sad = zero;
+    for (i = 0; i < 4; i++)
+        sad = _mm_add_epi64(sad, _mm_sad_epu8(c[i], m));
+    intra = hsum_sad_sse2(sad);
+
+    if (!prev)
+        return intra;
+
+    sad = zero;
+    for (i = 0; i < 4; i++)
+        sad = _mm_add_epi64(sad, _mm_sad_epu8(c[i], load_2x8_sse2(prev + 2 * i * pitch, pitch)));
+    inter = hsum_sad_sse2(sad);
+
+    return MIN(intra, inter);
+}
+
+__attribute__((target("sse2")))
+static unsigned int
+complexity_estimate_sse2(const uint8_t *cur, const uint8_t *prev,
+                         unsigned int pitch,
+                         unsigned int width, unsigned int height)
+{
+    unsigned int x, y, offset, cost = 0;
+
+    for (y = 0; y + 8 <= height; y += 8) {
+        for (x = 0; x + 8 <= width; x += 8) {
+            offset = y * pitch + x;
+            cost += block_cost_sse2(cur + offset, prev ? prev + offset : NULL, pitch);
+        }
+    }
+    return cost;
+}
+
+/*
+ * Two horizontally adjacent blocks at once: every 256 bit row pair holds
+ * the 8 bytes of the left block, then of the right block, of each row.
+ */
+__attribute__((target("avx2")))
+static inline __m256i
+load_2x16_avx2(const uint8_t *p, unsigned int pitch)
+{
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+                                   _mm_loadu_si128((const __m128i *)(p + pitch)), 1);
+}
+
+/* Returns the sums of the left block in the low and of the right block in the high 64 bits */
+__attribute__((target("avx2")))
+static inline __m128i
+sum_sad_avx2(__m256i sad)
+{
+    return _mm_add_epi64(_mm256_castsi256_si128(sad), _mm256_extracti128_si256(sad, 1));
+}
+
+__attribute__((target("avx2")))
+static inline void
+block_cost_2_avx2(const uint8_t *cur, const uint8_t *prev, unsigned int pitch,
+                  unsigned int *cost)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i c[4], m, sad;
+    __m128i sum, intra, inter;
+    int i;
+
+    sad = zero;
+    for (i = 0; i < 4; i++) {
+        c[i] = load_2x16_avx2(cur + 2 * i * pitch, pitch);
+        sad = _mm256_add_epi64(sad, _mm256_sad_epu8(c[i], zero));
+    }
+
+    sum = _mm_srli_epi64(_mm_add_epi64(sum_sad_avx2(sad), _mm_set1_epi64x(32)), 6);
+    /* Spread each mean over the 8 bytes of its block */
+    sum = _mm_mul_epu32(sum, _mm_set1_epi64x(0x01010101));
+    sum = _mm_or_si128(sum, _mm_slli_epi64(sum, 32));
+    m = _mm256_inserti128_si256(_mm256_castsi128_si256(sum), sum, 1);
+
+    sad = zero;
+    for (i = 0; i < 4; i++)
+        sad = _mm256_add_epi64(sad, _mm256_sad_epu8(c[i], m));
+    intra = sum_sad_avx2(sad);
+
+    if (prev) {
+        sad = zero;
+        for (i = 0; i < 4; i++)
+            sad = _mm256_add_epi64(sad, _mm256_sad_epu8(c[i], load_2x16_avx2(prev + 2 * i * pitch, pitch)));
+        inter = sum_sad_avx2(sad);
+        intra = _mm_min_epi32(intra, inter);
+    }
+
+    cost[0] = _mm_cvtsi128_si32(intra);
+    cost[1] = _mm_cvtsi128_si32(_mm_srli_si128(intra, 8));
+}
+
+__attribute__((target("avx2")))
+static unsigned int
+complexity_estimate_avx2(const uint8_t *cur, const uint8_t *prev,
+                         unsigned int pitch,
+                         unsigned int width, unsigned int height)
+{
+    unsigned int x, y, offset, cost = 0;
+    unsigned int pair[2];
+
+    for (y = 0; y + 8 <= height; y += 8) {
+        for (x = 0; x + 16 <= width; x += 16) {
+            offset = y * pitch + x;
+            block_cost_2_avx2(cur + offset, prev ? prev + offset : NULL, pitch, pair);
+            cost += pair[0] + pair[1];
+        }
+
+        if (x + 8 <= width) {
+            offset = y * pitch + x;
+            cost += block_cost_sse2(cur + offset, prev ? prev + offset : NULL, pitch);
+        }
+    }
+    return cost;
+}
+#endif
+
+static DownscaleFunc
+complexity_get_downscale_func(void)
+{
+    static DownscaleFunc downscale_func;
+    DownscaleFunc func = __atomic_load_n(&downscale_func, __ATOMIC_RELAXED);
+
+    if (func)
+        return func;
+
+    func = i965_complexity_downscale_c;
+#ifdef I965_COMPLEXITY_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        func = complexity_downscale_sse2;
+#endif
+
+    __atomic_store_n(&downscale_func, func, __ATOMIC_RELAXED);
+    return func;
+}
+
+static EstimateFunc
+complexity_get_estimate_func(void)
+{
+    static EstimateFunc estimate_func;
+    EstimateFunc func = __atomic_load_n(&estimate_func, __ATOMIC_RELAXED);
+
+    if (func)
+        return func;
+
+    func = i965_complexity_estimate_c;
+#ifdef I965_COMPLEXITY_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        func = complexity_estimate_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+        func = complexity_estimate_sse2;
+#endif
+
+    __atomic_store_n(&estimate_func, func, __ATOMIC_RELAXED);
+    return func;
+}
+
+void
+i965_complexity_downscale(uint8_t *dst, unsigned int dst_pitch,
+                          const uint8_t *src, unsigned int src_pitch,
+                          unsigned int width, unsigned int height)
+{
+    complexity_get_downscale_func()(dst, dst_pitch, src, src_pitch, width, height);
+}
+
+unsigned int
+i965_complexity_estimate(const uint8_t *cur, const uint8_t *prev,
+                         unsigned int pitch,
+                         unsigned int width, unsigned int height)
+{
+    return complexity_get_estimate_func()(cur, prev, pitch, width, height);
+}
+
+bool
+i965_complexity_context_init(struct i965_complexity_context *context,
+                             unsigned int frame_width,
+                             unsigned int frame_height)
+{
+    unsigned int width = frame_width / I965_COMPLEXITY_SCALE;
+    unsigned int height = frame_height / I965_COMPLEXITY_SCALE;
+
+    if (context->planes[0] &&
+        context->frame_width == frame_width &&
+        context->frame_height == frame_height)
+        return true;
+
+    i965_complexity_context_fini(context);
+
+    if (width < I965_COMPLEXITY_BLOCK_SIZE || height < I965_COMPLEXITY_BLOCK_SIZE)
+        return false;
+
+    context->planes[0] = malloc(2 * width * height);
+    context->band = malloc(frame_width * I965_COMPLEXITY_BAND_HEIGHT);
+    if (!context->planes[0] || !context->band) {
+        i965_complexity_context_fini(context);
+        return false;
+    }
+
+    context->planes[1] = context->planes[0] + width * height;
+    context->frame_width = frame_width;
+    context->frame_height = frame_height;
+    context->width = width;
+    context->height = height;
+    context->current = 0;
+    context->has_previous = false;
+    return true;
+}
+
+void
+i965_complexity_context_fini(struct i965_complexity_context *context)
+{
+    free(context->planes[0]);
+    free(context->band);
+    memset(context, 0, sizeof(*context));
+}
+
+void
+i965_complexity_add_rows(struct i965_complexity_context *context,
+                         const uint8_t *src, unsigned int src_pitch,
+                         unsigned int y, unsigned int height)
+{
+    unsigned int dst_y = y / I965_COMPLEXITY_SCALE;
+    unsigned int dst_height = height / I965_COMPLEXITY_SCALE;
+
+    assert(y % I965_COMPLEXITY_SCALE == 0);
+
+    if (dst_y >= context->height)
+        return;
+
+    if (dst_height > context->height - dst_y)
+        dst_height = context->height - dst_y;
+
+    i965_complexity_downscale(context->planes[context->current] + dst_y * context->width,
+                              context->width, src, src_pitch,
+                              context->width, dst_height);
+}
+
+unsigned int
+i965_complexity_end_frame(struct i965_complexity_context *context)
+{
+    unsigned int num_blocks = (context->width / I965_COMPLEXITY_BLOCK_SIZE) *
+                              (context->height / I965_COMPLEXITY_BLOCK_SIZE);
+    unsigned int cost;
+
+    cost = i965_complexity_estimate(context->planes[context->current],
+                                    context->has_previous ? context->planes[!context->current] : NULL,
+                                    context->width, context->width, context->height);
+
+    context->current = !context->current;
+    context->has_previous = true;
+
+    cost /= num_blocks;
+    return cost ? cost : 1;
+}
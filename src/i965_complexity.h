@@ -0,0 +1,113 @@
+/*
+ * i965_complexity.h - CPU estimate of the coding complexity of frames
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef I965_COMPLEXITY_H
+#define I965_COMPLEXITY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * The estimate works on the luma plane downscaled by 4 in both directions
+ * and sums, over its 8x8 blocks, the smaller of the intra activity (sum of
+ * the absolute deviations from the block mean) and of the inter cost (SAD
+ * against the co-located block of the previous frame). It is only meant
+ * to tell the rate control how much harder a frame is than the previous
+ * ones, e.g. on a scene cut.
+ */
+#define I965_COMPLEXITY_SCALE           4
+#define I965_COMPLEXITY_BLOCK_SIZE      8
+
+/** Height in rows of the source band buffer of struct i965_complexity_context */
+#define I965_COMPLEXITY_BAND_HEIGHT     64
+
+struct i965_complexity_context {
+    uint8_t *planes[2];                 /* downscaled luma of the current and previous frames */
+    uint8_t *band;                      /* linear source rows, for callers that have to detile */
+    unsigned int frame_width;
+    unsigned int frame_height;
+    unsigned int width;                 /* of the downscaled planes */
+    unsigned int height;
+    unsigned int current;
+    bool has_previous;
+};
+
+bool
+i965_complexity_context_init(struct i965_complexity_context *context,
+                             unsigned int frame_width,
+                             unsigned int frame_height);
+
+void
+i965_complexity_context_fini(struct i965_complexity_context *context);
+
+/**
+ * Downscales the height source luma rows starting at row y of the frame
+ * into the current plane. y must be a multiple of I965_COMPLEXITY_SCALE,
+ * and the rows of an incomplete group of 4 at the bottom are ignored.
+ */
+void
+i965_complexity_add_rows(struct i965_complexity_context *context,
+                         const uint8_t *src, unsigned int src_pitch,
+                         unsigned int y, unsigned int height);
+
+/**
+ * Returns the average cost of the blocks of the current frame, at least 1,
+ * and keeps the frame as the reference of the next one
+ */
+unsigned int
+i965_complexity_end_frame(struct i965_complexity_context *context);
+
+/**
+ * Averages 4x4 pixel blocks of src into width x height pixels of dst. SSE2
+ * code is selected at runtime when the CPU supports it.
+ */
+void
+i965_complexity_downscale(uint8_t *dst, unsigned int dst_pitch,
+                          const uint8_t *src, unsigned int src_pitch,
+                          unsigned int width, unsigned int height);
+
+/**
+ * Returns the sum of the costs of the 8x8 blocks of a width x height
+ * downscaled plane, intra only if prev is NULL. SSE2 or AVX2 code is
+ * selected at runtime when the CPU supports it.
+ */
+unsigned int
+i965_complexity_estimate(const uint8_t *cur, const uint8_t *prev,
+                         unsigned int pitch,
+                         unsigned int width, unsigned int height);
+
+/** Portable implementations, for reference */
+void
+i965_complexity_downscale_c(uint8_t *dst, unsigned int dst_pitch,
+                            const uint8_t *src, unsigned int src_pitch,
+                            unsigned int width, unsigned int height);
+
+unsigned int
+i965_complexity_estimate_c(const uint8_t *cur, const uint8_t *prev,
+                           unsigned int pitch,
+                           unsigned int width, unsigned int height);
+
+#endif /* I965_COMPLEXITY_H */
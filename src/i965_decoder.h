@@ -52,6 +52,15 @@
         gen_buffer->valid = 0;                  \
     } while (0)
 
+/* Direct MV buffers of the surfaces a decoder context still references */
+typedef struct gen_dmv_pool GenDmvPool;
+struct gen_dmv_pool {
+    struct {
+        dri_bo         *bo;
+        VASurfaceID     surface_id;     /* VA_INVALID_ID once recycled */
+    } buffers[MAX_GEN_REFERENCE_FRAMES + 1];
+};
+
 typedef struct gen_frame_store GenFrameStore;
 struct gen_frame_store {
     VASurfaceID surface_id;
@@ -78,6 +87,7 @@ typedef struct gen_buffer GenBuffer;
 struct gen_buffer {
     dri_bo     *bo;
     int         valid;
+    int         oversized;      /* pictures in a row, see intel_ensure_scratch_buffer() */
 };
 
 struct hw_context *
@@ -28,6 +28,7 @@
 #include "intel_media.h"
 #include "i965_drv_video.h"
 #include "i965_decoder_utils.h"
+#include "i965_byte_scan.h"
 #include "i965_defines.h"
 
 static const int fptype_to_picture_type[8][2] = {
@@ -294,7 +295,7 @@ avc_get_picture_id(struct object_surface *obj_surface)
        that holes in there are filled in for subsequent allocations.
        So, this ultimately means that we could just use the Heap ID of
        the VA surface as the resulting picture ID (16 bits) */
-    pic_id = 1 + (obj_surface->base.id & OBJECT_HEAP_ID_MASK);
+    pic_id = 1 + (obj_surface->base.id & OBJECT_HEAP_INDEX_MASK);
     return (pic_id <= 0xffff) ? pic_id : -1;
 }
 
@@ -335,41 +336,46 @@ avc_get_first_mb_bit_offset(
 /* XXX: slice_data_bit_offset does not account for EPB */
 unsigned int
 avc_get_first_mb_bit_offset_with_epb(
-    dri_bo                     *slice_data_bo,
+    struct buffer_store        *slice_data,
     VASliceParameterBufferH264 *slice_param,
     unsigned int                mode_flag
 )
 {
     unsigned int in_slice_data_bit_offset = slice_param->slice_data_bit_offset;
     unsigned int out_slice_data_bit_offset;
-    unsigned int i, j, n = 0, buf_size, data_size, header_size;
-    uint8_t *buf;
+    unsigned int n = 0, buf_size, data_size, header_size;
+    uint8_t local_buf[256], *buf = NULL;
+    const uint8_t *data;
     int ret;
 
     header_size = slice_param->slice_data_bit_offset / 8;
-    data_size   = slice_param->slice_data_size - slice_param->slice_data_offset;
+    data_size   = slice_param->slice_data_size;
     buf_size    = (header_size * 3 + 1) / 2; // Max possible header size (x1.5)
 
     if (buf_size > data_size)
         buf_size = data_size;
 
-    buf = malloc(buf_size);
-
-    if (!buf)
-        goto out;
+    if (slice_data->slab) {
+        /* The slab stays mapped, scan the header in place */
+        data = slice_data->slab->map + slice_param->slice_data_offset;
+    } else {
+        buf = buf_size <= sizeof(local_buf) ? local_buf : malloc(buf_size);
 
-    ret = dri_bo_get_subdata(
-              slice_data_bo, slice_param->slice_data_offset,
-              buf_size, buf
-          );
-    assert(ret == 0);
+        if (!buf)
+            goto out;
 
-    for (i = 2, j = 2, n = 0; i < buf_size && j < header_size; i++, j++) {
-        if (buf[i] == 0x03 && buf[i - 1] == 0x00 && buf[i - 2] == 0x00)
-            i += 2, j++, n++;
+        ret = dri_bo_get_subdata(
+                  slice_data->bo, slice_param->slice_data_offset,
+                  buf_size, buf
+              );
+        assert(ret == 0);
+        data = buf;
     }
 
-    free(buf);
+    n = i965_byte_scan_epb_count(data, buf_size, header_size);
+
+    if (buf != local_buf)
+        free(buf);
 
 out:
     out_slice_data_bit_offset = in_slice_data_bit_offset + n * 8;
@@ -1540,6 +1546,209 @@ intel_ensure_vp8_segmentation_buffer(VADriverContextP ctx, GenBuffer *buf,
     return buf->valid;
 }
 
+/* Pictures in a row a scratch buffer must be oversized for before it shrinks */
+#define GEN_BUFFER_SHRINK_PICTURES      64
+
+void
+intel_ensure_scratch_buffer(VADriverContextP ctx, GenBuffer *buf,
+                            const char *name, unsigned int size)
+{
+    struct i965_driver_data * const i965 = i965_driver_data(ctx);
+
+    /* Keep the high-water size while the stream does not settle at less
+       than a quarter of it */
+    if (buf->bo && buf->bo->size >= size) {
+        if (buf->bo->size / 4 < size)
+            buf->oversized = 0;
+        else
+            buf->oversized++;
+
+        if (buf->oversized < GEN_BUFFER_SHRINK_PICTURES) {
+            buf->valid = 1;
+            return;
+        }
+    }
+
+    dri_bo_unreference(buf->bo);
+    buf->bo = dri_bo_alloc(i965->intel.bufmgr, name, size, 0x1000);
+    assert(buf->bo);
+    buf->oversized = 0;
+    buf->valid = 1;
+    __atomic_add_fetch(&i965->decode_scratch_allocs, 1, __ATOMIC_RELAXED);
+}
+
+void
+intel_ensure_bitplane_buffer(VADriverContextP ctx, GenBuffer *buf,
+                             GenBuffer *spare, unsigned int size)
+{
+    GenBuffer tmp;
+
+    /* The bitplane is written by the CPU, mapping the buffer of a picture
+       still being decoded would wait for it. The buffer of the picture
+       before is usually idle by then, so alternate between the two */
+    if (buf->bo && drm_intel_bo_busy(buf->bo)) {
+        tmp = *buf;
+        *buf = *spare;
+        *spare = tmp;
+
+        if (buf->bo && drm_intel_bo_busy(buf->bo)) {
+            dri_bo_unreference(buf->bo);
+            buf->bo = NULL;
+        }
+    }
+
+    intel_ensure_scratch_buffer(ctx, buf, "VC-1 Bitplane", size);
+}
+
+void
+intel_dmv_pool_init(GenDmvPool *pool)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_ELEMS(pool->buffers); i++) {
+        pool->buffers[i].bo = NULL;
+        pool->buffers[i].surface_id = VA_INVALID_ID;
+    }
+}
+
+void
+intel_dmv_pool_terminate(GenDmvPool *pool)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_ELEMS(pool->buffers); i++) {
+        dri_bo_unreference(pool->buffers[i].bo);
+        pool->buffers[i].bo = NULL;
+        pool->buffers[i].surface_id = VA_INVALID_ID;
+    }
+}
+
+static bool
+dmv_pool_is_live(VASurfaceID surface_id, VASurfaceID current_id,
+                 const GenFrameStore frame_store[MAX_GEN_REFERENCE_FRAMES])
+{
+    int i;
+
+    if (surface_id == current_id)
+        return true;
+
+    for (i = 0; i < MAX_GEN_REFERENCE_FRAMES; i++) {
+        if (frame_store[i].surface_id == surface_id)
+            return true;
+    }
+    return false;
+}
+
+static inline bool
+dmv_pool_fits(const GenDmvPool *pool, int slot, unsigned int size)
+{
+    return pool->buffers[slot].bo && pool->buffers[slot].bo->size >= size;
+}
+
+/* Whether free slot i suits a surface better than free slot best */
+static bool
+dmv_pool_prefers(const GenDmvPool *pool, int i, int best,
+                 const dri_bo *former_bo, unsigned int size)
+{
+    if (best < 0)
+        return true;
+
+    /* Only the former buffer of the surface may still hold its motion vectors */
+    if (former_bo && pool->buffers[best].bo == former_bo)
+        return false;
+    if (former_bo && pool->buffers[i].bo == former_bo)
+        return true;
+
+    return !dmv_pool_fits(pool, best, size) && dmv_pool_fits(pool, i, size);
+}
+
+/* Gives obj_surface a slot of the pool, with a buffer of at least size bytes */
+static void
+dmv_pool_bind(VADriverContextP ctx, GenDmvPool *pool,
+              struct object_surface *obj_surface, unsigned int size)
+{
+    struct i965_driver_data * const i965 = i965_driver_data(ctx);
+    GenAvcSurface * const avc_surface = obj_surface->private_data;
+    const VASurfaceID surface_id = obj_surface->base.id;
+    int i, found = -1, free_slot = -1;
+
+    for (i = 0; i < ARRAY_ELEMS(pool->buffers); i++) {
+        if (pool->buffers[i].surface_id == surface_id)
+            found = i;
+        else if (pool->buffers[i].surface_id == VA_INVALID_ID &&
+                 dmv_pool_prefers(pool, i, free_slot, avc_surface->dmv_top, size))
+            free_slot = i;
+    }
+
+    /* There are more slots than frame stores, plus the current picture */
+    if (found < 0) {
+        assert(free_slot >= 0);
+        found = free_slot;
+        pool->buffers[found].surface_id = surface_id;
+    }
+
+    if (!pool->buffers[found].bo || pool->buffers[found].bo->size < size) {
+        dri_bo_unreference(pool->buffers[found].bo);
+        pool->buffers[found].bo = dri_bo_alloc(i965->intel.bufmgr,
+                                               "direct mv w/r buffer",
+                                               size,
+                                               0x1000);
+        assert(pool->buffers[found].bo);
+        __atomic_add_fetch(&i965->dmv_pooled_bytes, size, __ATOMIC_RELAXED);
+    }
+
+    /* Each surface used to get a buffer object of its own */
+    if (!avc_surface->dmv_top)
+        __atomic_add_fetch(&i965->dmv_surface_bytes, size, __ATOMIC_RELAXED);
+
+    if (avc_surface->dmv_top != pool->buffers[found].bo) {
+        dri_bo_unreference(avc_surface->dmv_top);
+        avc_surface->dmv_top = pool->buffers[found].bo;
+        dri_bo_reference(avc_surface->dmv_top);
+    }
+}
+
+void
+intel_dmv_pool_bind_avc(VADriverContextP ctx, GenDmvPool *pool,
+                        const GenFrameStore frame_store[MAX_GEN_REFERENCE_FRAMES],
+                        struct object_surface *obj_surface, unsigned int size)
+{
+    const VASurfaceID surface_id = obj_surface->base.id;
+    struct object_surface *ref_surface;
+    int i, j;
+
+    /* Recycle the buffers of the surfaces which left the DPB. A recycled
+       surface keeps a reference to its former buffer object, which is
+       harmless while the surface is no reference. */
+    for (i = 0; i < ARRAY_ELEMS(pool->buffers); i++) {
+        if (pool->buffers[i].surface_id != VA_INVALID_ID &&
+            !dmv_pool_is_live(pool->buffers[i].surface_id, surface_id, frame_store))
+            pool->buffers[i].surface_id = VA_INVALID_ID;
+    }
+
+    /* A surface missing from the frame store of one picture may come back
+       as a reference, while its former buffer went to another surface
+       meanwhile. Give it a slot again, so it never shares the buffer the
+       current picture writes. */
+    for (i = 0; i < MAX_GEN_REFERENCE_FRAMES; i++) {
+        ref_surface = frame_store[i].obj_surface;
+        if (frame_store[i].surface_id == VA_INVALID_ID ||
+            frame_store[i].surface_id == surface_id ||
+            !ref_surface || !ref_surface->private_data)
+            continue;
+
+        for (j = 0; j < ARRAY_ELEMS(pool->buffers); j++) {
+            if (pool->buffers[j].surface_id == frame_store[i].surface_id)
+                break;
+        }
+
+        if (j == ARRAY_ELEMS(pool->buffers))
+            dmv_pool_bind(ctx, pool, ref_surface, size);
+    }
+
+    dmv_pool_bind(ctx, pool, obj_surface, size);
+}
+
 void
 hevc_gen_default_iq_matrix(VAIQMatrixBufferHEVC *iq_matrix)
 {
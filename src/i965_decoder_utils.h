@@ -28,6 +28,7 @@
 #include "intel_batchbuffer.h"
 
 struct decode_state;
+struct buffer_store;
 
 int
 mpeg2_wa_slice_vertical_position(
@@ -69,7 +70,7 @@ avc_get_first_mb_bit_offset(
 
 unsigned int
 avc_get_first_mb_bit_offset_with_epb(
-    dri_bo                     *slice_data_bo,
+    struct buffer_store        *slice_data,
     VASliceParameterBufferH264 *slice_param,
     unsigned int                mode_flag
 );
@@ -175,6 +176,42 @@ bool
 intel_ensure_vp8_segmentation_buffer(VADriverContextP ctx, GenBuffer *buf,
                                      unsigned int mb_width, unsigned int mb_height);
 
+/**
+ * Makes buf hold a buffer object of at least size bytes and marks it
+ * valid. The buffer object is kept from picture to picture, and only
+ * reallocated when it is too small or after it stayed more than four times
+ * larger than needed for a while.
+ */
+void
+intel_ensure_scratch_buffer(VADriverContextP ctx, GenBuffer *buf,
+                            const char *name, unsigned int size);
+
+/**
+ * Same for the VC-1 bitplane, which the CPU writes. While the GPU still
+ * reads buf, it is swapped with spare, and only reallocated when both are
+ * busy.
+ */
+void
+intel_ensure_bitplane_buffer(VADriverContextP ctx, GenBuffer *buf,
+                             GenBuffer *spare, unsigned int size);
+
+void
+intel_dmv_pool_init(GenDmvPool *pool);
+
+void
+intel_dmv_pool_terminate(GenDmvPool *pool);
+
+/**
+ * Gives the AVC surface being decoded a direct MV buffer of at least size
+ * bytes. The buffers of the surfaces which are neither the current picture
+ * nor in the frame store any more are recycled first, and the references
+ * which lost theirs are given one again.
+ */
+void
+intel_dmv_pool_bind_avc(VADriverContextP ctx, GenDmvPool *pool,
+                        const GenFrameStore frame_store[MAX_GEN_REFERENCE_FRAMES],
+                        struct object_surface *obj_surface, unsigned int size);
+
 void
 hevc_gen_default_iq_matrix(VAIQMatrixBufferHEVC *iq_matrix);
 
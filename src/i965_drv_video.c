@@ -48,11 +48,17 @@
 #include "i965_drv_video.h"
 #include "i965_decoder.h"
 #include "i965_encoder.h"
+#include "i965_byte_scan.h"
+#include "i965_tiled_copy.h"
 
 #include "i965_post_processing.h"
 
 #include "gen9_vp9_encapi.h"
 
+#if HAVE_NULL_HW
+#include "intel_null_hw.h"
+#endif
+
 #define CONFIG_ID_OFFSET                0x01000000
 #define CONTEXT_ID_OFFSET               0x02000000
 #define SURFACE_ID_OFFSET               0x04000000
@@ -2017,6 +2023,7 @@ i965_CreateSurfaces2(
 
         obj_surface->wrapper_surface = VA_INVALID_ID;
         obj_surface->exported_primefd = -1;
+        obj_surface->sync_context = VA_INVALID_ID;
 
         switch (memory_type) {
         case I965_SURFACE_MEM_NATIVE:
@@ -2451,10 +2458,24 @@ i965_release_buffer_store(struct buffer_store **ptr)
 
     if (buffer_store->ref_count == 0) {
         dri_bo_unreference(buffer_store->bo);
-        free(buffer_store->buffer);
         buffer_store->bo = NULL;
-        buffer_store->buffer = NULL;
-        free(buffer_store);
+
+        if (buffer_store->slab) {
+            i965_slice_data_pool_free(buffer_store->slab);
+            buffer_store->slab = NULL;
+        }
+
+        if (buffer_store->cache) {
+            i965_buffer_cache_put_data(buffer_store->cache,
+                                       buffer_store->buffer,
+                                       buffer_store->buffer_size_class);
+            buffer_store->buffer = NULL;
+            i965_buffer_cache_put_record(buffer_store->cache, buffer_store);
+        } else {
+            free(buffer_store->buffer);
+            buffer_store->buffer = NULL;
+            free(buffer_store);
+        }
     }
 
     *ptr = NULL;
@@ -2544,6 +2565,7 @@ i965_destroy_context(struct object_heap *heap, struct object_base *obj)
     }
 
     free(obj_context->render_targets);
+    _i965DestroyMutex(&obj_context->mutex);
     object_heap_free(heap, obj);
 }
 
@@ -2630,6 +2652,8 @@ i965_CreateContext(VADriverContextP ctx,
         (VASurfaceID *)calloc(num_render_targets, sizeof(VASurfaceID));
     obj_context->hw_context = NULL;
     obj_context->wrapper_context = VA_INVALID_ID;
+    _i965InitMutex(&obj_context->mutex);
+    memset(&obj_context->sync_latency, 0, sizeof(obj_context->sync_latency));
 
     if (!obj_context->render_targets)
         return VA_STATUS_ERROR_ALLOCATION_FAILED;
@@ -2722,6 +2746,13 @@ i965_CreateContext(VADriverContextP ctx,
             assert(i965->codec_info->dec_hw_context_init);
             obj_context->hw_context = i965->codec_info->dec_hw_context_init(ctx, obj_config);
         }
+
+        /* Encoders read their own results back, keep their submissions immediate */
+        if ((obj_context->codec_type == CODEC_DEC ||
+             obj_context->codec_type == CODEC_PROC) &&
+            obj_context->hw_context &&
+            obj_context->hw_context->batch)
+            intel_batchbuffer_defer_submit(obj_context->hw_context->batch);
     }
 
     attrib = i965_lookup_config_attribute(obj_config, VAConfigAttribRTFormat);
@@ -2776,6 +2807,14 @@ i965_DestroyContext(VADriverContextP ctx, VAContextID context)
     if (i965->current_context_id == context)
         i965->current_context_id = VA_INVALID_ID;
 
+    if (g_intel_debug_option_flags & VA_INTEL_DEBUG_OPTION_STATS) {
+        char latency[512];
+
+        if (i965_sync_histogram_print(&obj_context->sync_latency,
+                                      latency, sizeof(latency)) > 0)
+            i965_log_info(ctx, "context %#x sync latency: %s\n", context, latency);
+    }
+
     if ((obj_context->wrapper_context != VA_INVALID_ID) &&
         i965->wrapper_pdrvctx) {
         CALL_VTABLE(i965->wrapper_pdrvctx, va_status,
@@ -2883,9 +2922,11 @@ i965_create_buffer_internal(VADriverContextP ctx,
     obj_buffer->wrapper_buffer = VA_INVALID_ID;
     obj_buffer->context_id = context;
 
-    buffer_store = calloc(1, sizeof(struct buffer_store));
+    buffer_store = i965_buffer_cache_get_record(&i965->buffer_cache);
     assert(buffer_store);
     buffer_store->ref_count = 1;
+    buffer_store->cache = &i965->buffer_cache;
+    buffer_store->buffer_size_class = I965_BUFFER_CACHE_NO_CLASS;
 
     if (obj_context &&
         (obj_context->wrapper_context != VA_INVALID_ID) &&
@@ -2899,12 +2940,27 @@ i965_create_buffer_internal(VADriverContextP ctx,
         if (vaStatus == VA_STATUS_SUCCESS) {
             obj_buffer->wrapper_buffer = wrapper_buffer;
         } else {
-            free(buffer_store);
+            i965_buffer_cache_put_record(&i965->buffer_cache, buffer_store);
             return vaStatus;
         }
         wrapper_flag = 1;
     }
 
+    /* Slice data of a decode context is packed into the shared slabs,
+     * except for VC-1 as the decoder patches the slice header in place
+     */
+    if (store_bo == NULL &&
+        type == VASliceDataBufferType &&
+        !wrapper_flag &&
+        obj_context &&
+        obj_context->codec_type == CODEC_DEC &&
+        obj_context->obj_config->profile != VAProfileVC1Simple &&
+        obj_context->obj_config->profile != VAProfileVC1Main &&
+        obj_context->obj_config->profile != VAProfileVC1Advanced)
+        buffer_store->slab = i965_slice_data_pool_alloc(&i965->slice_data_pool,
+                                                        size * num_elements,
+                                                        &buffer_store->bo_offset);
+
     if (store_bo != NULL) {
         buffer_store->bo = store_bo;
         dri_bo_reference(buffer_store->bo);
@@ -2912,6 +2968,13 @@ i965_create_buffer_internal(VADriverContextP ctx,
         /* If the buffer is wrapped, the buffer_store is bogus. Unnecessary to copy it */
         if (data && !wrapper_flag)
             dri_bo_subdata(buffer_store->bo, 0, size * num_elements, data);
+    } else if (buffer_store->slab) {
+        buffer_store->bo = buffer_store->slab->bo;
+        dri_bo_reference(buffer_store->bo);
+
+        /* The data only lives until we return, vaMapBuffer() is zero-copy */
+        if (data)
+            memcpy(buffer_store->slab->map + buffer_store->bo_offset, data, size * num_elements);
     } else if (type == VASliceDataBufferType ||
                type == VAImageBufferType ||
                type == VAEncCodedBufferType ||
@@ -2973,10 +3036,10 @@ i965_create_buffer_internal(VADriverContextP ctx,
         }
 
         /* If the buffer is wrapped, it is enough to allocate 4 bytes */
-        if (wrapper_flag)
-            buffer_store->buffer = malloc(4);
-        else
-            buffer_store->buffer = malloc(msize * num_elements);
+        buffer_store->buffer =
+            i965_buffer_cache_get_data(&i965->buffer_cache,
+                                       wrapper_flag ? 4 : msize * num_elements,
+                                       &buffer_store->buffer_size_class);
         assert(buffer_store->buffer);
 
         if (!wrapper_flag) {
@@ -2988,6 +3051,7 @@ i965_create_buffer_internal(VADriverContextP ctx,
     }
 
     buffer_store->num_elements = obj_buffer->num_elements;
+    buffer_store->size_element = obj_buffer->size_element;
     i965_reference_buffer_store(&obj_buffer->buffer_store, buffer_store);
     i965_release_buffer_store(&buffer_store);
     *buf_id = bufferID;
@@ -3058,6 +3122,9 @@ i965_MapBuffer(VADriverContextP ctx,
 
     obj_context = CONTEXT(obj_buffer->context_id);
 
+    /* Batches held back by deferred submission may still use the buffer */
+    intel_submit_queue_flush(&i965->intel);
+
     /* When the wrapper_buffer exists, it will wrapper to the
      * buffer allocated from backend driver.
      */
@@ -3076,7 +3143,11 @@ i965_MapBuffer(VADriverContextP ctx,
     if (obj_buffer->export_refcount > 0)
         return VA_STATUS_ERROR_INVALID_BUFFER;
 
-    if (NULL != obj_buffer->buffer_store->bo) {
+    if (NULL != obj_buffer->buffer_store->slab) {
+        /* Persistently mapped, the GPU doesn't read it before vaEndPicture() */
+        *pbuf = obj_buffer->buffer_store->slab->map + obj_buffer->buffer_store->bo_offset;
+        vaStatus = VA_STATUS_SUCCESS;
+    } else if (NULL != obj_buffer->buffer_store->bo) {
         unsigned int tiling, swizzle;
 
         dri_bo_get_tiling(obj_buffer->buffer_store->bo, &tiling, &swizzle);
@@ -3105,7 +3176,10 @@ i965_MapBuffer(VADriverContextP ctx,
                     obj_context->hw_context &&
                     obj_context->hw_context->get_status &&
                     coded_buffer_segment->status_support) {
+                    /* The application may map the coded buffer while it encodes the next picture */
+                    _i965LockMutex(&obj_context->mutex);
                     vaStatus = obj_context->hw_context->get_status(ctx, obj_context->hw_context, coded_buffer_segment);
+                    _i965UnlockMutex(&obj_context->mutex);
                 } else {
                     if (coded_buffer_segment->codec == CODEC_H264 ||
                         coded_buffer_segment->codec == CODEC_H264_MVC) {
@@ -3144,14 +3218,13 @@ i965_MapBuffer(VADriverContextP ctx,
                     } else if (coded_buffer_segment->codec != CODEC_VP8) {
                         /* vp8 coded buffer size can be told by vp8 internal statistics buffer,
                            so it don't need to traversal the coded buffer */
-                        for (i = 0; i < obj_buffer->size_element - header_offset - 3 - 0x1000; i++) {
-                            if ((buffer[i] == delimiter0) &&
-                                (buffer[i + 1] == delimiter1) &&
-                                (buffer[i + 2] == delimiter2) &&
-                                (buffer[i + 3] == delimiter3) &&
-                                (buffer[i + 4] == delimiter4))
-                                break;
-                        }
+                        const unsigned char delimiter[5] = {
+                            delimiter0, delimiter1, delimiter2, delimiter3, delimiter4
+                        };
+
+                        i = i965_byte_scan_pattern(buffer,
+                                                   obj_buffer->size_element - header_offset - 3 - 0x1000,
+                                                   delimiter, sizeof(delimiter));
 
                         if (i == obj_buffer->size_element - header_offset - 3 - 0x1000) {
                             coded_buffer_segment->base.status |= VA_CODED_BUF_STATUS_SLICE_OVERFLOW_MASK;
@@ -3206,7 +3279,10 @@ i965_UnmapBuffer(VADriverContextP ctx, VABufferID buf_id)
     ASSERT_RET(obj_buffer->buffer_store->bo || obj_buffer->buffer_store->buffer, VA_STATUS_ERROR_OPERATION_FAILED);
     ASSERT_RET(!(obj_buffer->buffer_store->bo && obj_buffer->buffer_store->buffer), VA_STATUS_ERROR_OPERATION_FAILED);
 
-    if (NULL != obj_buffer->buffer_store->bo) {
+    if (NULL != obj_buffer->buffer_store->slab) {
+        /* Do nothing, the slab stays mapped */
+        vaStatus = VA_STATUS_SUCCESS;
+    } else if (NULL != obj_buffer->buffer_store->bo) {
         unsigned int tiling, swizzle;
 
         dri_bo_get_tiling(obj_buffer->buffer_store->bo, &tiling, &swizzle);
@@ -3267,6 +3343,12 @@ i965_BeginPicture(VADriverContextP ctx,
     if (is_surface_busy(i965, obj_surface))
         return VA_STATUS_ERROR_SURFACE_BUSY;
 
+    /* The context state buffers are rewritten for the new picture */
+    if (obj_context->hw_context && obj_context->hw_context->batch)
+        intel_batchbuffer_sync_queued(obj_context->hw_context->batch);
+
+    obj_surface->sync_context = context;
+
     if (obj_context->codec_type == CODEC_PROC) {
         obj_context->codec_state.proc.current_render_target = render_target;
     } else if (obj_context->codec_type == CODEC_ENC) {
@@ -4007,12 +4089,126 @@ i965_RenderPicture(VADriverContextP ctx,
     return vaStatus;
 }
 
+/*
+ * The slice data offsets are relative to the slice data buffer, make them
+ * relative to the slab the buffer was packed into instead. The parameters
+ * are copied as the application may submit the same buffer again.
+ */
+static VAStatus
+i965_decoder_rebase_slice_params(struct i965_driver_data *i965,
+                                 struct decode_state *decode_state)
+{
+    struct buffer_store *slice_data, *rebased;
+    VASliceParameterBufferBase *slice_param;
+    int i, j;
+
+    for (j = 0; j < decode_state->num_slice_params; j++) {
+        slice_data = decode_state->slice_datas[j];
+
+        if (!slice_data->slab || !slice_data->bo_offset)
+            continue;
+
+        if (!decode_state->slice_params[j]->buffer ||
+            decode_state->slice_params[j]->size_element < sizeof(*slice_param))
+            return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+        rebased = i965_buffer_cache_get_record(&i965->buffer_cache);
+        assert(rebased);
+        rebased->ref_count = 1;
+        rebased->cache = &i965->buffer_cache;
+        rebased->num_elements = decode_state->slice_params[j]->num_elements;
+        rebased->size_element = decode_state->slice_params[j]->size_element;
+        rebased->buffer =
+            i965_buffer_cache_get_data(&i965->buffer_cache,
+                                       rebased->size_element * rebased->num_elements,
+                                       &rebased->buffer_size_class);
+        assert(rebased->buffer);
+        memcpy(rebased->buffer,
+               decode_state->slice_params[j]->buffer,
+               rebased->size_element * rebased->num_elements);
+
+        for (i = 0; i < rebased->num_elements; i++) {
+            slice_param = (VASliceParameterBufferBase *)(rebased->buffer + i * rebased->size_element);
+            slice_param->slice_data_offset += slice_data->bo_offset;
+        }
+
+        i965_release_buffer_store(&decode_state->slice_params[j]);
+        decode_state->slice_params[j] = rebased;
+    }
+
+    return VA_STATUS_SUCCESS;
+}
+
+static const char *i965_stats_codec_names[I965_STATS_CODEC_NUM] = {
+    "other", "MPEG-2", "H.264", "VC-1", "JPEG", "VP8", "HEVC", "VP9",
+};
+
+static const char *i965_stats_codec_types[CODEC_PREENC + 1] = {
+    "decode", "encode", "vpp", "preenc",
+};
+
+static int
+i965_stats_codec(VAProfile profile)
+{
+    switch (profile) {
+    case VAProfileMPEG2Simple:
+    case VAProfileMPEG2Main:
+        return 1;
+
+    case VAProfileH264ConstrainedBaseline:
+    case VAProfileH264Main:
+    case VAProfileH264High:
+    case VAProfileH264MultiviewHigh:
+    case VAProfileH264StereoHigh:
+        return 2;
+
+    case VAProfileVC1Simple:
+    case VAProfileVC1Main:
+    case VAProfileVC1Advanced:
+        return 3;
+
+    case VAProfileJPEGBaseline:
+        return 4;
+
+    case VAProfileVP8Version0_3:
+        return 5;
+
+    case VAProfileHEVCMain:
+    case VAProfileHEVCMain10:
+        return 6;
+
+    case VAProfileVP9Profile0:
+    case VAProfileVP9Profile2:
+        return 7;
+
+    default:
+        return 0;
+    }
+}
+
+static uint64_t
+i965_thread_cpu_time_ns(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return 0;
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
 VAStatus
 i965_EndPicture(VADriverContextP ctx, VAContextID context)
 {
     struct i965_driver_data *i965 = i965_driver_data(ctx);
     struct object_context *obj_context = CONTEXT(context);
     struct object_config *obj_config;
+    struct i965_end_picture_stats *stats;
+    uint64_t cpu_start_ns = 0;
+    VAStatus va_status;
+
+    if (g_intel_debug_option_flags & VA_INTEL_DEBUG_OPTION_STATS)
+        cpu_start_ns = i965_thread_cpu_time_ns();
 
     ASSERT_RET(obj_context, VA_STATUS_ERROR_INVALID_CONTEXT);
     obj_config = obj_context->obj_config;
@@ -4080,7 +4276,6 @@ i965_EndPicture(VADriverContextP ctx, VAContextID context)
         if (obj_context->wrapper_context != VA_INVALID_ID) {
             /* call the vaEndPicture of wrapped driver */
             VADriverContextP pdrvctx;
-            VAStatus va_status;
 
             pdrvctx = i965->wrapper_pdrvctx;
             CALL_VTABLE(pdrvctx, va_status,
@@ -4088,27 +4283,112 @@ i965_EndPicture(VADriverContextP ctx, VAContextID context)
 
             return va_status;
         }
+
+        va_status = i965_decoder_rebase_slice_params(i965, &obj_context->codec_state.decode);
+        if (va_status != VA_STATUS_SUCCESS)
+            return va_status;
+
+        __atomic_add_fetch(&i965->decode_pictures, 1, __ATOMIC_RELAXED);
     }
 
     ASSERT_RET(obj_context->hw_context->run, VA_STATUS_ERROR_OPERATION_FAILED);
-    return obj_context->hw_context->run(ctx, obj_config->profile, &obj_context->codec_state, obj_context->hw_context);
+    _i965LockMutex(&obj_context->mutex);
+    va_status = obj_context->hw_context->run(ctx, obj_config->profile, &obj_context->codec_state, obj_context->hw_context);
+    _i965UnlockMutex(&obj_context->mutex);
+
+    if (i965->intel.batch_recorder)
+        intel_batch_recorder_write_frame(i965->intel.batch_recorder);
+
+    if ((g_intel_debug_option_flags & VA_INTEL_DEBUG_OPTION_STATS) &&
+        va_status == VA_STATUS_SUCCESS &&
+        obj_context->codec_type <= CODEC_PREENC) {
+        stats = &i965->end_picture_stats[i965_stats_codec(obj_config->profile)][obj_context->codec_type];
+        __atomic_add_fetch(&stats->pictures, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&stats->cpu_ns, i965_thread_cpu_time_ns() - cpu_start_ns,
+                           __ATOMIC_RELAXED);
+    }
+
+    return va_status;
 }
 
 VAStatus
-i965_SyncSurface(VADriverContextP ctx,
-                 VASurfaceID render_target)
+i965_sync_surfaces(VADriverContextP ctx, const VASurfaceID *surfaces,
+                   int num_surfaces, int64_t timeout_ns)
 {
     struct i965_driver_data *i965 = i965_driver_data(ctx);
-    struct object_surface *obj_surface = SURFACE(render_target);
+    struct object_surface *obj_surface;
+    struct object_context *obj_context;
+    dri_bo *local_bos[16], **bos = local_bos;
+    VAContextID context;
+    uint64_t waited_ns;
+    bool idle;
+    int i, j;
 
-    ASSERT_RET(obj_surface, VA_STATUS_ERROR_INVALID_SURFACE);
+    if (num_surfaces < 0)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
 
-    if (obj_surface->bo)
-        drm_intel_bo_wait_rendering(obj_surface->bo);
+    if (num_surfaces > (int)ARRAY_ELEMS(local_bos)) {
+        bos = malloc(num_surfaces * sizeof(*bos));
+        if (!bos)
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
 
-    return VA_STATUS_SUCCESS;
+    for (i = 0; i < num_surfaces; i++) {
+        obj_surface = SURFACE(surfaces[i]);
+        if (!obj_surface) {
+            if (bos != local_bos)
+                free(bos);
+            return VA_STATUS_ERROR_INVALID_SURFACE;
+        }
+
+        bos[i] = obj_surface->bo;
+    }
+
+    intel_submit_queue_flush(&i965->intel);
+
+    idle = i965_sync_wait(&i965->sync, bos, num_surfaces, timeout_ns, &waited_ns);
+    i965_sync_histogram_add(&i965->sync.latency, waited_ns);
+
+    /* A single sample for each context the surfaces were rendered by */
+    for (i = 0; i < num_surfaces; i++) {
+        obj_surface = SURFACE(surfaces[i]);
+        context = obj_surface->sync_context;
+
+        for (j = 0; j < i; j++) {
+            if (SURFACE(surfaces[j])->sync_context == context)
+                break;
+        }
+
+        obj_context = CONTEXT(context);
+        if (j == i && obj_context)
+            i965_sync_histogram_add(&obj_context->sync_latency, waited_ns);
+    }
+
+    if (bos != local_bos)
+        free(bos);
+
+    return idle ? VA_STATUS_SUCCESS : VA_STATUS_ERROR_TIMEDOUT;
 }
 
+VAStatus
+i965_SyncSurface(VADriverContextP ctx,
+                 VASurfaceID render_target)
+{
+    return i965_sync_surfaces(ctx, &render_target, 1, -1);
+}
+
+#if VA_CHECK_VERSION(1,9,0)
+VAStatus
+i965_SyncSurface2(VADriverContextP ctx,
+                  VASurfaceID surface,
+                  uint64_t timeout_ns)
+{
+    int64_t timeout = timeout_ns > INT64_MAX ? -1 : (int64_t)timeout_ns;
+
+    return i965_sync_surfaces(ctx, &surface, 1, timeout);
+}
+#endif
+
 VAStatus
 i965_QuerySurfaceStatus(VADriverContextP ctx,
                         VASurfaceID render_target,
@@ -4119,15 +4399,13 @@ i965_QuerySurfaceStatus(VADriverContextP ctx,
 
     ASSERT_RET(obj_surface, VA_STATUS_ERROR_INVALID_SURFACE);
 
-    if (obj_surface->bo) {
-        if (drm_intel_bo_busy(obj_surface->bo)) {
-            *status = VASurfaceRendering;
-        } else {
-            *status = VASurfaceReady;
-        }
-    } else {
+    intel_submit_queue_flush(&i965->intel);
+
+    /* The same polling as vaSyncSurface(), without waiting */
+    if (i965_sync_wait(&i965->sync, &obj_surface->bo, 1, 0, NULL))
         *status = VASurfaceReady;
-    }
+    else
+        *status = VASurfaceRendering;
 
     return VA_STATUS_SUCCESS;
 }
@@ -5061,22 +5339,59 @@ get_sampling_from_fourcc(unsigned int fourcc)
         return -1;
 }
 
+/* The software image paths convert between NV12 surfaces and planar images */
+static inline bool
+is_nv12_to_planar_420(unsigned int surface_fourcc, unsigned int image_fourcc)
+{
+    return surface_fourcc == VA_FOURCC_NV12 &&
+           (image_fourcc == VA_FOURCC_I420 || image_fourcc == VA_FOURCC_YV12);
+}
+
+/* Large copies are split over the threads of the pool */
+static void
+copy_surface_rect(struct i965_thread_pool *pool, int op,
+                  const I965TiledSurface *surface,
+                  unsigned int x, unsigned int y,
+                  unsigned int width, unsigned int height,
+                  uint8_t *linear0, unsigned int linear0_pitch,
+                  uint8_t *linear1, unsigned int linear1_pitch)
+{
+    I965TiledCopyRect rect;
+
+    memset(&rect, 0, sizeof(rect));
+    rect.op = op;
+    rect.surface = surface;
+    rect.x = x;
+    rect.y = y;
+    rect.width = width;
+    rect.height = height;
+    rect.linear[0] = linear0;
+    rect.linear_pitch[0] = linear0_pitch;
+    rect.linear[1] = linear1;
+    rect.linear_pitch[1] = linear1_pitch;
+    i965_tiled_copy_execute(pool, &rect);
+}
+
 static inline void
-memcpy_pic(uint8_t *dst, unsigned int dst_stride,
+memcpy_pic(struct i965_thread_pool *pool,
+           uint8_t *dst, unsigned int dst_stride,
            const uint8_t *src, unsigned int src_stride,
            unsigned int len, unsigned int height)
 {
-    unsigned int i;
+    I965TiledSurface surface;
 
-    for (i = 0; i < height; i++) {
-        memcpy(dst, src, len);
-        dst += dst_stride;
-        src += src_stride;
-    }
+    surface.base = (uint8_t *)src;
+    surface.pitch = src_stride;
+    surface.tiling = I915_TILING_NONE;
+    surface.swizzle = I915_BIT_6_SWIZZLE_NONE;
+
+    copy_surface_rect(pool, I965_TILED_COPY_TO_LINEAR, &surface,
+                      0, 0, len, height, dst, dst_stride, NULL, 0);
 }
 
 static VAStatus
-get_image_i420(struct object_image *obj_image, uint8_t *image_data,
+get_image_i420(struct i965_thread_pool *pool,
+               struct object_image *obj_image, uint8_t *image_data,
                struct object_surface *obj_surface,
                const VARectangle *rect)
 {
@@ -5113,21 +5428,21 @@ get_image_i420(struct object_image *obj_image, uint8_t *image_data,
     /* Y plane */
     dst[Y] += rect->y * obj_image->image.pitches[Y] + rect->x;
     src[0] += rect->y * obj_surface->width + rect->x;
-    memcpy_pic(dst[Y], obj_image->image.pitches[Y],
+    memcpy_pic(pool, dst[Y], obj_image->image.pitches[Y],
                src[0], obj_surface->width,
                rect->width, rect->height);
 
     /* U plane */
     dst[U] += (rect->y / 2) * obj_image->image.pitches[U] + rect->x / 2;
     src[1] += (rect->y / 2) * obj_surface->width / 2 + rect->x / 2;
-    memcpy_pic(dst[U], obj_image->image.pitches[U],
+    memcpy_pic(pool, dst[U], obj_image->image.pitches[U],
                src[1], obj_surface->width / 2,
                rect->width / 2, rect->height / 2);
 
     /* V plane */
     dst[V] += (rect->y / 2) * obj_image->image.pitches[V] + rect->x / 2;
     src[2] += (rect->y / 2) * obj_surface->width / 2 + rect->x / 2;
-    memcpy_pic(dst[V], obj_image->image.pitches[V],
+    memcpy_pic(pool, dst[V], obj_image->image.pitches[V],
                src[2], obj_surface->width / 2,
                rect->width / 2, rect->height / 2);
 
@@ -5139,59 +5454,109 @@ get_image_i420(struct object_image *obj_image, uint8_t *image_data,
     return va_status;
 }
 
+/*
+ * Maps the surface for a CPU copy. Tiled surfaces are mapped through the
+ * CPU and (de)tiled by the copy routines, unless their swizzling can only
+ * be resolved through a GTT mapping.
+ */
+bool
+i965_map_surface_for_copy(struct object_surface *obj_surface, int write_enable,
+                          I965TiledSurface *surface)
+{
+    unsigned int tiling, swizzle;
+
+    dri_bo_get_tiling(obj_surface->bo, &tiling, &swizzle);
+
+    if (i965_tiled_copy_supported(tiling, swizzle, obj_surface->width)) {
+        dri_bo_map(obj_surface->bo, write_enable);
+        surface->tiling = tiling;
+        surface->swizzle = swizzle;
+    } else {
+        drm_intel_gem_bo_map_gtt(obj_surface->bo);
+        surface->tiling = I915_TILING_NONE;
+        surface->swizzle = I915_BIT_6_SWIZZLE_NONE;
+    }
+
+    surface->base = obj_surface->bo->virtual;
+    surface->pitch = obj_surface->width;
+
+    return surface->base != NULL;
+}
+
+void
+i965_unmap_surface_for_copy(struct object_surface *obj_surface,
+                            const I965TiledSurface *surface)
+{
+    unsigned int tiling, swizzle;
+
+    dri_bo_get_tiling(obj_surface->bo, &tiling, &swizzle);
+
+    if (tiling != I915_TILING_NONE && surface->tiling == I915_TILING_NONE)
+        drm_intel_gem_bo_unmap_gtt(obj_surface->bo);
+    else
+        dri_bo_unmap(obj_surface->bo);
+}
+
 static VAStatus
-get_image_nv12(struct object_image *obj_image, uint8_t *image_data,
+get_image_nv12(struct i965_thread_pool *pool,
+               struct object_image *obj_image, uint8_t *image_data,
                struct object_surface *obj_surface,
                const VARectangle *rect)
 {
-    uint8_t *dst[2], *src[2];
-    unsigned int tiling, swizzle;
+    uint8_t *dst[3];
+    I965TiledSurface src;
     VAStatus va_status = VA_STATUS_SUCCESS;
 
     if (!obj_surface->bo)
         return VA_STATUS_ERROR_INVALID_SURFACE;
 
     assert(obj_surface->fourcc);
-    dri_bo_get_tiling(obj_surface->bo, &tiling, &swizzle);
-
-    if (tiling != I915_TILING_NONE)
-        drm_intel_gem_bo_map_gtt(obj_surface->bo);
-    else
-        dri_bo_map(obj_surface->bo, 0);
 
-    if (!obj_surface->bo->virtual)
+    if (!i965_map_surface_for_copy(obj_surface, 0, &src))
         return VA_STATUS_ERROR_INVALID_SURFACE;
 
-    /* Both dest VA image and source surface have NV12 format */
+    /* Source surface has NV12 format, dest VA image has NV12, I420 or
+       YV12 format */
     dst[0] = image_data + obj_image->image.offsets[0];
-    src[0] = (uint8_t *)obj_surface->bo->virtual;
-    dst[1] = image_data + obj_image->image.offsets[1];
-    src[1] = src[0] + obj_surface->width * obj_surface->height;
 
     /* Y plane */
     dst[0] += rect->y * obj_image->image.pitches[0] + rect->x;
-    src[0] += rect->y * obj_surface->width + rect->x;
-    memcpy_pic(dst[0], obj_image->image.pitches[0],
-               src[0], obj_surface->width,
-               rect->width, rect->height);
+    copy_surface_rect(pool, I965_TILED_COPY_TO_LINEAR, &src,
+                      rect->x, rect->y, rect->width, rect->height,
+                      dst[0], obj_image->image.pitches[0], NULL, 0);
+
+    if (obj_image->image.format.fourcc == VA_FOURCC_NV12) {
+        /* UV plane */
+        dst[1] = image_data + obj_image->image.offsets[1];
+        dst[1] += (rect->y / 2) * obj_image->image.pitches[1] + (rect->x & -2);
+        copy_surface_rect(pool, I965_TILED_COPY_TO_LINEAR, &src,
+                          rect->x & -2, obj_surface->height + rect->y / 2,
+                          rect->width, rect->height / 2,
+                          dst[1], obj_image->image.pitches[1], NULL, 0);
+    } else {
+        /* U and V planes, split from the UV plane */
+        const int U = obj_image->image.format.fourcc == VA_FOURCC_I420 ? 1 : 2;
+        const int V = obj_image->image.format.fourcc == VA_FOURCC_I420 ? 2 : 1;
 
-    /* UV plane */
-    dst[1] += (rect->y / 2) * obj_image->image.pitches[1] + (rect->x & -2);
-    src[1] += (rect->y / 2) * obj_surface->width + (rect->x & -2);
-    memcpy_pic(dst[1], obj_image->image.pitches[1],
-               src[1], obj_surface->width,
-               rect->width, rect->height / 2);
+        dst[U] = image_data + obj_image->image.offsets[U];
+        dst[U] += (rect->y / 2) * obj_image->image.pitches[U] + rect->x / 2;
+        dst[V] = image_data + obj_image->image.offsets[V];
+        dst[V] += (rect->y / 2) * obj_image->image.pitches[V] + rect->x / 2;
+        copy_surface_rect(pool, I965_TILED_COPY_DEINTERLEAVE, &src,
+                          rect->x & -2, obj_surface->height + rect->y / 2,
+                          rect->width & -2, rect->height / 2,
+                          dst[U], obj_image->image.pitches[U],
+                          dst[V], obj_image->image.pitches[V]);
+    }
 
-    if (tiling != I915_TILING_NONE)
-        drm_intel_gem_bo_unmap_gtt(obj_surface->bo);
-    else
-        dri_bo_unmap(obj_surface->bo);
+    i965_unmap_surface_for_copy(obj_surface, &src);
 
     return va_status;
 }
 
 static VAStatus
-get_image_yuy2(struct object_image *obj_image, uint8_t *image_data,
+get_image_yuy2(struct i965_thread_pool *pool,
+               struct object_image *obj_image, uint8_t *image_data,
                struct object_surface *obj_surface,
                const VARectangle *rect)
 {
@@ -5220,7 +5585,7 @@ get_image_yuy2(struct object_image *obj_image, uint8_t *image_data,
     /* Y plane */
     dst += rect->y * obj_image->image.pitches[0] + rect->x * 2;
     src += rect->y * obj_surface->width + rect->x * 2;
-    memcpy_pic(dst, obj_image->image.pitches[0],
+    memcpy_pic(pool, dst, obj_image->image.pitches[0],
                src, obj_surface->width * 2,
                rect->width * 2, rect->height);
 
@@ -5240,7 +5605,8 @@ i965_sw_getimage(VADriverContextP ctx,
     void *image_data = NULL;
     VAStatus va_status;
 
-    if (obj_surface->fourcc != obj_image->image.format.fourcc)
+    if (obj_surface->fourcc != obj_image->image.format.fourcc &&
+        !is_nv12_to_planar_420(obj_surface->fourcc, obj_image->image.format.fourcc))
         return VA_STATUS_ERROR_INVALID_IMAGE_FORMAT;
 
     va_status = i965_MapBuffer(ctx, obj_image->image.buf, &image_data);
@@ -5250,14 +5616,17 @@ i965_sw_getimage(VADriverContextP ctx,
     switch (obj_image->image.format.fourcc) {
     case VA_FOURCC_YV12:
     case VA_FOURCC_I420:
-        get_image_i420(obj_image, image_data, obj_surface, rect);
+        if (obj_surface->fourcc == VA_FOURCC_NV12)
+            get_image_nv12(&i965->copy_pool, obj_image, image_data, obj_surface, rect);
+        else
+            get_image_i420(&i965->copy_pool, obj_image, image_data, obj_surface, rect);
         break;
     case VA_FOURCC_NV12:
-        get_image_nv12(obj_image, image_data, obj_surface, rect);
+        get_image_nv12(&i965->copy_pool, obj_image, image_data, obj_surface, rect);
         break;
     case VA_FOURCC_YUY2:
         /* YUY2 is the format supported by overlay plane */
-        get_image_yuy2(obj_image, image_data, obj_surface, rect);
+        get_image_yuy2(&i965->copy_pool, obj_image, image_data, obj_surface, rect);
         break;
     default:
         va_status = VA_STATUS_ERROR_OPERATION_FAILED;
@@ -5311,6 +5680,8 @@ i965_GetImage(VADriverContextP ctx,
     if (is_surface_busy(i965, obj_surface))
         return VA_STATUS_ERROR_SURFACE_BUSY;
 
+    intel_submit_queue_flush(&i965->intel);
+
     if (!obj_image || !obj_image->bo)
         return VA_STATUS_ERROR_INVALID_IMAGE;
     if (is_image_busy(i965, obj_image, surface))
@@ -5339,7 +5710,8 @@ i965_GetImage(VADriverContextP ctx,
 }
 
 static VAStatus
-put_image_i420(struct object_surface *obj_surface,
+put_image_i420(struct i965_thread_pool *pool,
+               struct object_surface *obj_surface,
                const VARectangle *dst_rect,
                struct object_image *obj_image, uint8_t *image_data,
                const VARectangle *src_rect)
@@ -5378,21 +5750,21 @@ put_image_i420(struct object_surface *obj_surface,
     /* Y plane */
     dst[0] += dst_rect->y * obj_surface->width + dst_rect->x;
     src[Y] += src_rect->y * obj_image->image.pitches[Y] + src_rect->x;
-    memcpy_pic(dst[0], obj_surface->width,
+    memcpy_pic(pool, dst[0], obj_surface->width,
                src[Y], obj_image->image.pitches[Y],
                src_rect->width, src_rect->height);
 
     /* U plane */
     dst[1] += (dst_rect->y / 2) * obj_surface->width / 2 + dst_rect->x / 2;
     src[U] += (src_rect->y / 2) * obj_image->image.pitches[U] + src_rect->x / 2;
-    memcpy_pic(dst[1], obj_surface->width / 2,
+    memcpy_pic(pool, dst[1], obj_surface->width / 2,
                src[U], obj_image->image.pitches[U],
                src_rect->width / 2, src_rect->height / 2);
 
     /* V plane */
     dst[2] += (dst_rect->y / 2) * obj_surface->width / 2 + dst_rect->x / 2;
     src[V] += (src_rect->y / 2) * obj_image->image.pitches[V] + src_rect->x / 2;
-    memcpy_pic(dst[2], obj_surface->width / 2,
+    memcpy_pic(pool, dst[2], obj_surface->width / 2,
                src[V], obj_image->image.pitches[V],
                src_rect->width / 2, src_rect->height / 2);
 
@@ -5405,13 +5777,14 @@ put_image_i420(struct object_surface *obj_surface,
 }
 
 static VAStatus
-put_image_nv12(struct object_surface *obj_surface,
+put_image_nv12(struct i965_thread_pool *pool,
+               struct object_surface *obj_surface,
                const VARectangle *dst_rect,
                struct object_image *obj_image, uint8_t *image_data,
                const VARectangle *src_rect)
 {
-    uint8_t *dst[2], *src[2];
-    unsigned int tiling, swizzle;
+    uint8_t *src[3];
+    I965TiledSurface dst;
     VAStatus va_status = VA_STATUS_SUCCESS;
 
     if (!obj_surface->bo)
@@ -5420,46 +5793,52 @@ put_image_nv12(struct object_surface *obj_surface,
     ASSERT_RET(obj_surface->fourcc, VA_STATUS_ERROR_INVALID_SURFACE);
     ASSERT_RET(dst_rect->width == src_rect->width, VA_STATUS_ERROR_UNIMPLEMENTED);
     ASSERT_RET(dst_rect->height == src_rect->height, VA_STATUS_ERROR_UNIMPLEMENTED);
-    dri_bo_get_tiling(obj_surface->bo, &tiling, &swizzle);
 
-    if (tiling != I915_TILING_NONE)
-        drm_intel_gem_bo_map_gtt(obj_surface->bo);
-    else
-        dri_bo_map(obj_surface->bo, 0);
-
-    if (!obj_surface->bo->virtual)
+    if (!i965_map_surface_for_copy(obj_surface, 1, &dst))
         return VA_STATUS_ERROR_INVALID_SURFACE;
 
-    /* Both dest VA image and source surface have NV12 format */
-    dst[0] = (uint8_t *)obj_surface->bo->virtual;
+    /* Dest surface has NV12 format, source VA image has NV12, I420 or
+       YV12 format */
     src[0] = image_data + obj_image->image.offsets[0];
-    dst[1] = dst[0] + obj_surface->width * obj_surface->height;
-    src[1] = image_data + obj_image->image.offsets[1];
 
     /* Y plane */
-    dst[0] += dst_rect->y * obj_surface->width + dst_rect->x;
     src[0] += src_rect->y * obj_image->image.pitches[0] + src_rect->x;
-    memcpy_pic(dst[0], obj_surface->width,
-               src[0], obj_image->image.pitches[0],
-               src_rect->width, src_rect->height);
+    copy_surface_rect(pool, I965_TILED_COPY_FROM_LINEAR, &dst,
+                      dst_rect->x, dst_rect->y, src_rect->width, src_rect->height,
+                      src[0], obj_image->image.pitches[0], NULL, 0);
+
+    if (obj_image->image.format.fourcc == VA_FOURCC_NV12) {
+        /* UV plane */
+        src[1] = image_data + obj_image->image.offsets[1];
+        src[1] += (src_rect->y / 2) * obj_image->image.pitches[1] + (src_rect->x & -2);
+        copy_surface_rect(pool, I965_TILED_COPY_FROM_LINEAR, &dst,
+                          dst_rect->x & -2, obj_surface->height + dst_rect->y / 2,
+                          src_rect->width, src_rect->height / 2,
+                          src[1], obj_image->image.pitches[1], NULL, 0);
+    } else {
+        /* U and V planes, merged into the UV plane */
+        const int U = obj_image->image.format.fourcc == VA_FOURCC_I420 ? 1 : 2;
+        const int V = obj_image->image.format.fourcc == VA_FOURCC_I420 ? 2 : 1;
 
-    /* UV plane */
-    dst[1] += (dst_rect->y / 2) * obj_surface->width + (dst_rect->x & -2);
-    src[1] += (src_rect->y / 2) * obj_image->image.pitches[1] + (src_rect->x & -2);
-    memcpy_pic(dst[1], obj_surface->width,
-               src[1], obj_image->image.pitches[1],
-               src_rect->width, src_rect->height / 2);
+        src[U] = image_data + obj_image->image.offsets[U];
+        src[U] += (src_rect->y / 2) * obj_image->image.pitches[U] + src_rect->x / 2;
+        src[V] = image_data + obj_image->image.offsets[V];
+        src[V] += (src_rect->y / 2) * obj_image->image.pitches[V] + src_rect->x / 2;
+        copy_surface_rect(pool, I965_TILED_COPY_INTERLEAVE, &dst,
+                          dst_rect->x & -2, obj_surface->height + dst_rect->y / 2,
+                          src_rect->width & -2, src_rect->height / 2,
+                          src[U], obj_image->image.pitches[U],
+                          src[V], obj_image->image.pitches[V]);
+    }
 
-    if (tiling != I915_TILING_NONE)
-        drm_intel_gem_bo_unmap_gtt(obj_surface->bo);
-    else
-        dri_bo_unmap(obj_surface->bo);
+    i965_unmap_surface_for_copy(obj_surface, &dst);
 
     return va_status;
 }
 
 static VAStatus
-put_image_yuy2(struct object_surface *obj_surface,
+put_image_yuy2(struct i965_thread_pool *pool,
+               struct object_surface *obj_surface,
                const VARectangle *dst_rect,
                struct object_image *obj_image, uint8_t *image_data,
                const VARectangle *src_rect)
@@ -5489,7 +5868,7 @@ put_image_yuy2(struct object_surface *obj_surface,
     /* YUYV packed plane */
     dst += dst_rect->y * obj_surface->width + dst_rect->x * 2;
     src += src_rect->y * obj_image->image.pitches[0] + src_rect->x * 2;
-    memcpy_pic(dst, obj_surface->width * 2,
+    memcpy_pic(pool, dst, obj_surface->width * 2,
                src, obj_image->image.pitches[0],
                src_rect->width * 2, src_rect->height);
 
@@ -5515,8 +5894,9 @@ i965_sw_putimage(VADriverContextP ctx,
         return VA_STATUS_ERROR_INVALID_PARAMETER;
 
     if (obj_surface->fourcc) {
-        /* Don't allow format mismatch */
-        if (obj_surface->fourcc != obj_image->image.format.fourcc)
+        /* Don't allow format mismatch, except NV12 <-> I420/YV12 */
+        if (obj_surface->fourcc != obj_image->image.format.fourcc &&
+            !is_nv12_to_planar_420(obj_surface->fourcc, obj_image->image.format.fourcc))
             return VA_STATUS_ERROR_INVALID_IMAGE_FORMAT;
     }
 
@@ -5540,13 +5920,16 @@ i965_sw_putimage(VADriverContextP ctx,
     switch (obj_image->image.format.fourcc) {
     case VA_FOURCC_YV12:
     case VA_FOURCC_I420:
-        va_status = put_image_i420(obj_surface, dst_rect, obj_image, image_data, src_rect);
+        if (obj_surface->fourcc == VA_FOURCC_NV12)
+            va_status = put_image_nv12(&i965->copy_pool, obj_surface, dst_rect, obj_image, image_data, src_rect);
+        else
+            va_status = put_image_i420(&i965->copy_pool, obj_surface, dst_rect, obj_image, image_data, src_rect);
         break;
     case VA_FOURCC_NV12:
-        va_status = put_image_nv12(obj_surface, dst_rect, obj_image, image_data, src_rect);
+        va_status = put_image_nv12(&i965->copy_pool, obj_surface, dst_rect, obj_image, image_data, src_rect);
         break;
     case VA_FOURCC_YUY2:
-        va_status = put_image_yuy2(obj_surface, dst_rect, obj_image, image_data, src_rect);
+        va_status = put_image_yuy2(&i965->copy_pool, obj_surface, dst_rect, obj_image, image_data, src_rect);
         break;
     default:
         va_status = VA_STATUS_ERROR_OPERATION_FAILED;
@@ -5622,6 +6005,8 @@ i965_PutImage(VADriverContextP ctx,
     if (is_surface_busy(i965, obj_surface))
         return VA_STATUS_ERROR_SURFACE_BUSY;
 
+    intel_submit_queue_flush(&i965->intel);
+
     if (!obj_image || !obj_image->bo)
         return VA_STATUS_ERROR_INVALID_IMAGE;
     if (is_image_busy(i965, obj_image, surface))
@@ -6652,6 +7037,8 @@ i965_AcquireBufferHandle(VADriverContextP ctx, VABufferID buf_id,
     if (obj_buffer->type != VAImageBufferType)
         return VA_STATUS_ERROR_UNSUPPORTED_BUFFERTYPE;
 
+    intel_submit_queue_flush(&i965->intel);
+
     /*
      * As the allocated buffer by calling vaCreateBuffer is related with
      * the specific context, it is unnecessary to export it.
@@ -6822,6 +7209,8 @@ i965_ExportSurfaceHandle(VADriverContextP ctx, VASurfaceID surface_id,
     if (!obj_surface || !obj_surface->bo)
         return VA_STATUS_ERROR_INVALID_SURFACE;
 
+    intel_submit_queue_flush(&i965->intel);
+
     if (mem_type != VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2) {
         i965_log_info(ctx, "vaExportSurfaceHandle: memory type %08x "
                       "is not supported.\n", mem_type);
@@ -7237,12 +7626,17 @@ static bool
 i965_driver_data_init(VADriverContextP ctx)
 {
     struct i965_driver_data *i965 = i965_driver_data(ctx);
+    unsigned int spin_us;
+    char *env_str;
 
     i965->codec_info = i965_get_codec_info(i965->intel.device_id);
 
     if (!i965->codec_info)
         return false;
 
+    i965_buffer_cache_init(&i965->buffer_cache, sizeof(struct buffer_store));
+    i965_slice_data_pool_init(&i965->slice_data_pool, &i965->intel);
+
     if (object_heap_init(&i965->config_heap,
                          sizeof(struct object_config),
                          CONFIG_ID_OFFSET))
@@ -7274,6 +7668,26 @@ i965_driver_data_init(VADriverContextP ctx)
     _i965InitMutex(&i965->render_mutex);
     _i965InitMutex(&i965->pp_mutex);
 
+    /*
+     * The software image copies, PAK objects and post-processing MEDIA_OBJECTs
+     * are single-threaded unless requested
+     */
+    i965_thread_pool_init(&i965->copy_pool,
+                          i965_thread_pool_get_env_threads("VA_INTEL_COPY_THREADS", 1));
+    i965_thread_pool_init(&i965->pak_pool,
+                          i965_thread_pool_get_env_threads("VA_INTEL_PAK_THREADS", 1));
+    i965_thread_pool_init(&i965->pp_pool,
+                          i965_thread_pool_get_env_threads("VA_INTEL_PP_THREADS", 1));
+
+    spin_us = I965_SYNC_SPIN_US;
+    if ((env_str = getenv("VA_INTEL_SYNC_SPIN")))
+        spin_us = MAX(atoi(env_str), 0);
+    i965_sync_init(&i965->sync, spin_us);
+
+    /* Buffers are cleared with the blitter unless requested otherwise */
+    i965_fill_init(&i965->fill, &i965->intel,
+                   i965_fill_parse_mode(getenv("VA_INTEL_FILL"), I965_FILL_GPU));
+
     return true;
 
 err_subpic_heap:
@@ -7299,6 +7713,10 @@ i965_driver_data_terminate(VADriverContextP ctx)
     _i965DestroyMutex(&i965->pp_mutex);
     _i965DestroyMutex(&i965->render_mutex);
 
+    i965_thread_pool_terminate(&i965->copy_pool);
+    i965_thread_pool_terminate(&i965->pak_pool);
+    i965_thread_pool_terminate(&i965->pp_pool);
+
     if (i965->batch)
         intel_batchbuffer_free(i965->batch);
 
@@ -7311,6 +7729,83 @@ i965_driver_data_terminate(VADriverContextP ctx)
     i965_destroy_heap(&i965->surface_heap, i965_destroy_surface);
     i965_destroy_heap(&i965->context_heap, i965_destroy_context);
     i965_destroy_heap(&i965->config_heap, i965_destroy_config);
+
+    if (g_intel_debug_option_flags & VA_INTEL_DEBUG_OPTION_STATS) {
+        struct i965_buffer_cache_stats stats;
+        struct i965_slice_data_pool_stats pool_stats;
+        struct i965_fill_stats fill_stats;
+        unsigned long avs_hits, avs_misses;
+        char latency[512];
+        int codec, type;
+
+        i965_buffer_cache_get_stats(&i965->buffer_cache, &stats);
+        i965_log_info(ctx, "buffer cache: records %lu hits / %lu misses, "
+                      "data %lu hits / %lu misses\n",
+                      stats.record_hits, stats.record_misses,
+                      stats.data_hits, stats.data_misses);
+        i965_log_info(ctx, "state shadow: %lu of %lu state DWORDs skipped\n",
+                      i965->intel.state_dwords_saved,
+                      i965->intel.state_dwords_emitted);
+        i965_log_info(ctx, "batch buffers: %lu allocated / %lu reused / %lu stalls\n",
+                      i965->intel.batch_bo_allocs,
+                      i965->intel.batch_bo_reuses,
+                      i965->intel.batch_bo_stalls);
+        i965_log_info(ctx, "deferred submission: %lu batches in %lu execbuffers\n",
+                      i965->intel.submit_batches,
+                      i965->intel.submit_execs);
+        i965_sync_histogram_print(&i965->sync.latency, latency, sizeof(latency));
+        i965_log_info(ctx, "surface sync: %lu polled / %lu blocked, latency %s\n",
+                      i965->sync.polled, i965->sync.blocked, latency);
+
+        i965_log_info(ctx, "decoder scratch: %lu buffer objects allocated for %lu pictures\n",
+                      i965->decode_scratch_allocs, i965->decode_pictures);
+        i965_log_info(ctx, "direct mv buffers: %lu KiB pooled, %lu KiB with one per surface\n",
+                      i965->dmv_pooled_bytes >> 10, i965->dmv_surface_bytes >> 10);
+
+        i965_fill_get_stats(&i965->fill, &fill_stats);
+        i965_log_info(ctx, "buffer fills: %lu blitter (%lu KiB) / %lu cpu (%lu KiB), "
+                      "%lu dry-run DWORDs\n",
+                      fill_stats.gpu_fills, fill_stats.gpu_bytes >> 10,
+                      fill_stats.cpu_fills, fill_stats.cpu_bytes >> 10,
+                      fill_stats.dry_run_dwords);
+
+        i965_slice_data_pool_get_stats(&i965->slice_data_pool, &pool_stats);
+        i965_log_info(ctx, "slice data pool: %lu packed / %lu own buffer objects\n",
+                      pool_stats.allocs, pool_stats.fallbacks);
+
+        avs_get_cache_stats(&avs_hits, &avs_misses);
+        i965_log_info(ctx, "avs coefficients: %lu hits / %lu misses\n",
+                      avs_hits, avs_misses);
+
+        for (codec = 0; codec < I965_STATS_CODEC_NUM; codec++) {
+            for (type = 0; type <= CODEC_PREENC; type++) {
+                const struct i965_end_picture_stats * const stats =
+                    &i965->end_picture_stats[codec][type];
+
+                if (!stats->pictures)
+                    continue;
+
+                i965_log_info(ctx, "%s %s: %lu pictures, %lu us CPU per vaEndPicture\n",
+                              i965_stats_codec_names[codec], i965_stats_codec_types[type],
+                              stats->pictures,
+                              (unsigned long)(stats->cpu_ns / stats->pictures / 1000));
+            }
+        }
+
+#if HAVE_NULL_HW
+        {
+            struct intel_null_hw_stats null_hw_stats;
+
+            intel_null_hw_get_stats(i965->intel.bufmgr, &null_hw_stats);
+            i965_log_info(ctx, "null hardware: %lu batches (%lu KiB) recorded\n",
+                          null_hw_stats.batches, null_hw_stats.batch_bytes >> 10);
+        }
+#endif
+    }
+
+    i965_fill_terminate(&i965->fill);
+    i965_slice_data_pool_terminate(&i965->slice_data_pool);
+    i965_buffer_cache_terminate(&i965->buffer_cache);
 }
 
 struct {
@@ -7658,6 +8153,9 @@ VA_DRIVER_INIT_FUNC(VADriverContextP ctx)
     vtable->vaRenderPicture = i965_RenderPicture;
     vtable->vaEndPicture = i965_EndPicture;
     vtable->vaSyncSurface = i965_SyncSurface;
+#if VA_CHECK_VERSION(1,9,0)
+    vtable->vaSyncSurface2 = i965_SyncSurface2;
+#endif
     vtable->vaQuerySurfaceStatus = i965_QuerySurfaceStatus;
     vtable->vaPutSurface = i965_PutSurface;
     vtable->vaQueryImageFormats = i965_QueryImageFormats;
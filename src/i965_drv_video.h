@@ -46,6 +46,11 @@
 
 #include "i965_mutext.h"
 #include "object_heap.h"
+#include "i965_buffer_cache.h"
+#include "i965_slice_data_pool.h"
+#include "i965_thread_pool.h"
+#include "i965_fill.h"
+#include "i965_sync.h"
 #include "intel_driver.h"
 #include "i965_fourcc.h"
 
@@ -198,6 +203,15 @@ struct buffer_store {
     dri_bo *bo;
     int ref_count;
     int num_elements;
+    int size_element;
+
+    /* The cache this record and its buffer are returned to */
+    struct i965_buffer_cache *cache;
+    int buffer_size_class;
+
+    /* Slice data packed into a shared slab, bo is the slab buffer object */
+    struct i965_slice_data_slab *slab;
+    unsigned int bo_offset;
 };
 
 struct object_config {
@@ -315,6 +329,14 @@ struct proc_state {
 #define CODEC_PROC      2
 #define CODEC_PREENC    3
 
+/* Codecs vaEndPicture() CPU time is accounted to */
+#define I965_STATS_CODEC_NUM    8
+
+struct i965_end_picture_stats {
+    unsigned long pictures;
+    uint64_t cpu_ns;                    /* thread CPU time */
+};
+
 union codec_state {
     struct codec_state_base base;
     struct decode_state decode;
@@ -346,6 +368,8 @@ struct object_context {
     int codec_type;
     union codec_state codec_state;
     struct hw_context *hw_context;
+    _I965Mutex mutex;                   /* hw_context, against status readers of other threads */
+    struct i965_sync_histogram sync_latency;    /* vaSyncSurface() on its render targets */
 
     VAGenericID       wrapper_context;
 };
@@ -394,6 +418,7 @@ struct object_surface {
     VAGenericID wrapper_surface;
 
     int exported_primefd;
+    VAContextID sync_context;           /* the last context rendering into the surface */
 };
 
 struct object_buffer {
@@ -528,6 +553,26 @@ struct i965_driver_data {
     struct object_heap buffer_heap;
     struct object_heap image_heap;
     struct object_heap subpic_heap;
+    struct i965_buffer_cache buffer_cache;
+    struct i965_slice_data_pool slice_data_pool;
+    struct i965_thread_pool copy_pool;  /* software vaGetImage/vaPutImage */
+    struct i965_thread_pool pak_pool;   /* software PAK object generation */
+    struct i965_thread_pool pp_pool;    /* post-processing MEDIA_OBJECT generation */
+    struct i965_sync sync;              /* vaSyncSurface(), VA_INTEL_SYNC_SPIN */
+    struct i965_fill fill;              /* buffer clears, VA_INTEL_FILL */
+
+    /* Decoder scratch buffer objects allocated, and pictures decoded */
+    unsigned long decode_scratch_allocs;
+    unsigned long decode_pictures;
+
+    /* Direct MV buffers allocated by the decoder pools, and what one
+       buffer per surface would have taken */
+    unsigned long dmv_pooled_bytes;
+    unsigned long dmv_surface_bytes;
+
+    /* vaEndPicture() per codec and context type, VA_INTEL_DEBUG_OPTION_STATS */
+    struct i965_end_picture_stats end_picture_stats[I965_STATS_CODEC_NUM][CODEC_PREENC + 1];
+
     struct hw_codec_info *codec_info;
 
     _I965Mutex render_mutex;
@@ -594,6 +639,14 @@ i965_check_alloc_surface_bo(VADriverContextP ctx,
 int
 va_enc_packed_type_to_idx(int packed_type);
 
+/**
+ * Waits for the rendering into several surfaces with a single polling
+ * loop, at most timeout_ns if it isn't negative
+ */
+VAStatus
+i965_sync_surfaces(VADriverContextP ctx, const VASurfaceID *surfaces,
+                   int num_surfaces, int64_t timeout_ns);
+
 /* reserve 2 byte for internal using */
 #define CODEC_H264      0
 #define CODEC_MPEG2     1
@@ -661,6 +714,20 @@ extern VAStatus i965_CreateSurfaces(VADriverContextP ctx,
 void
 i965_destroy_surface_storage(struct object_surface *obj_surface);
 
+struct i965_tiled_surface;
+
+/*
+ * Maps the surface for the CPU copy routines of i965_tiled_copy.h, through
+ * the GTT if its tiling can't be handled on the CPU
+ */
+bool
+i965_map_surface_for_copy(struct object_surface *obj_surface, int write_enable,
+                          struct i965_tiled_surface *surface);
+
+void
+i965_unmap_surface_for_copy(struct object_surface *obj_surface,
+                            const struct i965_tiled_surface *surface);
+
 // Logging functions for errors (to be shown to users) and info (useful for developers).
 void i965_log_error(VADriverContextP ctx, const char *format, ...);
 void i965_log_info(VADriverContextP ctx, const char *format, ...);
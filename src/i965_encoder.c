@@ -58,12 +58,14 @@ reduce_fraction(struct intel_fraction f)
 }
 
 static VAStatus
-clear_border(struct object_surface *obj_surface)
+clear_border(VADriverContextP ctx, struct object_surface *obj_surface)
 {
+    struct i965_driver_data *i965 = i965_driver_data(ctx);
     int width[3], height[3], hstride[3], vstride[3]; /* in byte */
-    int planes;
-    unsigned char* p;
-    int i, j;
+    struct i965_fill_rect rects[2 * 3];
+    unsigned int tiling, swizzle;
+    int planes, num_rects = 0;
+    int i, y = 0;
 
     if (obj_surface->border_cleared)
         return VA_STATUS_SUCCESS;
@@ -81,30 +83,30 @@ clear_border(struct object_surface *obj_surface)
         /* todo add P010 */
         return VA_STATUS_SUCCESS;
     }
-    drm_intel_gem_bo_map_gtt(obj_surface->bo);
-
-    p = (unsigned char*)obj_surface->bo->virtual;
-    if (!p)
-        return VA_STATUS_ERROR_INVALID_SURFACE;
 
+    /* The planes follow each other with the same pitch */
     for (i = 0; i < planes; i++) {
-        int w = width[i];
-        int h = height[i];
-        int hs = hstride[i];
-        int vs = vstride[i];
         /* right */
-        for (j = 0; j < h; j++) {
-            memset(p + w, 0, hs - w);
-            p += hs;
-        }
+        rects[num_rects].x = width[i];
+        rects[num_rects].y = y;
+        rects[num_rects].width = hstride[i] - width[i];
+        rects[num_rects++].height = height[i];
+
         /* bottom */
-        for (/* nothing */; j < vs; j++) {
-            memset(p, 0, hs);
-            p += hs;
-        }
+        rects[num_rects].x = 0;
+        rects[num_rects].y = y + height[i];
+        rects[num_rects].width = hstride[i];
+        rects[num_rects++].height = vstride[i] - height[i];
 
+        y += vstride[i];
     }
-    drm_intel_gem_bo_unmap_gtt(obj_surface->bo);
+
+    dri_bo_get_tiling(obj_surface->bo, &tiling, &swizzle);
+
+    if (!i965_fill_rects(&i965->fill, obj_surface->bo, tiling, obj_surface->width,
+                         rects, num_rects, 0))
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+
     obj_surface->border_cleared = true;
     return VA_STATUS_SUCCESS;
 }
@@ -150,7 +152,7 @@ intel_encoder_check_yuv_surface(VADriverContextP ctx,
         if (tiling == I915_TILING_Y) {
             encoder_context->input_yuv_surface = encode_state->current_render_target;
             encode_state->input_yuv_object = obj_surface;
-            return clear_border(obj_surface);
+            return clear_border(ctx, obj_surface);
         }
     }
 
@@ -194,7 +196,7 @@ intel_encoder_check_yuv_surface(VADriverContextP ctx,
 
     encoder_context->is_tmp_id = 1;
 
-    return clear_border(obj_surface);
+    return clear_border(ctx, obj_surface);
 }
 
 
@@ -1458,6 +1460,69 @@ out:
     return vaStatus;
 }
 
+struct intel_encoder_slice_job {
+    VADriverContextP ctx;
+    struct encode_state *encode_state;
+    struct intel_encoder_context *encoder_context;
+    intel_encoder_slice_func func;
+    struct intel_batchbuffer **segments;
+};
+
+static void
+intel_encoder_slice_job_run(void *arg, unsigned int job_index)
+{
+    struct intel_encoder_slice_job *job = arg;
+
+    job->func(job->ctx, job->encode_state, job->encoder_context,
+              job_index, job->segments[job_index]);
+}
+
+void
+intel_encoder_slice_programing(VADriverContextP ctx,
+                               struct encode_state *encode_state,
+                               struct intel_encoder_context *encoder_context,
+                               intel_encoder_slice_func func,
+                               struct intel_batchbuffer *slice_batch)
+{
+    struct i965_driver_data *i965 = i965_driver_data(ctx);
+    struct intel_encoder_slice_job job;
+    int num_slices = encode_state->num_slice_params_ext;
+    int segment_size, i;
+
+    if (num_slices > 1 && i965->pak_pool.num_threads > 1)
+        job.segments = calloc(num_slices, sizeof(*job.segments));
+    else
+        job.segments = NULL;
+
+    if (!job.segments) {
+        for (i = 0; i < num_slices; i++)
+            func(ctx, encode_state, encoder_context, i, slice_batch);
+
+        return;
+    }
+
+    /* Each slice goes into a segment of its own, concatenated in order */
+    segment_size = ALIGN(slice_batch->size / num_slices, 4096);
+
+    for (i = 0; i < num_slices; i++)
+        job.segments[i] = intel_batchbuffer_new_segment(slice_batch->intel,
+                                                        slice_batch->flag,
+                                                        segment_size);
+
+    job.ctx = ctx;
+    job.encode_state = encode_state;
+    job.encoder_context = encoder_context;
+    job.func = func;
+    i965_thread_pool_run(&i965->pak_pool, intel_encoder_slice_job_run, &job, num_slices);
+
+    for (i = 0; i < num_slices; i++) {
+        intel_batchbuffer_append(slice_batch, job.segments[i]);
+        intel_batchbuffer_free(job.segments[i]);
+    }
+
+    free(job.segments);
+}
+
 static VAStatus
 intel_encoder_end_picture(VADriverContextP ctx,
                           VAProfile profile,
@@ -1560,7 +1625,8 @@ intel_enc_hw_context_init(VADriverContextP ctx,
     struct i965_driver_data *i965 = i965_driver_data(ctx);
     struct intel_driver_data *intel = intel_driver_data(ctx);
     struct intel_encoder_context *encoder_context = calloc(1, sizeof(struct intel_encoder_context));
-    int i;
+    const char *env_str;
+    int i, depth;
 
     assert(encoder_context);
     encoder_context->base.destroy = intel_encoder_context_destroy;
@@ -1613,6 +1679,15 @@ intel_enc_hw_context_init(VADriverContextP ctx,
         if (obj_config->entrypoint == VAEntrypointStats)
             encoder_context->preenc_enabled = 1;
 
+        /*
+         * libva has no rate control mode for it, so the lookahead of the
+         * MFC CBR/VBR controller is set through the environment
+         */
+        if ((env_str = getenv("VA_INTEL_BRC_LOOKAHEAD"))) {
+            depth = atoi(env_str);
+            encoder_context->brc.lookahead_depth = MAX(0, MIN(depth, I965_BRC_LOOKAHEAD_MAX_DEPTH));
+        }
+
         break;
 
     case VAProfileH264StereoHigh:
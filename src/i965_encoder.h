@@ -95,6 +95,7 @@ struct intel_encoder_context {
         unsigned int initial_qp;
         unsigned int min_qp;
         unsigned int need_reset;
+        unsigned int lookahead_depth;   /* VA_INTEL_BRC_LOOKAHEAD, MFC AVC CBR/VBR only */
 
         unsigned int num_roi;
         unsigned int roi_max_delta_qp;
@@ -136,6 +137,26 @@ struct intel_encoder_context {
                           struct i965_coded_buffer_segment *coded_buffer_segment);
 };
 
+/* Programs slice slice_index of the picture into slice_batch */
+typedef void (*intel_encoder_slice_func)(VADriverContextP ctx,
+                                         struct encode_state *encode_state,
+                                         struct intel_encoder_context *encoder_context,
+                                         int slice_index,
+                                         struct intel_batchbuffer *slice_batch);
+
+/*
+ * Calls func for each slice in order. With VA_INTEL_PAK_THREADS set, the
+ * slices are programmed concurrently into host memory segments which are
+ * copied into slice_batch afterwards, which gives the same commands. func
+ * must not emit relocations nor touch state shared between slices.
+ */
+void
+intel_encoder_slice_programing(VADriverContextP ctx,
+                               struct encode_state *encode_state,
+                               struct intel_encoder_context *encoder_context,
+                               intel_encoder_slice_func func,
+                               struct intel_batchbuffer *slice_batch);
+
 extern struct hw_context *
 gen75_enc_hw_context_init(VADriverContextP ctx, struct object_config *obj_config);
 
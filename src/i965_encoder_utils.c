@@ -34,6 +34,7 @@
 #include <math.h>
 #include "gen6_mfc.h"
 #include "i965_encoder_utils.h"
+#include "i965_byte_scan.h"
 
 #define BITSTREAM_ALLOCATE_STEPPING     4096
 
@@ -1122,7 +1123,7 @@ int build_hevc_slice_header(VAEncSequenceParameterBufferHEVC *seq_param,
 int
 intel_avc_find_skipemulcnt(unsigned char *buf, int bits_length)
 {
-    int i, found;
+    int i;
     int leading_zero_cnt, byte_length, zero_byte;
     int nal_unit_type;
     int skip_cnt = 0;
@@ -1133,17 +1134,8 @@ intel_avc_find_skipemulcnt(unsigned char *buf, int bits_length)
     byte_length = ALIGN(bits_length, 32) >> 3;
 
 
-    leading_zero_cnt = 0;
-    found = 0;
-    for (i = 0; i < byte_length - 4; i++) {
-        if (((buf[i] == 0) && (buf[i + 1] == 0) && (buf[i + 2] == 1)) ||
-            ((buf[i] == 0) && (buf[i + 1] == 0) && (buf[i + 2] == 0) && (buf[i + 3] == 1))) {
-            found = 1;
-            break;
-        }
-        leading_zero_cnt++;
-    }
-    if (!found) {
+    leading_zero_cnt = i965_byte_scan_start_code(buf, byte_length - 4);
+    if (leading_zero_cnt >= byte_length - 4) {
         /* warning message is complained. But anyway it will be inserted. */
         WARN_ONCE("Invalid packed header data. "
                   "Can't find the 000001 start_prefix code\n");
@@ -1681,8 +1681,8 @@ i965_encoder_vp8_vme_init_mpu_tpu_buffer(VADriverContextP ctx,
 {
     char *pbuffer = NULL;
 
-    i965_zero_gpe_resource(&vp8_context->pak_mpu_tpu_mode_probs_buffer);
-    i965_zero_gpe_resource(&vp8_context->pak_mpu_tpu_ref_mode_probs_buffer);
+    i965_zero_gpe_resource(ctx, &vp8_context->pak_mpu_tpu_mode_probs_buffer);
+    i965_zero_gpe_resource(ctx, &vp8_context->pak_mpu_tpu_ref_mode_probs_buffer);
 
     pbuffer = i965_map_gpe_resource(&vp8_context->pak_mpu_tpu_ref_coeff_probs_buffer);
 
@@ -1807,7 +1807,7 @@ i965_encoder_vp8_vme_allocate_resources(VADriverContextP ctx,
      * BRC buffers
      */
     ALLOC_VP8_RESOURCE_BUFFER(brc_history_buffer, VP8_BRC_HISTORY_BUFFER_SIZE, "BRC history buffer");
-    i965_zero_gpe_resource(&vp8_context->brc_history_buffer);
+    i965_zero_gpe_resource(ctx, &vp8_context->brc_history_buffer);
 
     vp8_context->brc_segment_map_buffer.type = I965_GPE_RESOURCE_2D;
     vp8_context->brc_segment_map_buffer.width = vp8_context->frame_width_in_mbs;
@@ -1832,22 +1832,22 @@ i965_encoder_vp8_vme_allocate_resources(VADriverContextP ctx,
                                &vp8_context->brc_distortion_buffer,
                                vp8_context->brc_distortion_buffer.size,
                                "BRC distortion buffer");
-    i965_zero_gpe_resource(&vp8_context->brc_distortion_buffer);
+    i965_zero_gpe_resource(ctx, &vp8_context->brc_distortion_buffer);
 
     ALLOC_VP8_RESOURCE_BUFFER(brc_pak_statistics_buffer, sizeof(struct vp8_brc_pak_statistics), "BRC pak statistics buffer");
-    i965_zero_gpe_resource(&vp8_context->brc_pak_statistics_buffer);
+    i965_zero_gpe_resource(ctx, &vp8_context->brc_pak_statistics_buffer);
 
     ALLOC_VP8_RESOURCE_BUFFER(brc_vp8_cfg_command_read_buffer, VP8_BRC_IMG_STATE_SIZE_PER_PASS * VP8_BRC_MAXIMUM_NUM_PASSES, "BRC VP8 configuration command read buffer");
-    i965_zero_gpe_resource(&vp8_context->brc_vp8_cfg_command_read_buffer);
+    i965_zero_gpe_resource(ctx, &vp8_context->brc_vp8_cfg_command_read_buffer);
 
     ALLOC_VP8_RESOURCE_BUFFER(brc_vp8_cfg_command_write_buffer, VP8_BRC_IMG_STATE_SIZE_PER_PASS * VP8_BRC_MAXIMUM_NUM_PASSES, "BRC VP8 configuration command write buffer");
-    i965_zero_gpe_resource(&vp8_context->brc_vp8_cfg_command_write_buffer);
+    i965_zero_gpe_resource(ctx, &vp8_context->brc_vp8_cfg_command_write_buffer);
 
     ALLOC_VP8_RESOURCE_BUFFER(brc_vp8_constant_data_buffer, VP8_BRC_CONSTANT_DATA_SIZE, "BRC VP8 constant data buffer");
-    i965_zero_gpe_resource(&vp8_context->brc_vp8_constant_data_buffer);
+    i965_zero_gpe_resource(ctx, &vp8_context->brc_vp8_constant_data_buffer);
 
     ALLOC_VP8_RESOURCE_BUFFER(brc_pak_statistics_dump_buffer, vp8_context->num_brc_pak_passes * sizeof(unsigned int) * 12, "BRC pak statistics buffer");
-    i965_zero_gpe_resource(&vp8_context->brc_pak_statistics_dump_buffer);
+    i965_zero_gpe_resource(ctx, &vp8_context->brc_pak_statistics_dump_buffer);
 
     vp8_context->me_4x_mv_data_buffer.type = I965_GPE_RESOURCE_2D;
     vp8_context->me_4x_mv_data_buffer.width = vp8_context->down_scaled_width_in_mb4x * 32;
@@ -1897,7 +1897,7 @@ i965_encoder_vp8_vme_allocate_resources(VADriverContextP ctx,
     ALLOC_VP8_RESOURCE_BUFFER(pak_mpu_tpu_coeff_probs_buffer, VP8_COEFFS_PROPABILITIES_SIZE, "Coeff probs buffer");
     ALLOC_VP8_RESOURCE_BUFFER(pak_mpu_tpu_ref_coeff_probs_buffer, VP8_COEFFS_PROPABILITIES_SIZE, "Ref coeff probs buffer");
     ALLOC_VP8_RESOURCE_BUFFER(pak_mpu_tpu_token_bits_data_buffer, VP8_TOKEN_BITS_DATA_SIZE, "Token bits data buffer");
-    i965_zero_gpe_resource(&vp8_context->pak_mpu_tpu_token_bits_data_buffer);
+    i965_zero_gpe_resource(ctx, &vp8_context->pak_mpu_tpu_token_bits_data_buffer);
     ALLOC_VP8_RESOURCE_BUFFER(pak_mpu_tpu_picture_state_buffer, VP8_PICTURE_STATE_SIZE, "Picture state buffer");
     ALLOC_VP8_RESOURCE_BUFFER(pak_mpu_tpu_mpu_bitstream_buffer, VP8_MPU_BITSTREAM_SIZE, "Mpu bitstream buffer");
     ALLOC_VP8_RESOURCE_BUFFER(pak_mpu_tpu_tpu_bitstream_buffer, VP8_TPU_BITSTREAM_SIZE, "Tpu bitstream buffer");
@@ -2892,7 +2892,7 @@ i965_encoder_vp8_vme_init_brc_distorion_buffer(VADriverContextP ctx, struct inte
 {
     struct i965_encoder_vp8_context *vp8_context = encoder_context->vme_context;
 
-    i965_zero_gpe_resource(&vp8_context->brc_distortion_buffer);
+    i965_zero_gpe_resource(ctx, &vp8_context->brc_distortion_buffer);
 }
 
 static VAStatus
@@ -3748,8 +3748,8 @@ i965_encoder_vp8_vme_mbenc_init_constant_buffer(VADriverContextP ctx,
     struct i965_encoder_vp8_context *vp8_context = encoder_context->vme_context;
     char *pbuffer = NULL;
 
-    i965_zero_gpe_resource(&vp8_context->mb_mode_cost_luma_buffer);
-    i965_zero_gpe_resource(&vp8_context->block_mode_cost_buffer);
+    i965_zero_gpe_resource_cpu(ctx, &vp8_context->mb_mode_cost_luma_buffer);
+    i965_zero_gpe_resource_cpu(ctx, &vp8_context->block_mode_cost_buffer);
 
     pbuffer = i965_map_gpe_resource(&vp8_context->mb_mode_cost_luma_buffer);
 
@@ -3865,7 +3865,7 @@ i965_encoder_vp8_vme_mbenc(VADriverContextP ctx,
     }
 
     if (!is_phase2 || (is_phase2 && vp8_context->brc_mbenc_phase1_ignored)) {
-        i965_zero_gpe_resource(&vp8_context->histogram_buffer);
+        i965_zero_gpe_resource(ctx, &vp8_context->histogram_buffer);
     }
 
     gpe->reset_binding_table(ctx, gpe_context);
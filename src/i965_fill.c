@@ -0,0 +1,414 @@
+/*
+ * i965_fill.c - Fills buffer objects with blitter commands instead of the CPU
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sysdeps.h"
+#include "i965_fill.h"
+#include "intel_batchbuffer.h"
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+void
+i965_fill_init(struct i965_fill *fill, struct intel_driver_data *intel, int mode)
+{
+    memset(fill, 0, sizeof(*fill));
+    pthread_mutex_init(&fill->mutex, NULL);
+    fill->intel = intel;
+    fill->mode = mode;
+    fill->gen = intel->device_info->gen;
+
+    /* The BLT ring and BCS_SWCTRL came with Sandybridge */
+    if (mode == I965_FILL_GPU) {
+        if (fill->gen >= 6 && intel->has_blt)
+            fill->batches[fill->num_batches++] = intel_batchbuffer_new(intel, I915_EXEC_BLT, 0);
+        else
+            fill->mode = I965_FILL_CPU;
+    }
+}
+
+void
+i965_fill_terminate(struct i965_fill *fill)
+{
+    while (fill->num_batches > 0)
+        intel_batchbuffer_free(fill->batches[--fill->num_batches]);
+
+    pthread_mutex_destroy(&fill->mutex);
+}
+
+int
+i965_fill_parse_mode(const char *str, int default_mode)
+{
+    if (!str)
+        return default_mode;
+
+    if (!strcmp(str, "gpu"))
+        return I965_FILL_GPU;
+    else if (!strcmp(str, "cpu"))
+        return I965_FILL_CPU;
+    else if (!strcmp(str, "dry-run"))
+        return I965_FILL_DRY_RUN;
+
+    return default_mode;
+}
+
+int
+i965_fill_split_linear(unsigned int offset, unsigned int size, unsigned int pitch,
+                       struct i965_fill_rect rects[3])
+{
+    unsigned int x = offset % pitch;
+    unsigned int y = offset / pitch;
+    unsigned int width;
+    int n = 0;
+
+    if (!size || (uint64_t)offset + size > (uint64_t)pitch * I965_FILL_MAX_COORD)
+        return 0;
+
+    if (x) {
+        width = MIN(pitch - x, size);
+        rects[n].x = x;
+        rects[n].y = y++;
+        rects[n].width = width;
+        rects[n++].height = 1;
+        size -= width;
+    }
+
+    if (size >= pitch) {
+        rects[n].x = 0;
+        rects[n].y = y;
+        rects[n].width = pitch;
+        rects[n++].height = size / pitch;
+        y += size / pitch;
+        size %= pitch;
+    }
+
+    if (size) {
+        rects[n].x = 0;
+        rects[n].y = y;
+        rects[n].width = size;
+        rects[n++].height = 1;
+    }
+
+    return n;
+}
+
+/* Switches the blitter between linear or X-tiled and Y-tiled destinations */
+static uint32_t *
+fill_build_swctrl(int gen, uint32_t *dw, uint32_t dst_y)
+{
+    /* Idles the blitter before the tiling it assumes changes */
+    if (gen >= 8) {
+        *dw++ = MI_FLUSH_DW2;
+        *dw++ = 0;
+    } else
+        *dw++ = MI_FLUSH_DW;
+
+    *dw++ = 0;
+    *dw++ = 0;
+    *dw++ = 0;
+
+    /* The upper half masks the bits written */
+    *dw++ = MI_LOAD_REGISTER_IMM | (3 - 2);
+    *dw++ = BCS_SWCTRL;
+    *dw++ = BCS_SWCTRL_DST_Y << 16 | dst_y;
+
+    return dw;
+}
+
+bool
+i965_fill_build_commands(int gen, unsigned int tiling, unsigned int pitch,
+                         const struct i965_fill_rect *rects, int num_rects,
+                         uint8_t value, struct i965_fill_commands *cmds)
+{
+    uint32_t *dw = cmds->dw;
+    uint32_t blt_cmd, br13;
+    int i;
+
+    cmds->num_dw = 0;
+    cmds->num_relocs = 0;
+
+    if (gen < 6 || num_rects > I965_FILL_MAX_RECTS || pitch % 4)
+        return false;
+
+    blt_cmd = gen >= 8 ? GEN8_XY_COLOR_BLT_CMD : XY_COLOR_BLT_CMD;
+
+    if (tiling != I915_TILING_NONE) {
+        if (tiling != I915_TILING_X && tiling != I915_TILING_Y)
+            return false;
+
+        /* The pitch of tiled surfaces is in DWORDs */
+        blt_cmd |= XY_COLOR_BLT_DST_TILED;
+        pitch /= 4;
+    }
+
+    if (pitch > I965_FILL_MAX_COORD)
+        return false;
+
+    for (i = 0; i < num_rects; i++) {
+        if (rects[i].x + rects[i].width > I965_FILL_MAX_COORD ||
+            rects[i].y + rects[i].height > I965_FILL_MAX_COORD)
+            return false;
+    }
+
+    br13 = 0xf0 << 16;
+    br13 |= BR13_8;
+    br13 |= pitch;
+
+    if (tiling == I915_TILING_Y)
+        dw = fill_build_swctrl(gen, dw, BCS_SWCTRL_DST_Y);
+
+    for (i = 0; i < num_rects; i++) {
+        const struct i965_fill_rect * const r = &rects[i];
+
+        if (!r->width || !r->height)
+            continue;
+
+        *dw++ = blt_cmd;
+        *dw++ = br13;
+        *dw++ = r->y << 16 | r->x;
+        *dw++ = (r->y + r->height) << 16 | (r->x + r->width);
+        cmds->relocs[cmds->num_relocs++] = dw - cmds->dw;
+        *dw++ = 0;
+        if (gen >= 8)
+            *dw++ = 0;
+        *dw++ = value;
+    }
+
+    if (tiling == I915_TILING_Y)
+        dw = fill_build_swctrl(gen, dw, 0);
+
+    cmds->num_dw = dw - cmds->dw;
+    assert(cmds->num_dw <= I965_FILL_MAX_DWORDS);
+
+    return cmds->num_relocs > 0;
+}
+
+/* Takes an idle batch, or makes one when the other fills hold them all */
+static struct intel_batchbuffer *
+fill_get_batch(struct i965_fill *fill)
+{
+    struct intel_batchbuffer *batch = NULL;
+
+    pthread_mutex_lock(&fill->mutex);
+    if (fill->num_batches > 0)
+        batch = fill->batches[--fill->num_batches];
+    pthread_mutex_unlock(&fill->mutex);
+
+    if (!batch)
+        batch = intel_batchbuffer_new(fill->intel, I915_EXEC_BLT, 0);
+
+    return batch;
+}
+
+static void
+fill_put_batch(struct i965_fill *fill, struct intel_batchbuffer *batch,
+               unsigned long bytes)
+{
+    pthread_mutex_lock(&fill->mutex);
+    fill->stats.gpu_fills++;
+    fill->stats.gpu_bytes += bytes;
+
+    if (fill->num_batches < I965_FILL_MAX_BATCHES) {
+        fill->batches[fill->num_batches++] = batch;
+        batch = NULL;
+    }
+    pthread_mutex_unlock(&fill->mutex);
+
+    if (batch)
+        intel_batchbuffer_free(batch);
+}
+
+/* Emits the commands with their relocations, and submits them */
+static void
+fill_submit(struct i965_fill *fill, struct intel_batchbuffer *batch,
+            dri_bo *bo, const struct i965_fill_commands *cmds)
+{
+    unsigned int i, r = 0;
+
+    intel_batchbuffer_start_atomic_blt(batch, cmds->num_dw * 4);
+    BEGIN_BLT_BATCH(batch, cmds->num_dw);
+
+    for (i = 0; i < cmds->num_dw; i++) {
+        if (r < cmds->num_relocs && cmds->relocs[r] == i) {
+            if (fill->gen >= 8) {
+                OUT_RELOC64(batch, bo,
+                            I915_GEM_DOMAIN_RENDER, I915_GEM_DOMAIN_RENDER,
+                            cmds->dw[i]);
+                i++;
+            } else
+                OUT_BLT_RELOC(batch, bo,
+                              I915_GEM_DOMAIN_RENDER, I915_GEM_DOMAIN_RENDER,
+                              cmds->dw[i]);
+            r++;
+        } else
+            OUT_BLT_BATCH(batch, cmds->dw[i]);
+    }
+
+    ADVANCE_BLT_BATCH(batch);
+    intel_batchbuffer_end_atomic(batch);
+    intel_batchbuffer_flush(batch);
+}
+
+/* Returns whether the blitter took the fill */
+static bool
+fill_blit(struct i965_fill *fill, dri_bo *bo, unsigned int tiling,
+          unsigned int pitch, const struct i965_fill_rect *rects,
+          int num_rects, uint8_t value, unsigned long bytes)
+{
+    struct i965_fill_commands cmds;
+    struct intel_batchbuffer *batch;
+
+    if (fill->mode == I965_FILL_CPU ||
+        !i965_fill_build_commands(fill->gen, tiling, pitch, rects, num_rects,
+                                  value, &cmds))
+        return false;
+
+    if (fill->mode == I965_FILL_DRY_RUN) {
+        __atomic_add_fetch(&fill->stats.dry_run_dwords, cmds.num_dw, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    /* The submission runs outside of the mutex, on a batch of its own */
+    batch = fill_get_batch(fill);
+    fill_submit(fill, batch, bo, &cmds);
+    fill_put_batch(fill, batch, bytes);
+
+    return true;
+}
+
+static bool
+fill_cpu(struct i965_fill *fill, dri_bo *bo, unsigned int tiling,
+         unsigned int pitch, const struct i965_fill_rect *rects,
+         int num_rects, uint8_t value, unsigned long bytes)
+{
+    uint8_t *p;
+    unsigned int j;
+    int i;
+
+    /* The GTT detiles */
+    if (tiling != I915_TILING_NONE)
+        drm_intel_gem_bo_map_gtt(bo);
+    else
+        dri_bo_map(bo, 1);
+
+    p = bo->virtual;
+    if (!p)
+        return false;
+
+    for (i = 0; i < num_rects; i++) {
+        const struct i965_fill_rect * const r = &rects[i];
+
+        for (j = 0; j < r->height; j++)
+            memset(p + (r->y + j) * pitch + r->x, value, r->width);
+    }
+
+    if (tiling != I915_TILING_NONE)
+        drm_intel_gem_bo_unmap_gtt(bo);
+    else
+        dri_bo_unmap(bo);
+
+    __atomic_add_fetch(&fill->stats.cpu_fills, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&fill->stats.cpu_bytes, bytes, __ATOMIC_RELAXED);
+
+    return true;
+}
+
+bool
+i965_fill_buffer_cpu(struct i965_fill *fill, dri_bo *bo, unsigned int offset,
+                     unsigned int size, uint8_t value)
+{
+    struct i965_fill_rect rect;
+
+    if (!bo || !size)
+        return true;
+
+    assert(offset + size <= bo->size);
+
+    rect.x = offset;
+    rect.y = 0;
+    rect.width = size;
+    rect.height = 1;
+
+    return fill_cpu(fill, bo, I915_TILING_NONE, 0, &rect, 1, value, size);
+}
+
+bool
+i965_fill_buffer(struct i965_fill *fill, dri_bo *bo, unsigned int offset,
+                 unsigned int size, uint8_t value)
+{
+    struct i965_fill_rect rects[3];
+    int num_rects;
+
+    if (!bo || !size)
+        return true;
+
+    assert(offset + size <= bo->size);
+
+    /* Mapping a small idle buffer object costs less than a batch */
+    if (fill->mode != I965_FILL_CPU &&
+        (size > I965_FILL_CPU_MAX_SIZE || drm_intel_bo_busy(bo))) {
+        num_rects = i965_fill_split_linear(offset, size, I965_FILL_LINEAR_PITCH,
+                                           rects);
+
+        if (num_rects &&
+            fill_blit(fill, bo, I915_TILING_NONE, I965_FILL_LINEAR_PITCH,
+                      rects, num_rects, value, size))
+            return true;
+    }
+
+    return i965_fill_buffer_cpu(fill, bo, offset, size, value);
+}
+
+bool
+i965_fill_rects(struct i965_fill *fill, dri_bo *bo, unsigned int tiling,
+                unsigned int pitch, const struct i965_fill_rect *rects,
+                int num_rects, uint8_t value)
+{
+    unsigned long bytes = 0;
+    int i;
+
+    for (i = 0; i < num_rects; i++)
+        bytes += (unsigned long)rects[i].width * rects[i].height;
+
+    if (!bytes)
+        return true;
+
+    if (fill_blit(fill, bo, tiling, pitch, rects, num_rects, value, bytes))
+        return true;
+
+    return fill_cpu(fill, bo, tiling, pitch, rects, num_rects, value, bytes);
+}
+
+void
+i965_fill_get_stats(struct i965_fill *fill, struct i965_fill_stats *stats)
+{
+    pthread_mutex_lock(&fill->mutex);
+    *stats = fill->stats;
+    stats->cpu_fills = __atomic_load_n(&fill->stats.cpu_fills, __ATOMIC_RELAXED);
+    stats->cpu_bytes = __atomic_load_n(&fill->stats.cpu_bytes, __ATOMIC_RELAXED);
+    stats->dry_run_dwords = __atomic_load_n(&fill->stats.dry_run_dwords, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&fill->mutex);
+}
@@ -0,0 +1,157 @@
+/*
+ * i965_fill.h - Fills buffer objects with blitter commands instead of the CPU
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef I965_FILL_H
+#define I965_FILL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <intel_bufmgr.h>
+#include "intel_driver.h"
+
+/** Most rectangles one fill takes */
+#define I965_FILL_MAX_RECTS             8
+/** Most DWORDs the blitter commands of one fill take */
+#define I965_FILL_MAX_DWORDS            (I965_FILL_MAX_RECTS * 7 + 2 * 8)
+/** Blitter coordinates and pitches are signed 16-bit */
+#define I965_FILL_MAX_COORD             0x7fff
+/** Pitch linear fills are laid out with */
+#define I965_FILL_LINEAR_PITCH          16384
+/** Idle buffer objects up to this size are filled on the CPU, a batch costs more */
+#define I965_FILL_CPU_MAX_SIZE          4096
+/** Idle BLT batches kept for the next fills, more are made while all are in use */
+#define I965_FILL_MAX_BATCHES           4
+
+/** How the fills are carried out, VA_INTEL_FILL=gpu|cpu|dry-run selects it */
+enum i965_fill_mode {
+    I965_FILL_GPU = 0,                  /* XY_COLOR_BLT on the BLT ring */
+    I965_FILL_CPU,                      /* memset() through a mapping */
+    I965_FILL_DRY_RUN,                  /* builds the blitter commands, then fills on the CPU */
+};
+
+/** A rectangle of bytes, rows are pitch bytes apart from the start of the buffer object */
+struct i965_fill_rect {
+    unsigned int x;                     /* in bytes */
+    unsigned int y;
+    unsigned int width;                 /* in bytes */
+    unsigned int height;
+};
+
+/** Blitter commands of a fill, the relocations hold their delta until emitted */
+struct i965_fill_commands {
+    uint32_t dw[I965_FILL_MAX_DWORDS];
+    unsigned int num_dw;
+    unsigned int relocs[I965_FILL_MAX_RECTS];   /* DWORD index of each address */
+    unsigned int num_relocs;
+};
+
+struct i965_fill_stats {
+    unsigned long gpu_fills;
+    unsigned long gpu_bytes;
+    unsigned long cpu_fills;
+    unsigned long cpu_bytes;
+    unsigned long dry_run_dwords;       /* built but not submitted */
+};
+
+/**
+ * Fills buffer objects without mapping them, the blitter commands go
+ * into a batch of their own which is submitted right away, and the
+ * kernel orders it against the batches reading the buffer object. The
+ * CPU fills what the blitter can't address, and everything without a
+ * BLT ring.
+ *
+ * Each fill takes a batch for itself, the mutex only guards the idle
+ * batches and the statistics, so fills of different contexts are
+ * submitted concurrently.
+ */
+struct i965_fill {
+    pthread_mutex_t mutex;
+    struct intel_driver_data *intel;
+    struct intel_batchbuffer *batches[I965_FILL_MAX_BATCHES];
+    int num_batches;                    /* idle in batches */
+    int mode;
+    int gen;
+    struct i965_fill_stats stats;
+};
+
+void
+i965_fill_init(struct i965_fill *fill, struct intel_driver_data *intel, int mode);
+
+void
+i965_fill_terminate(struct i965_fill *fill);
+
+/** Parses "gpu", "cpu" or "dry-run", returns default_mode for anything else */
+int
+i965_fill_parse_mode(const char *str, int default_mode);
+
+/**
+ * Lays size bytes from offset out as rows of pitch bytes, a partial first
+ * row, full rows and a partial last row. Returns the number of rectangles,
+ * 0 if the range is past the blitter coordinates.
+ */
+int
+i965_fill_split_linear(unsigned int offset, unsigned int size, unsigned int pitch,
+                       struct i965_fill_rect rects[3]);
+
+/**
+ * Builds the XY_COLOR_BLT commands filling the rectangles of a surface
+ * with pitch and tiling on gen, Y-tiled surfaces switch the blitter to
+ * Y-tiling through BCS_SWCTRL. Returns false if the blitter can't address
+ * the surface.
+ */
+bool
+i965_fill_build_commands(int gen, unsigned int tiling, unsigned int pitch,
+                         const struct i965_fill_rect *rects, int num_rects,
+                         uint8_t value, struct i965_fill_commands *cmds);
+
+/**
+ * Fills size bytes of bo from offset with value, with the blitter when bo
+ * is busy or larger than I965_FILL_CPU_MAX_SIZE. Returns false if the CPU
+ * couldn't map it.
+ */
+bool
+i965_fill_buffer(struct i965_fill *fill, dri_bo *bo, unsigned int offset,
+                 unsigned int size, uint8_t value);
+
+/**
+ * Fills size bytes of bo from offset with value on the CPU, for callers
+ * which map bo right after: a blit would only make their mapping wait.
+ */
+bool
+i965_fill_buffer_cpu(struct i965_fill *fill, dri_bo *bo, unsigned int offset,
+                     unsigned int size, uint8_t value);
+
+/** Fills the rectangles of a surface laid out with pitch and tiling */
+bool
+i965_fill_rects(struct i965_fill *fill, dri_bo *bo, unsigned int tiling,
+                unsigned int pitch, const struct i965_fill_rect *rects,
+                int num_rects, uint8_t value);
+
+void
+i965_fill_get_stats(struct i965_fill *fill, struct i965_fill_stats *stats);
+
+#endif /* I965_FILL_H */
@@ -42,7 +42,7 @@ i965_gpe_select(VADriverContextP ctx,
 {
     BEGIN_BATCH(batch, 1);
     OUT_BATCH(batch, CMD_PIPELINE_SELECT | PIPELINE_SELECT_MEDIA);
-    ADVANCE_BATCH(batch);
+    ADVANCE_BATCH_STATE(batch, 0, 0);
 }
 
 static void
@@ -93,7 +93,7 @@ gen6_gpe_vfe_state(VADriverContextP ctx,
     OUT_BATCH(batch, gpe_context->vfe_desc6.dword);
     OUT_BATCH(batch, gpe_context->vfe_desc7.dword);
 
-    ADVANCE_BATCH(batch);
+    ADVANCE_BATCH_STATE(batch, 0, 0);
 
 }
 
@@ -1067,7 +1067,7 @@ gen8_gpe_vfe_state(VADriverContextP ctx,
     OUT_BATCH(batch, gpe_context->vfe_desc6.dword);
     OUT_BATCH(batch, gpe_context->vfe_desc7.dword);
 
-    ADVANCE_BATCH(batch);
+    ADVANCE_BATCH_STATE(batch, 0, 0);
 
 }
 
@@ -1342,7 +1342,7 @@ gen9_gpe_select(VADriverContextP ctx,
               GEN9_MEDIA_DOP_GATE_MASK |
               GEN9_FORCE_MEDIA_AWAKE_ON |
               GEN9_FORCE_MEDIA_AWAKE_MASK);
-    ADVANCE_BATCH(batch);
+    ADVANCE_BATCH_STATE(batch, 0, 0);
 }
 
 void
@@ -1459,13 +1459,21 @@ i965_dri_object_to_2d_gpe_resource(struct i965_gpe_resource *res,
 }
 
 void
-i965_zero_gpe_resource(struct i965_gpe_resource *res)
+i965_zero_gpe_resource(VADriverContextP ctx, struct i965_gpe_resource *res)
 {
-    if (res->bo) {
-        dri_bo_map(res->bo, 1);
-        memset(res->bo->virtual, 0, res->size);
-        dri_bo_unmap(res->bo);
-    }
+    struct i965_driver_data *i965 = i965_driver_data(ctx);
+
+    if (res->bo)
+        i965_fill_buffer(&i965->fill, res->bo, 0, MIN(res->size, res->bo->size), 0);
+}
+
+void
+i965_zero_gpe_resource_cpu(VADriverContextP ctx, struct i965_gpe_resource *res)
+{
+    struct i965_driver_data *i965 = i965_driver_data(ctx);
+
+    if (res->bo)
+        i965_fill_buffer_cpu(&i965->fill, res->bo, 0, MIN(res->size, res->bo->size), 0);
 }
 
 void
@@ -1640,6 +1648,9 @@ gen8_gpe_mi_batch_buffer_start(VADriverContextP ctx,
                                struct intel_batchbuffer *batch,
                                struct gpe_mi_batch_buffer_start_parameter *params)
 {
+    /* The called batch may change any state behind the shadow's back */
+    intel_batchbuffer_invalidate_state(batch, 0);
+
     __OUT_BATCH(batch, (MI_BATCH_BUFFER_START |
                         (!!params->is_second_level << 22) |
                         (!params->use_global_gtt << 8) |
@@ -364,7 +364,11 @@ void i965_dri_object_to_2d_gpe_resource(struct i965_gpe_resource *res,
                                         unsigned int height,
                                         unsigned int pitch);
 
-void i965_zero_gpe_resource(struct i965_gpe_resource *res);
+/* Clears the resource with the blitter where the driver can, see i965_fill_buffer() */
+void i965_zero_gpe_resource(VADriverContextP ctx, struct i965_gpe_resource *res);
+
+/* Clears the resource on the CPU, for callers which map it right after */
+void i965_zero_gpe_resource_cpu(VADriverContextP ctx, struct i965_gpe_resource *res);
 
 void i965_free_gpe_resource(struct i965_gpe_resource *res);
 
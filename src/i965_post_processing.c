@@ -1691,34 +1691,169 @@ ironlake_pp_constant_buffer(VADriverContextP ctx,
     ADVANCE_BATCH(batch);
 }
 
+static void update_block_mask_parameter(const struct i965_post_processing_context *pp_context, void *inline_parameter, int x, int y, int x_steps, int y_steps)
+{
+    struct pp_inline_parameter *pp_inline_parameter = inline_parameter;
+
+    pp_inline_parameter->grf5.block_vertical_mask = 0xff;
+    pp_inline_parameter->grf6.block_vertical_mask_bottom = pp_context->block_vertical_mask_bottom;
+    // for the first block, it always on the left edge. the second block will reload horizontal_mask from grf6.block_horizontal_mask_middle
+    pp_inline_parameter->grf5.block_horizontal_mask = pp_context->block_horizontal_mask_left;
+    pp_inline_parameter->grf6.block_horizontal_mask_middle = 0xffff;
+    pp_inline_parameter->grf6.block_horizontal_mask_right = pp_context->block_horizontal_mask_right;
+
+    /* 1 x N */
+    if (x_steps == 1) {
+        if (y == y_steps - 1) {
+            pp_inline_parameter->grf5.block_vertical_mask = pp_context->block_vertical_mask_bottom;
+        } else {
+            pp_inline_parameter->grf6.block_vertical_mask_bottom = 0xff;
+        }
+    }
+
+    /* M x 1 */
+    if (y_steps == 1) {
+        if (x == 0) { // all blocks in this group are on the left edge
+            pp_inline_parameter->grf6.block_horizontal_mask_middle = pp_context->block_horizontal_mask_left;
+            pp_inline_parameter->grf6.block_horizontal_mask_right = pp_context->block_horizontal_mask_left;
+        } else if (x == x_steps - 1) {
+            pp_inline_parameter->grf5.block_horizontal_mask = pp_context->block_horizontal_mask_right;
+            pp_inline_parameter->grf6.block_horizontal_mask_middle = pp_context->block_horizontal_mask_right;
+        } else {
+            pp_inline_parameter->grf5.block_horizontal_mask = 0xffff;
+            pp_inline_parameter->grf6.block_horizontal_mask_middle = 0xffff;
+            pp_inline_parameter->grf6.block_horizontal_mask_right = 0xffff;
+        }
+    }
+
+}
+
+/* Minimum number of blocks generated by a job, below which threads cost more than they save */
+#define PP_WALKER_MIN_BAND_BLOCKS 256
+
+union pp_walker_inline_parameter {
+    struct pp_inline_parameter gen5;
+    struct gen7_pp_inline_parameter gen7;
+};
+
+struct pp_walker_job {
+    const struct i965_post_processing_context *pp_context;
+    union pp_walker_inline_parameter inline_parameter;  /* before the first block */
+    int x_steps;
+    int y_steps;
+    int rows_per_band;
+    int header_dws;
+    int param_size;
+    bool update_block_mask;
+    unsigned int *commands;
+};
+
+/* Generates the MEDIA_OBJECT commands of one band of block rows */
+static void
+pp_walker_job_run(void *arg, unsigned int job_index)
+{
+    struct pp_walker_job * const job = arg;
+    const struct i965_post_processing_context * const pp_context = job->pp_context;
+    const int command_length_in_dws = job->header_dws + (job->param_size >> 2);
+    union pp_walker_inline_parameter inline_parameter;
+    unsigned int *command_ptr;
+    int x, y, y_end;
+
+    /*
+     * Blocks only depend on their position and, for the non-linear AVS, on
+     * the previous blocks of their row, so bands may run in any order as
+     * long as each one walks its own copy of the inline data
+     */
+    inline_parameter = job->inline_parameter;
+
+    y = job_index * job->rows_per_band;
+    y_end = MIN(y + job->rows_per_band, job->y_steps);
+    command_ptr = job->commands + y * job->x_steps * command_length_in_dws;
+
+    for (; y < y_end; y++) {
+        for (x = 0; x < job->x_steps; x++) {
+            /* Skipped blocks keep their slot, filled with MI_NOOPs */
+            if (pp_context->pp_set_block_parameter(pp_context, &inline_parameter, x, y)) {
+                memset(command_ptr, 0, command_length_in_dws * 4);
+                command_ptr += command_length_in_dws;
+                continue;
+            }
+
+            // some common block parameter update goes here, apply to all pp functions
+            if (job->update_block_mask)
+                update_block_mask_parameter(pp_context, &inline_parameter, x, y, job->x_steps, job->y_steps);
+
+            command_ptr[0] = CMD_MEDIA_OBJECT | (command_length_in_dws - 2);
+            memset(&command_ptr[1], 0, (job->header_dws - 1) * 4);
+            memcpy(&command_ptr[job->header_dws], &inline_parameter, job->param_size);
+            command_ptr += command_length_in_dws;
+        }
+    }
+
+    /* Leave the inline data as a sequential walk would */
+    if (y_end == job->y_steps)
+        memcpy(pp_context->pp_inline_parameter, &inline_parameter, job->param_size);
+}
+
+unsigned int *
+i965_pp_gen_media_objects(struct i965_thread_pool *pool,
+                          const struct i965_post_processing_context *pp_context,
+                          int x_steps, int y_steps, int header_dws, int param_size,
+                          bool update_block_mask, unsigned int *commands)
+{
+    struct pp_walker_job job;
+    int num_bands;
+
+    if (x_steps <= 0 || y_steps <= 0)
+        return commands;
+
+    job.pp_context = pp_context;
+    job.x_steps = x_steps;
+    job.y_steps = y_steps;
+    job.header_dws = header_dws;
+    job.param_size = param_size;
+    job.update_block_mask = update_block_mask;
+    job.commands = commands;
+    memcpy(&job.inline_parameter, pp_context->pp_inline_parameter, param_size);
+
+    /* A few bands per thread balance the load without tiny jobs */
+    job.rows_per_band = y_steps;
+    if (pool->num_threads > 1) {
+        job.rows_per_band = y_steps / (pool->num_threads * 4);
+        job.rows_per_band = MAX(job.rows_per_band,
+                                (PP_WALKER_MIN_BAND_BLOCKS + x_steps - 1) / x_steps);
+        job.rows_per_band = MIN(job.rows_per_band, y_steps);
+    }
+    num_bands = (y_steps + job.rows_per_band - 1) / job.rows_per_band;
+
+    i965_thread_pool_run(pool, pp_walker_job_run, &job, num_bands);
+
+    return commands + x_steps * y_steps * (header_dws + (param_size >> 2));
+}
+
 static void
 ironlake_pp_object_walker(VADriverContextP ctx,
                           struct i965_post_processing_context *pp_context)
 {
+    struct i965_driver_data *i965 = i965_driver_data(ctx);
     struct intel_batchbuffer *batch = pp_context->batch;
-    int x, x_steps, y, y_steps;
-    struct pp_inline_parameter *pp_inline_parameter = pp_context->pp_inline_parameter;
+    int x_steps, y_steps, command_length_in_dws;
+    unsigned int *command_ptr;
 
     x_steps = pp_context->pp_x_steps(pp_context->private_context);
     y_steps = pp_context->pp_y_steps(pp_context->private_context);
 
-    for (y = 0; y < y_steps; y++) {
-        for (x = 0; x < x_steps; x++) {
-            if (!pp_context->pp_set_block_parameter(pp_context, x, y)) {
-                BEGIN_BATCH(batch, 20);
-                OUT_BATCH(batch, CMD_MEDIA_OBJECT | 18);
-                OUT_BATCH(batch, 0);
-                OUT_BATCH(batch, 0); /* no indirect data */
-                OUT_BATCH(batch, 0);
-
-                /* inline data grf 5-6 */
-                assert(sizeof(*pp_inline_parameter) == 64);
-                intel_batchbuffer_data(batch, pp_inline_parameter, sizeof(*pp_inline_parameter));
-
-                ADVANCE_BATCH(batch);
-            }
-        }
-    }
+    /* no indirect data, inline data grf 5-6 */
+    assert(sizeof(struct pp_inline_parameter) == 64);
+    command_length_in_dws = 4 + (sizeof(struct pp_inline_parameter) >> 2);
+
+    command_ptr = intel_batchbuffer_reserve_span(batch,
+                                                 command_length_in_dws * x_steps * y_steps);
+    command_ptr = i965_pp_gen_media_objects(&i965->pp_pool, pp_context,
+                                            x_steps, y_steps, 4,
+                                            sizeof(struct pp_inline_parameter),
+                                            false, command_ptr);
+    intel_batchbuffer_commit_span(batch, command_ptr);
 }
 
 static void
@@ -2252,7 +2387,8 @@ pp_null_y_steps(void *private_context)
 }
 
 static int
-pp_null_set_block_parameter(struct i965_post_processing_context *pp_context, int x, int y)
+pp_null_set_block_parameter(const struct i965_post_processing_context *pp_context,
+                            void *inline_parameter, int x, int y)
 {
     return 0;
 }
@@ -2291,9 +2427,10 @@ pp_load_save_y_steps(void *private_context)
 }
 
 static int
-pp_load_save_set_block_parameter(struct i965_post_processing_context *pp_context, int x, int y)
+pp_load_save_set_block_parameter(const struct i965_post_processing_context *pp_context,
+                                 void *inline_parameter, int x, int y)
 {
-    struct pp_inline_parameter *pp_inline_parameter = pp_context->pp_inline_parameter;
+    struct pp_inline_parameter *pp_inline_parameter = inline_parameter;
     struct pp_load_save_context *pp_load_save_context = (struct pp_load_save_context *)pp_context->private_context;
 
     pp_inline_parameter->grf5.destination_block_horizontal_origin = x * 16 + pp_load_save_context->dest_x;
@@ -2393,11 +2530,12 @@ pp_scaling_y_steps(void *private_context)
     return pp_scaling_context->dest_h / 8;
 }
 
-static int
-pp_scaling_set_block_parameter(struct i965_post_processing_context *pp_context, int x, int y)
+int
+pp_scaling_set_block_parameter(const struct i965_post_processing_context *pp_context,
+                               void *inline_parameter, int x, int y)
 {
     struct pp_scaling_context *pp_scaling_context = (struct pp_scaling_context *)pp_context->private_context;
-    struct pp_inline_parameter *pp_inline_parameter = pp_context->pp_inline_parameter;
+    struct pp_inline_parameter *pp_inline_parameter = inline_parameter;
     struct pp_static_parameter *pp_static_parameter = pp_context->pp_static_parameter;
     float src_x_steping = pp_inline_parameter->grf5.normalized_video_x_scaling_step;
     float src_y_steping = pp_static_parameter->grf1.r1_6.normalized_video_y_scaling_step;
@@ -2525,11 +2663,12 @@ pp_avs_y_steps(void *private_context)
     return 1;
 }
 
-static int
-pp_avs_set_block_parameter(struct i965_post_processing_context *pp_context, int x, int y)
+int
+pp_avs_set_block_parameter(const struct i965_post_processing_context *pp_context,
+                           void *inline_parameter, int x, int y)
 {
     struct pp_avs_context *pp_avs_context = (struct pp_avs_context *)pp_context->private_context;
-    struct pp_inline_parameter *pp_inline_parameter = pp_context->pp_inline_parameter;
+    struct pp_inline_parameter *pp_inline_parameter = inline_parameter;
     struct pp_static_parameter *pp_static_parameter = pp_context->pp_static_parameter;
     float src_x_steping, src_y_steping, video_step_delta;
     int tmp_w = ALIGN(pp_avs_context->dest_h * pp_avs_context->src_w / pp_avs_context->src_h, 16);
@@ -3014,11 +3153,12 @@ gen7_pp_avs_y_steps(void *private_context)
     return pp_avs_context->dest_h / 16;
 }
 
-static int
-gen7_pp_avs_set_block_parameter(struct i965_post_processing_context *pp_context, int x, int y)
+int
+gen7_pp_avs_set_block_parameter(const struct i965_post_processing_context *pp_context,
+                                void *inline_parameter, int x, int y)
 {
     struct pp_avs_context *pp_avs_context = (struct pp_avs_context *)pp_context->private_context;
-    struct gen7_pp_inline_parameter *pp_inline_parameter = pp_context->pp_inline_parameter;
+    struct gen7_pp_inline_parameter *pp_inline_parameter = inline_parameter;
 
     pp_inline_parameter->grf9.destination_block_horizontal_origin = x * 16 + pp_avs_context->dest_x;
     pp_inline_parameter->grf9.destination_block_vertical_origin = y * 16 + pp_avs_context->dest_y;
@@ -3322,10 +3462,11 @@ pp_dndi_y_steps(void *private_context)
     return pp_dndi_context->dest_h / 4;
 }
 
-static int
-pp_dndi_set_block_parameter(struct i965_post_processing_context *pp_context, int x, int y)
+int
+pp_dndi_set_block_parameter(const struct i965_post_processing_context *pp_context,
+                            void *inline_parameter, int x, int y)
 {
-    struct pp_inline_parameter *pp_inline_parameter = pp_context->pp_inline_parameter;
+    struct pp_inline_parameter *pp_inline_parameter = inline_parameter;
 
     pp_inline_parameter->grf5.destination_block_horizontal_origin = x * 16;
     pp_inline_parameter->grf5.destination_block_vertical_origin = y * 4;
@@ -3521,9 +3662,10 @@ pp_dn_y_steps(void *private_context)
 }
 
 static int
-pp_dn_set_block_parameter(struct i965_post_processing_context *pp_context, int x, int y)
+pp_dn_set_block_parameter(const struct i965_post_processing_context *pp_context,
+                          void *inline_parameter, int x, int y)
 {
-    struct pp_inline_parameter *pp_inline_parameter = pp_context->pp_inline_parameter;
+    struct pp_inline_parameter *pp_inline_parameter = inline_parameter;
 
     pp_inline_parameter->grf5.destination_block_horizontal_origin = x * 16;
     pp_inline_parameter->grf5.destination_block_vertical_origin = y * 8;
@@ -3729,10 +3871,11 @@ gen7_pp_dndi_y_steps(void *private_context)
     return pp_dndi_context->dest_h / 4;
 }
 
-static int
-gen7_pp_dndi_set_block_parameter(struct i965_post_processing_context *pp_context, int x, int y)
+int
+gen7_pp_dndi_set_block_parameter(const struct i965_post_processing_context *pp_context,
+                                 void *inline_parameter, int x, int y)
 {
-    struct gen7_pp_inline_parameter *pp_inline_parameter = pp_context->pp_inline_parameter;
+    struct gen7_pp_inline_parameter *pp_inline_parameter = inline_parameter;
 
     pp_inline_parameter->grf9.destination_block_horizontal_origin = x * 16;
     pp_inline_parameter->grf9.destination_block_vertical_origin = y * 4;
@@ -3941,9 +4084,10 @@ gen7_pp_dn_y_steps(void *private_context)
 }
 
 static int
-gen7_pp_dn_set_block_parameter(struct i965_post_processing_context *pp_context, int x, int y)
+gen7_pp_dn_set_block_parameter(const struct i965_post_processing_context *pp_context,
+                               void *inline_parameter, int x, int y)
 {
-    struct pp_inline_parameter *pp_inline_parameter = pp_context->pp_inline_parameter;
+    struct pp_inline_parameter *pp_inline_parameter = inline_parameter;
 
     pp_inline_parameter->grf5.destination_block_horizontal_origin = x * 16;
     pp_inline_parameter->grf5.destination_block_vertical_origin = y * 4;
@@ -4582,50 +4726,13 @@ gen6_interface_descriptor_load(VADriverContextP ctx,
     ADVANCE_BATCH(batch);
 }
 
-static void update_block_mask_parameter(struct i965_post_processing_context *pp_context, int x, int y, int x_steps, int y_steps)
-{
-    struct pp_inline_parameter *pp_inline_parameter = pp_context->pp_inline_parameter;
-
-    pp_inline_parameter->grf5.block_vertical_mask = 0xff;
-    pp_inline_parameter->grf6.block_vertical_mask_bottom = pp_context->block_vertical_mask_bottom;
-    // for the first block, it always on the left edge. the second block will reload horizontal_mask from grf6.block_horizontal_mask_middle
-    pp_inline_parameter->grf5.block_horizontal_mask = pp_context->block_horizontal_mask_left;
-    pp_inline_parameter->grf6.block_horizontal_mask_middle = 0xffff;
-    pp_inline_parameter->grf6.block_horizontal_mask_right = pp_context->block_horizontal_mask_right;
-
-    /* 1 x N */
-    if (x_steps == 1) {
-        if (y == y_steps - 1) {
-            pp_inline_parameter->grf5.block_vertical_mask = pp_context->block_vertical_mask_bottom;
-        } else {
-            pp_inline_parameter->grf6.block_vertical_mask_bottom = 0xff;
-        }
-    }
-
-    /* M x 1 */
-    if (y_steps == 1) {
-        if (x == 0) { // all blocks in this group are on the left edge
-            pp_inline_parameter->grf6.block_horizontal_mask_middle = pp_context->block_horizontal_mask_left;
-            pp_inline_parameter->grf6.block_horizontal_mask_right = pp_context->block_horizontal_mask_left;
-        } else if (x == x_steps - 1) {
-            pp_inline_parameter->grf5.block_horizontal_mask = pp_context->block_horizontal_mask_right;
-            pp_inline_parameter->grf6.block_horizontal_mask_middle = pp_context->block_horizontal_mask_right;
-        } else {
-            pp_inline_parameter->grf5.block_horizontal_mask = 0xffff;
-            pp_inline_parameter->grf6.block_horizontal_mask_middle = 0xffff;
-            pp_inline_parameter->grf6.block_horizontal_mask_right = 0xffff;
-        }
-    }
-
-}
-
 static void
 gen6_pp_object_walker(VADriverContextP ctx,
                       struct i965_post_processing_context *pp_context)
 {
     struct i965_driver_data *i965 = i965_driver_data(ctx);
     struct intel_batchbuffer *batch = pp_context->batch;
-    int x, x_steps, y, y_steps;
+    int x_steps, y_steps;
     int param_size, command_length_in_dws;
     dri_bo *command_buffer;
     unsigned int *command_ptr;
@@ -4644,26 +4751,10 @@ gen6_pp_object_walker(VADriverContextP ctx,
                                   4096);
 
     dri_bo_map(command_buffer, 1);
-    command_ptr = command_buffer->virtual;
-
-    for (y = 0; y < y_steps; y++) {
-        for (x = 0; x < x_steps; x++) {
-            if (!pp_context->pp_set_block_parameter(pp_context, x, y)) {
-                // some common block parameter update goes here, apply to all pp functions
-                if (IS_GEN6(i965->intel.device_info))
-                    update_block_mask_parameter(pp_context, x, y, x_steps, y_steps);
-
-                *command_ptr++ = (CMD_MEDIA_OBJECT | (command_length_in_dws - 2));
-                *command_ptr++ = 0;
-                *command_ptr++ = 0;
-                *command_ptr++ = 0;
-                *command_ptr++ = 0;
-                *command_ptr++ = 0;
-                memcpy(command_ptr, pp_context->pp_inline_parameter, param_size);
-                command_ptr += (param_size >> 2);
-            }
-        }
-    }
+    command_ptr = i965_pp_gen_media_objects(&i965->pp_pool, pp_context,
+                                            x_steps, y_steps, 6, param_size,
+                                            IS_GEN6(i965->intel.device_info),
+                                            command_buffer->virtual);
 
     if (command_length_in_dws * x_steps * y_steps % 2 == 0)
         *command_ptr++ = 0;
@@ -34,6 +34,7 @@
 #include <i915_drm.h>
 #include <intel_bufmgr.h>
 #include "i965_gpe_utils.h"
+#include "i965_thread_pool.h"
 
 #define MAX_PP_SURFACES                 48
 
@@ -543,7 +544,9 @@ struct i965_post_processing_context {
 
     int (*pp_x_steps)(void *private_context);
     int (*pp_y_steps)(void *private_context);
-    int (*pp_set_block_parameter)(struct i965_post_processing_context *pp_context, int x, int y);
+    /* Updates inline_parameter, as left by the previous block, for block (x, y) */
+    int (*pp_set_block_parameter)(const struct i965_post_processing_context *pp_context,
+                                  void *inline_parameter, int x, int y);
 
     struct intel_batchbuffer *batch;
 
@@ -631,6 +634,37 @@ i965_image_processing(VADriverContextP ctx,
                       struct i965_surface *dst_surface,
                       const VARectangle *dst_rect);
 
+/*
+ * Writes one MEDIA_OBJECT with header_dws DWORDs of header and param_size
+ * bytes of inline data per block, in raster order, and returns the end of
+ * the commands. Bands of block rows are generated in parallel on pool.
+ */
+unsigned int *
+i965_pp_gen_media_objects(struct i965_thread_pool *pool,
+                          const struct i965_post_processing_context *pp_context,
+                          int x_steps, int y_steps, int header_dws, int param_size,
+                          bool update_block_mask, unsigned int *commands);
+
+int
+pp_scaling_set_block_parameter(const struct i965_post_processing_context *pp_context,
+                               void *inline_parameter, int x, int y);
+
+int
+pp_avs_set_block_parameter(const struct i965_post_processing_context *pp_context,
+                           void *inline_parameter, int x, int y);
+
+int
+gen7_pp_avs_set_block_parameter(const struct i965_post_processing_context *pp_context,
+                                void *inline_parameter, int x, int y);
+
+int
+pp_dndi_set_block_parameter(const struct i965_post_processing_context *pp_context,
+                            void *inline_parameter, int x, int y);
+
+int
+gen7_pp_dndi_set_block_parameter(const struct i965_post_processing_context *pp_context,
+                                 void *inline_parameter, int x, int y);
+
 void
 i965_post_processing_terminate(VADriverContextP ctx);
 bool
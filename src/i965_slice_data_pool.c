@@ -0,0 +1,167 @@
+/*
+ * i965_slice_data_pool.c - Persistently mapped sub-allocator for slice data
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sysdeps.h"
+#include "i965_slice_data_pool.h"
+#include "intel_batchbuffer.h"
+
+#define ALIGN_POT(x, a) (((x) + (a) - 1) & ~((a) - 1))
+
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+void
+i965_slice_data_pool_init(I965SliceDataPool *pool, struct intel_driver_data *intel)
+{
+    memset(pool, 0, sizeof(*pool));
+    pthread_mutex_init(&pool->mutex, NULL);
+    pool->intel = intel;
+}
+
+void
+i965_slice_data_pool_terminate(I965SliceDataPool *pool)
+{
+    unsigned int i;
+
+    for (i = 0; i < pool->num_slabs; i++) {
+        assert(pool->slabs[i].num_users == 0);
+        drm_intel_gem_bo_unmap_gtt(pool->slabs[i].bo);
+        dri_bo_unreference(pool->slabs[i].bo);
+    }
+
+    pool->num_slabs = 0;
+    pthread_mutex_destroy(&pool->mutex);
+}
+
+static bool
+slice_data_slab_create(I965SliceDataPool *pool, I965SliceDataSlab *slab)
+{
+    slab->bo = dri_bo_alloc(pool->intel->bufmgr, "slice data slab",
+                            I965_SLICE_DATA_SLAB_SIZE, 4096);
+    if (!slab->bo)
+        return false;
+
+    /* A fresh buffer isn't busy, the mapping stays valid until terminate */
+    if (drm_intel_gem_bo_map_unsynchronized(slab->bo) != 0 || !slab->bo->virtual) {
+        dri_bo_unreference(slab->bo);
+        slab->bo = NULL;
+        return false;
+    }
+
+    slab->map = (uint8_t *)slab->bo->virtual;
+    slab->used = 0;
+    slab->num_users = 0;
+    return true;
+}
+
+/* Rewinds a slab nobody reads from anymore, neither the CPU nor the GPU */
+static bool
+slice_data_slab_reclaim(I965SliceDataPool *pool, I965SliceDataSlab *slab)
+{
+    if (__atomic_load_n(&slab->num_users, __ATOMIC_ACQUIRE) > 0)
+        return false;
+
+    if (slab->used && drm_intel_bo_busy(slab->bo))
+        return false;
+
+    /* A batch held back by deferred submission isn't busy yet */
+    if (slab->used && intel_submit_queue_references(pool->intel, slab->bo))
+        return false;
+
+    slab->used = 0;
+    return true;
+}
+
+I965SliceDataSlab *
+i965_slice_data_pool_alloc(I965SliceDataPool *pool, unsigned int size,
+                           unsigned int *offset)
+{
+    I965SliceDataSlab *slab = NULL;
+    unsigned int i, index;
+
+    size = ALIGN_POT(MAX(size, 1), I965_SLICE_DATA_ALIGNMENT);
+    if (size > I965_SLICE_DATA_SLAB_SIZE) {
+        __atomic_add_fetch(&pool->stats.fallbacks, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+
+    if (pool->num_slabs > 0) {
+        slab = &pool->slabs[pool->current];
+
+        /* The next slabs of the ring in turn once the current one is full */
+        for (i = 0; slab->used + size > I965_SLICE_DATA_SLAB_SIZE && i < pool->num_slabs; i++) {
+            index = (pool->current + 1 + i) % pool->num_slabs;
+            if (slice_data_slab_reclaim(pool, &pool->slabs[index])) {
+                pool->current = index;
+                slab = &pool->slabs[index];
+            }
+        }
+
+        if (slab->used + size > I965_SLICE_DATA_SLAB_SIZE)
+            slab = NULL;
+    }
+
+    if (!slab && pool->num_slabs < I965_SLICE_DATA_MAX_SLABS &&
+        slice_data_slab_create(pool, &pool->slabs[pool->num_slabs])) {
+        pool->current = pool->num_slabs++;
+        slab = &pool->slabs[pool->current];
+    }
+
+    if (slab) {
+        *offset = slab->used;
+        slab->used += size;
+        __atomic_add_fetch(&slab->num_users, 1, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (slab)
+        __atomic_add_fetch(&pool->stats.allocs, 1, __ATOMIC_RELAXED);
+    else
+        __atomic_add_fetch(&pool->stats.fallbacks, 1, __ATOMIC_RELAXED);
+
+    return slab;
+}
+
+void
+i965_slice_data_pool_free(I965SliceDataSlab *slab)
+{
+    int num_users = __atomic_sub_fetch(&slab->num_users, 1, __ATOMIC_RELEASE);
+
+    assert(num_users >= 0);
+    (void)num_users;
+}
+
+void
+i965_slice_data_pool_get_stats(I965SliceDataPool *pool,
+                               struct i965_slice_data_pool_stats *stats)
+{
+    stats->allocs = __atomic_load_n(&pool->stats.allocs, __ATOMIC_RELAXED);
+    stats->fallbacks = __atomic_load_n(&pool->stats.fallbacks, __ATOMIC_RELAXED);
+}
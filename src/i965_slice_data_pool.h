@@ -0,0 +1,101 @@
+/*
+ * i965_slice_data_pool.h - Persistently mapped sub-allocator for slice data
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef I965_SLICE_DATA_POOL_H
+#define I965_SLICE_DATA_POOL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <intel_bufmgr.h>
+#include "intel_driver.h"
+
+/** Size of each buffer object, larger slice data gets a buffer object of its own */
+#define I965_SLICE_DATA_SLAB_SIZE       (4 << 20)
+/** Maximal number of buffer objects in the ring */
+#define I965_SLICE_DATA_MAX_SLABS       8
+/** Alignment of the sub-allocations */
+#define I965_SLICE_DATA_ALIGNMENT       64
+
+typedef struct i965_slice_data_pool     I965SliceDataPool;
+typedef struct i965_slice_data_slab     I965SliceDataSlab;
+
+/**
+ * A buffer object mapped once through the GTT for its whole lifetime and
+ * carved out with a bump pointer. The pointer only goes back to the start
+ * once no sub-allocation is alive and the GPU is done with the buffer.
+ */
+struct i965_slice_data_slab {
+    dri_bo *bo;
+    uint8_t *map;                       /* persistent GTT mapping */
+    unsigned int used;
+    int num_users;                      /* atomic, live sub-allocations */
+};
+
+/** Counters of i965_slice_data_pool_alloc() */
+struct i965_slice_data_pool_stats {
+    unsigned long allocs;
+    unsigned long fallbacks;            /* too large, or all slabs in use */
+};
+
+/**
+ * Ring of slabs the slice data buffers of all decode contexts are packed
+ * into, so that the data of a picture shares one buffer object and the
+ * application writes it in place through vaMapBuffer().
+ */
+struct i965_slice_data_pool {
+    pthread_mutex_t mutex;
+    struct intel_driver_data *intel;
+    struct i965_slice_data_slab slabs[I965_SLICE_DATA_MAX_SLABS];
+    unsigned int num_slabs;
+    unsigned int current;
+    struct i965_slice_data_pool_stats stats;
+};
+
+void
+i965_slice_data_pool_init(I965SliceDataPool *pool, struct intel_driver_data *intel);
+
+/** All sub-allocations must have been released */
+void
+i965_slice_data_pool_terminate(I965SliceDataPool *pool);
+
+/**
+ * Returns the slab a size bytes block was carved out of, and its offset
+ * in the buffer object, or NULL if the caller has to allocate a buffer
+ * object of its own
+ */
+I965SliceDataSlab *
+i965_slice_data_pool_alloc(I965SliceDataPool *pool, unsigned int size,
+                           unsigned int *offset);
+
+/** Releases a block returned by i965_slice_data_pool_alloc() */
+void
+i965_slice_data_pool_free(I965SliceDataSlab *slab);
+
+void
+i965_slice_data_pool_get_stats(I965SliceDataPool *pool,
+                               struct i965_slice_data_pool_stats *stats);
+
+#endif /* I965_SLICE_DATA_POOL_H */
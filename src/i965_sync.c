@@ -0,0 +1,189 @@
+/*
+ * i965_sync.c - Waits for the GPU, polling before sleeping in the kernel
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sysdeps.h"
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "i965_sync.h"
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+static uint64_t
+sync_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void
+i965_sync_init(struct i965_sync *sync, unsigned int max_spin_us)
+{
+    memset(sync, 0, sizeof(*sync));
+    sync->max_spin_us = max_spin_us;
+    sync->spin_us = max_spin_us;
+}
+
+/*
+ * A wait that blocked but was over soon after the window widens it, one
+ * that would have needed a much larger window halves it
+ */
+static void
+sync_adapt(struct i965_sync *sync, unsigned int spin_us, uint64_t waited_ns)
+{
+    const uint64_t waited_us = waited_ns / 1000;
+    unsigned int next;
+
+    if (waited_us <= 2 * MAX(spin_us, I965_SYNC_MIN_SPIN_US))
+        next = MIN(sync->max_spin_us, waited_us + waited_us / 4 + 1);
+    else
+        next = MAX(spin_us / 2, MIN(sync->max_spin_us, I965_SYNC_MIN_SPIN_US));
+
+    __atomic_store_n(&sync->spin_us, next, __ATOMIC_RELAXED);
+}
+
+bool
+i965_sync_wait(struct i965_sync *sync, dri_bo **bos, int num_bos,
+               int64_t timeout_ns, uint64_t *waited_ns)
+{
+    const unsigned int spin_us = __atomic_load_n(&sync->spin_us, __ATOMIC_RELAXED);
+    const uint64_t start = sync_now_ns();
+    uint64_t now = start, spin_end, end;
+    bool polled = false;
+    int i = 0;
+
+    end = timeout_ns >= 0 ? start + timeout_ns : UINT64_MAX;
+    spin_end = MIN(end, start + spin_us * 1000ull);
+
+    /* Idle buffers stay idle, only the first busy one is polled again */
+    for (;;) {
+        while (i < num_bos && (!bos[i] || !drm_intel_bo_busy(bos[i])))
+            i++;
+
+        if (i == num_bos || now >= spin_end)
+            break;
+
+        if (polled)
+            sched_yield();
+        polled = true;
+        now = sync_now_ns();
+    }
+
+    if (i == num_bos || now >= end) {
+        if (polled)
+            now = sync_now_ns();
+        if (waited_ns)
+            *waited_ns = now - start;
+        if (polled && i == num_bos)
+            __atomic_add_fetch(&sync->polled, 1, __ATOMIC_RELAXED);
+        return i == num_bos;
+    }
+
+    /* One sleep usually covers the remaining buffers, they complete together */
+    for (; i < num_bos; i++) {
+        int64_t left = -1;
+
+        if (!bos[i])
+            continue;
+
+        if (timeout_ns >= 0) {
+            now = sync_now_ns();
+            left = now < end ? (int64_t)(end - now) : 0;
+        }
+
+        if (drm_intel_gem_bo_wait(bos[i], left) != 0) {
+            /* Kernels without the wait ioctl only have the blocking wait */
+            if (left < 0)
+                drm_intel_bo_wait_rendering(bos[i]);
+            else if (drm_intel_bo_busy(bos[i]))
+                break;
+        }
+    }
+
+    now = sync_now_ns();
+    if (waited_ns)
+        *waited_ns = now - start;
+
+    __atomic_add_fetch(&sync->blocked, 1, __ATOMIC_RELAXED);
+    sync_adapt(sync, spin_us, now - start);
+
+    return i == num_bos;
+}
+
+void
+i965_sync_histogram_add(struct i965_sync_histogram *hist, uint64_t ns)
+{
+    uint64_t us = ns / 1000;
+    unsigned int bucket = 0;
+
+    while (bucket < I965_SYNC_HISTOGRAM_BUCKETS - 1 && us >= (1ull << bucket))
+        bucket++;
+
+    __atomic_add_fetch(&hist->buckets[bucket], 1, __ATOMIC_RELAXED);
+}
+
+int
+i965_sync_histogram_print(const struct i965_sync_histogram *hist,
+                          char *str, size_t size)
+{
+    unsigned long count;
+    unsigned int i;
+    size_t left;
+    char *out;
+    int len = 0;
+
+    if (size)
+        str[0] = '\0';
+
+    for (i = 0; i < I965_SYNC_HISTOGRAM_BUCKETS; i++) {
+        count = __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+        if (!count)
+            continue;
+
+        /* Once truncated, only the length is counted */
+        out = size > (size_t)len ? str + len : NULL;
+        left = size > (size_t)len ? size - len : 0;
+
+        if (i < I965_SYNC_HISTOGRAM_BUCKETS - 1)
+            len += snprintf(out, left, "%s<%luus:%lu",
+                            len ? " " : "", 1ul << i, count);
+        else
+            len += snprintf(out, left, "%s>=%luus:%lu",
+                            len ? " " : "", 1ul << (i - 1), count);
+    }
+
+    return len;
+}
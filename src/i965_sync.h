@@ -0,0 +1,80 @@
+/*
+ * i965_sync.h - Waits for the GPU, polling before sleeping in the kernel
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef I965_SYNC_H
+#define I965_SYNC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <intel_bufmgr.h>
+
+/** Default upper bound of the polling window, VA_INTEL_SYNC_SPIN overrides it */
+#define I965_SYNC_SPIN_US               100
+/** Smallest polling window once the waits turned out to be long */
+#define I965_SYNC_MIN_SPIN_US           2
+/** Bucket i counts the waits of less than (1 << i) microseconds, the last one all others */
+#define I965_SYNC_HISTOGRAM_BUCKETS     16
+
+/** Time the waits actually blocked, power-of-two microsecond buckets */
+struct i965_sync_histogram {
+    unsigned long buckets[I965_SYNC_HISTOGRAM_BUCKETS];     /* atomic */
+};
+
+/**
+ * A wait first polls the buffer objects for spin_us, which catches work
+ * about to complete without a sleep and wakeup in the kernel, and then
+ * blocks. The window follows how long the waits that had to block took.
+ */
+struct i965_sync {
+    unsigned int max_spin_us;
+    unsigned int spin_us;               /* atomic */
+    unsigned long polled;               /* atomic, waits done while polling */
+    unsigned long blocked;              /* atomic, waits done in the kernel */
+    struct i965_sync_histogram latency;
+};
+
+void
+i965_sync_init(struct i965_sync *sync, unsigned int max_spin_us);
+
+/**
+ * Waits until the GPU is done with all num_bos buffer objects, at most
+ * timeout_ns if it isn't negative. Returns whether they are all idle,
+ * and how long the call waited in *waited_ns if it isn't NULL.
+ */
+bool
+i965_sync_wait(struct i965_sync *sync, dri_bo **bos, int num_bos,
+               int64_t timeout_ns, uint64_t *waited_ns);
+
+void
+i965_sync_histogram_add(struct i965_sync_histogram *hist, uint64_t ns);
+
+/** Prints the non-empty buckets as "<1us:3 <64us:10 ...", returns the length like snprintf() */
+int
+i965_sync_histogram_print(const struct i965_sync_histogram *hist,
+                          char *str, size_t size);
+
+#endif /* I965_SYNC_H */
@@ -0,0 +1,165 @@
+/*
+ * i965_thread_pool.c - Worker threads for data-parallel CPU work
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sysdeps.h"
+#include "i965_thread_pool.h"
+
+static void
+thread_pool_run_jobs(struct i965_thread_pool *pool)
+{
+    unsigned int job;
+
+    while ((job = __atomic_fetch_add(&pool->next_job, 1, __ATOMIC_RELAXED)) <
+           pool->num_jobs)
+        pool->func(pool->arg, job);
+}
+
+static void *
+thread_pool_worker(void *data)
+{
+    struct i965_thread_pool * const pool = data;
+    unsigned int batch_id = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    for (;;) {
+        while (!pool->exiting && pool->batch_id == batch_id)
+            pthread_cond_wait(&pool->start_cond, &pool->mutex);
+
+        if (pool->exiting)
+            break;
+
+        batch_id = pool->batch_id;
+        pthread_mutex_unlock(&pool->mutex);
+
+        thread_pool_run_jobs(pool);
+
+        pthread_mutex_lock(&pool->mutex);
+
+        if (--pool->num_busy == 0)
+            pthread_cond_signal(&pool->done_cond);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+unsigned int
+i965_thread_pool_init(struct i965_thread_pool *pool, unsigned int num_threads)
+{
+    unsigned int i;
+
+    memset(pool, 0, sizeof(*pool));
+    pthread_mutex_init(&pool->run_mutex, NULL);
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    if (num_threads < 1)
+        num_threads = 1;
+    else if (num_threads > I965_THREAD_POOL_MAX_THREADS)
+        num_threads = I965_THREAD_POOL_MAX_THREADS;
+
+    pool->num_threads = 1;
+
+    for (i = 1; i < num_threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, thread_pool_worker, pool))
+            break;
+        pool->num_threads++;
+    }
+    return pool->num_threads;
+}
+
+void
+i965_thread_pool_terminate(struct i965_thread_pool *pool)
+{
+    unsigned int i;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->exiting = true;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (i = 1; i < pool->num_threads; i++)
+        pthread_join(pool->threads[i], NULL);
+    pool->num_threads = 1;
+
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->start_cond);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_mutex_destroy(&pool->run_mutex);
+}
+
+void
+i965_thread_pool_run(struct i965_thread_pool *pool, i965_thread_pool_func func,
+                     void *arg, unsigned int num_jobs)
+{
+    unsigned int i;
+
+    if (pool->num_threads < 2 || num_jobs < 2) {
+        for (i = 0; i < num_jobs; i++)
+            func(arg, i);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->run_mutex);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->func = func;
+    pool->arg = arg;
+    pool->num_jobs = num_jobs;
+    pool->next_job = 0;
+    pool->num_busy = pool->num_threads - 1;
+    pool->batch_id++;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    thread_pool_run_jobs(pool);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->num_busy > 0)
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+
+    pthread_mutex_unlock(&pool->run_mutex);
+}
+
+unsigned int
+i965_thread_pool_get_env_threads(const char *name, unsigned int default_value)
+{
+    const char *env_str;
+    int value;
+
+    if (!(env_str = getenv(name)))
+        return default_value;
+
+    value = atoi(env_str);
+    if (value < 1)
+        return 1;
+    if (value > I965_THREAD_POOL_MAX_THREADS)
+        return I965_THREAD_POOL_MAX_THREADS;
+    return value;
+}
@@ -0,0 +1,93 @@
+/*
+ * i965_thread_pool.h - Worker threads for data-parallel CPU work
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef I965_THREAD_POOL_H
+#define I965_THREAD_POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+/** Upper bound on the number of threads of a pool, caller included */
+#define I965_THREAD_POOL_MAX_THREADS    16
+
+typedef struct i965_thread_pool I965ThreadPool;
+
+/** Runs job number job_index (0 .. num_jobs - 1) of a batch */
+typedef void (*i965_thread_pool_func)(void *arg, unsigned int job_index);
+
+/**
+ * A fixed set of worker threads executing batches of independent jobs.
+ *
+ * i965_thread_pool_run() hands a batch to the workers and executes jobs
+ * itself until the batch is drained, so a pool of N threads has N - 1
+ * workers. A pool initialized with a single thread never spawns any and
+ * runs every batch in the calling thread. Batches from concurrent callers
+ * are serialized.
+ */
+struct i965_thread_pool {
+    unsigned int num_threads;
+    pthread_t threads[I965_THREAD_POOL_MAX_THREADS];
+
+    pthread_mutex_t run_mutex;          /* serializes batches */
+    pthread_mutex_t mutex;              /* protects the fields below */
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    unsigned int batch_id;
+    unsigned int num_busy;
+    bool exiting;
+
+    i965_thread_pool_func func;
+    void *arg;
+    unsigned int num_jobs;
+    unsigned int next_job;              /* atomic */
+};
+
+/**
+ * Starts a pool of num_threads threads, caller included. Returns the
+ * number of threads actually available, which is 1 if no worker could be
+ * created.
+ */
+unsigned int
+i965_thread_pool_init(struct i965_thread_pool *pool, unsigned int num_threads);
+
+/** Stops and joins the worker threads */
+void
+i965_thread_pool_terminate(struct i965_thread_pool *pool);
+
+/** Runs func(arg, i) for each i in 0 .. num_jobs - 1 and waits for all */
+void
+i965_thread_pool_run(struct i965_thread_pool *pool, i965_thread_pool_func func,
+                     void *arg, unsigned int num_jobs);
+
+/**
+ * Returns the thread count requested through the environment variable
+ * name, clamped to 1 .. I965_THREAD_POOL_MAX_THREADS, or default_value if
+ * it is unset
+ */
+unsigned int
+i965_thread_pool_get_env_threads(const char *name, unsigned int default_value);
+
+#endif /* I965_THREAD_POOL_H */
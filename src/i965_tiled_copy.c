@@ -0,0 +1,408 @@
+/*
+ * i965_tiled_copy.c - CPU copies between tiled surfaces and linear memory
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sysdeps.h"
+#include <i915_drm.h>
+#include "i965_tiled_copy.h"
+#include "i965_thread_pool.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* X tiles are 512B x 8 rows, Y tiles 128B x 32 rows of 16B columns */
+#define X_TILE_WIDTH            512
+#define X_TILE_HEIGHT           8
+#define Y_TILE_WIDTH            128
+#define Y_TILE_HEIGHT           32
+#define Y_TILE_COLUMN           16
+#define TILE_SIZE               4096
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+bool
+i965_tiled_copy_supported(unsigned int tiling, unsigned int swizzle,
+                          unsigned int pitch)
+{
+    switch (tiling) {
+    case I915_TILING_NONE:
+        return true;
+    case I915_TILING_X:
+        if (pitch % X_TILE_WIDTH)
+            return false;
+        break;
+    case I915_TILING_Y:
+        if (pitch % Y_TILE_WIDTH)
+            return false;
+        break;
+    default:
+        return false;
+    }
+
+    switch (swizzle) {
+    case I915_BIT_6_SWIZZLE_NONE:
+    case I915_BIT_6_SWIZZLE_9:
+    case I915_BIT_6_SWIZZLE_9_10:
+    case I915_BIT_6_SWIZZLE_9_11:
+    case I915_BIT_6_SWIZZLE_9_10_11:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static inline unsigned int
+swizzle_offset(unsigned int offset, unsigned int swizzle)
+{
+    unsigned int bit6;
+
+    switch (swizzle) {
+    case I915_BIT_6_SWIZZLE_9:
+        bit6 = offset >> 3;
+        break;
+    case I915_BIT_6_SWIZZLE_9_10:
+        bit6 = (offset >> 3) ^ (offset >> 4);
+        break;
+    case I915_BIT_6_SWIZZLE_9_11:
+        bit6 = (offset >> 3) ^ (offset >> 5);
+        break;
+    case I915_BIT_6_SWIZZLE_9_10_11:
+        bit6 = (offset >> 3) ^ (offset >> 4) ^ (offset >> 5);
+        break;
+    default:
+        return offset;
+    }
+    return offset ^ (bit6 & 64);
+}
+
+unsigned int
+i965_tiled_offset(const I965TiledSurface *surface, unsigned int x,
+                  unsigned int y)
+{
+    unsigned int offset;
+
+    switch (surface->tiling) {
+    case I915_TILING_X:
+        offset = ((y / X_TILE_HEIGHT) * (surface->pitch / X_TILE_WIDTH) +
+                  x / X_TILE_WIDTH) * TILE_SIZE +
+                 (y % X_TILE_HEIGHT) * X_TILE_WIDTH + x % X_TILE_WIDTH;
+        break;
+    case I915_TILING_Y:
+        offset = ((y / Y_TILE_HEIGHT) * (surface->pitch / Y_TILE_WIDTH) +
+                  x / Y_TILE_WIDTH) * TILE_SIZE +
+                 (x % Y_TILE_WIDTH / Y_TILE_COLUMN) * (Y_TILE_COLUMN * Y_TILE_HEIGHT) +
+                 (y % Y_TILE_HEIGHT) * Y_TILE_COLUMN + x % Y_TILE_COLUMN;
+        break;
+    default:
+        return y * surface->pitch + x;
+    }
+    return swizzle_offset(offset, surface->swizzle);
+}
+
+/* Number of bytes that stay contiguous in a row, from an aligned x */
+static inline unsigned int
+tiled_span_size(const I965TiledSurface *surface)
+{
+    switch (surface->tiling) {
+    case I915_TILING_X:
+        /* Bit 6 swizzling permutes 64B blocks */
+        return surface->swizzle == I915_BIT_6_SWIZZLE_NONE ? X_TILE_WIDTH : 64;
+    case I915_TILING_Y:
+        return Y_TILE_COLUMN;
+    default:
+        return 0;
+    }
+}
+
+static inline void
+span_copy(uint8_t *dst, const uint8_t *src, unsigned int n, bool stream)
+{
+#ifdef __SSE2__
+    /*
+     * Bypass the cache when whole lines are written in sequence, frames
+     * are too large to stay cached anyway
+     */
+    if (stream && ((uintptr_t)dst & 15) == 0) {
+        for (; n >= 16; n -= 16, dst += 16, src += 16)
+            _mm_stream_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+    }
+#endif
+    memcpy(dst, src, n);
+}
+
+static inline void
+span_deinterleave(uint8_t *dst_u, uint8_t *dst_v, const uint8_t *src,
+                  unsigned int n)
+{
+    unsigned int i;
+
+#ifdef __SSE2__
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+
+    for (; n >= 32; n -= 32, src += 32, dst_u += 16, dst_v += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i *)src);
+        const __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+
+        _mm_storeu_si128((__m128i *)dst_u,
+                         _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+        _mm_storeu_si128((__m128i *)dst_v,
+                         _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+
+    for (; n >= 16; n -= 16, src += 16, dst_u += 8, dst_v += 8) {
+        const __m128i a = _mm_loadu_si128((const __m128i *)src);
+
+        _mm_storel_epi64((__m128i *)dst_u, _mm_packus_epi16(_mm_and_si128(a, mask), mask));
+        _mm_storel_epi64((__m128i *)dst_v, _mm_packus_epi16(_mm_srli_epi16(a, 8), mask));
+    }
+#endif
+
+    for (i = 0; i < n / 2; i++) {
+        dst_u[i] = src[2 * i];
+        dst_v[i] = src[2 * i + 1];
+    }
+}
+
+static inline void
+span_interleave(uint8_t *dst, const uint8_t *src_u, const uint8_t *src_v,
+                unsigned int n)
+{
+    unsigned int i;
+
+#ifdef __SSE2__
+    for (; n >= 32; n -= 32, dst += 32, src_u += 16, src_v += 16) {
+        const __m128i u = _mm_loadu_si128((const __m128i *)src_u);
+        const __m128i v = _mm_loadu_si128((const __m128i *)src_v);
+
+        _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi8(u, v));
+        _mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi8(u, v));
+    }
+
+    for (; n >= 16; n -= 16, dst += 16, src_u += 8, src_v += 8) {
+        const __m128i u = _mm_loadl_epi64((const __m128i *)src_u);
+        const __m128i v = _mm_loadl_epi64((const __m128i *)src_v);
+
+        _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi8(u, v));
+    }
+#endif
+
+    for (i = 0; i < n / 2; i++) {
+        dst[2 * i] = src_u[i];
+        dst[2 * i + 1] = src_v[i];
+    }
+}
+
+static inline void
+tiled_span(int op, uint8_t *tiled, uint8_t *lin0, uint8_t *lin1,
+           unsigned int n, bool stream)
+{
+    switch (op) {
+    case I965_TILED_COPY_TO_LINEAR:
+        span_copy(lin0, tiled, n, stream);
+        break;
+    case I965_TILED_COPY_FROM_LINEAR:
+        span_copy(tiled, lin0, n, stream);
+        break;
+    case I965_TILED_COPY_DEINTERLEAVE:
+        span_deinterleave(lin0, lin1, tiled, n);
+        break;
+    case I965_TILED_COPY_INTERLEAVE:
+        span_interleave(tiled, lin0, lin1, n);
+        break;
+    }
+}
+
+/*
+ * Walks the rectangle in spans that are contiguous in the tiled layout,
+ * and applies the copy operation to each span. For the (de)interleaving
+ * operations, lin0/lin1 are the U/V planes and advance at half the rate
+ * of the tiled surface.
+ *
+ * Linear and X-tiled surfaces are walked row by row. Y-tiled surfaces are
+ * walked one 16B column of a tile row at a time, so that the tiled memory
+ * is accessed sequentially.
+ */
+static inline void
+tiled_walk(const I965TiledSurface *surface, int op,
+           unsigned int x, unsigned int y,
+           unsigned int width, unsigned int height,
+           uint8_t *lin0, unsigned int pitch0,
+           uint8_t *lin1, unsigned int pitch1)
+{
+    const unsigned int span_size = tiled_span_size(surface);
+    const int shift = (op == I965_TILED_COPY_DEINTERLEAVE || op == I965_TILED_COPY_INTERLEAVE);
+    unsigned int row, row_end, xi, n;
+
+    if (surface->tiling == I915_TILING_Y) {
+        I965TiledSurface linear_swizzle = *surface;
+
+        linear_swizzle.swizzle = I915_BIT_6_SWIZZLE_NONE;
+
+        for (row = y; row < y + height; row = row_end) {
+            row_end = MIN(y + height, row - row % Y_TILE_HEIGHT + Y_TILE_HEIGHT);
+
+            for (xi = 0; xi < width; xi += n) {
+                const unsigned int tx = x + xi;
+                const unsigned int start = i965_tiled_offset(&linear_swizzle, tx, row);
+                /* Bits 9 and up, hence the swizzle of bit 6, are the same
+                 * for the whole column */
+                const unsigned int flip = swizzle_offset(start, surface->swizzle) ^ start;
+                unsigned int ty;
+
+                n = MIN(width - xi, span_size - tx % span_size);
+
+                for (ty = row; ty < row_end; ty++) {
+                    tiled_span(op, surface->base + ((start + (ty - row) * Y_TILE_COLUMN) ^ flip),
+                               lin0 + (ty - y) * pitch0 + (xi >> shift),
+                               lin1 + (ty - y) * pitch1 + (xi >> shift),
+                               n, op == I965_TILED_COPY_FROM_LINEAR);
+                }
+            }
+        }
+    } else {
+        for (row = 0; row < height; row++) {
+            for (xi = 0; xi < width; xi += n) {
+                const unsigned int tx = x + xi;
+
+                n = width - xi;
+                if (span_size)
+                    n = MIN(n, span_size - tx % span_size);
+
+                tiled_span(op, surface->base + i965_tiled_offset(surface, tx, y + row),
+                           lin0 + (xi >> shift), lin1 + (xi >> shift), n, true);
+            }
+
+            lin0 += pitch0;
+            lin1 += pitch1;
+        }
+    }
+
+#ifdef __SSE2__
+    _mm_sfence();
+#endif
+}
+
+void
+i965_tiled_copy_to_linear(uint8_t *dst, unsigned int dst_pitch,
+                          const I965TiledSurface *src,
+                          unsigned int x, unsigned int y,
+                          unsigned int width, unsigned int height)
+{
+    tiled_walk(src, I965_TILED_COPY_TO_LINEAR, x, y, width, height,
+               dst, dst_pitch, dst, 0);
+}
+
+void
+i965_tiled_copy_from_linear(const I965TiledSurface *dst,
+                            unsigned int x, unsigned int y,
+                            const uint8_t *src, unsigned int src_pitch,
+                            unsigned int width, unsigned int height)
+{
+    tiled_walk(dst, I965_TILED_COPY_FROM_LINEAR, x, y, width, height,
+               (uint8_t *)src, src_pitch, (uint8_t *)src, 0);
+}
+
+void
+i965_tiled_copy_deinterleave_to_linear(uint8_t *dst_u, unsigned int dst_u_pitch,
+                                       uint8_t *dst_v, unsigned int dst_v_pitch,
+                                       const I965TiledSurface *src,
+                                       unsigned int x, unsigned int y,
+                                       unsigned int width, unsigned int height)
+{
+    assert(!(x & 1) && !(width & 1));
+
+    tiled_walk(src, I965_TILED_COPY_DEINTERLEAVE, x, y, width, height,
+               dst_u, dst_u_pitch, dst_v, dst_v_pitch);
+}
+
+void
+i965_tiled_copy_interleave_from_linear(const I965TiledSurface *dst,
+                                       unsigned int x, unsigned int y,
+                                       const uint8_t *src_u, unsigned int src_u_pitch,
+                                       const uint8_t *src_v, unsigned int src_v_pitch,
+                                       unsigned int width, unsigned int height)
+{
+    assert(!(x & 1) && !(width & 1));
+
+    tiled_walk(dst, I965_TILED_COPY_INTERLEAVE, x, y, width, height,
+               (uint8_t *)src_u, src_u_pitch, (uint8_t *)src_v, src_v_pitch);
+}
+
+static void
+tiled_copy_band(void *arg, unsigned int job_index)
+{
+    const struct i965_tiled_copy_rect * const rect = arg;
+    const unsigned int band_start = job_index * rect->band_height;
+    const unsigned int band_end = band_start + rect->band_height - rect->band_skew;
+    const unsigned int y = band_start ? band_start - rect->band_skew : 0;
+    const unsigned int height = MIN(rect->height, band_end) - y;
+
+    tiled_walk(rect->surface, rect->op, rect->x, rect->y + y,
+               rect->width, height,
+               rect->linear[0] + y * rect->linear_pitch[0], rect->linear_pitch[0],
+               rect->linear[1] + y * rect->linear_pitch[1], rect->linear_pitch[1]);
+}
+
+void
+i965_tiled_copy_execute(struct i965_thread_pool *pool,
+                        struct i965_tiled_copy_rect *rect)
+{
+    unsigned int num_bands = 1;
+
+    assert(rect->op == I965_TILED_COPY_TO_LINEAR ||
+           rect->op == I965_TILED_COPY_FROM_LINEAR ||
+           (!(rect->x & 1) && !(rect->width & 1)));
+
+    if (!rect->linear[1]) {
+        rect->linear[1] = rect->linear[0];
+        rect->linear_pitch[1] = 0;
+    }
+
+    if (pool && pool->num_threads > 1)
+        num_bands = MIN(pool->num_threads,
+                        rect->width * rect->height / I965_TILED_COPY_MIN_BAND_SIZE);
+
+    if (num_bands < 2) {
+        rect->band_height = rect->height;
+        rect->band_skew = 0;
+        tiled_copy_band(rect, 0);
+        return;
+    }
+
+    /*
+     * Bands cover whole tile rows, so that no tile is shared by two threads.
+     * They are counted from the tile row y falls into, the first band is
+     * shortened by the rows above y.
+     */
+    rect->band_skew = rect->y & (Y_TILE_HEIGHT - 1);
+    rect->band_height = (rect->height + num_bands - 1) / num_bands;
+    rect->band_height = (rect->band_height + Y_TILE_HEIGHT - 1) & ~(Y_TILE_HEIGHT - 1);
+    num_bands = (rect->band_skew + rect->height + rect->band_height - 1) / rect->band_height;
+
+    i965_thread_pool_run(pool, tiled_copy_band, rect, num_bands);
+}
@@ -0,0 +1,148 @@
+/*
+ * i965_tiled_copy.h - CPU copies between tiled surfaces and linear memory
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef I965_TILED_COPY_H
+#define I965_TILED_COPY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Copies are split into row bands of at least that many bytes */
+#define I965_TILED_COPY_MIN_BAND_SIZE   (512 * 1024)
+
+typedef struct i965_tiled_surface       I965TiledSurface;
+typedef struct i965_tiled_copy_rect     I965TiledCopyRect;
+
+struct i965_thread_pool;
+
+/** Copy operations of struct i965_tiled_copy_rect */
+enum {
+    I965_TILED_COPY_TO_LINEAR,
+    I965_TILED_COPY_FROM_LINEAR,
+    I965_TILED_COPY_DEINTERLEAVE,   /* UV rectangle to U and V planes */
+    I965_TILED_COPY_INTERLEAVE,     /* U and V planes to UV rectangle */
+};
+
+/**
+ * A CPU mapping of a (possibly) tiled buffer object. The tiling and
+ * swizzle modes are the I915_TILING_* and I915_BIT_6_SWIZZLE_* values
+ * returned by dri_bo_get_tiling().
+ */
+struct i965_tiled_surface {
+    uint8_t *base;
+    unsigned int pitch;
+    unsigned int tiling;
+    unsigned int swizzle;
+};
+
+/**
+ * Checks whether the surface layout can be handled on the CPU. Swizzle
+ * modes that depend on the physical address (bit 17) cannot, and such
+ * buffers must be accessed through a GTT mapping instead.
+ */
+bool
+i965_tiled_copy_supported(unsigned int tiling, unsigned int swizzle,
+                          unsigned int pitch);
+
+/** Returns the byte offset of pixel byte (x, y) in the surface */
+unsigned int
+i965_tiled_offset(const I965TiledSurface *surface, unsigned int x,
+                  unsigned int y);
+
+/**
+ * Copies a width x height bytes rectangle at (x, y) of the surface to
+ * linear memory
+ */
+void
+i965_tiled_copy_to_linear(uint8_t *dst, unsigned int dst_pitch,
+                          const I965TiledSurface *src,
+                          unsigned int x, unsigned int y,
+                          unsigned int width, unsigned int height);
+
+/**
+ * Copies a width x height bytes rectangle from linear memory to (x, y) of
+ * the surface
+ */
+void
+i965_tiled_copy_from_linear(const I965TiledSurface *dst,
+                            unsigned int x, unsigned int y,
+                            const uint8_t *src, unsigned int src_pitch,
+                            unsigned int width, unsigned int height);
+
+/**
+ * Splits an interleaved UV rectangle of the surface (NV12 chroma) into
+ * separate linear U and V planes (I420/YV12 chroma). x and width are in
+ * bytes of the interleaved plane and must be even.
+ */
+void
+i965_tiled_copy_deinterleave_to_linear(uint8_t *dst_u, unsigned int dst_u_pitch,
+                                       uint8_t *dst_v, unsigned int dst_v_pitch,
+                                       const I965TiledSurface *src,
+                                       unsigned int x, unsigned int y,
+                                       unsigned int width, unsigned int height);
+
+/**
+ * Merges linear U and V planes into an interleaved UV rectangle of the
+ * surface. x and width are in bytes of the interleaved plane and must be
+ * even.
+ */
+void
+i965_tiled_copy_interleave_from_linear(const I965TiledSurface *dst,
+                                       unsigned int x, unsigned int y,
+                                       const uint8_t *src_u, unsigned int src_u_pitch,
+                                       const uint8_t *src_v, unsigned int src_v_pitch,
+                                       unsigned int width, unsigned int height);
+
+/**
+ * A copy between a width x height bytes rectangle at (x, y) of the
+ * surface and linear memory. linear[1] is only used by the (de)interleave
+ * operations, which take the U plane in linear[0] and the V plane in
+ * linear[1].
+ */
+struct i965_tiled_copy_rect {
+    int op;
+    const I965TiledSurface *surface;
+    unsigned int x;
+    unsigned int y;
+    unsigned int width;
+    unsigned int height;
+    uint8_t *linear[2];
+    unsigned int linear_pitch[2];
+
+    /* private */
+    unsigned int band_height;
+    unsigned int band_skew;     /* rows of the first tile row above y */
+};
+
+/**
+ * Performs the copy, split into row bands over the threads of the pool
+ * if it is large enough. pool can be NULL.
+ */
+void
+i965_tiled_copy_execute(struct i965_thread_pool *pool,
+                        struct i965_tiled_copy_rect *rect);
+
+#endif /* I965_TILED_COPY_H */
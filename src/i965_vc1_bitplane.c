@@ -0,0 +1,122 @@
+/*
+ * i965_vc1_bitplane.c - VC-1 bitplane conversion
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sysdeps.h"
+#include "i965_vc1_bitplane.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * A row starting on an even macroblock is the source bytes with their
+ * nibbles swapped. A row starting on an odd macroblock takes the low
+ * nibble of a source byte and the high nibble of the next one.
+ */
+static void
+bitplane_convert_row_even(uint8_t *dst, const uint8_t *src, int n)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i low = _mm_set1_epi8(0x0f);
+
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+
+        _mm_storeu_si128((__m128i *)(dst + i),
+                         _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 4), low),
+                                      _mm_slli_epi16(_mm_and_si128(v, low), 4)));
+    }
+#endif
+
+    for (; i < n; i++)
+        dst[i] = (src[i] >> 4) | (src[i] << 4);
+}
+
+static void
+bitplane_convert_row_odd(uint8_t *dst, const uint8_t *src, int n)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i low = _mm_set1_epi8(0x0f);
+
+    for (; i + 16 <= n; i += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+        const __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 1));
+
+        _mm_storeu_si128((__m128i *)(dst + i),
+                         _mm_or_si128(_mm_and_si128(a, low),
+                                      _mm_andnot_si128(low, b)));
+    }
+#endif
+
+    for (; i < n; i++)
+        dst[i] = (src[i] & 0x0f) | (src[i + 1] & 0xf0);
+}
+
+void
+i965_vc1_bitplane_convert(uint8_t *dst, int dst_pitch, const uint8_t *src,
+                          int width_in_mbs, int height_in_mbs)
+{
+    const int pairs = width_in_mbs / 2;
+    int h, mb;
+
+    for (h = 0, mb = 0; h < height_in_mbs; h++, mb += width_in_mbs) {
+        /* Only the full bytes, the last macroblock of an odd row is the
+           only one of its byte */
+        if (mb & 1)
+            bitplane_convert_row_odd(dst, src + mb / 2, pairs);
+        else
+            bitplane_convert_row_even(dst, src + mb / 2, pairs);
+
+        if (width_in_mbs & 1) {
+            const int last = mb + width_in_mbs - 1;
+
+            dst[pairs] = (src[last / 2] >> ((last & 1) ? 0 : 4)) & 0x0f;
+        }
+
+        dst += dst_pitch;
+    }
+}
+
+void
+i965_vc1_bitplane_fill_skipped(uint8_t *dst, int dst_pitch,
+                               int width_in_mbs, int height_in_mbs)
+{
+    const int pairs = width_in_mbs / 2;
+    int h;
+
+    for (h = 0; h < height_in_mbs; h++) {
+        memset(dst, I965_VC1_BITPLANE_SKIPPED * 0x11, pairs);
+
+        if (width_in_mbs & 1)
+            dst[pairs] = I965_VC1_BITPLANE_SKIPPED;
+
+        dst += dst_pitch;
+    }
+}
@@ -0,0 +1,50 @@
+/*
+ * i965_vc1_bitplane.h - VC-1 bitplane conversion
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef I965_VC1_BITPLANE_H
+#define I965_VC1_BITPLANE_H
+
+#include <stdint.h>
+
+/* Bitplane value of the macroblocks of a skipped picture */
+#define I965_VC1_BITPLANE_SKIPPED       0x2
+
+/**
+ * Converts the VA bitplane buffer, one nibble per macroblock in raster
+ * order with the first macroblock in the high nibble, to the MFX layout:
+ * rows of dst_pitch bytes holding two macroblocks per byte, the first one
+ * in the low nibble. The unused high nibble of an odd row is cleared.
+ */
+void
+i965_vc1_bitplane_convert(uint8_t *dst, int dst_pitch, const uint8_t *src,
+                          int width_in_mbs, int height_in_mbs);
+
+/** Fills the bitplane of a skipped picture, in the MFX layout */
+void
+i965_vc1_bitplane_fill_skipped(uint8_t *dst, int dst_pitch,
+                               int width_in_mbs, int height_in_mbs);
+
+#endif /* I965_VC1_BITPLANE_H */
@@ -27,12 +27,59 @@
 
 #include "sysdeps.h"
 #include <math.h>
+#include <string.h>
+#include <pthread.h>
 #include <va/va.h>
 #include "i965_vpp_avs.h"
 
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define AVS_X86 1
+#include <immintrin.h>
+#endif
+
+/** Number of coefficient tables kept for all contexts of the process */
+#define AVS_CACHE_SIZE 32
+
+/** Number of configurations whose usual ratios are precomputed */
+#define AVS_CACHE_MAX_CONFIGS 8
+
 typedef void (*AVSGenCoeffsFunc)(float *coeffs, int num_coeffs, int phase,
                                  int num_phases, float f);
 
+/* Coefficients of all phases for one axis, normalized */
+typedef struct avs_coeffs_table {
+    const AVSConfig *config;
+    uint32_t flags;
+    float scale;
+    /* Whether the table is in range for either axis */
+    bool valid_h;
+    bool valid_v;
+    unsigned int last_use;
+    float y_k[AVS_MAX_PHASES + 1][AVS_MAX_LUMA_COEFFS];
+    float uv_k[AVS_MAX_PHASES + 1][AVS_MAX_CHROMA_COEFFS];
+} AVSCoeffsTable;
+
+static struct {
+    pthread_mutex_t mutex;
+    AVSCoeffsTable tables[AVS_CACHE_SIZE];
+    unsigned int num_tables;
+    unsigned int clock;
+    unsigned long hits;
+    unsigned long misses;
+    const AVSConfig *preloaded[AVS_CACHE_MAX_CONFIGS];
+    unsigned int num_preloaded;
+} avs_cache = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/* Ratios of usual scaling ladders, e.g. 1080p to 720p, 540p and 480p */
+static const struct {
+    unsigned int num;
+    unsigned int den;
+} avs_common_ratios[] = {
+    { 1, 1 }, { 3, 4 }, { 2, 3 }, { 1, 2 }, { 4, 9 }, { 1, 3 }, { 1, 4 },
+};
+
 /* Initializes all coefficients to zero */
 static void
 avs_init_coeffs(float *coeffs, int num_coeffs)
@@ -113,20 +160,6 @@ avs_normalize_coeffs_1(float *coeffs, int num_coeffs, float epsilon)
     }
 }
 
-/* Normalize all coefficients so that their sum yields 1.0f */
-static void
-avs_normalize_coeffs(AVSCoeffs *coeffs, const AVSConfig *config)
-{
-    avs_normalize_coeffs_1(coeffs->y_k_h, config->num_luma_coeffs,
-                           config->coeff_epsilon);
-    avs_normalize_coeffs_1(coeffs->y_k_v, config->num_luma_coeffs,
-                           config->coeff_epsilon);
-    avs_normalize_coeffs_1(coeffs->uv_k_h, config->num_chroma_coeffs,
-                           config->coeff_epsilon);
-    avs_normalize_coeffs_1(coeffs->uv_k_v, config->num_chroma_coeffs,
-                           config->coeff_epsilon);
-}
-
 /* Validate coefficients for one sample/direction */
 static bool
 avs_validate_coeffs_1(float *coeffs, int num_coeffs, const float *min_coeffs,
@@ -141,23 +174,6 @@ avs_validate_coeffs_1(float *coeffs, int num_coeffs, const float *min_coeffs,
     return true;
 }
 
-/* Validate coefficients wrt. the supplied range in config */
-static bool
-avs_validate_coeffs(AVSCoeffs *coeffs, const AVSConfig *config)
-{
-    const AVSCoeffs * const min_coeffs = &config->coeff_range.lower_bound;
-    const AVSCoeffs * const max_coeffs = &config->coeff_range.upper_bound;
-
-    return avs_validate_coeffs_1(coeffs->y_k_h, config->num_luma_coeffs,
-                                 min_coeffs->y_k_h, max_coeffs->y_k_h) &&
-           avs_validate_coeffs_1(coeffs->y_k_v, config->num_luma_coeffs,
-                                 min_coeffs->y_k_v, max_coeffs->y_k_v) &&
-           avs_validate_coeffs_1(coeffs->uv_k_h, config->num_chroma_coeffs,
-                                 min_coeffs->uv_k_h, max_coeffs->uv_k_h) &&
-           avs_validate_coeffs_1(coeffs->uv_k_v, config->num_chroma_coeffs,
-                                 min_coeffs->uv_k_v, max_coeffs->uv_k_v);
-}
-
 /* Generate coefficients for default quality (bilinear) */
 static void
 avs_gen_coeffs_linear(float *coeffs, int num_coeffs, int phase, int num_phases,
@@ -172,9 +188,9 @@ avs_gen_coeffs_linear(float *coeffs, int num_coeffs, int phase, int num_phases,
 }
 
 /* Generate coefficients for high quality (lanczos) */
-static void
-avs_gen_coeffs_lanczos(float *coeffs, int num_coeffs, int phase, int num_phases,
-                       float f)
+void
+avs_gen_coeffs_lanczos_c(float *coeffs, int num_coeffs, int phase,
+                         int num_phases, float f)
 {
     const int c = num_coeffs / 2 - 1;
     const int l = num_coeffs > 4 ? 3 : 2;
@@ -187,30 +203,258 @@ avs_gen_coeffs_lanczos(float *coeffs, int num_coeffs, int phase, int num_phases,
         coeffs[i] = avs_kernel_lanczos((i - (c + p)) * f, l);
 }
 
-/* Generate coefficients with the supplied scaler */
+#ifdef AVS_X86
+
+/* sin(pi * x), from the Taylor series of sin(pi * r) for |r| <= 1/2 */
+__attribute__((target("sse2")))
+static inline __m128
+avs_sin_pi_sse2(__m128 x)
+{
+    const __m128i n = _mm_cvtps_epi32(x);
+    const __m128 r = _mm_sub_ps(x, _mm_cvtepi32_ps(n));
+    const __m128 r2 = _mm_mul_ps(r, r);
+    __m128 s;
+
+    s = _mm_set1_ps(4.663028058e-04f);
+    s = _mm_add_ps(_mm_mul_ps(s, r2), _mm_set1_ps(-7.370430946e-03f));
+    s = _mm_add_ps(_mm_mul_ps(s, r2), _mm_set1_ps(8.214588661e-02f));
+    s = _mm_add_ps(_mm_mul_ps(s, r2), _mm_set1_ps(-5.992645293e-01f));
+    s = _mm_add_ps(_mm_mul_ps(s, r2), _mm_set1_ps(2.550164040e+00f));
+    s = _mm_add_ps(_mm_mul_ps(s, r2), _mm_set1_ps(-5.167712780e+00f));
+    s = _mm_add_ps(_mm_mul_ps(s, r2), _mm_set1_ps(3.141592654e+00f));
+    s = _mm_mul_ps(s, r);
+
+    /* sin(pi * (n + r)) = (-1)^n * sin(pi * r) */
+    return _mm_xor_ps(s, _mm_castsi128_ps(_mm_slli_epi32(n, 31)));
+}
+
+/* Four taps of the lanczos kernel at x, x + f, x + 2f and x + 3f */
+__attribute__((target("sse2")))
+static inline __m128
+avs_kernel_lanczos_sse2(__m128 x, float a)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 abs_x = _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+    const __m128 is_zero = _mm_cmpeq_ps(x, zero);
+    __m128 num, den, k;
+
+    /* sinc(x) * sinc(x / a) = a * sin(pi x) * sin(pi x / a) / (pi x)^2 */
+    num = _mm_mul_ps(avs_sin_pi_sse2(x),
+                     avs_sin_pi_sse2(_mm_mul_ps(x, _mm_set1_ps(1.0f / a))));
+    den = _mm_mul_ps(_mm_mul_ps(x, x), _mm_set1_ps(M_PI * M_PI / a));
+    den = _mm_or_ps(_mm_and_ps(is_zero, one), _mm_andnot_ps(is_zero, den));
+    k = _mm_div_ps(num, den);
+    k = _mm_or_ps(_mm_and_ps(is_zero, one), _mm_andnot_ps(is_zero, k));
+
+    return _mm_and_ps(k, _mm_cmplt_ps(abs_x, _mm_set1_ps(a)));
+}
+
+__attribute__((target("sse2")))
+static void
+avs_gen_coeffs_lanczos_sse2(float *coeffs, int num_coeffs, int phase,
+                            int num_phases, float f)
+{
+    const int c = num_coeffs / 2 - 1;
+    const int l = num_coeffs > 4 ? 3 : 2;
+    const float p = (float)phase / (num_phases * 2);
+    __m128 x;
+    int i;
+
+    if (num_coeffs & 3) {
+        avs_gen_coeffs_lanczos_c(coeffs, num_coeffs, phase, num_phases, f);
+        return;
+    }
+
+    if (f > 1.0f)
+        f = 1.0f;
+
+    x = _mm_mul_ps(_mm_sub_ps(_mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f),
+                              _mm_set1_ps(c + p)),
+                   _mm_set1_ps(f));
+    for (i = 0; i < num_coeffs; i += 4) {
+        _mm_storeu_ps(&coeffs[i], avs_kernel_lanczos_sse2(x, l));
+        x = _mm_add_ps(x, _mm_set1_ps(4.0f * f));
+    }
+}
+
+#endif
+
+static AVSGenCoeffsFunc
+avs_get_lanczos_func(void)
+{
+    static AVSGenCoeffsFunc lanczos_func;
+    AVSGenCoeffsFunc func = __atomic_load_n(&lanczos_func, __ATOMIC_RELAXED);
+
+    if (func)
+        return func;
+
+    func = avs_gen_coeffs_lanczos_c;
+#ifdef AVS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        func = avs_gen_coeffs_lanczos_sse2;
+#endif
+
+    __atomic_store_n(&lanczos_func, func, __ATOMIC_RELAXED);
+    return func;
+}
+
+void
+avs_gen_coeffs_lanczos(float *coeffs, int num_coeffs, int phase,
+                       int num_phases, float f)
+{
+    avs_get_lanczos_func()(coeffs, num_coeffs, phase, num_phases, f);
+}
+
+/* Generate coefficients of all phases for one axis */
+static void
+avs_gen_coeffs_table(AVSCoeffsTable *table, AVSGenCoeffsFunc gen_coeffs)
+{
+    const AVSConfig * const config = table->config;
+    const AVSCoeffs * const min_coeffs = &config->coeff_range.lower_bound;
+    const AVSCoeffs * const max_coeffs = &config->coeff_range.upper_bound;
+    int i;
+
+    table->valid_h = true;
+    table->valid_v = true;
+
+    for (i = 0; i <= config->num_phases; i++) {
+        float * const y_k = table->y_k[i];
+        float * const uv_k = table->uv_k[i];
+
+        gen_coeffs(y_k, config->num_luma_coeffs,
+                   i, config->num_phases, table->scale);
+        gen_coeffs(uv_k, config->num_chroma_coeffs,
+                   i, config->num_phases, table->scale);
+
+        avs_normalize_coeffs_1(y_k, config->num_luma_coeffs,
+                               config->coeff_epsilon);
+        avs_normalize_coeffs_1(uv_k, config->num_chroma_coeffs,
+                               config->coeff_epsilon);
+
+        table->valid_h = table->valid_h &&
+                         avs_validate_coeffs_1(y_k, config->num_luma_coeffs,
+                                               min_coeffs->y_k_h, max_coeffs->y_k_h) &&
+                         avs_validate_coeffs_1(uv_k, config->num_chroma_coeffs,
+                                               min_coeffs->uv_k_h, max_coeffs->uv_k_h);
+        table->valid_v = table->valid_v &&
+                         avs_validate_coeffs_1(y_k, config->num_luma_coeffs,
+                                               min_coeffs->y_k_v, max_coeffs->y_k_v) &&
+                         avs_validate_coeffs_1(uv_k, config->num_chroma_coeffs,
+                                               min_coeffs->uv_k_v, max_coeffs->uv_k_v);
+    }
+}
+
+/*
+ * Looks up the table for the supplied scaling factor, and generates it in
+ * place of the least recently used one on a miss. The cache mutex must be
+ * held, the table stays valid until it is released. Only lookups with
+ * count set go into the hit/miss stats.
+ */
+static const AVSCoeffsTable *
+avs_cache_get_table(const AVSConfig *config, uint32_t flags, float f,
+                    bool count)
+{
+    AVSCoeffsTable *table, *lru = NULL;
+    AVSGenCoeffsFunc gen_coeffs;
+    unsigned int i;
+
+    /* Tables only depend on the factor when it is actually used */
+    if (flags == VA_FILTER_SCALING_HQ) {
+        gen_coeffs = avs_get_lanczos_func();
+        if (f > 1.0f)
+            f = 1.0f;
+    } else {
+        gen_coeffs = avs_gen_coeffs_linear;
+        f = 0.0f;
+    }
+
+    for (i = 0; i < avs_cache.num_tables; i++) {
+        table = &avs_cache.tables[i];
+
+        if (table->config == config && table->flags == flags &&
+            table->scale == f) {
+            table->last_use = ++avs_cache.clock;
+            if (count)
+                avs_cache.hits++;
+            return table;
+        }
+
+        if (!lru || table->last_use < lru->last_use)
+            lru = table;
+    }
+
+    if (avs_cache.num_tables < AVS_CACHE_SIZE)
+        lru = &avs_cache.tables[avs_cache.num_tables++];
+
+    lru->config = config;
+    lru->flags = flags;
+    lru->scale = f;
+    lru->last_use = ++avs_cache.clock;
+    avs_gen_coeffs_table(lru, gen_coeffs);
+    if (count)
+        avs_cache.misses++;
+
+    return lru;
+}
+
+/*
+ * Generates the tables of the usual ratios on the first high quality use
+ * of a configuration. The cache mutex must be held.
+ */
+static void
+avs_cache_preload(const AVSConfig *config)
+{
+    unsigned int i;
+
+    for (i = 0; i < avs_cache.num_preloaded; i++) {
+        if (avs_cache.preloaded[i] == config)
+            return;
+    }
+
+    if (avs_cache.num_preloaded == AVS_CACHE_MAX_CONFIGS)
+        return;
+
+    avs_cache.preloaded[avs_cache.num_preloaded++] = config;
+
+    for (i = 0; i < sizeof(avs_common_ratios) / sizeof(avs_common_ratios[0]); i++)
+        avs_cache_get_table(config, VA_FILTER_SCALING_HQ,
+                            (float)avs_common_ratios[i].num / avs_common_ratios[i].den,
+                            false);
+}
+
+/* Generate coefficients of both axes through the cache */
 static bool
-avs_gen_coeffs(AVSState *avs, float sx, float sy, AVSGenCoeffsFunc gen_coeffs)
+avs_gen_coeffs(AVSState *avs, float sx, float sy, uint32_t flags)
 {
     const AVSConfig * const config = avs->config;
+    const AVSCoeffsTable *table_x, *table_y;
+    bool valid;
     int i;
 
-    for (i = 0; i <= config->num_phases; i++) {
-        AVSCoeffs * const coeffs = &avs->coeffs[i];
-
-        gen_coeffs(coeffs->y_k_h, config->num_luma_coeffs,
-                   i, config->num_phases, sx);
-        gen_coeffs(coeffs->uv_k_h, config->num_chroma_coeffs,
-                   i, config->num_phases, sx);
-        gen_coeffs(coeffs->y_k_v, config->num_luma_coeffs,
-                   i, config->num_phases, sy);
-        gen_coeffs(coeffs->uv_k_v, config->num_chroma_coeffs,
-                   i, config->num_phases, sy);
-
-        avs_normalize_coeffs(coeffs, config);
-        if (!avs_validate_coeffs(coeffs, config))
-            return false;
+    pthread_mutex_lock(&avs_cache.mutex);
+
+    if (flags == VA_FILTER_SCALING_HQ)
+        avs_cache_preload(config);
+
+    table_x = avs_cache_get_table(config, flags, sx, true);
+    valid = table_x->valid_h;
+    for (i = 0; valid && i <= config->num_phases; i++) {
+        memcpy(avs->coeffs[i].y_k_h, table_x->y_k[i], sizeof(table_x->y_k[i]));
+        memcpy(avs->coeffs[i].uv_k_h, table_x->uv_k[i], sizeof(table_x->uv_k[i]));
     }
-    return true;
+
+    table_y = avs_cache_get_table(config, flags, sy, true);
+    valid = valid && table_y->valid_v;
+    for (i = 0; valid && i <= config->num_phases; i++) {
+        memcpy(avs->coeffs[i].y_k_v, table_y->y_k[i], sizeof(table_y->y_k[i]));
+        memcpy(avs->coeffs[i].uv_k_v, table_y->uv_k[i], sizeof(table_y->uv_k[i]));
+    }
+
+    pthread_mutex_unlock(&avs_cache.mutex);
+
+    return valid;
 }
 
 /* Initializes AVS state with the supplied configuration */
@@ -223,6 +467,16 @@ avs_init_state(AVSState *avs, const AVSConfig *config)
     avs->scale_y = 0.0f;
 }
 
+/* Returns the hits and misses of the process-wide coefficient cache */
+void
+avs_get_cache_stats(unsigned long *hits, unsigned long *misses)
+{
+    pthread_mutex_lock(&avs_cache.mutex);
+    *hits = avs_cache.hits;
+    *misses = avs_cache.misses;
+    pthread_mutex_unlock(&avs_cache.mutex);
+}
+
 /* Checks whether the AVS scaling parameters changed */
 static inline bool
 avs_params_changed(AVSState *avs, float sx, float sy, uint32_t flags)
@@ -244,21 +498,11 @@ avs_params_changed(AVSState *avs, float sx, float sy, uint32_t flags)
 bool
 avs_update_coefficients(AVSState *avs, float sx, float sy, uint32_t flags)
 {
-    AVSGenCoeffsFunc gen_coeffs;
-
     flags &= VA_FILTER_SCALING_MASK;
     if (!avs_params_changed(avs, sx, sy, flags))
         return true;
 
-    switch (flags) {
-    case VA_FILTER_SCALING_HQ:
-        gen_coeffs = avs_gen_coeffs_lanczos;
-        break;
-    default:
-        gen_coeffs = avs_gen_coeffs_linear;
-        break;
-    }
-    if (!avs_gen_coeffs(avs, sx, sy, gen_coeffs)) {
+    if (!avs_gen_coeffs(avs, sx, sy, flags)) {
         assert(0 && "invalid set of coefficients generated");
         return false;
     }
@@ -103,6 +103,20 @@ avs_init_state(AVSState *avs, const AVSConfig *config);
 bool
 avs_update_coefficients(AVSState *avs, float sx, float sy, uint32_t flags);
 
+/** Returns the hits and misses of the coefficient tables cache */
+void
+avs_get_cache_stats(unsigned long *hits, unsigned long *misses);
+
+/** Generates lanczos coefficients for one phase (best implementation) */
+void
+avs_gen_coeffs_lanczos(float *coeffs, int num_coeffs, int phase,
+                       int num_phases, float f);
+
+/** Generates lanczos coefficients for one phase (reference implementation) */
+void
+avs_gen_coeffs_lanczos_c(float *coeffs, int num_coeffs, int phase,
+                         int num_phases, float f);
+
 /** Checks whether AVS is needed, e.g. if high-quality scaling is requested */
 static inline bool
 avs_is_needed(uint32_t flags)
@@ -28,10 +28,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "intel_batchbuffer.h"
+#include "i965_defines.h"
 
 #define MAX_BATCH_SIZE      0x400000
+#define SEGMENT_MIN_SIZE    0x1000
 
 
 #define LOCAL_I915_EXEC_BSD_MASK        (3<<13)
@@ -39,10 +44,151 @@
 #define LOCAL_I915_EXEC_BSD_RING0       (1<<13)
 #define LOCAL_I915_EXEC_BSD_RING1       (2<<13)
 
+/* Largest cache flush of intel_batchbuffer_emit_mi_flush(), in bytes */
+#define BATCH_FLUSH_SIZE                (12 * 4)
+
+/* A batch flushed with deferred submission, not executed yet */
+struct intel_submit_entry {
+    struct intel_batchbuffer *batch;
+    int flag;
+    dri_bo **bos;               /* links, then the last buffer */
+    unsigned int num_bos;
+    unsigned int head_used;
+    unsigned int end_offset;    /* MI_BATCH_BUFFER_END in the last buffer */
+};
+
+/*
+ * Batches of several contexts held back, in flush order, so that runs of
+ * batches for the same ring go to the kernel in a single execbuffer. A
+ * thread submits them once the oldest one has waited delay_us.
+ */
+struct intel_submit_queue {
+    struct intel_driver_data *intel;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t thread;
+    bool exiting;
+    unsigned int threshold;
+    unsigned int delay_us;
+    struct timespec deadline;
+    struct intel_submit_entry entries[INTEL_SUBMIT_QUEUE_MAX];
+    unsigned int num_entries;
+};
+
+static void
+intel_batchbuffer_drop_bo(struct intel_batchbuffer *batch, dri_bo *bo)
+{
+    if (batch->persistent_map)
+        dri_bo_unmap(bo);
+
+    dri_bo_unreference(bo);
+}
+
+/*
+ * Takes the oldest buffer of the ring which is idle and large enough.
+ * Only once the ring is full and every buffer is still in flight, it
+ * waits for the oldest one instead of allocating another buffer.
+ */
+static dri_bo *
+intel_batchbuffer_get_bo(struct intel_batchbuffer *batch, unsigned int size)
+{
+    unsigned int i;
+    dri_bo *bo;
+
+    for (i = 0; i < batch->num_ring; i++) {
+        if (batch->ring[i]->size >= size && !drm_intel_bo_busy(batch->ring[i]))
+            break;
+    }
+
+    if (i == batch->num_ring && batch->num_ring == batch->ring_size) {
+        for (i = 0; i < batch->num_ring; i++) {
+            if (batch->ring[i]->size >= size)
+                break;
+        }
+
+        if (i < batch->num_ring) {
+            drm_intel_bo_wait_rendering(batch->ring[i]);
+            batch->bo_stalls++;
+        }
+    }
+
+    if (i < batch->num_ring) {
+        bo = batch->ring[i];
+        batch->num_ring--;
+        memmove(&batch->ring[i], &batch->ring[i + 1],
+                (batch->num_ring - i) * sizeof(batch->ring[0]));
+        batch->bo_reuses++;
+
+        /* libdrm keeps the relocations of a buffer until it is freed */
+        drm_intel_gem_bo_clear_relocs(bo, 0);
+
+        if (!batch->persistent_map)
+            dri_bo_map(bo, 1);
+    } else {
+        bo = dri_bo_alloc(batch->intel->bufmgr,
+                          "batch buffer",
+                          size,
+                          0x1000);
+        assert(bo);
+        dri_bo_map(bo, 1);
+        batch->bo_allocs++;
+    }
+
+    assert(bo->virtual);
+
+    return bo;
+}
+
+/* Queues a submitted buffer for reuse, the oldest one goes if the ring is full */
+static void
+intel_batchbuffer_put_bo(struct intel_batchbuffer *batch, dri_bo *bo)
+{
+    if (batch->num_ring == batch->ring_size) {
+        intel_batchbuffer_drop_bo(batch, batch->ring[0]);
+        batch->num_ring--;
+        memmove(&batch->ring[0], &batch->ring[1],
+                batch->num_ring * sizeof(batch->ring[0]));
+    }
+
+    batch->ring[batch->num_ring++] = bo;
+}
+
+/* Hands all buffers of a submitted batch over to the ring */
+static void
+intel_batchbuffer_release_links(struct intel_batchbuffer *batch)
+{
+    unsigned int i;
+
+    for (i = 0; i < batch->num_links; i++)
+        intel_batchbuffer_put_bo(batch, batch->links[i]);
+
+    intel_batchbuffer_put_bo(batch, batch->buffer);
+    batch->buffer = NULL;
+    batch->num_links = 0;
+}
+
+/*
+ * The submit queue may hand buffers back to the ring of a deferred batch
+ * from any thread. Each ring has a lock of its own, so that contexts don't
+ * contend for the queue lock whenever they start a new buffer.
+ */
+static void
+intel_batchbuffer_lock_ring(struct intel_batchbuffer *batch)
+{
+    if (batch->defer_submit)
+        pthread_mutex_lock(&batch->ring_mutex);
+}
+
+static void
+intel_batchbuffer_unlock_ring(struct intel_batchbuffer *batch)
+{
+    if (batch->defer_submit)
+        pthread_mutex_unlock(&batch->ring_mutex);
+}
+
 static void
 intel_batchbuffer_reset(struct intel_batchbuffer *batch, int buffer_size)
 {
-    struct intel_driver_data *intel = batch->intel;
     int batch_size = buffer_size;
     int ring_flag;
 
@@ -53,18 +199,20 @@ intel_batchbuffer_reset(struct intel_batchbuffer *batch, int buffer_size)
            ring_flag == I915_EXEC_BSD ||
            ring_flag == I915_EXEC_VEBOX);
 
-    dri_bo_unreference(batch->buffer);
-    batch->buffer = dri_bo_alloc(intel->bufmgr,
-                                 "batch buffer",
-                                 batch_size,
-                                 0x1000);
-    assert(batch->buffer);
-    dri_bo_map(batch->buffer, 1);
-    assert(batch->buffer->virtual);
+    assert(!batch->buffer);
+    intel_batchbuffer_lock_ring(batch);
+    batch->buffer = intel_batchbuffer_get_bo(batch, batch_size);
+    intel_batchbuffer_unlock_ring(batch);
     batch->map = batch->buffer->virtual;
     batch->size = batch_size;
     batch->ptr = batch->map;
+    batch->emit_start = batch->ptr;
+    batch->emit_total = 0;
     batch->atomic = 0;
+    batch->num_relocs = 0;
+    batch->relocs_dropped = 0;
+    batch->num_state_shadow = 0;
+    batch->last_reloc = NULL;
 }
 
 static unsigned int
@@ -73,7 +221,6 @@ intel_batchbuffer_space(struct intel_batchbuffer *batch)
     return (batch->size - BATCH_RESERVED) - (batch->ptr - batch->map);
 }
 
-
 struct intel_batchbuffer *
 intel_batchbuffer_new(struct intel_driver_data *intel, int flag, int buffer_size)
 {
@@ -99,6 +246,8 @@ intel_batchbuffer_new(struct intel_driver_data *intel, int flag, int buffer_size
     batch->intel = intel;
     batch->flag = flag;
     batch->run = drm_intel_bo_mrb_exec;
+    batch->ring_size = intel->batch_ring_size ? intel->batch_ring_size : INTEL_BATCH_RING_SIZE;
+    batch->persistent_map = intel->has_llc;
 
     if (IS_GEN6(intel->device_info) &&
         flag == I915_EXEC_RENDER)
@@ -114,27 +263,360 @@ intel_batchbuffer_new(struct intel_driver_data *intel, int flag, int buffer_size
     return batch;
 }
 
+/*
+ * A segment is a batch in host memory only. Commands are built into it
+ * apart, e.g. from another thread, then copied into a real batch with
+ * intel_batchbuffer_append(). It grows instead of flushing and can't
+ * carry relocations.
+ */
+struct intel_batchbuffer *
+intel_batchbuffer_new_segment(struct intel_driver_data *intel, int flag, int buffer_size)
+{
+    struct intel_batchbuffer *batch = calloc(1, sizeof(*batch));
+
+    assert(batch);
+
+    if (buffer_size < SEGMENT_MIN_SIZE)
+        buffer_size = SEGMENT_MIN_SIZE;
+
+    batch->intel = intel;
+    batch->flag = flag;
+    batch->map = malloc(buffer_size);
+    assert(batch->map);
+    batch->ptr = batch->map;
+    batch->size = buffer_size;
+
+    return batch;
+}
+
 void intel_batchbuffer_free(struct intel_batchbuffer *batch)
 {
+    unsigned int i;
+
+    intel_batchbuffer_sync_queued(batch);
+
     if (batch->map) {
-        dri_bo_unmap(batch->buffer);
+        if (batch->buffer)
+            dri_bo_unmap(batch->buffer);
+        else
+            free(batch->map);
+
         batch->map = NULL;
     }
 
     dri_bo_unreference(batch->buffer);
     dri_bo_unreference(batch->wa_render_bo);
+    free(batch->relocs);
+
+    for (i = 0; i < batch->num_links; i++)
+        intel_batchbuffer_drop_bo(batch, batch->links[i]);
+
+    for (i = 0; i < batch->num_ring; i++)
+        intel_batchbuffer_drop_bo(batch, batch->ring[i]);
+
+    free(batch->links);
+
+    __atomic_add_fetch(&batch->intel->state_dwords_emitted,
+                       batch->state_dwords_emitted, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&batch->intel->state_dwords_saved,
+                       batch->state_dwords_saved, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&batch->intel->batch_bo_allocs,
+                       batch->bo_allocs, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&batch->intel->batch_bo_reuses,
+                       batch->bo_reuses, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&batch->intel->batch_bo_stalls,
+                       batch->bo_stalls, __ATOMIC_RELAXED);
+
+    if (batch->defer_submit)
+        pthread_mutex_destroy(&batch->ring_mutex);
+
     free(batch);
 }
 
+/* Replaces the MI_BATCH_BUFFER_END of prev with a jump to the head of next */
+static void
+intel_submit_entry_link(struct intel_driver_data *intel,
+                        struct intel_submit_entry *prev,
+                        struct intel_submit_entry *next)
+{
+    dri_bo * const tail = prev->bos[prev->num_bos - 1];
+    dri_bo * const head = next->bos[0];
+    unsigned int jump[3], n = 0;
+
+    if (intel->device_info->gen >= 8) {
+        jump[n++] = MI_BATCH_BUFFER_START | (1 << 8) | (1 << 0);
+        dri_bo_emit_reloc(tail, I915_GEM_DOMAIN_COMMAND, 0,
+                          0, prev->end_offset + 4, head);
+        jump[n++] = head->offset64;
+        jump[n++] = head->offset64 >> 32;
+    } else {
+        jump[n++] = MI_BATCH_BUFFER_START | (1 << 8);
+        dri_bo_emit_reloc(tail, I915_GEM_DOMAIN_COMMAND, 0,
+                          0, prev->end_offset + 4, head);
+        jump[n++] = head->offset;
+    }
+
+    /* The end was written into BATCH_RESERVED, which has room for the jump */
+    assert(prev->end_offset + n * 4 <= tail->size);
+    dri_bo_subdata(tail, prev->end_offset, n * 4, jump);
+}
+
+/* Executes all queued batches, each run of batches for one ring at once */
+static void
+intel_submit_queue_submit_locked(struct intel_submit_queue *queue)
+{
+    struct intel_driver_data * const intel = queue->intel;
+    struct intel_submit_entry *entry, *first;
+    unsigned int i, j;
+
+    for (i = 0; i < queue->num_entries; i = j) {
+        first = &queue->entries[i];
+
+        for (j = i + 1; j < queue->num_entries && queue->entries[j].flag == first->flag; j++)
+            intel_submit_entry_link(intel, &queue->entries[j - 1], &queue->entries[j]);
+
+        first->batch->run(first->bos[0], first->head_used, 0, 0, 0, first->flag);
+        intel->submit_execs++;
+    }
+
+    for (i = 0; i < queue->num_entries; i++) {
+        entry = &queue->entries[i];
+
+        intel_batchbuffer_lock_ring(entry->batch);
+        for (j = 0; j < entry->num_bos; j++)
+            intel_batchbuffer_put_bo(entry->batch, entry->bos[j]);
+        intel_batchbuffer_unlock_ring(entry->batch);
+
+        free(entry->bos);
+        __atomic_store_n(&entry->batch->queued, 0, __ATOMIC_RELEASE);
+    }
+
+    intel->submit_batches += queue->num_entries;
+    __atomic_store_n(&queue->num_entries, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Hands the buffers of a flushed batch over to the submit queue, used is
+ * the size of the last buffer up to its MI_BATCH_BUFFER_END
+ */
+static void
+intel_batchbuffer_queue(struct intel_batchbuffer *batch, unsigned int used)
+{
+    struct intel_submit_queue * const queue = batch->intel->submit_queue;
+    struct intel_submit_entry *entry;
+
+    /* The links array becomes the buffer list of the entry */
+    if (batch->num_links == batch->max_links) {
+        dri_bo **links = realloc(batch->links, (batch->max_links + 1) * sizeof(*links));
+
+        assert(links);
+        batch->links = links;
+        batch->max_links++;
+    }
+    batch->links[batch->num_links] = batch->buffer;
+
+    pthread_mutex_lock(&queue->mutex);
+
+    /*
+     * The CPU may write into the buffers of a context once its next batch
+     * is under way, so a context only ever has one batch queued
+     */
+    if (batch->queued || queue->num_entries == INTEL_SUBMIT_QUEUE_MAX)
+        intel_submit_queue_submit_locked(queue);
+
+    if (!queue->num_entries) {
+        clock_gettime(CLOCK_MONOTONIC, &queue->deadline);
+        queue->deadline.tv_nsec += queue->delay_us * 1000L;
+        queue->deadline.tv_sec += queue->deadline.tv_nsec / 1000000000L;
+        queue->deadline.tv_nsec %= 1000000000L;
+        pthread_cond_signal(&queue->cond);
+    }
+
+    entry = &queue->entries[queue->num_entries];
+    entry->batch = batch;
+    entry->flag = batch->flag;
+    entry->bos = batch->links;
+    entry->num_bos = batch->num_links + 1;
+    entry->head_used = batch->num_links ? batch->head_used : used;
+    entry->end_offset = used - 4;
+    batch->queued = 1;
+    __atomic_store_n(&queue->num_entries, queue->num_entries + 1, __ATOMIC_RELEASE);
+
+    batch->links = NULL;
+    batch->num_links = 0;
+    batch->max_links = 0;
+    batch->buffer = NULL;
+
+    if (queue->num_entries >= queue->threshold)
+        intel_submit_queue_submit_locked(queue);
+
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+static void *
+intel_submit_queue_thread(void *arg)
+{
+    struct intel_submit_queue * const queue = arg;
+
+    pthread_mutex_lock(&queue->mutex);
+
+    while (!queue->exiting) {
+        if (!queue->num_entries)
+            pthread_cond_wait(&queue->cond, &queue->mutex);
+        else if (pthread_cond_timedwait(&queue->cond, &queue->mutex,
+                                        &queue->deadline) == ETIMEDOUT)
+            intel_submit_queue_submit_locked(queue);
+    }
+
+    pthread_mutex_unlock(&queue->mutex);
+
+    return NULL;
+}
+
+bool
+intel_submit_queue_init(struct intel_driver_data *intel,
+                        unsigned int threshold, unsigned int delay_us)
+{
+    struct intel_submit_queue *queue = calloc(1, sizeof(*queue));
+    pthread_condattr_t attr;
+
+    if (!queue)
+        return false;
+
+    queue->intel = intel;
+    queue->threshold = MAX(1, MIN(threshold, INTEL_SUBMIT_QUEUE_MAX));
+    queue->delay_us = MIN(delay_us, 1000000);
+
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&queue->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&queue->thread, NULL, intel_submit_queue_thread, queue)) {
+        pthread_cond_destroy(&queue->cond);
+        pthread_mutex_destroy(&queue->mutex);
+        free(queue);
+        return false;
+    }
+
+    intel->submit_queue = queue;
+    return true;
+}
+
+void
+intel_submit_queue_terminate(struct intel_driver_data *intel)
+{
+    struct intel_submit_queue * const queue = intel->submit_queue;
+
+    if (!queue)
+        return;
+
+    pthread_mutex_lock(&queue->mutex);
+    intel_submit_queue_submit_locked(queue);
+    queue->exiting = true;
+    pthread_cond_signal(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+
+    pthread_join(queue->thread, NULL);
+    pthread_cond_destroy(&queue->cond);
+    pthread_mutex_destroy(&queue->mutex);
+    free(queue);
+
+    intel->submit_queue = NULL;
+}
+
+void
+intel_submit_queue_flush(struct intel_driver_data *intel)
+{
+    struct intel_submit_queue * const queue = intel->submit_queue;
+
+    /* Batches flushed without deferral don't take the queue lock when there's nothing queued */
+    if (!queue || !__atomic_load_n(&queue->num_entries, __ATOMIC_ACQUIRE))
+        return;
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->num_entries)
+        intel_submit_queue_submit_locked(queue);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+bool
+intel_submit_queue_references(struct intel_driver_data *intel, dri_bo *bo)
+{
+    struct intel_submit_queue * const queue = intel->submit_queue;
+    bool found = false;
+    unsigned int i;
+
+    if (!queue)
+        return false;
+
+    pthread_mutex_lock(&queue->mutex);
+    for (i = 0; i < queue->num_entries && !found; i++)
+        found = drm_intel_bo_references(queue->entries[i].bos[0], bo);
+    pthread_mutex_unlock(&queue->mutex);
+
+    return found;
+}
+
+void
+intel_batchbuffer_defer_submit(struct intel_batchbuffer *batch)
+{
+    if (batch->intel->submit_queue && !batch->defer_submit) {
+        pthread_mutex_init(&batch->ring_mutex, NULL);
+        batch->defer_submit = 1;
+    }
+}
+
+void
+intel_batchbuffer_sync_queued(struct intel_batchbuffer *batch)
+{
+    if (__atomic_load_n(&batch->queued, __ATOMIC_ACQUIRE))
+        intel_submit_queue_flush(batch->intel);
+}
+
+/* ring_flag of the trace record of the current buffer */
+static unsigned int
+intel_batchbuffer_trace_flag(struct intel_batchbuffer *batch, bool second_level)
+{
+    unsigned int flag = batch->flag;
+
+    /* Every link past the head of a chain is reached by a jump */
+    if (second_level)
+        flag |= INTEL_BATCH_TRACE_SECOND_LEVEL;
+
+    if (batch->relocs_dropped)
+        flag |= INTEL_BATCH_TRACE_INCOMPLETE;
+
+    return flag;
+}
+
 void
 intel_batchbuffer_flush(struct intel_batchbuffer *batch)
 {
     unsigned int used = batch->ptr - batch->map;
+    unsigned int head_size;
+    bool deferred;
 
-    if (used == 0) {
+    if (used == 0 && !batch->num_links) {
         return;
     }
 
+    /* A segment is never submitted on its own */
+    assert(batch->buffer);
+
+    /*
+     * Batches run back to back in one execbuffer don't get the cache
+     * flushes the kernel emits between execbuffers, so a deferred batch
+     * ends with its own. Without room for it, the batch goes out right away.
+     */
+    deferred = batch->defer_submit &&
+               intel_batchbuffer_space(batch) >= BATCH_FLUSH_SIZE;
+    if (deferred) {
+        intel_batchbuffer_emit_mi_flush(batch);
+        used = batch->ptr - batch->map;
+    }
+
     if ((used & 4) == 0) {
         *(unsigned int*)batch->ptr = 0;
         batch->ptr += 4;
@@ -142,26 +624,113 @@ intel_batchbuffer_flush(struct intel_batchbuffer *batch)
 
     *(unsigned int*)batch->ptr = MI_BATCH_BUFFER_END;
     batch->ptr += 4;
-    dri_bo_unmap(batch->buffer);
     used = batch->ptr - batch->map;
-    batch->run(batch->buffer, used, 0, 0, 0, batch->flag);
-    intel_batchbuffer_reset(batch, batch->size);
+
+    if (batch->intel->batch_recorder)
+        intel_batch_recorder_write_batch(batch->intel->batch_recorder,
+                                         intel_batchbuffer_trace_flag(batch, batch->num_links > 0),
+                                         (const uint32_t *)batch->map, used / 4,
+                                         batch->relocs, batch->num_relocs);
+
+    if (!batch->persistent_map)
+        dri_bo_unmap(batch->buffer);
+
+    head_size = batch->num_links ? batch->links[0]->size : batch->size;
+
+    if (deferred) {
+        intel_batchbuffer_queue(batch, used);
+    } else {
+        /* Whatever is queued was flushed first and must run first */
+        intel_submit_queue_flush(batch->intel);
+
+        if (batch->num_links)
+            batch->run(batch->links[0], batch->head_used, 0, 0, 0, batch->flag);
+        else
+            batch->run(batch->buffer, used, 0, 0, 0, batch->flag);
+
+        intel_batchbuffer_lock_ring(batch);
+        intel_batchbuffer_release_links(batch);
+        intel_batchbuffer_unlock_ring(batch);
+    }
+
+    intel_batchbuffer_reset(batch, head_size);
+}
+
+/*
+ * A second-level batch isn't flushed, a first-level batch jumps into it
+ * with MI_BATCH_BUFFER_START. It's recorded when handed over instead,
+ * ahead of the batch that runs it.
+ */
+void
+intel_batchbuffer_record_second_level(struct intel_batchbuffer *batch)
+{
+    struct intel_batch_recorder * const recorder = batch->intel->batch_recorder;
+
+    if (!recorder || batch->ptr == batch->map)
+        return;
+
+    intel_batch_recorder_write_batch(recorder,
+                                     intel_batchbuffer_trace_flag(batch, true),
+                                     (const uint32_t *)batch->map,
+                                     (batch->ptr - batch->map) / 4,
+                                     batch->relocs, batch->num_relocs);
 }
 
 void
 intel_batchbuffer_emit_dword(struct intel_batchbuffer *batch, unsigned int x)
 {
     assert(intel_batchbuffer_space(batch) >= 4);
+
+    /* A DWORD outside of a BEGIN/ADVANCE block may switch any state */
+    if (batch->num_state_shadow &&
+        batch->ptr >= batch->emit_start + batch->emit_total)
+        intel_batchbuffer_invalidate_state(batch, 0);
+
     *(unsigned int *)batch->ptr = x;
     batch->ptr += 4;
 }
 
+static void
+intel_batchbuffer_record_reloc(struct intel_batchbuffer *batch, dri_bo *bo,
+                               uint32_t read_domains, uint32_t write_domains,
+                               uint32_t delta)
+{
+    struct intel_batch_trace_reloc *reloc;
+
+    if (batch->num_relocs == batch->max_relocs) {
+        unsigned int max_relocs = batch->max_relocs ? batch->max_relocs * 2 : 256;
+
+        reloc = realloc(batch->relocs, max_relocs * sizeof(*reloc));
+        if (!reloc) {
+            batch->relocs_dropped = 1;
+            return;
+        }
+
+        batch->relocs = reloc;
+        batch->max_relocs = max_relocs;
+    }
+
+    reloc = &batch->relocs[batch->num_relocs++];
+    reloc->offset = batch->ptr - batch->map;
+    reloc->delta = delta;
+    reloc->read_domains = read_domains;
+    reloc->write_domain = write_domains;
+    reloc->target_handle = bo->handle;
+    reloc->target_size = bo->size;
+}
+
 void
 intel_batchbuffer_emit_reloc(struct intel_batchbuffer *batch, dri_bo *bo,
                              uint32_t read_domains, uint32_t write_domains,
                              uint32_t delta)
 {
+    assert(batch->buffer);
     assert(batch->ptr - batch->map < batch->size);
+
+    if (batch->intel->batch_recorder)
+        intel_batchbuffer_record_reloc(batch, bo, read_domains, write_domains, delta);
+
+    batch->last_reloc = batch->ptr;
     dri_bo_emit_reloc(batch->buffer, read_domains, write_domains,
                       delta, batch->ptr - batch->map, bo);
     intel_batchbuffer_emit_dword(batch, bo->offset + delta);
@@ -172,7 +741,13 @@ intel_batchbuffer_emit_reloc64(struct intel_batchbuffer *batch, dri_bo *bo,
                                uint32_t read_domains, uint32_t write_domains,
                                uint32_t delta)
 {
+    assert(batch->buffer);
     assert(batch->ptr - batch->map < batch->size);
+
+    if (batch->intel->batch_recorder)
+        intel_batchbuffer_record_reloc(batch, bo, read_domains, write_domains, delta);
+
+    batch->last_reloc = batch->ptr;
     dri_bo_emit_reloc(batch->buffer, read_domains, write_domains,
                       delta, batch->ptr - batch->map, bo);
 
@@ -185,13 +760,130 @@ intel_batchbuffer_emit_reloc64(struct intel_batchbuffer *batch, dri_bo *bo,
     intel_batchbuffer_emit_dword(batch, offset >> 32);
 }
 
+static void
+intel_batchbuffer_grow_segment(struct intel_batchbuffer *batch,
+                               unsigned int size)
+{
+    unsigned int used = batch->ptr - batch->map;
+    unsigned int new_size = batch->size;
+    unsigned char *map;
+
+    while (new_size - BATCH_RESERVED - used < size)
+        new_size *= 2;
+
+    map = realloc(batch->map, new_size);
+    assert(map);
+
+    if (batch->emit_start)
+        batch->emit_start = map + (batch->emit_start - batch->map);
+
+    batch->map = map;
+    batch->ptr = map + used;
+    batch->size = new_size;
+}
+
+static void
+intel_batchbuffer_out_reserved(struct intel_batchbuffer *batch, unsigned int x)
+{
+    *(unsigned int *)batch->ptr = x;
+    batch->ptr += 4;
+}
+
+/*
+ * Continues the batch in a new buffer instead of flushing it, the current
+ * buffer ends with a jump to the new one. The jump goes into the space
+ * reserved for the end of the batch.
+ */
+static void
+intel_batchbuffer_chain(struct intel_batchbuffer *batch, unsigned int size)
+{
+    struct intel_driver_data *intel = batch->intel;
+    unsigned int link_size = MAX(batch->size, ALIGN(size + BATCH_RESERVED, 0x1000));
+    dri_bo *link;
+
+    if (batch->num_links == batch->max_links) {
+        unsigned int max_links = batch->max_links ? batch->max_links * 2 : 4;
+        dri_bo **links = realloc(batch->links, max_links * sizeof(*links));
+
+        assert(links);
+        batch->links = links;
+        batch->max_links = max_links;
+    }
+
+    intel_batchbuffer_lock_ring(batch);
+    link = intel_batchbuffer_get_bo(batch, link_size);
+    intel_batchbuffer_unlock_ring(batch);
+
+    if (intel->device_info->gen >= 8) {
+        intel_batchbuffer_out_reserved(batch, MI_BATCH_BUFFER_START | (1 << 8) | (1 << 0));
+
+        if (intel->batch_recorder)
+            intel_batchbuffer_record_reloc(batch, link, I915_GEM_DOMAIN_COMMAND, 0, 0);
+
+        dri_bo_emit_reloc(batch->buffer, I915_GEM_DOMAIN_COMMAND, 0,
+                          0, batch->ptr - batch->map, link);
+        intel_batchbuffer_out_reserved(batch, link->offset64);
+        intel_batchbuffer_out_reserved(batch, link->offset64 >> 32);
+    } else {
+        intel_batchbuffer_out_reserved(batch, MI_BATCH_BUFFER_START | (1 << 8));
+
+        if (intel->batch_recorder)
+            intel_batchbuffer_record_reloc(batch, link, I915_GEM_DOMAIN_COMMAND, 0, 0);
+
+        dri_bo_emit_reloc(batch->buffer, I915_GEM_DOMAIN_COMMAND, 0,
+                          0, batch->ptr - batch->map, link);
+        intel_batchbuffer_out_reserved(batch, link->offset);
+    }
+
+    if ((batch->ptr - batch->map) & 4)
+        intel_batchbuffer_out_reserved(batch, MI_NOOP);
+
+    if (intel->batch_recorder)
+        intel_batch_recorder_write_batch(intel->batch_recorder,
+                                         intel_batchbuffer_trace_flag(batch, batch->num_links > 0),
+                                         (const uint32_t *)batch->map,
+                                         (batch->ptr - batch->map) / 4,
+                                         batch->relocs, batch->num_relocs);
+
+    if (!batch->num_links)
+        batch->head_used = batch->ptr - batch->map;
+
+    if (!batch->persistent_map)
+        dri_bo_unmap(batch->buffer);
+
+    batch->links[batch->num_links++] = batch->buffer;
+
+    batch->buffer = link;
+    batch->map = batch->buffer->virtual;
+    batch->size = link_size;
+    batch->ptr = batch->map;
+    batch->emit_start = batch->ptr;
+    batch->emit_total = 0;
+    batch->num_relocs = 0;
+    batch->relocs_dropped = 0;
+    batch->num_state_shadow = 0;
+    batch->last_reloc = NULL;
+}
+
 void
 intel_batchbuffer_require_space(struct intel_batchbuffer *batch,
                                 unsigned int size)
 {
-    assert(size < batch->size - 8);
+    if (!batch->buffer) {
+        if (intel_batchbuffer_space(batch) < size)
+            intel_batchbuffer_grow_segment(batch, size);
+
+        return;
+    }
 
     if (intel_batchbuffer_space(batch) < size) {
+        /* Flushing would split a sequence which must not be split */
+        if (batch->atomic) {
+            intel_batchbuffer_chain(batch, size);
+            return;
+        }
+
+        assert(size < batch->size - 8);
         intel_batchbuffer_flush(batch);
     }
 }
@@ -205,10 +897,28 @@ intel_batchbuffer_data(struct intel_batchbuffer *batch,
     intel_batchbuffer_require_space(batch, size);
 
     assert(batch->ptr);
+
+    if (batch->num_state_shadow &&
+        batch->ptr >= batch->emit_start + batch->emit_total)
+        intel_batchbuffer_invalidate_state(batch, 0);
+
     memcpy(batch->ptr, data, size);
     batch->ptr += size;
 }
 
+void
+intel_batchbuffer_append(struct intel_batchbuffer *batch,
+                         struct intel_batchbuffer *segment)
+{
+    assert(!segment->buffer);
+    assert(batch->flag == segment->flag);
+
+    intel_batchbuffer_data(batch, segment->map, segment->ptr - segment->map);
+
+    /* The shadow doesn't know about the state packets of the segment */
+    intel_batchbuffer_invalidate_state(batch, 0);
+}
+
 void
 intel_batchbuffer_emit_mi_flush(struct intel_batchbuffer *batch)
 {
@@ -329,10 +1039,245 @@ intel_batchbuffer_begin_batch(struct intel_batchbuffer *batch, int total)
     batch->emit_start = batch->ptr;
 }
 
+/* Written right after a span in debug builds to catch overruns */
+#define SPAN_GUARD      0x5ca1ab1e
+
+unsigned int *
+intel_batchbuffer_reserve_span(struct intel_batchbuffer *batch, int total)
+{
+    unsigned int *dw;
+
+#ifdef NDEBUG
+    intel_batchbuffer_require_space(batch, total * 4);
+#else
+    intel_batchbuffer_require_space(batch, (total + 1) * 4);
+#endif
+    intel_batchbuffer_begin_batch(batch, total);
+
+    dw = (unsigned int *)batch->ptr;
+#ifndef NDEBUG
+    dw[total] = SPAN_GUARD;
+#endif
+
+    return dw;
+}
+
+void
+intel_batchbuffer_commit_span(struct intel_batchbuffer *batch, unsigned int *end)
+{
+    assert((unsigned char *)end == batch->emit_start + batch->emit_total);
+    assert(*end == SPAN_GUARD);
+
+    batch->ptr = (unsigned char *)end;
+    intel_batchbuffer_advance_batch(batch);
+}
+
+static unsigned int
+intel_batchbuffer_state_header(unsigned int dw0)
+{
+    /* MI commands keep their opcode in bits 28:23, the others in 31:16 */
+    if ((dw0 & (7 << 29)) == CMD_MI)
+        return dw0 & 0xff800000;
+
+    return dw0 & 0xffff0000;
+}
+
+void
+intel_batchbuffer_invalidate_state(struct intel_batchbuffer *batch, unsigned int flags)
+{
+    unsigned int i, n = 0;
+
+    if (!flags) {
+        batch->num_state_shadow = 0;
+        return;
+    }
+
+    for (i = 0; i < batch->num_state_shadow; i++) {
+        if (batch->state_shadow[i].flags & flags)
+            continue;
+
+        batch->state_shadow[n++] = batch->state_shadow[i];
+    }
+
+    batch->num_state_shadow = n;
+}
+
+/*
+ * Packets which switch the pipeline, rebase the state heaps or jump to
+ * another batch leave the hardware state unknown to the shadow.
+ */
+static void
+intel_batchbuffer_check_state_invalidation(struct intel_batchbuffer *batch,
+                                           unsigned int header)
+{
+    switch (header) {
+    case CMD_STATE_BASE_ADDRESS:
+        intel_batchbuffer_invalidate_state(batch, INTEL_BATCH_STATE_BASE_RELATIVE);
+        break;
+
+    case CMD_PIPELINE_SELECT:
+    case MFX_PIPE_MODE_SELECT:
+    case HCP_PIPE_MODE_SELECT:
+    case VDENC_PIPE_MODE_SELECT:
+    case MI_BATCH_BUFFER_START:
+        intel_batchbuffer_invalidate_state(batch, 0);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* Size in DWORDs encoded in DW0, 0 if the length field isn't known */
+static unsigned int
+intel_batchbuffer_packet_dwords(unsigned int dw0)
+{
+    switch (dw0 & (7 << 29)) {
+    case CMD_MI:
+        /* MI_NOOP, MI_FLUSH, MI_BATCH_BUFFER_END etc. have no length field */
+        if (((dw0 >> 23) & 0x3f) < 0x10)
+            return 1;
+
+        return (dw0 & 0x3f) + 2;
+
+    case (3 << 29):
+        return (dw0 & 0xff) + 2;
+
+    default:
+        return 0;
+    }
+}
+
+static void
+intel_batchbuffer_forget_state(struct intel_batchbuffer *batch, unsigned int header)
+{
+    unsigned int i, n = 0;
+
+    for (i = 0; i < batch->num_state_shadow; i++) {
+        if (batch->state_shadow[i].header == header)
+            continue;
+
+        batch->state_shadow[n++] = batch->state_shadow[i];
+    }
+
+    batch->num_state_shadow = n;
+}
+
 void
 intel_batchbuffer_advance_batch(struct intel_batchbuffer *batch)
 {
+    unsigned int dw0, header;
+
     assert(batch->emit_total == (batch->ptr - batch->emit_start));
+
+    if (!batch->num_state_shadow || !batch->emit_total)
+        return;
+
+    dw0 = *(unsigned int *)batch->emit_start;
+
+    /*
+     * Only a block holding exactly one packet can be matched against the
+     * shadow, anything else may carry state the shadow doesn't know about.
+     */
+    if (intel_batchbuffer_packet_dwords(dw0) * 4 != batch->emit_total) {
+        intel_batchbuffer_invalidate_state(batch, 0);
+        return;
+    }
+
+    header = intel_batchbuffer_state_header(dw0);
+
+    /* The packet overrides whatever the shadow holds for its header */
+    intel_batchbuffer_forget_state(batch, header);
+    intel_batchbuffer_check_state_invalidation(batch, header);
+}
+
+static unsigned int
+intel_batchbuffer_state_hash(const unsigned int *dw, unsigned int count)
+{
+    unsigned int hash = 2166136261u;
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        hash ^= dw[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static struct intel_batch_state_shadow *
+intel_batchbuffer_lookup_state(struct intel_batchbuffer *batch,
+                               unsigned int header, unsigned int key)
+{
+    unsigned int i;
+
+    for (i = 0; i < batch->num_state_shadow; i++) {
+        if (batch->state_shadow[i].header == header &&
+            batch->state_shadow[i].key == key)
+            return &batch->state_shadow[i];
+    }
+
+    return NULL;
+}
+
+void
+intel_batchbuffer_advance_batch_state(struct intel_batchbuffer *batch,
+                                      unsigned int key, unsigned int flags)
+{
+    struct intel_batch_state_shadow *shadow;
+    unsigned int offset = batch->emit_start - batch->map;
+    unsigned int size = batch->ptr - batch->emit_start;
+    unsigned int header, hash;
+
+    assert(batch->emit_total == size);
+
+    if (!size)
+        return;
+
+    batch->state_dwords_emitted += size / 4;
+
+    /* A relocated packet can't be dropped, the kernel would patch its DWORDs */
+    if (batch->last_reloc >= batch->emit_start) {
+        intel_batchbuffer_advance_batch(batch);
+        return;
+    }
+
+    header = intel_batchbuffer_state_header(*(unsigned int *)batch->emit_start);
+    hash = intel_batchbuffer_state_hash((unsigned int *)batch->emit_start, size / 4);
+
+    shadow = intel_batchbuffer_lookup_state(batch, header, key);
+
+    if (shadow &&
+        shadow->hash == hash &&
+        shadow->size == size &&
+        memcmp(batch->map + shadow->offset, batch->emit_start, size) == 0) {
+        batch->ptr = batch->emit_start;
+        batch->emit_total = 0;
+        batch->state_dwords_saved += size / 4;
+        return;
+    }
+
+    intel_batchbuffer_check_state_invalidation(batch, header);
+
+    /* The lookup above may be stale after an invalidation */
+    shadow = intel_batchbuffer_lookup_state(batch, header, key);
+
+    if (!shadow) {
+        if (batch->num_state_shadow == INTEL_BATCH_STATE_SHADOW_SIZE) {
+            memmove(&batch->state_shadow[0], &batch->state_shadow[1],
+                    (INTEL_BATCH_STATE_SHADOW_SIZE - 1) * sizeof(batch->state_shadow[0]));
+            batch->num_state_shadow--;
+        }
+
+        shadow = &batch->state_shadow[batch->num_state_shadow++];
+    }
+
+    shadow->header = header;
+    shadow->key = key;
+    shadow->flags = flags;
+    shadow->hash = hash;
+    shadow->offset = offset;
+    shadow->size = size;
 }
 
 void
@@ -7,6 +7,26 @@
 #include <intel_bufmgr.h>
 
 #include "intel_driver.h"
+#include "intel_batchbuffer_record.h"
+
+#define INTEL_BATCH_STATE_SHADOW_SIZE   16
+#define INTEL_BATCH_RING_SIZE           4
+#define INTEL_BATCH_RING_MAX            16
+#define INTEL_SUBMIT_QUEUE_MAX          64
+#define INTEL_SUBMIT_DELAY_US           1000
+
+/* The state packet is relative to STATE_BASE_ADDRESS */
+#define INTEL_BATCH_STATE_BASE_RELATIVE (1 << 0)
+
+/* A non-relocated state packet already emitted into the current batch */
+struct intel_batch_state_shadow {
+    unsigned int header;        /* DW0 without the length field */
+    unsigned int key;           /* distinguishes indexed state, e.g. QM type */
+    unsigned int flags;
+    unsigned int hash;
+    unsigned int offset;        /* where the packet lives in the batch */
+    unsigned int size;
+};
 
 struct intel_batchbuffer {
     struct intel_driver_data *intel;
@@ -26,9 +46,50 @@ struct intel_batchbuffer {
 
     /* Used for Sandybdrige workaround */
     dri_bo *wa_render_bo;
+
+    /*
+     * Buffers already filled by the current batch when it outgrew its
+     * buffer inside an atomic section, head first. Each one jumps to the
+     * next with MI_BATCH_BUFFER_START, the last one is the current buffer.
+     */
+    dri_bo **links;
+    unsigned int num_links;
+    unsigned int max_links;
+    unsigned int head_used;
+
+    /*
+     * Buffers of submitted batches, oldest first, reused once the GPU is
+     * done with them. They stay mapped on LLC platforms.
+     */
+    dri_bo *ring[INTEL_BATCH_RING_MAX];
+    unsigned int num_ring;
+    unsigned int ring_size;
+    int persistent_map;
+    unsigned long bo_allocs;
+    unsigned long bo_reuses;
+    unsigned long bo_stalls;
+
+    /* Relocations of the current batch, only kept while recording */
+    struct intel_batch_trace_reloc *relocs;
+    unsigned int num_relocs;
+    unsigned int max_relocs;
+    int relocs_dropped;
+
+    /* Redundant state elimination, reset with each new batch */
+    struct intel_batch_state_shadow state_shadow[INTEL_BATCH_STATE_SHADOW_SIZE];
+    unsigned int num_state_shadow;
+    unsigned char *last_reloc;
+    unsigned long state_dwords_emitted;
+    unsigned long state_dwords_saved;
+
+    /* Deferred submission through the submit queue of the driver */
+    int defer_submit;
+    int queued;                         /* atomic, a flushed batch waits in the queue */
+    pthread_mutex_t ring_mutex;         /* the queue hands buffers back to the ring */
 };
 
 struct intel_batchbuffer *intel_batchbuffer_new(struct intel_driver_data *intel, int flag, int buffer_size);
+struct intel_batchbuffer *intel_batchbuffer_new_segment(struct intel_driver_data *intel, int flag, int buffer_size);
 void intel_batchbuffer_free(struct intel_batchbuffer *batch);
 void intel_batchbuffer_start_atomic(struct intel_batchbuffer *batch, unsigned int size);
 void intel_batchbuffer_start_atomic_bcs(struct intel_batchbuffer *batch, unsigned int size);
@@ -44,15 +105,38 @@ void intel_batchbuffer_emit_reloc64(struct intel_batchbuffer *batch, dri_bo *bo,
                                     uint32_t delta);
 void intel_batchbuffer_require_space(struct intel_batchbuffer *batch, unsigned int size);
 void intel_batchbuffer_data(struct intel_batchbuffer *batch, void *data, unsigned int size);
+void intel_batchbuffer_append(struct intel_batchbuffer *batch, struct intel_batchbuffer *segment);
 void intel_batchbuffer_emit_mi_flush(struct intel_batchbuffer *batch);
 void intel_batchbuffer_flush(struct intel_batchbuffer *batch);
+void intel_batchbuffer_record_second_level(struct intel_batchbuffer *batch);
 void intel_batchbuffer_begin_batch(struct intel_batchbuffer *batch, int total);
 void intel_batchbuffer_advance_batch(struct intel_batchbuffer *batch);
+unsigned int *intel_batchbuffer_reserve_span(struct intel_batchbuffer *batch, int total);
+void intel_batchbuffer_commit_span(struct intel_batchbuffer *batch, unsigned int *end);
+void intel_batchbuffer_advance_batch_state(struct intel_batchbuffer *batch,
+                                           unsigned int key, unsigned int flags);
+void intel_batchbuffer_invalidate_state(struct intel_batchbuffer *batch, unsigned int flags);
 void intel_batchbuffer_check_batchbuffer_flag(struct intel_batchbuffer *batch, int flag);
 int intel_batchbuffer_check_free_space(struct intel_batchbuffer *batch, int size);
 int intel_batchbuffer_used_size(struct intel_batchbuffer *batch);
 void intel_batchbuffer_align(struct intel_batchbuffer *batch, unsigned int alignedment);
 
+/*
+ * Deferred submission: flushes of opted-in batches are queued, and the
+ * queue executes runs of batches for the same ring with one execbuffer.
+ * It is submitted when threshold batches are queued, when the oldest one
+ * has waited delay_us, when another batch is flushed, and through
+ * intel_submit_queue_flush() before the CPU accesses GPU buffers.
+ */
+bool intel_submit_queue_init(struct intel_driver_data *intel,
+                             unsigned int threshold, unsigned int delay_us);
+void intel_submit_queue_terminate(struct intel_driver_data *intel);
+void intel_submit_queue_flush(struct intel_driver_data *intel);
+bool intel_submit_queue_references(struct intel_driver_data *intel, dri_bo *bo);
+/* Opts a batch in, its owner must call intel_batchbuffer_sync_queued() before reusing its own buffers */
+void intel_batchbuffer_defer_submit(struct intel_batchbuffer *batch);
+void intel_batchbuffer_sync_queued(struct intel_batchbuffer *batch);
+
 typedef enum {
     BSD_DEFAULT,
     BSD_RING0,
@@ -91,6 +175,33 @@ void intel_batchbuffer_start_atomic_bcs_override(struct intel_batchbuffer *batch
         intel_batchbuffer_advance_batch(batch); \
     } while (0)
 
+/*
+ * Closes a state packet which may be dropped again if an identical packet
+ * with the same header and key was already emitted into this batch and no
+ * pipeline or base address change happened in between. Packets carrying
+ * relocations are always kept.
+ */
+#define __ADVANCE_BATCH_STATE(batch, key, flags) do {                   \
+        intel_batchbuffer_advance_batch_state(batch, key, flags);       \
+    } while (0)
+
+/*
+ * Reserves n DWORDs once and hands back a raw pointer in dw, the packet is
+ * then written with plain stores (*dw++ = x) and closed with
+ * __ADVANCE_BATCH_SPAN(). No relocations can be emitted into a span. Debug
+ * builds catch a span that wasn't filled exactly, including writes past its
+ * end.
+ */
+#define __BEGIN_BATCH_SPAN(batch, n, f, dw) do {                        \
+        assert(f == (batch->flag & I915_EXEC_RING_MASK));               \
+        intel_batchbuffer_check_batchbuffer_flag(batch, batch->flag);   \
+        (dw) = intel_batchbuffer_reserve_span(batch, (n));              \
+    } while (0)
+
+#define __ADVANCE_BATCH_SPAN(batch, dw) do {                    \
+        intel_batchbuffer_commit_span(batch, (dw));             \
+    } while (0)
+
 #define BEGIN_BATCH(batch, n)           __BEGIN_BATCH(batch, n, I915_EXEC_RENDER)
 #define BEGIN_BLT_BATCH(batch, n)       __BEGIN_BATCH(batch, n, I915_EXEC_BLT)
 #define BEGIN_BCS_BATCH(batch, n)       __BEGIN_BATCH(batch, n, I915_EXEC_BSD)
@@ -117,4 +228,17 @@ void intel_batchbuffer_start_atomic_bcs_override(struct intel_batchbuffer *batch
 #define ADVANCE_BCS_BATCH(batch)        __ADVANCE_BATCH(batch)
 #define ADVANCE_VEB_BATCH(batch)        __ADVANCE_BATCH(batch)
 
+#define BEGIN_BATCH_SPAN(batch, n, dw)          __BEGIN_BATCH_SPAN(batch, n, I915_EXEC_RENDER, dw)
+#define BEGIN_BCS_BATCH_SPAN(batch, n, dw)      __BEGIN_BATCH_SPAN(batch, n, I915_EXEC_BSD, dw)
+#define BEGIN_VEB_BATCH_SPAN(batch, n, dw)      __BEGIN_BATCH_SPAN(batch, n, I915_EXEC_VEBOX, dw)
+
+#define ADVANCE_BATCH_SPAN(batch, dw)           __ADVANCE_BATCH_SPAN(batch, dw)
+#define ADVANCE_BCS_BATCH_SPAN(batch, dw)       __ADVANCE_BATCH_SPAN(batch, dw)
+#define ADVANCE_VEB_BATCH_SPAN(batch, dw)       __ADVANCE_BATCH_SPAN(batch, dw)
+
+#define ADVANCE_BATCH_STATE(batch, key, flags)          \
+    __ADVANCE_BATCH_STATE(batch, key, flags)
+#define ADVANCE_BCS_BATCH_STATE(batch, key, flags)      \
+    __ADVANCE_BATCH_STATE(batch, key, flags)
+
 #endif /* _INTEL_BATCHBUFFER_H_ */
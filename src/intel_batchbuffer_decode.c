@@ -0,0 +1,552 @@
+/*
+ * intel_batchbuffer_decode.c - Offline decoding of batchbuffer traces
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sysdeps.h"
+#include <i915_drm.h>
+#include "i965_defines.h"
+#include "intel_batchbuffer_decode.h"
+
+#define RING_ANY                0
+#define GEN_ANY                 0
+
+#define CMD_TYPE(dw)            ((dw) >> 29)
+#define CMD_TYPE_MI             0
+#define CMD_TYPE_BLT            2
+#define CMD_TYPE_GFX            3
+#define GFX_PIPELINE(dw)        (((dw) >> 27) & 3)
+#define MI_OPCODE(dw)           (((dw) >> 23) & 0x3f)
+
+#define MI_BATCH_BUFFER_END_KEY (0x0a << 23)
+#define PIPE_CONTROL            CMD(3, 2, 0)
+
+#define MI_KEY_MASK             0xff800000
+#define BLT_KEY_MASK            0xffc00000
+#define GFX_KEY_MASK            0xffff0000
+
+struct command_desc {
+    uint32_t key;
+    uint32_t key_mask;
+    unsigned int ring;
+    unsigned int min_gen;
+    unsigned int max_gen;
+    uint32_t length_mask;               /* 0 for single DWORD commands */
+    const char *name;
+};
+
+#define MI_CMD(opcode, length_mask, name) \
+    { (opcode) << 23, MI_KEY_MASK, RING_ANY, GEN_ANY, GEN_ANY, length_mask, name }
+
+#define GFX_CMD_DESC(cmd, name, ring, min_gen, max_gen, length_mask) \
+    { cmd, GFX_KEY_MASK, ring, min_gen, max_gen, length_mask, name }
+
+/* The names are stringified here, before the opcode macros get expanded */
+#define GFX_CMD(cmd, ring, min_gen, max_gen, length_mask) \
+    GFX_CMD_DESC(cmd, #cmd, ring, min_gen, max_gen, length_mask)
+#define RENDER_CMD(cmd, min_gen, max_gen) \
+    GFX_CMD_DESC(cmd, #cmd, I915_EXEC_RENDER, min_gen, max_gen, 0xff)
+#define MEDIA_CMD(cmd, min_gen, max_gen) \
+    GFX_CMD_DESC(cmd, #cmd, I915_EXEC_RENDER, min_gen, max_gen, 0xffff)
+#define VIDEO_CMD(cmd, min_gen) \
+    GFX_CMD_DESC(cmd, #cmd, I915_EXEC_BSD, min_gen, GEN_ANY, 0xfff)
+#define VEBOX_CMD(cmd) \
+    GFX_CMD_DESC(cmd, #cmd, I915_EXEC_VEBOX, 7, GEN_ANY, 0xfff)
+
+/*
+ * Commands emitted by the driver, first match wins. Several opcodes are
+ * reused across rings (MFX vs. media vs. VEBOX) and generations, hence
+ * the ring and generation ranges.
+ */
+static const struct command_desc commands[] = {
+    MI_CMD(0x00, 0, "MI_NOOP"),
+    MI_CMD(0x02, 0, "MI_USER_INTERRUPT"),
+    MI_CMD(0x03, 0, "MI_WAIT_FOR_EVENT"),
+    MI_CMD(0x04, 0, "MI_FLUSH"),
+    MI_CMD(0x05, 0, "MI_ARB_CHECK"),
+    MI_CMD(0x0a, 0, "MI_BATCH_BUFFER_END"),
+    MI_CMD(0x16, 0x3f, "MI_SEMAPHORE_MBOX"),
+    MI_CMD(0x1a, 0x3f, "MI_MATH"),
+    MI_CMD(0x20, 0x3ff, "MI_STORE_DATA_IMM"),
+    MI_CMD(0x22, 0xff, "MI_LOAD_REGISTER_IMM"),
+    MI_CMD(0x24, 0xff, "MI_STORE_REGISTER_MEM"),
+    MI_CMD(0x26, 0x3f, "MI_FLUSH_DW"),
+    MI_CMD(0x29, 0xff, "MI_LOAD_REGISTER_MEM"),
+    MI_CMD(0x2a, 0xff, "MI_LOAD_REGISTER_REG"),
+    MI_CMD(0x2e, 0xff, "MI_COPY_MEM_MEM"),
+    MI_CMD(0x2f, 0xff, "MI_ATOMIC"),
+    MI_CMD(0x31, 0xff, "MI_BATCH_BUFFER_START"),
+    MI_CMD(0x36, 0xff, "MI_CONDITIONAL_BATCH_BUFFER_END"),
+
+    GFX_CMD(CMD_PIPELINE_SELECT, RING_ANY, GEN_ANY, GEN_ANY, 0),
+    GFX_CMD(CMD_STATE_BASE_ADDRESS, RING_ANY, GEN_ANY, GEN_ANY, 0xff),
+    GFX_CMD(CMD_STATE_SIP, RING_ANY, GEN_ANY, GEN_ANY, 0xff),
+    GFX_CMD(PIPE_CONTROL, RING_ANY, GEN_ANY, GEN_ANY, 0xff),
+    RENDER_CMD(CMD_URB_FENCE, 4, 5),
+    RENDER_CMD(CMD_CS_URB_STATE, 4, 5),
+    RENDER_CMD(CMD_CONSTANT_BUFFER, 4, 5),
+    RENDER_CMD(CMD_STATE_PREFETCH, 4, 5),
+
+    /* Media (GPE) */
+    MEDIA_CMD(CMD_MEDIA_VFE_STATE, 6, 0),
+    MEDIA_CMD(CMD_MEDIA_STATE_POINTERS, 4, 5),
+    MEDIA_CMD(CMD_MEDIA_CURBE_LOAD, 0, 0),
+    MEDIA_CMD(CMD_MEDIA_INTERFACE_DESCRIPTOR_LOAD, 6, 0),
+    MEDIA_CMD(CMD_MEDIA_INTERFACE_LOAD, 4, 5),
+    MEDIA_CMD(CMD_MEDIA_GATEWAY_STATE, 6, 0),
+    MEDIA_CMD(CMD_MEDIA_STATE_FLUSH, 6, 0),
+    MEDIA_CMD(CMD_MEDIA_OBJECT, 0, 0),
+    MEDIA_CMD(CMD_MEDIA_OBJECT_EX, 4, 5),
+    MEDIA_CMD(CMD_MEDIA_OBJECT_WALKER, 6, 0),
+
+    /* 3D */
+    RENDER_CMD(GEN8_3DSTATE_RASTER, 8, 0),
+    RENDER_CMD(GEN8_3DSTATE_WM_HZ_OP, 8, 0),
+    RENDER_CMD(GEN8_3DSTATE_MULTISAMPLE, 8, 0),
+    RENDER_CMD(GEN8_3DSTATE_SAMPLE_PATTERN, 8, 0),
+    RENDER_CMD(GEN8_3DSTATE_SBE_SWIZ, 8, 0),
+    RENDER_CMD(GEN8_3DSTATE_PSEXTRA, 8, 0),
+    RENDER_CMD(GEN8_3DSTATE_PSBLEND, 8, 0),
+    RENDER_CMD(GEN8_3DSTATE_WM_DEPTH_STENCIL, 8, 0),
+    RENDER_CMD(GEN8_3DSTATE_VF_INSTANCING, 8, 0),
+    RENDER_CMD(GEN8_3DSTATE_VF_SGVS, 8, 0),
+    RENDER_CMD(GEN8_3DSTATE_VF_TOPOLOGY, 8, 0),
+    RENDER_CMD(GEN7_3DSTATE_CLEAR_PARAMS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_DEPTH_BUFFER, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_HIER_DEPTH_BUFFER, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_URB_VS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_URB_HS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_URB_DS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_URB_GS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_PUSH_CONSTANT_ALLOC_VS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_PUSH_CONSTANT_ALLOC_PS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_PUSH_CONSTANT_ALLOC_DS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_PUSH_CONSTANT_ALLOC_HS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_PUSH_CONSTANT_ALLOC_GS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_CONSTANT_HS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_CONSTANT_DS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_HS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_TE, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_DS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_STREAMOUT, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_SBE, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_PS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_STENCIL_BUFFER, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_VIEWPORT_STATE_POINTERS_SF_CL, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_VIEWPORT_STATE_POINTERS_CC, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_BLEND_STATE_POINTERS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_DEPTH_STENCIL_STATE_POINTERS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_BINDING_TABLE_POINTERS_VS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_BINDING_TABLE_POINTERS_HS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_BINDING_TABLE_POINTERS_DS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_BINDING_TABLE_POINTERS_GS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_BINDING_TABLE_POINTERS_PS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_SAMPLER_STATE_POINTERS_VS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_SAMPLER_STATE_POINTERS_GS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_SAMPLER_STATE_POINTERS_PS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_SAMPLER_STATE_POINTERS_HS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_SAMPLER_STATE_POINTERS_DS, 7, 0),
+    RENDER_CMD(GEN7_3DSTATE_VF, 7, 0),
+    RENDER_CMD(GEN6_3DSTATE_SAMPLER_STATE_POINTERS, 6, 6),
+    RENDER_CMD(GEN6_3DSTATE_URB, 6, 6),
+    RENDER_CMD(GEN6_3DSTATE_VIEWPORT_STATE_POINTERS, 6, 6),
+    RENDER_CMD(GEN6_3DSTATE_CC_STATE_POINTERS, 6, 6),
+    RENDER_CMD(GEN6_3DSTATE_VS, 6, 6),
+    RENDER_CMD(GEN6_3DSTATE_GS, 6, 6),
+    RENDER_CMD(GEN6_3DSTATE_CLIP, 6, 6),
+    RENDER_CMD(GEN6_3DSTATE_SF, 6, 6),
+    RENDER_CMD(GEN6_3DSTATE_WM, 6, 6),
+    RENDER_CMD(GEN6_3DSTATE_CONSTANT_VS, 6, 6),
+    RENDER_CMD(GEN6_3DSTATE_CONSTANT_GS, 6, 6),
+    RENDER_CMD(GEN6_3DSTATE_CONSTANT_PS, 6, 6),
+    RENDER_CMD(GEN6_3DSTATE_SAMPLE_MASK, 6, 6),
+    RENDER_CMD(GEN6_3DSTATE_MULTISAMPLE, 6, 6),
+    RENDER_CMD(CMD_SAMPLER_PALETTE_LOAD, 4, 5),
+    RENDER_CMD(CMD_PIPELINED_POINTERS, 4, 5),
+    RENDER_CMD(CMD_BINDING_TABLE_POINTERS, 4, 5),
+    RENDER_CMD(CMD_VERTEX_BUFFERS, 4, 5),
+    RENDER_CMD(CMD_VERTEX_ELEMENTS, 4, 5),
+    RENDER_CMD(CMD_DRAWING_RECTANGLE, 4, 5),
+    RENDER_CMD(CMD_CONSTANT_COLOR, 4, 5),
+    RENDER_CMD(CMD_3DPRIMITIVE, 4, 5),
+    RENDER_CMD(CMD_DEPTH_BUFFER, 4, 5),
+    RENDER_CMD(CMD_CLEAR_PARAMS, 4, 5),
+
+    /* Gen4/5 BSD */
+    GFX_CMD(CMD_AVC_BSD_IMG_STATE, I915_EXEC_BSD, 4, 5, 0xffff),
+    GFX_CMD(CMD_AVC_BSD_QM_STATE, I915_EXEC_BSD, 4, 5, 0xffff),
+    GFX_CMD(CMD_AVC_BSD_SLICE_STATE, I915_EXEC_BSD, 4, 5, 0xffff),
+    GFX_CMD(CMD_AVC_BSD_BUF_BASE_STATE, I915_EXEC_BSD, 4, 5, 0xffff),
+    GFX_CMD(CMD_BSD_IND_OBJ_BASE_ADDR, I915_EXEC_BSD, 4, 5, 0xffff),
+    GFX_CMD(CMD_AVC_BSD_OBJECT, I915_EXEC_BSD, 4, 5, 0xffff),
+
+    /* MFX */
+    GFX_CMD(MFX_WAIT, I915_EXEC_BSD, 6, GEN_ANY, 0),
+    VIDEO_CMD(MFX_PIPE_MODE_SELECT, 6),
+    VIDEO_CMD(MFX_SURFACE_STATE, 6),
+    VIDEO_CMD(MFX_PIPE_BUF_ADDR_STATE, 6),
+    VIDEO_CMD(MFX_IND_OBJ_BASE_ADDR_STATE, 6),
+    VIDEO_CMD(MFX_BSP_BUF_BASE_ADDR_STATE, 6),
+    VIDEO_CMD(MFX_AES_STATE, 6),
+    VIDEO_CMD(MFX_STATE_POINTER, 6),
+    VIDEO_CMD(MFX_QM_STATE, 6),
+    VIDEO_CMD(MFX_FQM_STATE, 6),
+    VIDEO_CMD(MFX_INSERT_OBJECT, 6),
+    VIDEO_CMD(MFX_AVC_IMG_STATE, 6),
+    VIDEO_CMD(MFX_AVC_QM_STATE, 6),
+    VIDEO_CMD(MFX_AVC_DIRECTMODE_STATE, 6),
+    VIDEO_CMD(MFX_AVC_SLICE_STATE, 6),
+    VIDEO_CMD(MFX_AVC_REF_IDX_STATE, 6),
+    VIDEO_CMD(MFX_AVC_WEIGHTOFFSET_STATE, 6),
+    VIDEO_CMD(MFD_AVC_PICID_STATE, 6),
+    VIDEO_CMD(MFD_AVC_BSD_OBJECT, 6),
+    VIDEO_CMD(MFC_AVC_FQM_STATE, 6),
+    VIDEO_CMD(MFC_AVC_INSERT_OBJECT, 6),
+    VIDEO_CMD(MFC_AVC_PAK_OBJECT, 6),
+    VIDEO_CMD(MFX_MPEG2_PIC_STATE, 6),
+    VIDEO_CMD(MFX_MPEG2_QM_STATE, 6),
+    VIDEO_CMD(MFD_MPEG2_BSD_OBJECT, 6),
+    VIDEO_CMD(MFC_MPEG2_SLICEGROUP_STATE, 6),
+    VIDEO_CMD(MFC_MPEG2_PAK_OBJECT, 6),
+    VIDEO_CMD(MFX_VC1_PIC_STATE, 6),
+    VIDEO_CMD(MFX_VC1_PRED_PIPE_STATE, 6),
+    VIDEO_CMD(MFX_VC1_DIRECTMODE_STATE, 6),
+    VIDEO_CMD(MFD_VC1_SHORT_PIC_STATE, 6),
+    VIDEO_CMD(MFD_VC1_LONG_PIC_STATE, 6),
+    VIDEO_CMD(MFD_VC1_BSD_OBJECT, 6),
+    VIDEO_CMD(MFX_JPEG_PIC_STATE, 7),
+    VIDEO_CMD(MFX_JPEG_HUFF_TABLE_STATE, 7),
+    VIDEO_CMD(MFC_JPEG_SCAN_OBJECT, 8),
+    VIDEO_CMD(MFC_JPEG_HUFF_TABLE_STATE, 8),
+    VIDEO_CMD(MFD_JPEG_BSD_OBJECT, 7),
+    VIDEO_CMD(MFX_VP8_PIC_STATE, 7),
+    VIDEO_CMD(MFD_VP8_BSD_OBJECT, 7),
+    VIDEO_CMD(MFX_VP8_ENCODER_CFG, 8),
+    VIDEO_CMD(MFX_VP8_BSP_BUF_BASE_ADDR_STATE, 8),
+    VIDEO_CMD(MFX_VP8_PAK_OBJECT, 8),
+
+    /* HCP */
+    VIDEO_CMD(HCP_PIPE_MODE_SELECT, 9),
+    VIDEO_CMD(HCP_SURFACE_STATE, 9),
+    VIDEO_CMD(HCP_PIPE_BUF_ADDR_STATE, 9),
+    VIDEO_CMD(HCP_IND_OBJ_BASE_ADDR_STATE, 9),
+    VIDEO_CMD(HCP_QM_STATE, 9),
+    VIDEO_CMD(HCP_FQM_STATE, 9),
+    VIDEO_CMD(HCP_RDOQ_STATE, 9),
+    VIDEO_CMD(HCP_PIC_STATE, 9),
+    VIDEO_CMD(HCP_TILE_STATE, 9),
+    VIDEO_CMD(HCP_REF_IDX_STATE, 9),
+    VIDEO_CMD(HCP_WEIGHTOFFSET, 9),
+    VIDEO_CMD(HCP_SLICE_STATE, 9),
+    VIDEO_CMD(HCP_BSD_OBJECT, 9),
+    VIDEO_CMD(HCP_PAK_OBJECT, 9),
+    VIDEO_CMD(HCP_INSERT_PAK_OBJECT, 9),
+    VIDEO_CMD(HCP_VP9_PIC_STATE, 9),
+    VIDEO_CMD(HCP_VP9_SEGMENT_STATE, 9),
+
+    /* HuC */
+    VIDEO_CMD(HUC_PIPE_MODE_SELECT, 9),
+    VIDEO_CMD(HUC_IMEM_STATE, 9),
+    VIDEO_CMD(HUC_DMEM_STATE, 9),
+    VIDEO_CMD(HUC_CFG_STATE, 9),
+    VIDEO_CMD(HUC_VIRTUAL_ADDR_STATE, 9),
+    VIDEO_CMD(HUC_IND_OBJ_BASE_ADDR_STATE, 9),
+    VIDEO_CMD(HUC_STREAM_OBJECT, 9),
+    VIDEO_CMD(HUC_START, 9),
+
+    /* VDEnc */
+    VIDEO_CMD(VD_PIPELINE_FLUSH, 9),
+    VIDEO_CMD(VDENC_PIPE_MODE_SELECT, 9),
+    VIDEO_CMD(VDENC_SRC_SURFACE_STATE, 9),
+    VIDEO_CMD(VDENC_REF_SURFACE_STATE, 9),
+    VIDEO_CMD(VDENC_DS_REF_SURFACE_STATE, 9),
+    VIDEO_CMD(VDENC_PIPE_BUF_ADDR_STATE, 9),
+    VIDEO_CMD(VDENC_IMG_STATE, 9),
+    VIDEO_CMD(VDENC_CONST_QPT_STATE, 9),
+    VIDEO_CMD(VDENC_WALKER_STATE, 9),
+    VIDEO_CMD(VDENC_WEIGHTSOFFSETS_STATE, 9),
+
+    /* VEBOX */
+    VEBOX_CMD(VEB_SURFACE_STATE),
+    VEBOX_CMD(VEB_STATE),
+    VEBOX_CMD(VEB_DNDI_IECP_STATE),
+};
+
+#define NUM_COMMANDS            (sizeof(commands) / sizeof(commands[0]))
+
+static inline bool
+command_matches(const struct command_desc *desc, unsigned int gen,
+                unsigned int ring, uint32_t dw)
+{
+    return (dw & desc->key_mask) == desc->key &&
+           (desc->ring == RING_ANY || desc->ring == ring) &&
+           (desc->min_gen == GEN_ANY || gen >= desc->min_gen) &&
+           (desc->max_gen == GEN_ANY || gen <= desc->max_gen);
+}
+
+/* Length rules of the command types for commands missing from the table */
+static void
+decode_unknown(uint32_t dw, struct intel_batch_command_info *info)
+{
+    info->name = NULL;
+
+    switch (CMD_TYPE(dw)) {
+    case CMD_TYPE_MI:
+        info->key = dw & MI_KEY_MASK;
+        info->length = MI_OPCODE(dw) < 0x10 ? 1 : (dw & 0x3f) + 2;
+        break;
+
+    case CMD_TYPE_BLT:
+        info->key = dw & BLT_KEY_MASK;
+        info->length = (dw & 0xff) + 2;
+        break;
+
+    case CMD_TYPE_GFX:
+        info->key = dw & GFX_KEY_MASK;
+
+        if (GFX_PIPELINE(dw) == 1)
+            info->length = 1;
+        else if (GFX_PIPELINE(dw) == 2)
+            info->length = (dw & 0xfff) + 2;
+        else
+            info->length = (dw & 0xff) + 2;
+        break;
+
+    default:
+        info->key = dw;
+        info->length = 1;
+        break;
+    }
+}
+
+unsigned int
+intel_batch_decode_command(unsigned int gen, unsigned int ring,
+                           const uint32_t *dwords, unsigned int remaining,
+                           struct intel_batch_command_info *info)
+{
+    const uint32_t dw = dwords[0];
+    unsigned int i;
+
+    ring &= I915_EXEC_RING_MASK;
+
+    for (i = 0; i < NUM_COMMANDS; i++) {
+        if (command_matches(&commands[i], gen, ring, dw))
+            break;
+    }
+
+    if (i < NUM_COMMANDS) {
+        info->key = commands[i].key;
+        info->name = commands[i].name;
+        info->length = commands[i].length_mask ?
+                       (dw & commands[i].length_mask) + 2 : 1;
+    } else
+        decode_unknown(dw, info);
+
+    if (info->length > remaining)
+        info->length = remaining;
+
+    return info->length;
+}
+
+void
+intel_batch_decode_stats_reset(struct intel_batch_decode_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+static void
+stats_add_command(struct intel_batch_decode_stats *stats,
+                  const struct intel_batch_command_info *info)
+{
+    struct intel_batch_command_stats *command;
+    unsigned int i;
+
+    for (i = 0; i < stats->num_commands; i++) {
+        if (stats->commands[i].key == info->key &&
+            stats->commands[i].name == info->name)
+            break;
+    }
+
+    if (i == stats->num_commands) {
+        if (stats->num_commands == INTEL_BATCH_DECODE_MAX_COMMANDS)
+            return;
+
+        command = &stats->commands[stats->num_commands++];
+        command->key = info->key;
+        command->name = info->name;
+    }
+
+    command = &stats->commands[i];
+    command->count++;
+    command->dwords += info->length;
+}
+
+void
+intel_batch_decode_batch(unsigned int gen, unsigned int ring,
+                         const uint32_t *dwords, unsigned int num_dwords,
+                         struct intel_batch_decode_stats *stats)
+{
+    struct intel_batch_command_info info;
+    unsigned int index = 0;
+
+    stats->num_batches++;
+    if (ring & INTEL_BATCH_TRACE_SECOND_LEVEL)
+        stats->num_second_level++;
+
+    while (index < num_dwords) {
+        index += intel_batch_decode_command(gen, ring, dwords + index,
+                                            num_dwords - index, &info);
+        stats->num_dwords += info.length;
+        if (!info.name)
+            stats->num_unknown++;
+
+        stats_add_command(stats, &info);
+
+        if (info.key == MI_BATCH_BUFFER_END_KEY)
+            break;
+    }
+}
+
+static int
+compare_command_stats(const void *a, const void *b)
+{
+    const struct intel_batch_command_stats *ca = a, *cb = b;
+
+    if (ca->dwords != cb->dwords)
+        return ca->dwords < cb->dwords ? 1 : -1;
+
+    return ca->count < cb->count ? 1 : ca->count > cb->count ? -1 : 0;
+}
+
+void
+intel_batch_decode_stats_sort(struct intel_batch_decode_stats *stats)
+{
+    qsort(stats->commands, stats->num_commands, sizeof(stats->commands[0]),
+          compare_command_stats);
+}
+
+void
+intel_batch_decode_stats_print(FILE *out,
+                               const struct intel_batch_decode_stats *stats)
+{
+    unsigned int i;
+
+    fprintf(out, "  %lu batches (%lu second level), %lu dwords, %lu relocations, "
+            "%lu unknown commands\n",
+            stats->num_batches, stats->num_second_level, stats->num_dwords,
+            stats->num_relocs, stats->num_unknown);
+
+    for (i = 0; i < stats->num_commands; i++) {
+        const struct intel_batch_command_stats * const command = &stats->commands[i];
+
+        if (command->name)
+            fprintf(out, "  %-44s", command->name);
+        else
+            fprintf(out, "  UNKNOWN 0x%08x%-26s", command->key, "");
+
+        fprintf(out, " %8lu %10lu\n", command->count, command->dwords);
+    }
+}
+
+int
+intel_batch_trace_open(struct intel_batch_trace_reader *reader,
+                       const char *path)
+{
+    memset(reader, 0, sizeof(*reader));
+
+    reader->file = fopen(path, "rb");
+    if (!reader->file)
+        return -1;
+
+    if (fread(&reader->header, sizeof(reader->header), 1, reader->file) != 1 ||
+        memcmp(reader->header.magic, INTEL_BATCH_TRACE_MAGIC,
+               sizeof(reader->header.magic)) ||
+        reader->header.version != INTEL_BATCH_TRACE_VERSION) {
+        intel_batch_trace_close(reader);
+        return -1;
+    }
+
+    return 0;
+}
+
+static bool
+reserve(void **buffer, unsigned int *max_count, unsigned int count,
+        size_t element_size)
+{
+    void *p;
+
+    if (count <= *max_count)
+        return true;
+
+    p = realloc(*buffer, count * element_size);
+    if (!p)
+        return false;
+
+    *buffer = p;
+    *max_count = count;
+    return true;
+}
+
+int
+intel_batch_trace_next(struct intel_batch_trace_reader *reader)
+{
+    struct intel_batch_trace_record * const record = &reader->record;
+
+    if (fread(record, sizeof(*record), 1, reader->file) != 1)
+        return feof(reader->file) ? 0 : -1;
+
+    switch (record->type) {
+    case INTEL_BATCH_TRACE_FRAME:
+        return record->type;
+
+    case INTEL_BATCH_TRACE_BATCH:
+        if (!reserve((void **)&reader->relocs, &reader->max_relocs,
+                     record->num_relocs, sizeof(*reader->relocs)) ||
+            !reserve((void **)&reader->dwords, &reader->max_dwords,
+                     record->num_dwords, sizeof(*reader->dwords)))
+            return -1;
+
+        if (fread(reader->relocs, sizeof(*reader->relocs), record->num_relocs,
+                  reader->file) != record->num_relocs ||
+            fread(reader->dwords, sizeof(*reader->dwords), record->num_dwords,
+                  reader->file) != record->num_dwords)
+            return -1;
+
+        return record->type;
+
+    default:
+        return -1;
+    }
+}
+
+void
+intel_batch_trace_close(struct intel_batch_trace_reader *reader)
+{
+    if (reader->file)
+        fclose(reader->file);
+
+    free(reader->dwords);
+    free(reader->relocs);
+    memset(reader, 0, sizeof(*reader));
+}
@@ -0,0 +1,117 @@
+/*
+ * intel_batchbuffer_decode.h - Offline decoding of batchbuffer traces
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef INTEL_BATCHBUFFER_DECODE_H
+#define INTEL_BATCHBUFFER_DECODE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "intel_batchbuffer_record.h"
+
+/** Maximum number of distinct commands tracked by the statistics */
+#define INTEL_BATCH_DECODE_MAX_COMMANDS 256
+
+/** A decoded command header */
+struct intel_batch_command_info {
+    uint32_t key;                       /* header bits identifying the command */
+    const char *name;                   /* NULL if unknown */
+    unsigned int length;                /* in DWORDs */
+};
+
+struct intel_batch_command_stats {
+    uint32_t key;
+    const char *name;
+    unsigned long count;
+    unsigned long dwords;
+};
+
+/** Per-command counts and DWORD totals of a set of batches */
+struct intel_batch_decode_stats {
+    unsigned long num_batches;
+    unsigned long num_second_level;     /* of num_batches */
+    unsigned long num_dwords;
+    unsigned long num_relocs;
+    unsigned long num_unknown;
+    unsigned int num_commands;
+    struct intel_batch_command_stats commands[INTEL_BATCH_DECODE_MAX_COMMANDS];
+};
+
+/** Sequential reader of a trace file written by intel_batch_recorder */
+struct intel_batch_trace_reader {
+    FILE *file;
+    struct intel_batch_trace_header header;
+    struct intel_batch_trace_record record;
+    uint32_t *dwords;
+    struct intel_batch_trace_reloc *relocs;
+    unsigned int max_dwords;
+    unsigned int max_relocs;
+};
+
+/**
+ * Decodes the command at dwords for a device of generation gen and the
+ * ring (I915_EXEC_*) the batch was submitted to. The returned length is
+ * at least 1 and at most remaining.
+ */
+unsigned int
+intel_batch_decode_command(unsigned int gen, unsigned int ring,
+                           const uint32_t *dwords, unsigned int remaining,
+                           struct intel_batch_command_info *info);
+
+void
+intel_batch_decode_stats_reset(struct intel_batch_decode_stats *stats);
+
+/** Walks a batch up to MI_BATCH_BUFFER_END and accumulates its commands */
+void
+intel_batch_decode_batch(unsigned int gen, unsigned int ring,
+                         const uint32_t *dwords, unsigned int num_dwords,
+                         struct intel_batch_decode_stats *stats);
+
+/** Sorts the command statistics by decreasing DWORD totals */
+void
+intel_batch_decode_stats_sort(struct intel_batch_decode_stats *stats);
+
+/** Prints the statistics, one line per command */
+void
+intel_batch_decode_stats_print(FILE *out,
+                               const struct intel_batch_decode_stats *stats);
+
+/** Opens a trace file and validates its header. Returns 0 on success. */
+int
+intel_batch_trace_open(struct intel_batch_trace_reader *reader,
+                       const char *path);
+
+/**
+ * Reads the next record. Returns its type, 0 at the end of the file and
+ * -1 if the file is truncated or corrupted.
+ */
+int
+intel_batch_trace_next(struct intel_batch_trace_reader *reader);
+
+void
+intel_batch_trace_close(struct intel_batch_trace_reader *reader);
+
+#endif /* INTEL_BATCHBUFFER_DECODE_H */
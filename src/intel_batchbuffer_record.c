@@ -0,0 +1,112 @@
+/*
+ * intel_batchbuffer_record.c - Binary capture of submitted batchbuffers
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sysdeps.h"
+#include "intel_batchbuffer_record.h"
+
+struct intel_batch_recorder *
+intel_batch_recorder_open(const char *path, unsigned int device_id,
+                          unsigned int gen)
+{
+    struct intel_batch_recorder *recorder;
+    struct intel_batch_trace_header header;
+
+    recorder = calloc(1, sizeof(*recorder));
+    if (!recorder)
+        return NULL;
+
+    recorder->file = fopen(path, "wb");
+    if (!recorder->file) {
+        free(recorder);
+        return NULL;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INTEL_BATCH_TRACE_MAGIC, sizeof(header.magic));
+    header.version = INTEL_BATCH_TRACE_VERSION;
+    header.device_id = device_id;
+    header.gen = gen;
+    fwrite(&header, sizeof(header), 1, recorder->file);
+
+    pthread_mutex_init(&recorder->mutex, NULL);
+
+    return recorder;
+}
+
+void
+intel_batch_recorder_close(struct intel_batch_recorder *recorder)
+{
+    if (!recorder)
+        return;
+
+    fclose(recorder->file);
+    pthread_mutex_destroy(&recorder->mutex);
+    free(recorder);
+}
+
+void
+intel_batch_recorder_write_batch(struct intel_batch_recorder *recorder,
+                                 unsigned int ring_flag,
+                                 const uint32_t *dwords,
+                                 unsigned int num_dwords,
+                                 const struct intel_batch_trace_reloc *relocs,
+                                 unsigned int num_relocs)
+{
+    struct intel_batch_trace_record record;
+
+    record.type = INTEL_BATCH_TRACE_BATCH;
+    record.ring_flag = ring_flag;
+    record.num_dwords = num_dwords;
+    record.num_relocs = num_relocs;
+
+    pthread_mutex_lock(&recorder->mutex);
+    fwrite(&record, sizeof(record), 1, recorder->file);
+    if (num_relocs)
+        fwrite(relocs, sizeof(*relocs), num_relocs, recorder->file);
+    fwrite(dwords, sizeof(*dwords), num_dwords, recorder->file);
+    recorder->num_batches++;
+
+    if ((ring_flag & INTEL_BATCH_TRACE_INCOMPLETE) &&
+        recorder->num_incomplete++ == 0)
+        fprintf(stderr, "batch trace: out of memory, relocations are missing\n");
+
+    pthread_mutex_unlock(&recorder->mutex);
+}
+
+void
+intel_batch_recorder_write_frame(struct intel_batch_recorder *recorder)
+{
+    struct intel_batch_trace_record record;
+
+    memset(&record, 0, sizeof(record));
+    record.type = INTEL_BATCH_TRACE_FRAME;
+
+    pthread_mutex_lock(&recorder->mutex);
+    fwrite(&record, sizeof(record), 1, recorder->file);
+    recorder->num_frames++;
+    fflush(recorder->file);
+    pthread_mutex_unlock(&recorder->mutex);
+}
@@ -0,0 +1,111 @@
+/*
+ * intel_batchbuffer_record.h - Binary capture of submitted batchbuffers
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef INTEL_BATCHBUFFER_RECORD_H
+#define INTEL_BATCHBUFFER_RECORD_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * Trace file layout, in host byte order:
+ *
+ *   struct intel_batch_trace_header
+ *   { struct intel_batch_trace_record
+ *     struct intel_batch_trace_reloc[num_relocs]
+ *     uint32_t dwords[num_dwords] }*
+ *
+ * A record of type INTEL_BATCH_TRACE_FRAME has neither relocations nor
+ * DWORDs and marks the end of a picture (vaEndPicture).
+ */
+#define INTEL_BATCH_TRACE_MAGIC         "I965BTRC"
+#define INTEL_BATCH_TRACE_VERSION       1
+
+#define INTEL_BATCH_TRACE_BATCH         1
+#define INTEL_BATCH_TRACE_FRAME         2
+
+/* In ring_flag, the batch ran through MI_BATCH_BUFFER_START from another one */
+#define INTEL_BATCH_TRACE_SECOND_LEVEL  (1u << 31)
+
+/* In ring_flag, some relocations of the batch couldn't be recorded */
+#define INTEL_BATCH_TRACE_INCOMPLETE    (1u << 30)
+
+struct intel_batch_trace_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t device_id;
+    uint32_t gen;
+    uint32_t reserved;
+};
+
+struct intel_batch_trace_record {
+    uint32_t type;
+    uint32_t ring_flag;                 /* I915_EXEC_* flags of the batch */
+    uint32_t num_dwords;
+    uint32_t num_relocs;
+};
+
+struct intel_batch_trace_reloc {
+    uint32_t offset;                    /* byte offset in the batch */
+    uint32_t delta;
+    uint32_t read_domains;
+    uint32_t write_domain;
+    uint32_t target_handle;
+    uint32_t target_size;
+};
+
+/** Writer of a trace file, shared by all the batchbuffers of a driver */
+struct intel_batch_recorder {
+    FILE *file;
+    pthread_mutex_t mutex;
+    unsigned int num_batches;
+    unsigned int num_frames;
+    unsigned int num_incomplete;
+};
+
+/** Creates the trace file path. Returns NULL on failure. */
+struct intel_batch_recorder *
+intel_batch_recorder_open(const char *path, unsigned int device_id,
+                          unsigned int gen);
+
+void
+intel_batch_recorder_close(struct intel_batch_recorder *recorder);
+
+/** Appends one batch with its relocation list */
+void
+intel_batch_recorder_write_batch(struct intel_batch_recorder *recorder,
+                                 unsigned int ring_flag,
+                                 const uint32_t *dwords,
+                                 unsigned int num_dwords,
+                                 const struct intel_batch_trace_reloc *relocs,
+                                 unsigned int num_relocs);
+
+/** Appends an end of picture marker */
+void
+intel_batch_recorder_write_frame(struct intel_batch_recorder *recorder);
+
+#endif /* INTEL_BATCHBUFFER_RECORD_H */
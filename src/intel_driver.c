@@ -32,8 +32,14 @@
 #include <va/va_drmcommon.h>
 
 #include "intel_batchbuffer.h"
+#include "intel_batchbuffer_record.h"
 #include "intel_memman.h"
 #include "intel_driver.h"
+
+#if HAVE_NULL_HW
+#include "intel_null_hw.h"
+#endif
+
 uint32_t g_intel_debug_option_flags = 0;
 
 #ifdef I915_PARAM_HAS_BSD2
@@ -59,12 +65,16 @@ uint32_t g_intel_debug_option_flags = 0;
 static Bool
 intel_driver_get_param(struct intel_driver_data *intel, int param, int *value)
 {
+#if HAVE_NULL_HW
+    return intel_null_hw_get_param(intel->bufmgr, param, value);
+#else
     struct drm_i915_getparam gp;
 
     gp.param = param;
     gp.value = value;
 
     return drmCommandWriteRead(intel->fd, DRM_I915_GETPARAM, &gp, sizeof(gp)) == 0;
+#endif
 }
 
 static void intel_driver_get_revid(struct intel_driver_data *intel, int *value)
@@ -107,6 +117,13 @@ intel_driver_init(VADriverContextP ctx)
         fprintf(stderr, "g_intel_debug_option_flags:%x\n", g_intel_debug_option_flags);
 
     ASSERT_RET(drm_state, false);
+
+#if HAVE_NULL_HW
+    /* Any file descriptor will do, nothing is sent to the kernel */
+    intel->fd = drm_state->fd;
+    intel->dri2Enabled = 1;
+    intel->null_hw = 1;
+#else
     ASSERT_RET((VA_CHECK_DRM_AUTH_TYPE(ctx, VA_DRM_AUTH_DRI1) ||
                 VA_CHECK_DRM_AUTH_TYPE(ctx, VA_DRM_AUTH_DRI2) ||
                 VA_CHECK_DRM_AUTH_TYPE(ctx, VA_DRM_AUTH_CUSTOM)),
@@ -115,14 +132,12 @@ intel_driver_init(VADriverContextP ctx)
     intel->fd = drm_state->fd;
     intel->dri2Enabled = (VA_CHECK_DRM_AUTH_TYPE(ctx, VA_DRM_AUTH_DRI2) ||
                           VA_CHECK_DRM_AUTH_TYPE(ctx, VA_DRM_AUTH_CUSTOM));
+#endif
 
     if (!intel->dri2Enabled) {
         return false;
     }
 
-    intel->locked = 0;
-    pthread_mutex_init(&intel->ctxmutex, NULL);
-
     if (!intel_memman_init(intel))
         return false;
 
@@ -145,6 +160,10 @@ intel_driver_init(VADriverContextP ctx)
     if (intel_driver_get_param(intel, LOCAL_I915_PARAM_HAS_BSD2, &ret_value))
         intel->has_bsd2 = !!ret_value;
 
+    intel->has_llc = 0;
+    if (intel_driver_get_param(intel, I915_PARAM_HAS_LLC, &ret_value))
+        intel->has_llc = !!ret_value;
+
     intel->has_huc = 0;
     ret_value = 0;
 
@@ -165,6 +184,36 @@ intel_driver_init(VADriverContextP ctx)
         intel->mocs_state = GEN9_PTE_CACHE;
 
     intel_driver_get_revid(intel, &intel->revision);
+
+    intel->batch_ring_size = INTEL_BATCH_RING_SIZE;
+    if ((env_str = getenv("VA_INTEL_BATCH_RING"))) {
+        int ring_size = atoi(env_str);
+
+        if (ring_size > 0)
+            intel->batch_ring_size = MIN(ring_size, INTEL_BATCH_RING_MAX);
+    }
+
+    intel->submit_queue = NULL;
+    if ((env_str = getenv("VA_INTEL_DEFERRED_SUBMIT")) && atoi(env_str) > 0) {
+        unsigned int delay_us = INTEL_SUBMIT_DELAY_US;
+        char *delay_str;
+
+        if ((delay_str = getenv("VA_INTEL_DEFERRED_SUBMIT_DELAY")))
+            delay_us = atoi(delay_str);
+
+        if (!intel_submit_queue_init(intel, atoi(env_str), delay_us))
+            fprintf(stderr, "failed to start the deferred submission thread\n");
+    }
+
+    intel->batch_recorder = NULL;
+    if ((env_str = getenv("VA_INTEL_BATCH_RECORD"))) {
+        intel->batch_recorder = intel_batch_recorder_open(env_str,
+                                                          intel->device_id,
+                                                          intel->device_info->gen);
+        if (!intel->batch_recorder)
+            fprintf(stderr, "failed to create the batch record file %s\n", env_str);
+    }
+
     return true;
 }
 
@@ -173,6 +222,10 @@ intel_driver_terminate(VADriverContextP ctx)
 {
     struct intel_driver_data *intel = intel_driver_data(ctx);
 
+    intel_submit_queue_terminate(intel);
+
+    intel_batch_recorder_close(intel->batch_recorder);
+    intel->batch_recorder = NULL;
+
     intel_memman_terminate(intel);
-    pthread_mutex_destroy(&intel->ctxmutex);
 }
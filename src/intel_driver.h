@@ -3,7 +3,6 @@
 
 #include <stddef.h>
 #include <pthread.h>
-#include <signal.h>
 #include <stdbool.h>
 
 #include <drm.h>
@@ -61,6 +60,11 @@
 
 #define GEN8_XY_COLOR_BLT_CMD                   (CMD_2D | (0x50 << 22) | 0x05)
 
+/* Selects Y-tiling for the XY_ blitter commands with a TILED bit */
+#define BCS_SWCTRL                              0x22200
+#define   BCS_SWCTRL_SRC_Y                              (1 << 0)
+#define   BCS_SWCTRL_DST_Y                              (1 << 1)
+
 /* BR13 */
 #define BR13_8                                  (0x0 << 24)
 #define BR13_565                                (0x1 << 24)
@@ -110,6 +114,7 @@ extern uint32_t g_intel_debug_option_flags;
 #define VA_INTEL_DEBUG_OPTION_ASSERT    (1 << 0)
 #define VA_INTEL_DEBUG_OPTION_BENCH     (1 << 1)
 #define VA_INTEL_DEBUG_OPTION_DUMP_AUB  (1 << 2)
+#define VA_INTEL_DEBUG_OPTION_STATS     (1 << 3)
 
 #define ASSERT_RET(value, fail_ret) do {    \
         if (!(value)) {                     \
@@ -119,31 +124,6 @@ extern uint32_t g_intel_debug_option_flags;
         }                                   \
     } while (0)
 
-#define SET_BLOCKED_SIGSET()   do {     \
-        sigset_t bl_mask;               \
-        sigfillset(&bl_mask);           \
-        sigdelset(&bl_mask, SIGFPE);    \
-        sigdelset(&bl_mask, SIGILL);    \
-        sigdelset(&bl_mask, SIGSEGV);   \
-        sigdelset(&bl_mask, SIGBUS);    \
-        sigdelset(&bl_mask, SIGKILL);   \
-        pthread_sigmask(SIG_SETMASK, &bl_mask, &intel->sa_mask); \
-    } while (0)
-
-#define RESTORE_BLOCKED_SIGSET() do {    \
-        pthread_sigmask(SIG_SETMASK, &intel->sa_mask, NULL); \
-    } while (0)
-
-#define PPTHREAD_MUTEX_LOCK() do {             \
-        SET_BLOCKED_SIGSET();                  \
-        pthread_mutex_lock(&intel->ctxmutex);       \
-    } while (0)
-
-#define PPTHREAD_MUTEX_UNLOCK() do {           \
-        pthread_mutex_unlock(&intel->ctxmutex);     \
-        RESTORE_BLOCKED_SIGSET();              \
-    } while (0)
-
 #define WARN_ONCE(...) do {                     \
         static int g_once = 1;                  \
         if (g_once) {                           \
@@ -171,6 +151,9 @@ struct intel_device_info {
     unsigned int is_cfllake     : 1;
 };
 
+struct intel_batch_recorder;
+struct intel_submit_queue;
+
 struct intel_driver_data {
     int fd;
     int device_id;
@@ -178,10 +161,6 @@ struct intel_driver_data {
 
     int dri2Enabled;
 
-    sigset_t sa_mask;
-    pthread_mutex_t ctxmutex;
-    int locked;
-
     dri_bufmgr *bufmgr;
 
     unsigned int has_exec2  : 1; /* Flag: has execbuffer2? */
@@ -190,11 +169,30 @@ struct intel_driver_data {
     unsigned int has_vebox  : 1; /* Flag: has VEBOX unit */
     unsigned int has_bsd2   : 1; /* Flag: has the second BSD video ring unit */
     unsigned int has_huc    : 1; /* Flag: has a fully loaded HuC firmware? */
+    unsigned int has_llc    : 1; /* Flag: CPU and GPU share the last level cache */
+    unsigned int null_hw    : 1; /* Flag: batches are recorded, not executed */
 
     int eu_total;
 
     const struct intel_device_info *device_info;
     unsigned int mocs_state;
+
+    struct intel_batch_recorder *batch_recorder; /* VA_INTEL_BATCH_RECORD */
+
+    /* Redundant state elimination, summed up over the freed batches */
+    unsigned long state_dwords_emitted;
+    unsigned long state_dwords_saved;
+
+    /* Batch buffer ring, VA_INTEL_BATCH_RING and its counters */
+    unsigned int batch_ring_size;
+    unsigned long batch_bo_allocs;
+    unsigned long batch_bo_reuses;
+    unsigned long batch_bo_stalls;
+
+    /* Deferred submission, VA_INTEL_DEFERRED_SUBMIT, and its counters */
+    struct intel_submit_queue *submit_queue;
+    unsigned long submit_batches;
+    unsigned long submit_execs;
 };
 
 bool intel_driver_init(VADriverContextP ctx);
@@ -0,0 +1,433 @@
+/*
+ * intel_null_hw.c - Null hardware stand-in for libdrm_intel
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sysdeps.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <drm.h>
+#include <i915_drm.h>
+
+#include "intel_null_hw.h"
+
+#define NULL_HW_PAGE_SIZE               4096
+#define NULL_HW_ALIGN(x, a)             (((x) + (a) - 1) & ~((unsigned long)(a) - 1))
+
+struct _drm_intel_bufmgr {
+    pthread_mutex_t mutex;
+    int devid;
+    int next_handle;
+    uint64_t next_offset;               /* presumed GPU address of the next buffer object */
+    struct intel_null_hw_stats stats;
+};
+
+struct null_hw_reloc {
+    uint32_t offset;
+    drm_intel_bo *target;
+};
+
+struct null_hw_bo {
+    drm_intel_bo base;
+    int refcount;                       /* atomic */
+    int map_count;
+    void *mem;
+    uint32_t tiling;
+    int busy;                           /* atomic, set by intel_null_hw_bo_set_busy() */
+    struct null_hw_reloc *relocs;
+    unsigned int num_relocs;
+    unsigned int max_relocs;
+};
+
+static inline struct null_hw_bo *
+null_hw_bo(drm_intel_bo *bo)
+{
+    return (struct null_hw_bo *)bo;
+}
+
+drm_intel_bufmgr *
+drm_intel_bufmgr_gem_init(int fd, int batch_size)
+{
+    drm_intel_bufmgr *bufmgr;
+    const char *env_str;
+
+    bufmgr = calloc(1, sizeof(*bufmgr));
+    if (!bufmgr)
+        return NULL;
+
+    pthread_mutex_init(&bufmgr->mutex, NULL);
+    bufmgr->devid = INTEL_NULL_HW_DEVID;
+    if ((env_str = getenv("VA_INTEL_NULL_HW_DEVID")))
+        bufmgr->devid = strtol(env_str, NULL, 0);
+    bufmgr->next_handle = 1;
+    bufmgr->next_offset = NULL_HW_PAGE_SIZE;
+
+    return bufmgr;
+}
+
+void
+drm_intel_bufmgr_destroy(drm_intel_bufmgr *bufmgr)
+{
+    pthread_mutex_destroy(&bufmgr->mutex);
+    free(bufmgr);
+}
+
+void
+drm_intel_bufmgr_gem_enable_reuse(drm_intel_bufmgr *bufmgr)
+{
+}
+
+void
+drm_intel_bufmgr_gem_set_aub_filename(drm_intel_bufmgr *bufmgr, const char *filename)
+{
+}
+
+void
+drm_intel_bufmgr_gem_set_aub_dump(drm_intel_bufmgr *bufmgr, int enable)
+{
+}
+
+int
+drm_intel_bufmgr_gem_get_devid(drm_intel_bufmgr *bufmgr)
+{
+    return bufmgr->devid;
+}
+
+bool
+intel_null_hw_get_param(drm_intel_bufmgr *bufmgr, int param, int *value)
+{
+    switch (param) {
+    case I915_PARAM_HAS_EXECBUF2:
+    case I915_PARAM_HAS_BSD:
+    case I915_PARAM_HAS_BLT:
+    case I915_PARAM_HAS_LLC:
+    case I915_PARAM_HAS_VEBOX:
+        *value = 1;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+void
+intel_null_hw_get_stats(drm_intel_bufmgr *bufmgr, struct intel_null_hw_stats *stats)
+{
+    pthread_mutex_lock(&bufmgr->mutex);
+    *stats = bufmgr->stats;
+    pthread_mutex_unlock(&bufmgr->mutex);
+}
+
+void
+intel_null_hw_bo_set_busy(drm_intel_bo *bo, bool busy)
+{
+    __atomic_store_n(&null_hw_bo(bo)->busy, busy, __ATOMIC_RELAXED);
+}
+
+static drm_intel_bo *
+null_hw_bo_alloc(drm_intel_bufmgr *bufmgr, const char *name, unsigned long size,
+                 unsigned int alignment, uint32_t tiling)
+{
+    struct null_hw_bo *bo;
+
+    /* GEM objects are whole pages */
+    size = NULL_HW_ALIGN(size ? size : 1, NULL_HW_PAGE_SIZE);
+
+    bo = calloc(1, sizeof(*bo));
+    if (!bo)
+        return NULL;
+
+    bo->mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bo->mem == MAP_FAILED) {
+        free(bo);
+        return NULL;
+    }
+
+    bo->refcount = 1;
+    bo->tiling = tiling;
+    bo->base.size = size;
+    bo->base.align = alignment;
+    bo->base.bufmgr = bufmgr;
+
+    pthread_mutex_lock(&bufmgr->mutex);
+    bo->base.handle = bufmgr->next_handle++;
+    bo->base.offset64 = bufmgr->next_offset;
+    bo->base.offset = bo->base.offset64;
+    bufmgr->next_offset += size;
+    bufmgr->stats.bo_allocs++;
+    bufmgr->stats.bo_bytes += size;
+    pthread_mutex_unlock(&bufmgr->mutex);
+
+    return &bo->base;
+}
+
+drm_intel_bo *
+drm_intel_bo_alloc(drm_intel_bufmgr *bufmgr, const char *name,
+                   unsigned long size, unsigned int alignment)
+{
+    return null_hw_bo_alloc(bufmgr, name, size, alignment, I915_TILING_NONE);
+}
+
+drm_intel_bo *
+drm_intel_bo_alloc_tiled(drm_intel_bufmgr *bufmgr, const char *name,
+                         int x, int y, int cpp, uint32_t *tiling_mode,
+                         unsigned long *pitch, unsigned long flags)
+{
+    unsigned long stride = (unsigned long)x * cpp;
+    unsigned long height = y;
+
+    /* Same layout as the kernel would need */
+    if (*tiling_mode == I915_TILING_X) {
+        stride = NULL_HW_ALIGN(stride, 512);
+        height = NULL_HW_ALIGN(height, 8);
+    } else if (*tiling_mode == I915_TILING_Y) {
+        stride = NULL_HW_ALIGN(stride, 128);
+        height = NULL_HW_ALIGN(height, 32);
+    } else
+        stride = NULL_HW_ALIGN(stride, 64);
+
+    *pitch = stride;
+
+    return null_hw_bo_alloc(bufmgr, name, stride * height, 0, *tiling_mode);
+}
+
+/* Nothing is shared without a kernel */
+drm_intel_bo *
+drm_intel_bo_gem_create_from_name(drm_intel_bufmgr *bufmgr, const char *name,
+                                  unsigned int handle)
+{
+    return NULL;
+}
+
+drm_intel_bo *
+drm_intel_bo_gem_create_from_prime(drm_intel_bufmgr *bufmgr, int prime_fd, int size)
+{
+    return NULL;
+}
+
+int
+drm_intel_bo_gem_export_to_prime(drm_intel_bo *bo, int *prime_fd)
+{
+    return -ENODEV;
+}
+
+int
+drm_intel_bo_flink(drm_intel_bo *bo, uint32_t *name)
+{
+    return -ENODEV;
+}
+
+void
+drm_intel_bo_reference(drm_intel_bo *bo)
+{
+    __atomic_add_fetch(&null_hw_bo(bo)->refcount, 1, __ATOMIC_RELAXED);
+}
+
+void
+drm_intel_gem_bo_clear_relocs(drm_intel_bo *bo, int start)
+{
+    struct null_hw_bo * const nbo = null_hw_bo(bo);
+    unsigned int i;
+
+    for (i = start; i < nbo->num_relocs; i++)
+        drm_intel_bo_unreference(nbo->relocs[i].target);
+
+    if ((unsigned int)start < nbo->num_relocs)
+        nbo->num_relocs = start;
+}
+
+void
+drm_intel_bo_unreference(drm_intel_bo *bo)
+{
+    struct null_hw_bo * const nbo = null_hw_bo(bo);
+    drm_intel_bufmgr * const bufmgr = bo ? bo->bufmgr : NULL;
+
+    if (!bo || __atomic_sub_fetch(&nbo->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+
+    drm_intel_gem_bo_clear_relocs(bo, 0);
+    free(nbo->relocs);
+    munmap(nbo->mem, bo->size);
+
+    pthread_mutex_lock(&bufmgr->mutex);
+    bufmgr->stats.bo_bytes -= bo->size;
+    pthread_mutex_unlock(&bufmgr->mutex);
+
+    free(nbo);
+}
+
+/* The memory never moves, all kinds of mappings are the same */
+int
+drm_intel_bo_map(drm_intel_bo *bo, int write_enable)
+{
+    struct null_hw_bo * const nbo = null_hw_bo(bo);
+
+    pthread_mutex_lock(&bo->bufmgr->mutex);
+    nbo->map_count++;
+    bo->virtual = nbo->mem;
+    pthread_mutex_unlock(&bo->bufmgr->mutex);
+
+    return 0;
+}
+
+int
+drm_intel_bo_unmap(drm_intel_bo *bo)
+{
+    struct null_hw_bo * const nbo = null_hw_bo(bo);
+
+    pthread_mutex_lock(&bo->bufmgr->mutex);
+    if (nbo->map_count > 0 && --nbo->map_count == 0)
+        bo->virtual = NULL;
+    pthread_mutex_unlock(&bo->bufmgr->mutex);
+
+    return 0;
+}
+
+int
+drm_intel_gem_bo_map_gtt(drm_intel_bo *bo)
+{
+    return drm_intel_bo_map(bo, 1);
+}
+
+int
+drm_intel_gem_bo_map_unsynchronized(drm_intel_bo *bo)
+{
+    return drm_intel_bo_map(bo, 1);
+}
+
+int
+drm_intel_gem_bo_unmap_gtt(drm_intel_bo *bo)
+{
+    return drm_intel_bo_unmap(bo);
+}
+
+int
+drm_intel_bo_subdata(drm_intel_bo *bo, unsigned long offset,
+                     unsigned long size, const void *data)
+{
+    if (offset + size > bo->size)
+        return -EINVAL;
+
+    memcpy((uint8_t *)null_hw_bo(bo)->mem + offset, data, size);
+    return 0;
+}
+
+int
+drm_intel_bo_get_subdata(drm_intel_bo *bo, unsigned long offset,
+                         unsigned long size, void *data)
+{
+    if (offset + size > bo->size)
+        return -EINVAL;
+
+    memcpy(data, (const uint8_t *)null_hw_bo(bo)->mem + offset, size);
+    return 0;
+}
+
+int
+drm_intel_bo_get_tiling(drm_intel_bo *bo, uint32_t *tiling_mode,
+                        uint32_t *swizzle_mode)
+{
+    *tiling_mode = null_hw_bo(bo)->tiling;
+    *swizzle_mode = I915_BIT_6_SWIZZLE_NONE;
+    return 0;
+}
+
+/* The GPU never holds on to a buffer object, unless a test pretends so */
+int
+drm_intel_bo_busy(drm_intel_bo *bo)
+{
+    return __atomic_load_n(&null_hw_bo(bo)->busy, __ATOMIC_RELAXED);
+}
+
+void
+drm_intel_bo_wait_rendering(drm_intel_bo *bo)
+{
+}
+
+int
+drm_intel_gem_bo_wait(drm_intel_bo *bo, int64_t timeout_ns)
+{
+    return 0;
+}
+
+int
+drm_intel_bo_emit_reloc(drm_intel_bo *bo, uint32_t offset,
+                        drm_intel_bo *target_bo, uint32_t target_offset,
+                        uint32_t read_domains, uint32_t write_domain)
+{
+    struct null_hw_bo * const nbo = null_hw_bo(bo);
+
+    if (nbo->num_relocs == nbo->max_relocs) {
+        unsigned int max_relocs = nbo->max_relocs ? 2 * nbo->max_relocs : 64;
+        struct null_hw_reloc *relocs;
+
+        relocs = realloc(nbo->relocs, max_relocs * sizeof(*relocs));
+        if (!relocs)
+            return -ENOMEM;
+
+        nbo->relocs = relocs;
+        nbo->max_relocs = max_relocs;
+    }
+
+    drm_intel_bo_reference(target_bo);
+    nbo->relocs[nbo->num_relocs].offset = offset;
+    nbo->relocs[nbo->num_relocs++].target = target_bo;
+
+    return 0;
+}
+
+int
+drm_intel_bo_references(drm_intel_bo *bo, drm_intel_bo *target_bo)
+{
+    struct null_hw_bo * const nbo = null_hw_bo(bo);
+    unsigned int i;
+
+    if (bo == target_bo)
+        return 1;
+
+    for (i = 0; i < nbo->num_relocs; i++) {
+        if (drm_intel_bo_references(nbo->relocs[i].target, target_bo))
+            return 1;
+    }
+
+    return 0;
+}
+
+/* Records the batch instead of executing it */
+int
+drm_intel_bo_mrb_exec(drm_intel_bo *bo, int used,
+                      struct drm_clip_rect *cliprects, int num_cliprects,
+                      int DR4, unsigned int flags)
+{
+    drm_intel_bufmgr * const bufmgr = bo->bufmgr;
+
+    pthread_mutex_lock(&bufmgr->mutex);
+    bufmgr->stats.batches++;
+    bufmgr->stats.batch_bytes += used;
+    pthread_mutex_unlock(&bufmgr->mutex);
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * intel_null_hw.h - Null hardware stand-in for libdrm_intel
+ *
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef INTEL_NULL_HW_H
+#define INTEL_NULL_HW_H
+
+#include <stdbool.h>
+#include <intel_bufmgr.h>
+
+/*
+ * Builds configured with the null hardware backend link this instead of
+ * libdrm_intel. Buffer objects are anonymous memory, idle unless a test
+ * says otherwise, and execbuffers are counted but never reach a kernel, so
+ * the driver runs all its CPU paths on machines without an i915 device.
+ */
+
+/** Device reported unless VA_INTEL_NULL_HW_DEVID names another one, Skylake GT2 */
+#define INTEL_NULL_HW_DEVID             0x1912
+
+struct intel_null_hw_stats {
+    unsigned long batches;              /* execbuffers recorded */
+    unsigned long batch_bytes;
+    unsigned long bo_allocs;
+    unsigned long bo_bytes;             /* allocated right now */
+};
+
+/** Answers I915_GETPARAM like a kernel with all rings, execbuffer2 and LLC */
+bool
+intel_null_hw_get_param(drm_intel_bufmgr *bufmgr, int param, int *value);
+
+void
+intel_null_hw_get_stats(drm_intel_bufmgr *bufmgr, struct intel_null_hw_stats *stats);
+
+/** Makes drm_intel_bo_busy() report bo as still used by the GPU, for tests */
+void
+intel_null_hw_bo_set_busy(drm_intel_bo *bo, bool busy);
+
+#endif /* INTEL_NULL_HW_H */
@@ -34,29 +34,99 @@
 #define LAST_FREE   -1
 #define ALLOCATED   -2
 
+#define OBJECT_HEAP_LOAD(p)         __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define OBJECT_HEAP_STORE(p, v)     __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define OBJECT_HEAP_CAS(p, o, n)                                        \
+    __atomic_compare_exchange_n((p), (o), (n), 0,                       \
+                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
+/* Same layout as the free list head in struct object_heap */
+typedef union {
+    struct {
+        int next_free;
+        unsigned int next_free_tag;
+    };
+    uint64_t free_list;
+} object_heap_free_head;
+
+static inline object_base_p
+object_heap_get(object_heap_p heap, void *bucket, int index)
+{
+    return (object_base_p)(bucket + (index % heap->heap_increment) * heap->object_size);
+}
+
+static inline object_base_p
+object_heap_slot(object_heap_p heap, int index)
+{
+    void *bucket = OBJECT_HEAP_LOAD(&heap->bucket[index / heap->heap_increment]);
+
+    return object_heap_get(heap, bucket, index);
+}
+
+/*
+ * Pushes the chain first..last (already linked through next_free) onto
+ * the free list
+ */
+static void
+object_heap_push(object_heap_p heap, object_base_p first, object_base_p last)
+{
+    object_heap_free_head head, new_head;
+    int index = first->id & OBJECT_HEAP_INDEX_MASK;
+
+    head.free_list = OBJECT_HEAP_LOAD(&heap->free_list);
+
+    do {
+        OBJECT_HEAP_STORE(&last->next_free, head.next_free);
+        new_head.next_free = index;
+        new_head.next_free_tag = head.next_free_tag + 1;
+    } while (!OBJECT_HEAP_CAS(&heap->free_list, &head.free_list, new_head.free_list));
+}
+
+/*
+ * Pops an object from the free list
+ * Returns NULL if the free list is empty
+ */
+static object_base_p
+object_heap_pop(object_heap_p heap)
+{
+    object_heap_free_head head, new_head;
+    object_base_p obj;
+
+    head.free_list = OBJECT_HEAP_LOAD(&heap->free_list);
+
+    do {
+        if (LAST_FREE == head.next_free)
+            return NULL;
+
+        ASSERT(head.next_free >= 0);
+
+        /*
+         * Buckets are never released before the heap is destroyed, so
+         * reading a slot that another thread just popped is harmless:
+         * the tag makes the CAS below fail in that case.
+         */
+        obj = object_heap_slot(heap, head.next_free);
+        new_head.next_free = OBJECT_HEAP_LOAD(&obj->next_free);
+        new_head.next_free_tag = head.next_free_tag + 1;
+    } while (!OBJECT_HEAP_CAS(&heap->free_list, &head.free_list, new_head.free_list));
+
+    return obj;
+}
+
 /*
- * Expands the heap
+ * Expands the heap, must be called with heap->mutex held
  * Return 0 on success, -1 on error
  */
 static int object_heap_expand(object_heap_p heap)
 {
     int i;
     void *new_heap_index;
-    int next_free;
+    object_base_p obj;
     int new_heap_size = heap->heap_size + heap->heap_increment;
     int bucket_index = new_heap_size / heap->heap_increment - 1;
 
-    if (bucket_index >= heap->num_buckets) {
-        int new_num_buckets = heap->num_buckets + 8;
-        void **new_bucket;
-
-        new_bucket = realloc(heap->bucket, new_num_buckets * sizeof(void *));
-        if (NULL == new_bucket) {
-            return -1;
-        }
-
-        heap->num_buckets = new_num_buckets;
-        heap->bucket = new_bucket;
+    if (bucket_index >= heap->max_buckets) {
+        return -1; /* Out of object IDs */
     }
 
     new_heap_index = (void *) malloc(heap->heap_increment * heap->object_size);
@@ -64,16 +134,21 @@ static int object_heap_expand(object_heap_p heap)
         return -1; /* Out of memory */
     }
 
-    heap->bucket[bucket_index] = new_heap_index;
-    next_free = heap->next_free;
-    for (i = new_heap_size; i-- > heap->heap_size;) {
-        object_base_p obj = (object_base_p)(new_heap_index + (i - heap->heap_size) * heap->object_size);
+    for (i = heap->heap_size; i < new_heap_size; i++) {
+        obj = object_heap_get(heap, new_heap_index, i);
         obj->id = i + heap->id_offset;
-        obj->next_free = next_free;
-        next_free = i;
+        obj->next_free = i + 1;
     }
-    heap->next_free = next_free;
-    heap->heap_size = new_heap_size;
+
+    /* Publish the bucket before any lookup can see an index inside it */
+    OBJECT_HEAP_STORE(&heap->bucket[bucket_index], new_heap_index);
+    OBJECT_HEAP_STORE(&heap->heap_size, new_heap_size);
+    heap->num_buckets = bucket_index + 1;
+
+    object_heap_push(heap,
+                     object_heap_get(heap, new_heap_index, new_heap_size - heap->heap_increment),
+                     object_heap_get(heap, new_heap_index, new_heap_size - 1));
+
     return 0; /* Success */
 }
 
@@ -87,10 +162,12 @@ int object_heap_init(object_heap_p heap, int object_size, int id_offset)
     heap->heap_size = 0;
     heap->heap_increment = 16;
     heap->next_free = LAST_FREE;
+    heap->next_free_tag = 0;
     heap->num_buckets = 0;
-    heap->bucket = NULL;
+    heap->max_buckets = OBJECT_HEAP_MAX_OBJECTS / heap->heap_increment;
+    heap->bucket = calloc(heap->max_buckets, sizeof(void *));
 
-    if (object_heap_expand(heap) == 0) {
+    if (heap->bucket && object_heap_expand(heap) == 0) {
         ASSERT(heap->heap_size);
         _i965InitMutex(&heap->mutex);
         return 0;
@@ -99,6 +176,7 @@ int object_heap_init(object_heap_p heap, int object_size, int id_offset)
         ASSERT(!heap->bucket || !heap->bucket[0]);
 
         free(heap->bucket);
+        heap->bucket = NULL;
 
         return -1;
     }
@@ -111,25 +189,20 @@ int object_heap_init(object_heap_p heap, int object_size, int id_offset)
 int object_heap_allocate(object_heap_p heap)
 {
     object_base_p obj;
-    int bucket_index, obj_index;
 
-    _i965LockMutex(&heap->mutex);
-    if (LAST_FREE == heap->next_free) {
-        if (-1 == object_heap_expand(heap)) {
-            _i965UnlockMutex(&heap->mutex);
-            return -1; /* Out of memory */
-        }
-    }
-    ASSERT(heap->next_free >= 0);
+    while (NULL == (obj = object_heap_pop(heap))) {
+        int ret = 0;
 
-    bucket_index = heap->next_free / heap->heap_increment;
-    obj_index = heap->next_free % heap->heap_increment;
+        _i965LockMutex(&heap->mutex);
+        if (LAST_FREE == OBJECT_HEAP_LOAD(&heap->next_free))
+            ret = object_heap_expand(heap);
+        _i965UnlockMutex(&heap->mutex);
 
-    obj = (object_base_p)(heap->bucket[bucket_index] + obj_index * heap->object_size);
-    heap->next_free = obj->next_free;
-    _i965UnlockMutex(&heap->mutex);
+        if (-1 == ret)
+            return -1; /* Out of memory */
+    }
 
-    obj->next_free = ALLOCATED;
+    OBJECT_HEAP_STORE(&obj->next_free, ALLOCATED);
     return obj->id;
 }
 
@@ -140,21 +213,19 @@ int object_heap_allocate(object_heap_p heap)
 object_base_p object_heap_lookup(object_heap_p heap, int id)
 {
     object_base_p obj;
-    int bucket_index, obj_index;
+    int index = id & OBJECT_HEAP_INDEX_MASK;
 
-    _i965LockMutex(&heap->mutex);
-    if ((id < heap->id_offset) || (id > (heap->heap_size + heap->id_offset))) {
-        _i965UnlockMutex(&heap->mutex);
+    if ((id < 0) ||
+        ((id & OBJECT_HEAP_OFFSET_MASK) != heap->id_offset) ||
+        (index >= OBJECT_HEAP_LOAD(&heap->heap_size))) {
         return NULL;
     }
-    id &= OBJECT_HEAP_ID_MASK;
-    bucket_index = id / heap->heap_increment;
-    obj_index = id % heap->heap_increment;
-    obj = (object_base_p)(heap->bucket[bucket_index] + obj_index * heap->object_size);
-    _i965UnlockMutex(&heap->mutex);
-
-    /* Check if the object has in fact been allocated */
-    if (obj->next_free != ALLOCATED) {
+
+    obj = object_heap_slot(heap, index);
+
+    /* Check if the object has in fact been allocated, and not recycled */
+    if (OBJECT_HEAP_LOAD(&obj->next_free) != ALLOCATED ||
+        OBJECT_HEAP_LOAD(&obj->id) != id) {
         return NULL;
     }
     return obj;
@@ -178,22 +249,16 @@ object_base_p object_heap_next(object_heap_p heap, object_heap_iterator *iter)
 {
     object_base_p obj;
     int i = *iter + 1;
-    int bucket_index, obj_index;
+    int heap_size = OBJECT_HEAP_LOAD(&heap->heap_size);
 
-    _i965LockMutex(&heap->mutex);
-    while (i < heap->heap_size) {
-        bucket_index = i / heap->heap_increment;
-        obj_index = i % heap->heap_increment;
-
-        obj = (object_base_p)(heap->bucket[bucket_index] + obj_index * heap->object_size);
-        if (obj->next_free == ALLOCATED) {
-            _i965UnlockMutex(&heap->mutex);
+    while (i < heap_size) {
+        obj = object_heap_slot(heap, i);
+        if (OBJECT_HEAP_LOAD(&obj->next_free) == ALLOCATED) {
             *iter = i;
             return obj;
         }
         i++;
     }
-    _i965UnlockMutex(&heap->mutex);
     *iter = i;
     return NULL;
 }
@@ -207,13 +272,16 @@ void object_heap_free(object_heap_p heap, object_base_p obj)
 {
     /* Don't complain about NULL pointers */
     if (NULL != obj) {
+        int gen;
+
         /* Check if the object has in fact been allocated */
         ASSERT(obj->next_free == ALLOCATED);
 
-        _i965LockMutex(&heap->mutex);
-        obj->next_free = heap->next_free;
-        heap->next_free = obj->id & OBJECT_HEAP_ID_MASK;
-        _i965UnlockMutex(&heap->mutex);
+        /* Retire the ID so that stale lookups fail from now on */
+        gen = (obj->id + (1 << OBJECT_HEAP_GEN_SHIFT)) & OBJECT_HEAP_GEN_MASK;
+        OBJECT_HEAP_STORE(&obj->id, (obj->id & ~OBJECT_HEAP_GEN_MASK) | gen);
+
+        object_heap_push(heap, obj, obj);
     }
 }
 
@@ -224,7 +292,6 @@ void object_heap_destroy(object_heap_p heap)
 {
     object_base_p obj;
     int i;
-    int bucket_index, obj_index;
 
     if (heap->heap_size) {
         _i965DestroyMutex(&heap->mutex);
@@ -232,9 +299,7 @@ void object_heap_destroy(object_heap_p heap)
         /* Check if heap is empty */
         for (i = 0; i < heap->heap_size; i++) {
             /* Check if object is not still allocated */
-            bucket_index = i / heap->heap_increment;
-            obj_index = i % heap->heap_increment;
-            obj = (object_base_p)(heap->bucket[bucket_index] + obj_index * heap->object_size);
+            obj = object_heap_slot(heap, i);
             ASSERT(obj->next_free != ALLOCATED);
         }
 
@@ -247,5 +312,6 @@ void object_heap_destroy(object_heap_p heap)
 
     heap->bucket = NULL;
     heap->heap_size = 0;
+    heap->num_buckets = 0;
     heap->next_free = LAST_FREE;
 }
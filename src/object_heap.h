@@ -25,11 +25,23 @@
 #ifndef _OBJECT_HEAP_H_
 #define _OBJECT_HEAP_H_
 
+#include <stdint.h>
+
 #include "i965_mutext.h"
 
 #define OBJECT_HEAP_OFFSET_MASK     0x7F000000
 #define OBJECT_HEAP_ID_MASK         0x00FFFFFF
 
+/*
+ * The per-heap part of an object ID is split into a slot index and a
+ * generation counter. The generation is bumped every time a slot is freed
+ * so that a stale ID never aliases the object recycled into that slot.
+ */
+#define OBJECT_HEAP_INDEX_MASK      0x0003FFFF
+#define OBJECT_HEAP_GEN_MASK        0x00FC0000
+#define OBJECT_HEAP_GEN_SHIFT       18
+#define OBJECT_HEAP_MAX_OBJECTS     (OBJECT_HEAP_INDEX_MASK + 1)
+
 typedef struct object_base *object_base_p;
 typedef struct object_heap *object_heap_p;
 
@@ -38,15 +50,29 @@ struct object_base {
     int next_free;
 };
 
+/*
+ * Lookups never take the heap mutex: the bucket directory is allocated
+ * once with room for OBJECT_HEAP_MAX_OBJECTS and never moves, and a bucket
+ * is published before heap_size grows to cover it. The free list is a
+ * lock-free stack whose head is tagged to avoid ABA; the mutex only
+ * serializes heap expansion.
+ */
 struct object_heap {
     int object_size;
     int id_offset;
-    int next_free;
+    union {
+        struct {
+            int next_free;              /* index of the free list head */
+            unsigned int next_free_tag; /* bumped on every push/pop */
+        };
+        uint64_t free_list;
+    };
     int heap_size;
     int heap_increment;
     _I965Mutex mutex;
     void **bucket;
-    int num_buckets;
+    int num_buckets;                    /* number of populated buckets */
+    int max_buckets;                    /* size of the bucket directory */
 };
 
 typedef int object_heap_iterator;
@@ -63,8 +89,9 @@ int object_heap_init(object_heap_p heap, int object_size, int id_offset);
 int object_heap_allocate(object_heap_p heap);
 
 /*
- * Lookup an allocated object by object ID
+ * Lookup an allocated object by object ID, without locking.
  * Returns a pointer to the object on success, returns NULL on error
+ * (including IDs of objects that were freed, even if the slot is reused)
  */
 object_base_p object_heap_lookup(object_heap_p heap, int id);
 
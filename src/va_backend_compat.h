@@ -66,4 +66,8 @@
 
 #endif
 
+#if !VA_CHECK_VERSION(1,9,0)
+# define VA_STATUS_ERROR_TIMEDOUT       0x00000026
+#endif
+
 #endif /* VA_BACKEND_COMPAT_H */
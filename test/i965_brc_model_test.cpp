@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test.h"
+
+extern "C" {
+    #include "i965_defines.h"
+    #include "i965_brc_model.h"
+}
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+i965_brc_model_params cbr_params(unsigned bitrate)
+{
+    i965_brc_model_params params;
+
+    memset(&params, 0, sizeof(params));
+    params.mode = VA_RC_CBR;
+    params.frame_width = 1920;
+    params.frame_height = 1080;
+    params.num_layers = 1;
+    params.gop_size = 30;
+    params.num_iframes_in_gop = 1;
+    params.num_pframes_in_gop = 29;
+    params.bits_per_second[0] = bitrate;
+    params.framerate_num[0] = 30;
+    params.framerate_den[0] = 1;
+    params.hrd_buffer_size = bitrate * 2;
+    params.hrd_initial_buffer_fullness = bitrate;
+
+    return params;
+}
+
+/* I frames every 30 frames, 5x the size of the P frames, coded at QP 30 */
+std::vector<i965_brc_trace_frame> stationary_trace(unsigned num_frames, int p_bits)
+{
+    std::vector<i965_brc_trace_frame> frames(num_frames);
+
+    for (unsigned i = 0; i < num_frames; i++) {
+        frames[i].slice_type = (i % 30) ? SLICE_TYPE_P : SLICE_TYPE_I;
+        frames[i].qp = 30;
+        frames[i].frame_bits = (i % 30) ? p_bits : 5 * p_bits;
+    }
+
+    return frames;
+}
+
+TEST(BrcModelTest, InitialQpFollowsBitrate)
+{
+    i965_brc_model_params params = cbr_params(1000000);
+    i965_brc_rate_state brc;
+    i965_brc_hrd_state hrd;
+    int low_rate_qp;
+
+    i965_brc_model_init(&params, &brc, &hrd);
+    low_rate_qp = brc.qp_prime_y[0][SLICE_TYPE_P];
+    EXPECT_EQ(params.hrd_buffer_size, hrd.buffer_size[0]);
+    EXPECT_DOUBLE_EQ(params.hrd_initial_buffer_fullness, hrd.current_buffer_fullness[0]);
+
+    params = cbr_params(20000000);
+    i965_brc_model_init(&params, &brc, &hrd);
+    EXPECT_LT(brc.qp_prime_y[0][SLICE_TYPE_P], low_rate_qp);
+
+    params.initial_qp = 60;
+    i965_brc_model_init(&params, &brc, &hrd);
+    EXPECT_EQ(51, brc.qp_prime_y[0][SLICE_TYPE_I]);
+}
+
+TEST(BrcModelTest, CbrConverges)
+{
+    i965_brc_model_params params = cbr_params(4000000);
+    std::vector<i965_brc_trace_frame> frames = stationary_trace(900, 100000);
+    i965_brc_replay_stats stats;
+    double rate;
+
+    i965_brc_model_replay(&params, &frames[0], frames.size(), NULL, NULL, &stats);
+
+    rate = stats.total_bits * 30 / stats.num_frames;
+    EXPECT_EQ(900u, stats.num_frames);
+    EXPECT_EQ(0u, stats.num_underflows);
+    EXPECT_EQ(0u, stats.num_overflows);
+    EXPECT_NEAR(4000000., rate, 4000000. * 0.05);
+    EXPECT_GT(stats.min_buffer_fullness, 0.);
+    EXPECT_LE(stats.max_buffer_fullness, params.hrd_buffer_size);
+}
+
+TEST(BrcModelTest, UnderflowReencodes)
+{
+    i965_brc_model_params params = cbr_params(4000000);
+    std::vector<i965_brc_trace_frame> frames = stationary_trace(60, 100000);
+    i965_brc_replay_stats stats;
+    unsigned qp_frames = 0;
+
+    /* A scene cut larger than the whole HRD buffer at the current QP */
+    frames[40].frame_bits = 40 * 100000;
+
+    i965_brc_model_replay(&params, &frames[0], frames.size(), NULL, NULL, &stats);
+
+    EXPECT_GT(stats.num_passes, stats.num_frames);
+    EXPECT_EQ(0u, stats.num_underflows);
+
+    for (unsigned i = 0; i < 52; i++)
+        qp_frames += stats.qp_histogram[i];
+
+    EXPECT_EQ(stats.num_frames, qp_frames);
+}
+
+TEST(BrcModelTest, VbrKeepsQpSteady)
+{
+    i965_brc_model_params cbr = cbr_params(4000000);
+    i965_brc_model_params vbr = cbr_params(4000000);
+    std::vector<i965_brc_trace_frame> frames = stationary_trace(600, 100000);
+    i965_brc_replay_stats cbr_stats, vbr_stats;
+
+    vbr.mode = VA_RC_VBR;
+
+    /* Noisy frame sizes make the CBR controller chase every frame */
+    srand(1);
+    for (size_t i = 0; i < frames.size(); i++)
+        frames[i].frame_bits += frames[i].frame_bits * (rand() % 41 - 20) / 100;
+
+    i965_brc_model_replay(&cbr, &frames[0], frames.size(), NULL, NULL, &cbr_stats);
+    i965_brc_model_replay(&vbr, &frames[0], frames.size(), NULL, NULL, &vbr_stats);
+
+    EXPECT_EQ(0u, vbr_stats.num_overflows);
+    EXPECT_LT(vbr_stats.qp_swing, cbr_stats.qp_swing);
+}
+
+void count_frame(void *data, unsigned int frame_index,
+                 const i965_brc_trace_frame *coded,
+                 const i965_brc_hrd_state *hrd)
+{
+    unsigned *count = static_cast<unsigned *>(data);
+
+    EXPECT_EQ(*count, frame_index);
+    EXPECT_GE(coded->qp, 1);
+    EXPECT_LE(coded->qp, 51);
+    EXPECT_GT(hrd->current_buffer_fullness[0], 0.);
+    (*count)++;
+}
+
+TEST(BrcModelTest, ReplayCallback)
+{
+    i965_brc_model_params params = cbr_params(2000000);
+    std::vector<i965_brc_trace_frame> frames = stationary_trace(90, 50000);
+    i965_brc_replay_stats stats;
+    unsigned count = 0;
+
+    i965_brc_model_replay(&params, &frames[0], frames.size(), count_frame, &count, &stats);
+    EXPECT_EQ(90u, count);
+}
+
+TEST(BrcModelTest, LookaheadPrepack)
+{
+    i965_brc_model_params params = cbr_params(4000000);
+    i965_brc_rate_state brc;
+    i965_brc_hrd_state hrd;
+    i965_brc_model_frame frame;
+    int base_qp;
+
+    memset(&brc, 0, sizeof(brc));
+    memset(&hrd, 0, sizeof(hrd));
+    memset(&frame, 0, sizeof(frame));
+    params.lookahead_depth = 4;
+    i965_brc_model_init(&params, &brc, &hrd);
+    base_qp = brc.qp_prime_y[0][SLICE_TYPE_P];
+
+    /* Nothing to compare the first frames of a type with */
+    frame.slice_type = SLICE_TYPE_P;
+    frame.complexity = 100;
+    for (int i = 0; i < 4; i++) {
+        i965_brc_model_prepack(&params, &brc, &hrd, &frame);
+        EXPECT_EQ(0, brc.lookahead.qp_offset);
+    }
+    EXPECT_EQ(base_qp, brc.qp_prime_y[0][SLICE_TYPE_P]);
+
+    /* Small differences are noise */
+    frame.complexity = 110;
+    i965_brc_model_prepack(&params, &brc, &hrd, &frame);
+    EXPECT_EQ(0, brc.lookahead.qp_offset);
+
+    /* 4 times harder, 12 QP steps clipped to the maximal change */
+    frame.complexity = 400;
+    i965_brc_model_prepack(&params, &brc, &hrd, &frame);
+    EXPECT_EQ(BRC_QP_MAX_CHANGE, brc.lookahead.qp_offset);
+    EXPECT_EQ(base_qp + BRC_QP_MAX_CHANGE, brc.qp_prime_y[0][SLICE_TYPE_P]);
+
+    /* The controller goes on from its own QP */
+    frame.frame_bits = brc.target_frame_size[0][SLICE_TYPE_P];
+    EXPECT_EQ(BRC_NO_HRD_VIOLATION, i965_brc_model_postpack(&params, &brc, &hrd, &frame));
+    EXPECT_EQ(0, brc.lookahead.qp_offset);
+    EXPECT_NEAR(base_qp, brc.qp_prime_y[0][SLICE_TYPE_P], 1);
+
+    /* Other slice types have their own history */
+    frame.slice_type = SLICE_TYPE_I;
+    i965_brc_model_prepack(&params, &brc, &hrd, &frame);
+    EXPECT_EQ(0, brc.lookahead.qp_offset);
+
+    /* Disabled */
+    params.lookahead_depth = 0;
+    frame.slice_type = SLICE_TYPE_P;
+    frame.complexity = 4000;
+    i965_brc_model_prepack(&params, &brc, &hrd, &frame);
+    EXPECT_EQ(0, brc.lookahead.qp_offset);
+}
+
+void record_bits(void *data, unsigned int,
+                 const i965_brc_trace_frame *coded,
+                 const i965_brc_hrd_state *)
+{
+    std::vector<int> *bits = static_cast<std::vector<int> *>(data);
+
+    bits->push_back(coded->frame_bits);
+}
+
+TEST(BrcModelTest, LookaheadAbsorbsSceneCut)
+{
+    i965_brc_model_params params = cbr_params(4000000);
+    std::vector<i965_brc_trace_frame> frames = stationary_trace(200, 100000);
+    i965_brc_replay_stats stats, lookahead_stats;
+    std::vector<int> bits, lookahead_bits;
+
+    /* The second scene is 4 times harder */
+    for (size_t i = 0; i < frames.size(); i++) {
+        frames[i].complexity = (i < 60 ? 100 : 400) + i % 7;
+        if (i >= 60)
+            frames[i].frame_bits *= 4;
+    }
+
+    i965_brc_model_replay(&params, &frames[0], frames.size(), record_bits, &bits, &stats);
+
+    params.lookahead_depth = 8;
+    i965_brc_model_replay(&params, &frames[0], frames.size(), record_bits, &lookahead_bits,
+                          &lookahead_stats);
+
+    EXPECT_LT(lookahead_bits[60], bits[60]);
+    EXPECT_GT(lookahead_stats.min_buffer_fullness, stats.min_buffer_fullness);
+    EXPECT_EQ(0u, lookahead_stats.num_underflows);
+}
+
+TEST(BrcModelTest, TraceLoad)
+{
+    char text[] = "# type qp bits\nI 30 500000\n\n  p 31 90000  # comment\nB 33 40000 250\n";
+    char bad[] = "I 30 500000\nX 30 1000\n";
+    i965_brc_trace_frame *frames;
+    FILE *fp;
+
+    fp = fmemopen(text, strlen(text), "r");
+    ASSERT_TRUE(fp != NULL);
+    ASSERT_EQ(3, i965_brc_trace_load(fp, &frames));
+    fclose(fp);
+
+    EXPECT_EQ(SLICE_TYPE_I, frames[0].slice_type);
+    EXPECT_EQ(500000, frames[0].frame_bits);
+    EXPECT_EQ(SLICE_TYPE_P, frames[1].slice_type);
+    EXPECT_EQ(31, frames[1].qp);
+    EXPECT_EQ(SLICE_TYPE_B, frames[2].slice_type);
+    EXPECT_EQ(0u, frames[1].complexity);
+    EXPECT_EQ(250u, frames[2].complexity);
+    free(frames);
+
+    fp = fmemopen(bad, strlen(bad), "r");
+    ASSERT_TRUE(fp != NULL);
+    EXPECT_EQ(-1, i965_brc_trace_load(fp, &frames));
+    EXPECT_TRUE(frames == NULL);
+    fclose(fp);
+}
+
+} // namespace
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2018 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test.h"
+
+extern "C" {
+    #include "i965_buffer_cache.h"
+}
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+TEST(BufferCacheTest, Records)
+{
+    struct record {
+        int a[7];
+    };
+
+    I965BufferCache cache;
+    I965BufferCacheStats stats;
+
+    i965_buffer_cache_init(&cache, sizeof(record));
+
+    record *r = (record *)i965_buffer_cache_get_record(&cache);
+    ASSERT_PTR(r);
+    std::fill(r->a, r->a + 7, 0x55);
+    i965_buffer_cache_put_record(&cache, r);
+
+    // recycled records are returned zero-initialized
+    record *r2 = (record *)i965_buffer_cache_get_record(&cache);
+    EXPECT_TRUE(r == r2);
+    EXPECT_TRUE(std::all_of(r2->a, r2->a + 7, [](int v){ return v == 0; }));
+
+    i965_buffer_cache_get_stats(&cache, &stats);
+    EXPECT_EQ(1u, stats.record_hits);
+    EXPECT_EQ(1u, stats.record_misses);
+
+    // the cache keeps at most I965_BUFFER_CACHE_NUM_SLOTS records
+    std::vector<void *> records(2 * I965_BUFFER_CACHE_NUM_SLOTS);
+    records[0] = r2;
+    std::generate(records.begin() + 1, records.end(),
+        [&]{ return i965_buffer_cache_get_record(&cache); });
+    std::for_each(records.begin(), records.end(),
+        [&](void *p){ i965_buffer_cache_put_record(&cache, p); });
+    std::generate(records.begin(), records.end(),
+        [&]{ return i965_buffer_cache_get_record(&cache); });
+
+    i965_buffer_cache_get_stats(&cache, &stats);
+    EXPECT_EQ(1u + I965_BUFFER_CACHE_NUM_SLOTS, stats.record_hits);
+    EXPECT_EQ(1u + 3 * I965_BUFFER_CACHE_NUM_SLOTS - 1, stats.record_misses);
+
+    std::for_each(records.begin(), records.end(),
+        [&](void *p){ i965_buffer_cache_put_record(&cache, p); });
+    i965_buffer_cache_terminate(&cache);
+}
+
+TEST(BufferCacheTest, SizeClasses)
+{
+    I965BufferCache cache;
+    I965BufferCacheStats stats;
+    int size_class;
+
+    i965_buffer_cache_init(&cache, 16);
+
+    void *data = i965_buffer_cache_get_data(&cache, 1, &size_class);
+    ASSERT_PTR(data);
+    EXPECT_EQ(0, size_class);
+    i965_buffer_cache_put_data(&cache, data, size_class);
+
+    // a block is reused for any size within the same class
+    const size_t min_size = 1 << I965_BUFFER_CACHE_MIN_SHIFT;
+    EXPECT_TRUE(data == i965_buffer_cache_get_data(&cache, min_size, &size_class));
+    EXPECT_EQ(0, size_class);
+    i965_buffer_cache_put_data(&cache, data, size_class);
+
+    void *data2 = i965_buffer_cache_get_data(&cache, min_size + 1, &size_class);
+    EXPECT_EQ(1, size_class);
+    EXPECT_TRUE(data != data2);
+    memset(data2, 0, min_size * 2);
+    i965_buffer_cache_put_data(&cache, data2, size_class);
+
+    void *large = i965_buffer_cache_get_data(&cache, I965_BUFFER_CACHE_MAX_SIZE,
+                                             &size_class);
+    EXPECT_EQ(I965_BUFFER_CACHE_NUM_CLASSES - 1, size_class);
+    i965_buffer_cache_put_data(&cache, large, size_class);
+
+    void *huge = i965_buffer_cache_get_data(&cache, I965_BUFFER_CACHE_MAX_SIZE + 1,
+                                            &size_class);
+    ASSERT_PTR(huge);
+    EXPECT_EQ(I965_BUFFER_CACHE_NO_CLASS, size_class);
+    i965_buffer_cache_put_data(&cache, huge, size_class);
+
+    i965_buffer_cache_get_stats(&cache, &stats);
+    EXPECT_EQ(1u, stats.data_hits);
+    EXPECT_EQ(4u, stats.data_misses);
+
+    i965_buffer_cache_terminate(&cache);
+}
+
+TEST(BufferCacheTest, MultiThreaded)
+{
+    I965BufferCache cache;
+    I965BufferCacheStats stats;
+    const int nthreads(4);
+    const int iterations(10000);
+
+    i965_buffer_cache_init(&cache, 64);
+
+    auto worker = [&](int seed) {
+        for (int i(0); i < iterations; ++i) {
+            int size_class;
+            size_t size = ((i * 131 + seed) % 4096) + 1;
+            unsigned char *record = (unsigned char *)i965_buffer_cache_get_record(&cache);
+            unsigned char *data = (unsigned char *)i965_buffer_cache_get_data(&cache, size, &size_class);
+            memset(record, seed, 64);
+            memset(data, seed, size);
+            EXPECT_EQ(seed, record[63]);
+            EXPECT_EQ(seed, data[size - 1]);
+            i965_buffer_cache_put_data(&cache, data, size_class);
+            i965_buffer_cache_put_record(&cache, record);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i(0); i < nthreads; ++i)
+        threads.push_back(std::thread(worker, i + 1));
+    std::for_each(threads.begin(), threads.end(),
+        [](std::thread& t){ t.join(); });
+
+    i965_buffer_cache_get_stats(&cache, &stats);
+    EXPECT_EQ((unsigned long)nthreads * iterations,
+              stats.record_hits + stats.record_misses);
+    EXPECT_EQ((unsigned long)nthreads * iterations,
+              stats.data_hits + stats.data_misses);
+    EXPECT_LT(stats.record_misses, stats.record_hits);
+
+    i965_buffer_cache_terminate(&cache);
+}
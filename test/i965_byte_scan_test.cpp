@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2018 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test.h"
+
+extern "C" {
+    #include "i965_byte_scan.h"
+}
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <vector>
+
+namespace {
+
+const uint8_t h264_delimiter[5] = { 0x00, 0x00, 0x00, 0x00, 0x00 };
+const uint8_t mpeg2_delimiter[5] = { 0x00, 0x00, 0x00, 0x00, 0xb0 };
+
+// the coded buffer end-of-stream scan used by i965_MapBuffer() before
+int legacy_scan(const uint8_t *buf, int size, const uint8_t *d)
+{
+    int i;
+
+    for (i = 0; i < size; i++) {
+        if ((buf[i] == d[0]) &&
+            (buf[i + 1] == d[1]) &&
+            (buf[i + 2] == d[2]) &&
+            (buf[i + 3] == d[3]) &&
+            (buf[i + 4] == d[4]))
+            break;
+    }
+    return i;
+}
+
+// zero-rich pseudo bitstream without any run of 4+ zero bytes
+std::vector<uint8_t> make_bitstream(size_t size, unsigned seed)
+{
+    std::vector<uint8_t> buf(size);
+    int zeros(0);
+
+    std::srand(seed);
+    for (size_t i(0); i < size; ++i) {
+        uint8_t v = (std::rand() % 4) ? std::rand() & 0xff : 0;
+        if (v == 0 && ++zeros > 3)
+            v = 0x03;
+        if (v != 0)
+            zeros = 0;
+        buf[i] = v;
+    }
+    return buf;
+}
+
+// the start code search of intel_avc_find_skipemulcnt() before
+int legacy_start_code(const uint8_t *buf, int size)
+{
+    int i;
+
+    for (i = 0; i < size; i++) {
+        if (((buf[i] == 0) && (buf[i + 1] == 0) && (buf[i + 2] == 1)) ||
+            ((buf[i] == 0) && (buf[i + 1] == 0) && (buf[i + 2] == 0) && (buf[i + 3] == 1)))
+            break;
+    }
+    return i;
+}
+
+// the slice header walk of avc_get_first_mb_bit_offset_with_epb() before
+int legacy_epb_count(const uint8_t *buf, int size, int rbsp_size)
+{
+    int i, j, n;
+
+    for (i = 2, j = 2, n = 0; i < size && j < rbsp_size; i++, j++) {
+        if (buf[i] == 0x03 && buf[i - 1] == 0x00 && buf[i - 2] == 0x00)
+            i += 2, j++, n++;
+    }
+    return n;
+}
+
+// bytes drawn from { 00, 01, 03, random } so that start codes and
+// emulation prevention bytes are frequent
+std::vector<uint8_t> make_nal_bytes(size_t size, unsigned seed)
+{
+    std::vector<uint8_t> buf(size);
+
+    std::srand(seed);
+    for (size_t i(0); i < size; ++i) {
+        switch (std::rand() % 6) {
+        case 0:
+        case 1:
+        case 2:
+            buf[i] = 0x00;
+            break;
+        case 3:
+            buf[i] = 0x01;
+            break;
+        case 4:
+            buf[i] = 0x03;
+            break;
+        default:
+            buf[i] = std::rand() & 0xff;
+            break;
+        }
+    }
+    return buf;
+}
+
+} // namespace
+
+TEST(ByteScanTest, MatchesLegacyScan)
+{
+    const uint8_t *delimiters[] = { h264_delimiter, mpeg2_delimiter };
+
+    for (const uint8_t *d : delimiters) {
+        for (unsigned seed(0); seed < 64; ++seed) {
+            const int size = 64 + seed * 37;
+            std::vector<uint8_t> buf = make_bitstream(size + 4, seed);
+            const int pos = std::rand() % (size + 1);
+
+            if (pos < size)
+                std::copy(d, d + 5, buf.begin() + pos);
+
+            SCOPED_TRACE(::testing::Message() << "size=" << size << " pos=" << pos);
+
+            EXPECT_EQ(legacy_scan(buf.data(), size, d),
+                      i965_byte_scan_pattern(buf.data(), size, d, 5));
+            EXPECT_EQ(legacy_scan(buf.data(), size, d),
+                      i965_byte_scan_pattern_c(buf.data(), size, d, 5));
+        }
+    }
+}
+
+TEST(ByteScanTest, Boundaries)
+{
+    std::vector<uint8_t> buf(100 + 4, 0x11);
+
+    // no match
+    EXPECT_EQ(100, i965_byte_scan_pattern(buf.data(), 100, h264_delimiter, 5));
+
+    // match starting at the last valid offset, ending in the tail bytes
+    std::fill(buf.begin() + 99, buf.end(), 0);
+    EXPECT_EQ(99, i965_byte_scan_pattern(buf.data(), 100, h264_delimiter, 5));
+
+    // first of two matches
+    std::fill(buf.begin() + 3, buf.begin() + 8, 0);
+    EXPECT_EQ(3, i965_byte_scan_pattern(buf.data(), 100, h264_delimiter, 5));
+
+    // single byte patterns and empty buffers
+    EXPECT_EQ(3, i965_byte_scan_pattern(buf.data(), 100, h264_delimiter, 1));
+    EXPECT_EQ(0, i965_byte_scan_pattern(buf.data(), 0, h264_delimiter, 5));
+}
+
+TEST(ByteScanTest, StartCode)
+{
+    for (unsigned seed(0); seed < 256; ++seed) {
+        const int size = seed % 80;
+        std::vector<uint8_t> buf = make_nal_bytes(size + 3, seed);
+
+        SCOPED_TRACE(::testing::Message() << "size=" << size << " seed=" << seed);
+
+        EXPECT_EQ(legacy_start_code(buf.data(), size),
+                  i965_byte_scan_start_code(buf.data(), size));
+    }
+
+    const uint8_t three[] = { 0x00, 0x00, 0x01, 0x67, 0x00, 0x00 };
+    const uint8_t four[] = { 0x00, 0x00, 0x00, 0x01, 0x67, 0x00 };
+    const uint8_t late[] = { 0x00, 0x00, 0x00, 0x00, 0x01, 0x67 };
+
+    EXPECT_EQ(0, i965_byte_scan_start_code(three, 2));
+    EXPECT_EQ(0, i965_byte_scan_start_code(four, 2));
+    EXPECT_EQ(1, i965_byte_scan_start_code(late, 2));
+    EXPECT_EQ(1, i965_byte_scan_start_code(late, 1));
+    EXPECT_EQ(0, i965_byte_scan_start_code(late, 0));
+}
+
+TEST(ByteScanTest, EpbCount)
+{
+    for (unsigned seed(0); seed < 256; ++seed) {
+        const int size = seed % 120;
+        const int rbsp_size = (size * 2) / 3 + (seed % 7);
+        std::vector<uint8_t> buf = make_nal_bytes(size, seed);
+
+        SCOPED_TRACE(::testing::Message() << "size=" << size
+                     << " rbsp_size=" << rbsp_size << " seed=" << seed);
+
+        EXPECT_EQ(legacy_epb_count(buf.data(), size, rbsp_size),
+                  i965_byte_scan_epb_count(buf.data(), size, rbsp_size));
+    }
+
+    const uint8_t header[] = {
+        0x88, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x01, 0x00, 0x00, 0x03, 0x02
+    };
+
+    EXPECT_EQ(3, i965_byte_scan_epb_count(header, sizeof(header), sizeof(header)));
+    EXPECT_EQ(1, i965_byte_scan_epb_count(header, sizeof(header), 4));
+    EXPECT_EQ(0, i965_byte_scan_epb_count(header, 3, sizeof(header)));
+}
+
+TEST(ByteScanTest, CodedBufferBenchmark)
+{
+    const int size = 8 << 20;
+    std::vector<uint8_t> buf = make_bitstream(size + 4, 1);
+    const int expect = size - 5;
+    buf[expect - 1] = 0x01;
+    std::copy(h264_delimiter, h264_delimiter + 5, buf.begin() + expect);
+
+    auto bench = [&](const char *name, std::function<int()> scan) {
+        const int runs(8);
+        auto start = std::chrono::steady_clock::now();
+        for (int i(0); i < runs; ++i)
+            EXPECT_EQ(expect, scan());
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        std::cout << name << ": " << std::fixed << std::setprecision(1)
+            << (double(size) * runs / elapsed.count() / (1 << 20))
+            << " MB/s" << std::endl;
+    };
+
+    bench("legacy scan", [&]{ return legacy_scan(buf.data(), size, h264_delimiter); });
+    bench("i965_byte_scan_pattern",
+        [&]{ return i965_byte_scan_pattern(buf.data(), size, h264_delimiter, 5); });
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "test.h"
+
+extern "C" {
+    #include "i965_complexity.h"
+}
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <vector>
+
+namespace {
+
+std::vector<uint8_t> make_noise(size_t size, unsigned seed)
+{
+    std::vector<uint8_t> buf(size);
+
+    std::srand(seed);
+    for (size_t i(0); i < size; ++i)
+        buf[i] = std::rand() & 0xff;
+    return buf;
+}
+
+// smooth horizontal gradient, shifted by dx pixels
+std::vector<uint8_t> make_gradient(unsigned width, unsigned height, unsigned dx)
+{
+    std::vector<uint8_t> buf(width * height);
+
+    for (unsigned y(0); y < height; ++y)
+        for (unsigned x(0); x < width; ++x)
+            buf[y * width + x] = ((x + dx) / 8 + y / 16) & 0xff;
+    return buf;
+}
+
+unsigned frame_complexity(struct i965_complexity_context *context,
+                          const std::vector<uint8_t> &frame, unsigned width, unsigned height)
+{
+    for (unsigned y(0); y < height; y += I965_COMPLEXITY_BAND_HEIGHT) {
+        unsigned rows = std::min(height - y, unsigned(I965_COMPLEXITY_BAND_HEIGHT));
+        i965_complexity_add_rows(context, &frame[y * width], width, y, rows);
+    }
+    return i965_complexity_end_frame(context);
+}
+
+} // namespace
+
+TEST(ComplexityTest, DownscaleMatchesReference)
+{
+    // widths with and without a scalar tail
+    const unsigned widths[] = { 1, 15, 16, 17, 33, 64, 75 };
+
+    for (unsigned width : widths) {
+        const unsigned height(9), pitch(4 * width + 3);
+        std::vector<uint8_t> src = make_noise(pitch * 4 * height, width);
+        std::vector<uint8_t> dst(width * height, 0), ref(width * height, 0);
+
+        SCOPED_TRACE(::testing::Message() << "width=" << width);
+
+        i965_complexity_downscale(dst.data(), width, src.data(), pitch, width, height);
+        i965_complexity_downscale_c(ref.data(), width, src.data(), pitch, width, height);
+        EXPECT_EQ(ref, dst);
+    }
+
+    // rounding of the averages
+    const uint8_t block[16] = { 0, 1, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0 };
+    uint8_t pixel;
+    i965_complexity_downscale_c(&pixel, 1, block, 4, 1, 1);
+    EXPECT_EQ(0u, pixel);
+}
+
+TEST(ComplexityTest, EstimateMatchesReference)
+{
+    // block columns with and without an odd trailing block, plus partial blocks
+    const unsigned widths[] = { 8, 16, 24, 40, 63, 130 };
+
+    for (unsigned width : widths) {
+        const unsigned height(27), pitch(width + 5);
+        std::vector<uint8_t> cur = make_noise(pitch * height, width);
+        std::vector<uint8_t> prev = make_noise(pitch * height, width + 1);
+
+        // make part of the frame a close match of the previous one
+        for (unsigned i(0); i < pitch * height / 2; ++i)
+            prev[i] = cur[i] ^ (i & 1);
+
+        SCOPED_TRACE(::testing::Message() << "width=" << width);
+
+        EXPECT_EQ(i965_complexity_estimate_c(cur.data(), NULL, pitch, width, height),
+                  i965_complexity_estimate(cur.data(), NULL, pitch, width, height));
+        EXPECT_EQ(i965_complexity_estimate_c(cur.data(), prev.data(), pitch, width, height),
+                  i965_complexity_estimate(cur.data(), prev.data(), pitch, width, height));
+    }
+}
+
+TEST(ComplexityTest, BlockCosts)
+{
+    std::vector<uint8_t> flat(8 * 8, 100), cur(8 * 8), prev(8 * 8);
+
+    EXPECT_EQ(0u, i965_complexity_estimate(flat.data(), NULL, 8, 8, 8));
+
+    // columns alternating 0 and 200: mean 100, deviation 100
+    for (unsigned i(0); i < cur.size(); ++i)
+        cur[i] = (i & 1) ? 200 : 0;
+    EXPECT_EQ(64u * 100, i965_complexity_estimate(cur.data(), NULL, 8, 8, 8));
+
+    // the inter cost wins when the previous frame is close
+    for (unsigned i(0); i < prev.size(); ++i)
+        prev[i] = cur[i] + 1;
+    EXPECT_EQ(64u, i965_complexity_estimate(cur.data(), prev.data(), 8, 8, 8));
+
+    // and the intra cost when it isn't
+    EXPECT_EQ(64u * 100, i965_complexity_estimate(cur.data(), flat.data(), 8, 8, 8));
+}
+
+TEST(ComplexityTest, SceneCut)
+{
+    const unsigned width(320), height(240);
+    struct i965_complexity_context context;
+    std::vector<uint8_t> noise = make_noise(width * height, 3);
+    unsigned still, moving, cut;
+
+    memset(&context, 0, sizeof(context));
+    ASSERT_TRUE(i965_complexity_context_init(&context, width, height));
+    EXPECT_EQ(width / 4, context.width);
+    EXPECT_EQ(height / 4, context.height);
+
+    frame_complexity(&context, make_gradient(width, height, 0), width, height);
+    still = frame_complexity(&context, make_gradient(width, height, 0), width, height);
+    moving = frame_complexity(&context, make_gradient(width, height, 4), width, height);
+    cut = frame_complexity(&context, noise, width, height);
+
+    EXPECT_EQ(1u, still);
+    EXPECT_LE(still, moving);
+    EXPECT_GT(cut, 10 * moving);
+
+    // the same size keeps the planes, another one reallocates them
+    uint8_t *planes = context.planes[0];
+    EXPECT_TRUE(i965_complexity_context_init(&context, width, height));
+    EXPECT_EQ(planes, context.planes[0]);
+    EXPECT_TRUE(i965_complexity_context_init(&context, 2 * width, height));
+    EXPECT_EQ(2 * width / 4, context.width);
+    EXPECT_FALSE(context.has_previous);
+
+    // frames smaller than a downscaled block can't be estimated
+    EXPECT_FALSE(i965_complexity_context_init(&context, 16, 16));
+    i965_complexity_context_fini(&context);
+}
+
+TEST(ComplexityTest, Benchmark)
+{
+    const unsigned width(1920), height(1080);
+    const unsigned dst_width(width / 4), dst_height(height / 4);
+    std::vector<uint8_t> src = make_noise(width * height, 5);
+    std::vector<uint8_t> cur(dst_width * dst_height), prev(dst_width * dst_height);
+
+    i965_complexity_downscale_c(prev.data(), dst_width, src.data(), width, dst_width, dst_height);
+    std::reverse(src.begin(), src.end());
+
+    auto bench = [&](const char *name,
+                     std::function<void(uint8_t *, const uint8_t *, unsigned)> downscale,
+                     std::function<unsigned(const uint8_t *, const uint8_t *, unsigned, unsigned, unsigned)> estimate) {
+        const int runs(16);
+        unsigned cost(0);
+        auto start = std::chrono::steady_clock::now();
+        for (int i(0); i < runs; ++i) {
+            downscale(cur.data(), src.data(), width);
+            cost += estimate(cur.data(), prev.data(), dst_width, dst_width, dst_height);
+        }
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        std::cout << name << ": " << std::fixed << std::setprecision(1)
+            << (double(width) * height * runs / elapsed.count() / (1 << 20))
+            << " MB/s of luma" << std::endl;
+        return cost;
+    };
+
+    unsigned ref = bench("reference",
+        [&](uint8_t *dst, const uint8_t *s, unsigned pitch) {
+            i965_complexity_downscale_c(dst, dst_width, s, pitch, dst_width, dst_height);
+        }, i965_complexity_estimate_c);
+    unsigned simd = bench("i965_complexity",
+        [&](uint8_t *dst, const uint8_t *s, unsigned pitch) {
+            i965_complexity_downscale(dst, dst_width, s, pitch, dst_width, dst_height);
+        }, i965_complexity_estimate);
+    EXPECT_EQ(ref, simd);
+}
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "i965_jpeg_test_data.h"
+#include "i965_test_fixture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/*
+ * Contexts of different threads only share the driver objects, so
+ * pictures of independent contexts are expected to go through the
+ * entry points concurrently.
+ */
+class ContextThreadingTest
+    : public I965TestFixture
+{
+protected:
+    void decode(unsigned iterations)
+    {
+        JPEG::Decode::TestPattern::SharedConst pattern(
+            new JPEG::Decode::TestPatternData<1>);
+        JPEG::Decode::PictureData::SharedConst pd(
+            pattern->encoded(VA_FOURCC_IMC3));
+        ASSERT_PTR(pd.get());
+
+        VAConfigAttrib a = { type:VAConfigAttribRTFormat, value:pd->format };
+        Surfaces surfaces = createSurfaces(
+            pd->pparam.picture_width, pd->pparam.picture_height, pd->format);
+        VAConfigID config = createConfig(JPEG::profile,
+            JPEG::Decode::entrypoint, ConfigAttribs(1, a));
+        VAContextID context = createContext(config,
+            pd->pparam.picture_width, pd->pparam.picture_height, 0, surfaces);
+
+        for (unsigned i(0); i < iterations && !HasFailure(); ++i) {
+            Buffers buffers;
+            buffers.push_back(createBuffer(context,
+                VAPictureParameterBufferType, sizeof(pd->pparam), 1,
+                &pd->pparam));
+            buffers.push_back(createBuffer(context, VAIQMatrixBufferType,
+                sizeof(pd->iqmatrix), 1, &pd->iqmatrix));
+            buffers.push_back(createBuffer(context, VAHuffmanTableBufferType,
+                sizeof(pd->huffman), 1, &pd->huffman));
+            buffers.push_back(createBuffer(context,
+                VASliceParameterBufferType, sizeof(pd->sparam), 1,
+                &pd->sparam));
+            buffers.push_back(createBuffer(context, VASliceDataBufferType,
+                pd->sparam.slice_data_size, 1, pd->slice.data()));
+
+            beginPicture(context, surfaces.front());
+            renderPicture(context, buffers.data(), buffers.size());
+            endPicture(context);
+            syncSurface(surfaces.front());
+
+            for (auto id : buffers)
+                destroyBuffer(id);
+        }
+
+        destroyContext(context);
+        destroyConfig(config);
+        destroySurfaces(surfaces);
+    }
+
+    void encode(unsigned iterations)
+    {
+        struct i965_driver_data *i965(*this);
+        ASSERT_PTR(i965);
+
+        JPEG::Encode::FixedSizeCreator creator({320, 240});
+        JPEG::Encode::TestInput::Shared input(creator.create(VA_FOURCC_NV12));
+        ASSERT_PTR(input.get());
+
+        SurfaceAttribs attributes(1);
+        attributes.front().flags = VA_SURFACE_ATTRIB_SETTABLE;
+        attributes.front().type = VASurfaceAttribPixelFormat;
+        attributes.front().value.type = VAGenericValueTypeInteger;
+        attributes.front().value.value.i = input->image->fourcc;
+        Surfaces surfaces = createSurfaces(input->image->width,
+            input->image->height, input->image->format, 1, attributes);
+        input->image->toSurface(surfaces.front());
+
+        VAConfigAttrib a = {
+            type:VAConfigAttribRTFormat, value:input->image->format };
+        VAConfigID config = createConfig(JPEG::profile,
+            JPEG::Encode::entrypoint, ConfigAttribs(1, a));
+        VAContextID context = createContext(config, input->image->width,
+            input->image->height, 0, surfaces);
+        VABufferID coded = createBuffer(context, VAEncCodedBufferType,
+            2 * (input->image->sizes.sum() + 8192u));
+        input->picture.coded_buf = coded;
+
+        VAEncPackedHeaderParameterBuffer packed;
+        std::memset(&packed, 0, sizeof(packed));
+        packed.type = VAEncPackedHeaderRawData;
+        packed.bit_length = 8;
+        const uint8_t header(0);
+
+        for (unsigned i(0); i < iterations && !HasFailure(); ++i) {
+            Buffers buffers;
+            buffers.push_back(createBuffer(context,
+                VAEncPictureParameterBufferType, sizeof(input->picture), 1,
+                &input->picture));
+            buffers.push_back(createBuffer(context, VAQMatrixBufferType,
+                sizeof(input->matrix), 1, &input->matrix));
+            buffers.push_back(createBuffer(context, VAHuffmanTableBufferType,
+                sizeof(input->huffman), 1, &input->huffman));
+            buffers.push_back(createBuffer(context,
+                VAEncSliceParameterBufferType, sizeof(input->slice), 1,
+                &input->slice));
+            buffers.push_back(createBuffer(context,
+                VAEncPackedHeaderParameterBufferType, sizeof(packed), 1,
+                &packed));
+            buffers.push_back(createBuffer(context,
+                VAEncPackedHeaderDataBufferType, 1, 1, &header));
+
+            beginPicture(context, surfaces.front());
+            renderPicture(context, buffers.data(), buffers.size());
+            endPicture(context);
+            syncSurface(surfaces.front());
+
+            /* Nothing writes the coded buffer without hardware */
+            VACodedBufferSegment *segment =
+                mapBuffer<VACodedBufferSegment>(coded);
+            if (segment and not i965->intel.null_hw)
+                EXPECT_GT(segment->size, 0u);
+            unmapBuffer(coded);
+
+            for (auto id : buffers)
+                destroyBuffer(id);
+        }
+
+        destroyBuffer(coded);
+        destroyContext(context);
+        destroyConfig(config);
+        destroySurfaces(surfaces);
+    }
+};
+
+TEST_F(ContextThreadingTest, DecodeEncodeThroughput)
+{
+    struct i965_driver_data *i965(*this);
+    ASSERT_PTR(i965);
+    if (not HAS_JPEG_DECODING(i965) or not HAS_JPEG_ENCODING(i965)) {
+        RecordProperty("skipped", true);
+        std::cout << "[  SKIPPED ] " << getFullTestName()
+            << " is unsupported on this hardware" << std::endl;
+        return;
+    }
+
+    const unsigned iterations(32);
+    const unsigned max_threads(
+        std::max(2u, std::min(8u, std::thread::hardware_concurrency())));
+
+    /*
+     * Every thread decodes or encodes with contexts of its own. Pictures
+     * of independent contexts should not contend on a shared lock, so
+     * the throughput is expected to grow with the number of threads.
+     */
+    std::vector<unsigned> counts;
+    for (unsigned n(1); n < max_threads; n *= 2)
+        counts.push_back(n);
+    counts.push_back(max_threads);
+
+    double single(0.0);
+    for (unsigned nthreads : counts) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (unsigned i(0); i < nthreads; ++i) {
+            threads.push_back(std::thread([&] { decode(iterations); }));
+            threads.push_back(std::thread([&] { encode(iterations); }));
+        }
+        std::for_each(threads.begin(), threads.end(),
+            [](std::thread& t){ t.join(); });
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        ASSERT_FALSE(HasFailure());
+
+        const double throughput(
+            double(iterations) * threads.size() / elapsed.count());
+        if (nthreads == 1)
+            single = throughput;
+
+        std::cout << "context_threading: " << nthreads
+            << " decode + " << nthreads << " encode threads, "
+            << std::fixed << std::setprecision(1) << throughput
+            << " pictures/s (x" << std::setprecision(2)
+            << (throughput / single) << ")" << std::endl;
+    }
+}
+
+} // namespace
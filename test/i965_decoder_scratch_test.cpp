@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "i965_test_environment.h"
+
+extern "C" {
+    #include "i965_decoder_utils.h"
+#if HAVE_NULL_HW
+    #include "intel_null_hw.h"
+#endif
+}
+
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+class DecoderScratchTest : public ::testing::Test
+{
+protected:
+    void SetUp()
+    {
+        I965TestEnvironment *env(I965TestEnvironment::instance());
+        ASSERT_PTR(env);
+
+        ctx = *env;
+        i965 = *env;
+        ASSERT_PTR(ctx);
+        ASSERT_PTR(i965);
+
+        memset(&buffer, 0, sizeof(buffer));
+        memset(&spare, 0, sizeof(spare));
+    }
+
+    void TearDown()
+    {
+        dri_bo_unreference(buffer.bo);
+        dri_bo_unreference(spare.bo);
+    }
+
+    /* Buffer object allocations done by the picture, like a decode_init */
+    unsigned long picture(unsigned int size)
+    {
+        const unsigned long allocs(i965->decode_scratch_allocs);
+
+        buffer.valid = 0;
+        intel_ensure_scratch_buffer(ctx, &buffer, "scratch test", size);
+        EXPECT_PTR(buffer.bo);
+        EXPECT_TRUE(buffer.valid);
+        EXPECT_LE(size, buffer.bo->size);
+        return i965->decode_scratch_allocs - allocs;
+    }
+
+    VADriverContextP ctx;
+    struct i965_driver_data *i965;
+    GenBuffer buffer;
+    GenBuffer spare;
+};
+
+TEST_F(DecoderScratchTest, SteadyState)
+{
+    EXPECT_EQ(1ul, picture(64 * 120));
+
+    for (int i(0); i < 256; ++i)
+        EXPECT_EQ(0ul, picture(64 * 120));
+}
+
+TEST_F(DecoderScratchTest, HighWaterMark)
+{
+    EXPECT_EQ(1ul, picture(64 * 45));
+    EXPECT_EQ(1ul, picture(64 * 120));
+
+    /* Switching back and forth between resolutions keeps the larger one */
+    for (int i(0); i < 256; ++i) {
+        EXPECT_EQ(0ul, picture(64 * 45));
+        EXPECT_EQ(0ul, picture(64 * 120));
+    }
+}
+
+TEST_F(DecoderScratchTest, Shrink)
+{
+    unsigned long allocs(0);
+    dri_bo *large;
+
+    EXPECT_EQ(1ul, picture(64 * 240));
+    large = buffer.bo;
+
+    /* Half the size is not worth a new buffer object */
+    for (int i(0); i < 256; ++i)
+        EXPECT_EQ(0ul, picture(64 * 120));
+    EXPECT_EQ(large, buffer.bo);
+
+    /* A sixth of it eventually is, once */
+    for (int i(0); i < 256; ++i)
+        allocs += picture(64 * 40);
+    EXPECT_EQ(1ul, allocs);
+    EXPECT_GT(large->size, buffer.bo->size);
+}
+
+TEST_F(DecoderScratchTest, IdleBitplane)
+{
+    const unsigned long allocs(i965->decode_scratch_allocs);
+
+    intel_ensure_bitplane_buffer(ctx, &buffer, &spare, 60 * 68);
+    ASSERT_PTR(buffer.bo);
+
+    for (int i(0); i < 16; ++i)
+        intel_ensure_bitplane_buffer(ctx, &buffer, &spare, 60 * 68);
+    EXPECT_EQ(1ul, i965->decode_scratch_allocs - allocs);
+    EXPECT_PTR_NULL(spare.bo);
+}
+
+TEST_F(DecoderScratchTest, BusyBitplane)
+{
+#if HAVE_NULL_HW
+    const unsigned long allocs(i965->decode_scratch_allocs);
+    dri_bo *previous;
+
+    /* The bitplane of the previous picture is still being decoded, the one
+       before it is done */
+    for (int i(0); i < 16; ++i) {
+        previous = buffer.bo;
+        intel_ensure_bitplane_buffer(ctx, &buffer, &spare, 60 * 68);
+        ASSERT_PTR(buffer.bo);
+        EXPECT_NE(previous, buffer.bo);
+        EXPECT_EQ(previous, spare.bo);
+
+        intel_null_hw_bo_set_busy(buffer.bo, true);
+        if (spare.bo)
+            intel_null_hw_bo_set_busy(spare.bo, false);
+    }
+    EXPECT_EQ(2ul, i965->decode_scratch_allocs - allocs);
+
+    /* Only a new buffer object avoids waiting when both are busy */
+    intel_null_hw_bo_set_busy(spare.bo, true);
+    previous = buffer.bo;
+    intel_ensure_bitplane_buffer(ctx, &buffer, &spare, 60 * 68);
+    EXPECT_EQ(3ul, i965->decode_scratch_allocs - allocs);
+    EXPECT_EQ(previous, spare.bo);
+    EXPECT_FALSE(drm_intel_bo_busy(buffer.bo));
+#else
+    std::cout << "[  SKIPPED ] DecoderScratchTest.BusyBitplane needs the"
+        " null hardware backend to keep buffer objects busy" << std::endl;
+#endif
+}
+
+} // namespace
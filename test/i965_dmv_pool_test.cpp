@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "i965_test_environment.h"
+
+extern "C" {
+    #include "i965_decoder_utils.h"
+    #include "intel_media.h"
+}
+
+#include <cstring>
+#include <set>
+#include <vector>
+
+namespace {
+
+/* 1080p, in bytes */
+const unsigned int dmv_size(120 * 68 * 128);
+
+class DmvPoolTest : public ::testing::Test
+{
+protected:
+    void SetUp()
+    {
+        I965TestEnvironment *env(I965TestEnvironment::instance());
+        ASSERT_PTR(env);
+
+        ctx = *env;
+        i965 = *env;
+        ASSERT_PTR(ctx);
+        ASSERT_PTR(i965);
+
+        intel_dmv_pool_init(&pool);
+        surfaces.resize(32);
+        for (size_t i(0); i < surfaces.size(); ++i) {
+            memset(&surfaces[i], 0, sizeof(surfaces[i]));
+            surfaces[i].base.id = 0x04000000 + i;
+            surfaces[i].private_data = calloc(1, sizeof(GenAvcSurface));
+            surfaces[i].free_private_data = gen_free_avc_surface;
+        }
+        clearFrameStore();
+    }
+
+    void TearDown()
+    {
+        intel_dmv_pool_terminate(&pool);
+        for (size_t i(0); i < surfaces.size(); ++i)
+            gen_free_avc_surface(&surfaces[i].private_data);
+    }
+
+    void clearFrameStore()
+    {
+        for (int i(0); i < MAX_GEN_REFERENCE_FRAMES; ++i) {
+            frame_store[i].surface_id = VA_INVALID_ID;
+            frame_store[i].obj_surface = NULL;
+        }
+    }
+
+    dri_bo *decode(size_t surface)
+    {
+        intel_dmv_pool_bind_avc(ctx, &pool, frame_store, &surfaces[surface], dmv_size);
+        return dmv(surface);
+    }
+
+    dri_bo *dmv(size_t surface)
+    {
+        return static_cast<GenAvcSurface *>(surfaces[surface].private_data)->dmv_top;
+    }
+
+    VADriverContextP ctx;
+    struct i965_driver_data *i965;
+    GenDmvPool pool;
+    GenFrameStore frame_store[MAX_GEN_REFERENCE_FRAMES];
+    std::vector<struct object_surface> surfaces;
+};
+
+TEST_F(DmvPoolTest, SlidingWindow)
+{
+    const int num_refs(4);
+    const unsigned long pooled(i965->dmv_pooled_bytes);
+    const unsigned long per_surface(i965->dmv_surface_bytes);
+    std::set<dri_bo *> bos;
+
+    /* Cycle through all the surfaces, with the last num_refs pictures as
+       references */
+    for (size_t n(0); n < 4 * surfaces.size(); ++n) {
+        const size_t current(n % surfaces.size());
+
+        clearFrameStore();
+        for (int i(0); i < num_refs && i < int(n); ++i) {
+            const size_t ref((n - 1 - i) % surfaces.size());
+
+            frame_store[i].surface_id = surfaces[ref].base.id;
+            frame_store[i].obj_surface = &surfaces[ref];
+        }
+
+        ASSERT_PTR(decode(current));
+        EXPECT_LE(dmv_size, dmv(current)->size);
+        bos.insert(dmv(current));
+
+        /* The references keep their own buffers */
+        for (int i(0); i < num_refs && i < int(n); ++i)
+            EXPECT_NE(dmv(current), dmv((n - 1 - i) % surfaces.size()));
+    }
+
+    EXPECT_EQ(size_t(num_refs + 1), bos.size());
+    EXPECT_EQ((num_refs + 1) * dmv_size, i965->dmv_pooled_bytes - pooled);
+    EXPECT_EQ(surfaces.size() * dmv_size, i965->dmv_surface_bytes - per_surface);
+}
+
+TEST_F(DmvPoolTest, SecondField)
+{
+    dri_bo *first;
+
+    first = decode(0);
+    ASSERT_PTR(first);
+
+    /* The second field is decoded into the same surface */
+    EXPECT_EQ(first, decode(0));
+
+    frame_store[0].surface_id = surfaces[0].base.id;
+    frame_store[0].obj_surface = &surfaces[0];
+    EXPECT_NE(first, decode(1));
+    EXPECT_EQ(first, dmv(0));
+
+    /* Once out of the DPB, the buffer goes to the next picture */
+    clearFrameStore();
+    EXPECT_EQ(first, decode(2));
+}
+
+TEST_F(DmvPoolTest, ReturningReference)
+{
+    dri_bo *first;
+
+    first = decode(0);
+    ASSERT_PTR(first);
+
+    /* Surface 0 is missing from the frame store of one picture, which
+       takes its buffer */
+    EXPECT_EQ(first, decode(1));
+
+    /* Back as a reference, it must not share the buffer of surface 1 nor
+       the one of the picture being decoded */
+    frame_store[0].surface_id = surfaces[0].base.id;
+    frame_store[0].obj_surface = &surfaces[0];
+    frame_store[1].surface_id = surfaces[1].base.id;
+    frame_store[1].obj_surface = &surfaces[1];
+    ASSERT_PTR(decode(2));
+    ASSERT_PTR(dmv(0));
+    EXPECT_NE(dmv(0), dmv(1));
+    EXPECT_NE(dmv(0), dmv(2));
+    EXPECT_NE(dmv(1), dmv(2));
+    EXPECT_EQ(first, dmv(1));
+}
+
+TEST_F(DmvPoolTest, ReturningReferenceKeepsBuffer)
+{
+    dri_bo *first;
+
+    first = decode(0);
+    ASSERT_PTR(first);
+
+    frame_store[0].surface_id = surfaces[0].base.id;
+    frame_store[0].obj_surface = &surfaces[0];
+    EXPECT_NE(first, decode(1));
+
+    /* The second field of surface 1 references nothing, so surface 0 loses
+       its slot, but nobody takes the buffer meanwhile */
+    clearFrameStore();
+    decode(1);
+
+    /* Back as a reference, surface 0 gets its former buffer again */
+    frame_store[0].surface_id = surfaces[0].base.id;
+    frame_store[0].obj_surface = &surfaces[0];
+    frame_store[1].surface_id = surfaces[1].base.id;
+    frame_store[1].obj_surface = &surfaces[1];
+    ASSERT_PTR(decode(2));
+    EXPECT_EQ(first, dmv(0));
+    EXPECT_NE(dmv(0), dmv(2));
+    EXPECT_NE(dmv(1), dmv(2));
+}
+
+} // namespace
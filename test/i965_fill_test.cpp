@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "i965_test_environment.h"
+
+extern "C" {
+    #include "i965_fill.h"
+}
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+TEST(FillModeTest, Parse)
+{
+    EXPECT_EQ(I965_FILL_GPU, i965_fill_parse_mode("gpu", I965_FILL_CPU));
+    EXPECT_EQ(I965_FILL_CPU, i965_fill_parse_mode("cpu", I965_FILL_GPU));
+    EXPECT_EQ(I965_FILL_DRY_RUN, i965_fill_parse_mode("dry-run", I965_FILL_GPU));
+    EXPECT_EQ(I965_FILL_GPU, i965_fill_parse_mode(NULL, I965_FILL_GPU));
+    EXPECT_EQ(I965_FILL_CPU, i965_fill_parse_mode("blitter", I965_FILL_CPU));
+}
+
+TEST(FillSplitTest, Linear)
+{
+    struct i965_fill_rect rects[3];
+
+    /* Partial first row, full rows, partial last row */
+    ASSERT_EQ(3, i965_fill_split_linear(100, 3 * 256, 256, rects));
+    EXPECT_EQ(100u, rects[0].x);
+    EXPECT_EQ(0u, rects[0].y);
+    EXPECT_EQ(156u, rects[0].width);
+    EXPECT_EQ(1u, rects[0].height);
+    EXPECT_EQ(0u, rects[1].x);
+    EXPECT_EQ(1u, rects[1].y);
+    EXPECT_EQ(256u, rects[1].width);
+    EXPECT_EQ(2u, rects[1].height);
+    EXPECT_EQ(0u, rects[2].x);
+    EXPECT_EQ(3u, rects[2].y);
+    EXPECT_EQ(100u, rects[2].width);
+    EXPECT_EQ(1u, rects[2].height);
+
+    ASSERT_EQ(1, i965_fill_split_linear(512, 1024, 256, rects));
+    EXPECT_EQ(2u, rects[0].y);
+    EXPECT_EQ(4u, rects[0].height);
+
+    /* Within one row */
+    ASSERT_EQ(1, i965_fill_split_linear(300, 10, 256, rects));
+    EXPECT_EQ(44u, rects[0].x);
+    EXPECT_EQ(1u, rects[0].y);
+    EXPECT_EQ(10u, rects[0].width);
+
+    /* Past the blitter coordinates */
+    EXPECT_EQ(0, i965_fill_split_linear(0, 256 * I965_FILL_MAX_COORD + 1, 256, rects));
+    EXPECT_EQ(0, i965_fill_split_linear(0, 0, 256, rects));
+}
+
+/* Every byte the rectangles of a split cover, exactly once */
+TEST(FillSplitTest, Coverage)
+{
+    static const unsigned int pitch(64);
+
+    for (unsigned int offset(0); offset < 3 * pitch; offset += 7) {
+        for (unsigned int size(1); size < 5 * pitch; size += 13) {
+            struct i965_fill_rect rects[3];
+            std::vector<int> hits(offset + size + 2 * pitch, 0);
+            const int n(i965_fill_split_linear(offset, size, pitch, rects));
+
+            ASSERT_GT(n, 0);
+            for (int i(0); i < n; ++i) {
+                EXPECT_LE(rects[i].x + rects[i].width, pitch);
+                for (unsigned int y(0); y < rects[i].height; ++y) {
+                    for (unsigned int x(0); x < rects[i].width; ++x)
+                        hits[(rects[i].y + y) * pitch + rects[i].x + x]++;
+                }
+            }
+
+            for (unsigned int i(0); i < hits.size(); ++i)
+                EXPECT_EQ(i >= offset && i < offset + size ? 1 : 0, hits[i]);
+        }
+    }
+}
+
+TEST(FillCommandsTest, Gen8Linear)
+{
+    struct i965_fill_commands cmds;
+    struct i965_fill_rect rect = { 16, 2, 100, 3 };
+
+    ASSERT_TRUE(i965_fill_build_commands(9, I915_TILING_NONE, 256, &rect, 1,
+                                         0x5a, &cmds));
+    ASSERT_EQ(7u, cmds.num_dw);
+    EXPECT_EQ(GEN8_XY_COLOR_BLT_CMD, cmds.dw[0]);
+    EXPECT_EQ(0xf0u << 16 | BR13_8 | 256, cmds.dw[1]);
+    EXPECT_EQ(2u << 16 | 16, cmds.dw[2]);
+    EXPECT_EQ(5u << 16 | 116, cmds.dw[3]);
+    ASSERT_EQ(1u, cmds.num_relocs);
+    EXPECT_EQ(4u, cmds.relocs[0]);
+    EXPECT_EQ(0x5au, cmds.dw[6]);
+}
+
+TEST(FillCommandsTest, Gen7YTiled)
+{
+    struct i965_fill_commands cmds;
+    struct i965_fill_rect rects[2] = {
+        { 1920, 0, 128, 1080 },
+        { 0, 1080, 2048, 8 },
+    };
+
+    ASSERT_TRUE(i965_fill_build_commands(7, I915_TILING_Y, 2048, rects, 2,
+                                         0, &cmds));
+
+    /* The blits are wrapped into switching BCS_SWCTRL to Y-tiling and back */
+    ASSERT_EQ(7u + 2 * 6 + 7u, cmds.num_dw);
+    EXPECT_EQ(MI_FLUSH_DW, cmds.dw[0]);
+    EXPECT_EQ(MI_LOAD_REGISTER_IMM | 1, cmds.dw[4]);
+    EXPECT_EQ(BCS_SWCTRL, cmds.dw[5]);
+    EXPECT_EQ(BCS_SWCTRL_DST_Y << 16 | BCS_SWCTRL_DST_Y, cmds.dw[6]);
+
+    EXPECT_EQ(XY_COLOR_BLT_CMD | XY_COLOR_BLT_DST_TILED, cmds.dw[7]);
+    EXPECT_EQ(0xf0u << 16 | BR13_8 | 2048 / 4, cmds.dw[8]);
+    ASSERT_EQ(2u, cmds.num_relocs);
+    EXPECT_EQ(11u, cmds.relocs[0]);
+    EXPECT_EQ(17u, cmds.relocs[1]);
+
+    EXPECT_EQ(BCS_SWCTRL_DST_Y << 16, cmds.dw[cmds.num_dw - 1]);
+}
+
+TEST(FillCommandsTest, Unsupported)
+{
+    struct i965_fill_commands cmds;
+    struct i965_fill_rect rect = { 0, 0, 64, 64 };
+    struct i965_fill_rect far = { 0, I965_FILL_MAX_COORD, 64, 1 };
+
+    EXPECT_FALSE(i965_fill_build_commands(5, I915_TILING_NONE, 64, &rect, 1, 0, &cmds));
+    EXPECT_FALSE(i965_fill_build_commands(9, I915_TILING_NONE, 62, &rect, 1, 0, &cmds));
+    EXPECT_FALSE(i965_fill_build_commands(9, I915_TILING_NONE, 64, &far, 1, 0, &cmds));
+    EXPECT_FALSE(i965_fill_build_commands(9, I915_TILING_NONE, 65536, &rect, 1, 0, &cmds));
+}
+
+class FillTest : public ::testing::TestWithParam<int>
+{
+protected:
+    void SetUp()
+    {
+        I965TestEnvironment *env(I965TestEnvironment::instance());
+        ASSERT_PTR(env);
+
+        i965 = *env;
+        ASSERT_PTR(i965);
+
+        i965_fill_init(&fill, &i965->intel, GetParam());
+        bo = dri_bo_alloc(i965->intel.bufmgr, "fill test", 1 << 20, 4096);
+        ASSERT_PTR(bo);
+    }
+
+    void TearDown()
+    {
+        dri_bo_unreference(bo);
+        i965_fill_terminate(&fill);
+    }
+
+    void expect(unsigned int offset, unsigned int size, uint8_t value)
+    {
+        const uint8_t *p;
+
+        /* Blits are only recorded on null hardware */
+        if (fill.mode == I965_FILL_GPU && i965->intel.null_hw)
+            return;
+
+        ASSERT_EQ(0, dri_bo_map(bo, 0));
+        p = static_cast<const uint8_t *>(bo->virtual);
+        for (unsigned int i(0); i < size; ++i)
+            ASSERT_EQ(value, p[offset + i]) << "offset " << offset + i;
+        dri_bo_unmap(bo);
+    }
+
+    struct i965_driver_data *i965;
+    struct i965_fill fill;
+    dri_bo *bo;
+};
+
+TEST_P(FillTest, Buffer)
+{
+    struct i965_fill_stats stats;
+
+    ASSERT_TRUE(i965_fill_buffer(&fill, bo, 0, bo->size, 0xff));
+    ASSERT_TRUE(i965_fill_buffer(&fill, bo, 1000, 100000, 0));
+    ASSERT_TRUE(i965_fill_buffer(&fill, bo, 200000, 64, 0x11));
+
+    expect(0, 1000, 0xff);
+    expect(1000, 100000, 0);
+    expect(101000, 200000 - 101000, 0xff);
+    expect(200000, 64, 0x11);
+    expect(200064, bo->size - 200064, 0xff);
+
+    i965_fill_get_stats(&fill, &stats);
+    EXPECT_EQ(3ul, stats.gpu_fills + stats.cpu_fills);
+    if (fill.mode == I965_FILL_DRY_RUN)
+        EXPECT_LT(0ul, stats.dry_run_dwords);
+}
+
+TEST_P(FillTest, BufferCpu)
+{
+    struct i965_fill_stats stats;
+
+    /* Callers mapping the buffer next get a memset(), however large */
+    ASSERT_TRUE(i965_fill_buffer_cpu(&fill, bo, 0, bo->size, 0x5a));
+
+    i965_fill_get_stats(&fill, &stats);
+    EXPECT_EQ(0ul, stats.gpu_fills);
+    EXPECT_EQ(1ul, stats.cpu_fills);
+    EXPECT_EQ(bo->size, stats.cpu_bytes);
+
+    ASSERT_EQ(0, dri_bo_map(bo, 0));
+    const uint8_t *p(static_cast<const uint8_t *>(bo->virtual));
+    for (unsigned long i(0); i < bo->size; ++i)
+        ASSERT_EQ(0x5a, p[i]) << "offset " << i;
+    dri_bo_unmap(bo);
+}
+
+TEST_P(FillTest, Rects)
+{
+    struct i965_fill_rect rects[2] = {
+        { 100, 0, 28, 10 },
+        { 0, 10, 128, 6 },
+    };
+
+    ASSERT_TRUE(i965_fill_buffer(&fill, bo, 0, 128 * 16, 0x80));
+    ASSERT_TRUE(i965_fill_rects(&fill, bo, I915_TILING_NONE, 128, rects, 2, 0));
+
+    for (unsigned int y(0); y < 10; ++y) {
+        expect(y * 128, 100, 0x80);
+        expect(y * 128 + 100, 28, 0);
+    }
+    expect(10 * 128, 6 * 128, 0);
+}
+
+INSTANTIATE_TEST_CASE_P(
+    Mode, FillTest,
+    ::testing::Values(I965_FILL_GPU, I965_FILL_CPU, I965_FILL_DRY_RUN));
+
+} // namespace
@@ -258,7 +258,9 @@ TEST_P(FourCCTest, Decode)
     printImageOutputTo(oss, image, output);
     RecordProperty("Output", oss.str());
 
-    validateImageOutput(image, output);
+    /* Nothing decodes the picture without hardware */
+    if (not i965->intel.null_hw)
+        validateImageOutput(image, output);
 
 //     std::cout << oss.str();
 
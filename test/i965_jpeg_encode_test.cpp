@@ -424,7 +424,11 @@ TEST_P(JPEGEncodeInputTest, Full)
     ASSERT_NO_FAILURE(SetUpHeader());
     ASSERT_NO_FAILURE(Encode());
 
-    VerifyOutput();
+    /* Nothing writes the coded buffer without hardware */
+    struct i965_driver_data *i965(*this);
+    ASSERT_PTR(i965);
+    if (not i965->intel.null_hw)
+        VerifyOutput();
 }
 
 INSTANTIATE_TEST_CASE_P(
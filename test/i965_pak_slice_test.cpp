@@ -0,0 +1,406 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "i965_test_environment.h"
+
+extern "C" {
+    #include "gen6_mfc.h"
+    #include "gen6_vme.h"
+    #include "gen9_mfc.h"
+    #include "i965_defines.h"
+}
+
+#include <cstring>
+#include <ostream>
+#include <vector>
+
+namespace {
+
+const unsigned kWidth = 320;
+const unsigned kHeight = 240;
+const unsigned kWidthInMbs = kWidth / 16;
+const unsigned kHeightInMbs = kHeight / 16;
+const unsigned kBlockSize = INTRA_VME_OUTPUT_IN_BYTES * 24;
+const unsigned kPoolThreads = 4;
+
+struct Generator
+{
+    const char *name;
+    int codec;
+    Bool (*context_init)(VADriverContextP, struct intel_encoder_context *);
+    intel_encoder_slice_func func;
+};
+
+std::ostream& operator<<(std::ostream& os, const Generator& generator)
+{
+    return os << generator.name;
+}
+
+const Generator generators[] = {
+    {"gen6_avc", CODEC_H264, gen6_mfc_context_init,
+     gen6_mfc_avc_pipeline_slice_programing},
+    {"gen75_avc", CODEC_H264, gen75_mfc_context_init,
+     gen75_mfc_avc_pipeline_slice_programing},
+    {"gen8_avc", CODEC_H264, gen8_mfc_context_init,
+     gen8_mfc_avc_pipeline_slice_programing},
+    {"gen7_mpeg2", CODEC_MPEG2, gen7_mfc_context_init,
+     gen7_mfc_mpeg2_slice_programing},
+    {"gen75_mpeg2", CODEC_MPEG2, gen75_mfc_context_init,
+     gen75_mfc_mpeg2_slice_programing},
+    {"gen8_mpeg2", CODEC_MPEG2, gen8_mfc_context_init,
+     gen8_mfc_mpeg2_slice_programing},
+    {"gen9_hevc", CODEC_HEVC, gen9_hcpe_context_init,
+     gen9_hcpe_hevc_pipeline_slice_programing},
+};
+
+/*
+ * Feeds a canned VME output through the software PAK slice generators, once
+ * serially and once on the PAK worker pool, and compares the batches.
+ */
+class PakSliceTest
+    : public ::testing::TestWithParam<Generator>
+{
+protected:
+    void SetUp()
+    {
+        I965TestEnvironment *env(I965TestEnvironment::instance());
+        ASSERT_PTR(env);
+
+        ctx = *env;
+        i965 = *env;
+        ASSERT_PTR(ctx);
+        ASSERT_PTR(i965);
+
+        generator = GetParam();
+        pool_threads = i965->pak_pool.num_threads;
+
+        memset(&encode_state, 0, sizeof(encode_state));
+        memset(&encoder_context, 0, sizeof(encoder_context));
+        memset(&vme_context, 0, sizeof(vme_context));
+
+        /*
+         * gen8_mfc_context_init() sets Broadwell AVC up for another PAK, the
+         * MFC context is the same for every codec otherwise
+         */
+        encoder_context.codec = CODEC_MPEG2;
+        ASSERT_TRUE(generator.context_init(ctx, &encoder_context));
+        encoder_context.codec = generator.codec;
+        encoder_context.rate_control_mode = VA_RC_CQP;
+        encoder_context.vme_context = &vme_context;
+
+        vme_context.vme_output.num_blocks = kWidthInMbs * kHeightInMbs;
+        vme_context.vme_output.size_block = kBlockSize;
+        vme_context.vme_output.bo = dri_bo_alloc(i965->intel.bufmgr,
+            "canned VME output", kWidthInMbs * kHeightInMbs * kBlockSize,
+            0x1000);
+        ASSERT_PTR(vme_context.vme_output.bo);
+
+        switch (generator.codec) {
+        case CODEC_H264:
+            setupAVC();
+            break;
+        case CODEC_MPEG2:
+            setupMPEG2();
+            break;
+        case CODEC_HEVC:
+            setupHEVC();
+            break;
+        }
+
+        encode_state.num_slice_params_ext = slice_stores.size();
+        encode_state.max_slice_num = slice_stores.size();
+        encode_state.slice_params_ext = slice_stores.data();
+        encode_state.slice_header_index = slice_indices.data();
+        encode_state.slice_rawdata_index = slice_indices.data();
+        encode_state.slice_rawdata_count = slice_indices.data();
+    }
+
+    void TearDown()
+    {
+        if (encoder_context.mfc_context)
+            encoder_context.mfc_context_destroy(encoder_context.mfc_context);
+        dri_bo_unreference(vme_context.vme_output.bo);
+
+        if (i965 && i965->pak_pool.num_threads != pool_threads) {
+            i965_thread_pool_terminate(&i965->pak_pool);
+            i965_thread_pool_init(&i965->pak_pool, pool_threads);
+        }
+    }
+
+    void addSlice(void *param, size_t size)
+    {
+        struct buffer_store store;
+
+        memset(&store, 0, sizeof(store));
+        store.buffer = static_cast<unsigned char *>(param);
+        store.num_elements = 1;
+        store.size_element = size;
+        stores.push_back(store);
+    }
+
+    void setupStores(void *seq, void *pic)
+    {
+        memset(&seq_store, 0, sizeof(seq_store));
+        memset(&pic_store, 0, sizeof(pic_store));
+        seq_store.buffer = static_cast<unsigned char *>(seq);
+        pic_store.buffer = static_cast<unsigned char *>(pic);
+        encode_state.seq_param_ext = &seq_store;
+        encode_state.pic_param_ext = &pic_store;
+
+        for (size_t i(0); i < stores.size(); ++i)
+            slice_stores.push_back(&stores[i]);
+        slice_indices.assign(stores.size(), 0);
+    }
+
+    void setupAVC()
+    {
+        struct gen6_mfc_context *mfc_context =
+            static_cast<struct gen6_mfc_context *>(encoder_context.mfc_context);
+
+        mfc_context->surface_state.width = kWidth;
+        mfc_context->surface_state.height = kHeight;
+
+        memset(&avc.seq, 0, sizeof(avc.seq));
+        avc.seq.seq_fields.bits.frame_mbs_only_flag = 1;
+        memset(&avc.pic, 0, sizeof(avc.pic));
+        avc.pic.pic_init_qp = 26;
+        avc.pic.pic_fields.bits.reference_pic_flag = 1;
+
+        /* P slices of three macroblock rows, with QP deltas */
+        avc.slices.resize(kHeightInMbs / 3);
+        for (size_t i(0); i < avc.slices.size(); ++i) {
+            VAEncSliceParameterBufferH264& slice(avc.slices[i]);
+
+            memset(&slice, 0, sizeof(slice));
+            slice.macroblock_address = i * 3 * kWidthInMbs;
+            slice.num_macroblocks = 3 * kWidthInMbs;
+            slice.slice_type = SLICE_TYPE_P;
+            slice.slice_qp_delta = i - 2;
+            addSlice(&slice, sizeof(slice));
+        }
+        setupStores(&avc.seq, &avc.pic);
+    }
+
+    void setupMPEG2()
+    {
+        memset(&mpeg2.seq, 0, sizeof(mpeg2.seq));
+        mpeg2.seq.picture_width = kWidth;
+        mpeg2.seq.picture_height = kHeight;
+        memset(&mpeg2.pic, 0, sizeof(mpeg2.pic));
+        mpeg2.pic.picture_type = VAEncPictureTypePredictive;
+        for (unsigned i(0); i < 2; ++i)
+            for (unsigned j(0); j < 2; ++j)
+                mpeg2.pic.f_code[i][j] = 4;
+
+        /* One slice group per macroblock row, every third one intra */
+        mpeg2.slices.resize(kHeightInMbs);
+        for (size_t i(0); i < mpeg2.slices.size(); ++i) {
+            VAEncSliceParameterBufferMPEG2& slice(mpeg2.slices[i]);
+
+            memset(&slice, 0, sizeof(slice));
+            slice.macroblock_address = i * kWidthInMbs;
+            slice.num_macroblocks = kWidthInMbs;
+            slice.is_intra_slice = (i % 3) == 0;
+            slice.quantiser_scale_code = 4 + i;
+            addSlice(&slice, sizeof(slice));
+        }
+        setupStores(&mpeg2.seq, &mpeg2.pic);
+    }
+
+    void setupHEVC()
+    {
+        struct gen9_hcpe_context *mfc_context =
+            static_cast<struct gen9_hcpe_context *>(encoder_context.mfc_context);
+        const unsigned ctb_size(32);
+        const unsigned width_in_ctb((kWidth + ctb_size - 1) / ctb_size);
+        const unsigned height_in_ctb((kHeight + ctb_size - 1) / ctb_size);
+
+        memset(&hevc.seq, 0, sizeof(hevc.seq));
+        hevc.seq.pic_width_in_luma_samples = kWidth;
+        hevc.seq.pic_height_in_luma_samples = kHeight;
+        hevc.seq.log2_min_luma_coding_block_size_minus3 = 0;
+        hevc.seq.log2_diff_max_min_luma_coding_block_size = 2;
+        hevc.seq.ip_period = 1;
+        memset(&hevc.pic, 0, sizeof(hevc.pic));
+        hevc.pic.pic_init_qp = 30;
+
+        /* P slices of two CTB rows, the last row is padded */
+        hevc.slices.resize(height_in_ctb / 2);
+        for (size_t i(0); i < hevc.slices.size(); ++i) {
+            VAEncSliceParameterBufferHEVC& slice(hevc.slices[i]);
+
+            memset(&slice, 0, sizeof(slice));
+            slice.slice_segment_address = i * 2 * width_in_ctb;
+            slice.num_ctu_in_slice = 2 * width_in_ctb;
+            slice.slice_type = HEVC_SLICE_P;
+            slice.slice_qp_delta = 1 - i;
+            addSlice(&slice, sizeof(slice));
+        }
+        setupStores(&hevc.seq, &hevc.pic);
+
+        /* 16 CU records of 16 dwords per 32x32 CTB, as intel_hcpe_hevc_prepare() */
+        mfc_context->hcp_indirect_cu_object.bo = dri_bo_alloc(
+            i965->intel.bufmgr, "indirect CU objects",
+            width_in_ctb * height_in_ctb * 16 * 16 * 4, 0x1000);
+        ASSERT_PTR(mfc_context->hcp_indirect_cu_object.bo);
+    }
+
+    /*
+     * A plausible VME output: a mix of intra and inter macroblocks of every
+     * partitioning, with small motion vectors. The generators rewrite parts
+     * of it, so it is refilled before each run.
+     */
+    void fillVMEOutput()
+    {
+        dri_bo *bo(vme_context.vme_output.bo);
+
+        ASSERT_EQ(0, dri_bo_map(bo, 1));
+        for (unsigned i(0); i < kWidthInMbs * kHeightInMbs; ++i) {
+            unsigned int *msg = reinterpret_cast<unsigned int *>(
+                static_cast<unsigned char *>(bo->virtual) + i * kBlockSize);
+
+            for (unsigned j(0); j < kBlockSize / 4; ++j)
+                msg[j] = ((i + j) & 0x1f) | (((i * 3 + j) & 0x1f) << 16);
+
+            msg[0] = ((i % 3) << 4) | (i & 3) | ((i % 5) ? 0 : INTRA_MB_FLAG_MASK);
+            msg[1] = 0x32103210 >> ((i & 3) * 4);
+            msg[2] = 0x01230123;
+            msg[3] = i & 3;
+            msg[4] = (i * 7) % 23;              /* intra distortion */
+            msg[8] = (i >> 2) & 3;              /* inter partitioning */
+            msg[9] = (i & 8) ? 0x0100 : 0;      /* sub-macroblock shapes */
+            msg[10] = (i * 5) % 19;             /* inter distortion */
+        }
+        dri_bo_unmap(bo);
+    }
+
+    void clearCUObjects()
+    {
+        if (generator.codec != CODEC_HEVC)
+            return;
+
+        struct gen9_hcpe_context *mfc_context =
+            static_cast<struct gen9_hcpe_context *>(encoder_context.mfc_context);
+        dri_bo *bo(mfc_context->hcp_indirect_cu_object.bo);
+
+        ASSERT_EQ(0, dri_bo_map(bo, 1));
+        memset(bo->virtual, 0, bo->size);
+        dri_bo_unmap(bo);
+    }
+
+    std::vector<unsigned char> readCUObjects()
+    {
+        std::vector<unsigned char> data;
+
+        if (generator.codec != CODEC_HEVC)
+            return data;
+
+        struct gen9_hcpe_context *mfc_context =
+            static_cast<struct gen9_hcpe_context *>(encoder_context.mfc_context);
+        dri_bo *bo(mfc_context->hcp_indirect_cu_object.bo);
+
+        EXPECT_EQ(0, dri_bo_map(bo, 0));
+        data.assign(static_cast<unsigned char *>(bo->virtual),
+                    static_cast<unsigned char *>(bo->virtual) + bo->size);
+        dri_bo_unmap(bo);
+        return data;
+    }
+
+    /* Programs all slices into a fresh aux batch and returns its commands */
+    std::vector<unsigned char> program(unsigned threads)
+    {
+        std::vector<unsigned char> commands;
+        struct intel_batchbuffer *batch;
+
+        if (i965->pak_pool.num_threads != threads) {
+            i965_thread_pool_terminate(&i965->pak_pool);
+            EXPECT_EQ(threads, i965_thread_pool_init(&i965->pak_pool, threads));
+        }
+
+        fillVMEOutput();
+        clearCUObjects();
+
+        batch = intel_batchbuffer_new(&i965->intel, I915_EXEC_BSD, 0x100000);
+        EXPECT_PTR(batch);
+        if (!batch)
+            return commands;
+
+        intel_encoder_slice_programing(ctx, &encode_state, &encoder_context,
+                                       generator.func, batch);
+
+        commands.assign(batch->map, batch->ptr);
+        intel_batchbuffer_free(batch);
+        return commands;
+    }
+
+    VADriverContextP ctx;
+    struct i965_driver_data *i965;
+    Generator generator;
+    unsigned pool_threads;
+
+    struct encode_state encode_state;
+    struct intel_encoder_context encoder_context;
+    struct gen6_vme_context vme_context;
+
+    struct buffer_store seq_store;
+    struct buffer_store pic_store;
+    std::vector<struct buffer_store> stores;
+    std::vector<struct buffer_store *> slice_stores;
+    std::vector<int> slice_indices;
+
+    struct {
+        VAEncSequenceParameterBufferH264 seq;
+        VAEncPictureParameterBufferH264 pic;
+        std::vector<VAEncSliceParameterBufferH264> slices;
+    } avc;
+
+    struct {
+        VAEncSequenceParameterBufferMPEG2 seq;
+        VAEncPictureParameterBufferMPEG2 pic;
+        std::vector<VAEncSliceParameterBufferMPEG2> slices;
+    } mpeg2;
+
+    struct {
+        VAEncSequenceParameterBufferHEVC seq;
+        VAEncPictureParameterBufferHEVC pic;
+        std::vector<VAEncSliceParameterBufferHEVC> slices;
+    } hevc;
+};
+
+TEST_P(PakSliceTest, PoolMatchesSerial)
+{
+    const std::vector<unsigned char> serial(program(1));
+    const std::vector<unsigned char> serial_cu(readCUObjects());
+    ASSERT_FALSE(serial.empty());
+
+    const std::vector<unsigned char> pooled(program(kPoolThreads));
+    ASSERT_EQ(serial.size(), pooled.size());
+    EXPECT_EQ(0, memcmp(serial.data(), pooled.data(), serial.size()));
+    EXPECT_TRUE(serial_cu == readCUObjects());
+}
+
+INSTANTIATE_TEST_CASE_P(
+    Generators, PakSliceTest, ::testing::ValuesIn(generators));
+
+} // namespace
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "test.h"
+
+extern "C" {
+    #include "sysdeps.h"
+    #include "i965_drv_video.h"
+    #include "i965_post_processing.h"
+}
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const unsigned kPoolThreads = 4;
+
+struct Size
+{
+    int src_w, src_h;
+    int dest_w, dest_h;
+};
+
+const Size sizes[] = {
+    { 320, 240, 320, 240 },
+    { 720, 480, 1920, 1080 },
+    { 640, 480, 1920, 1080 },
+    { 1920, 1080, 1280, 720 },
+    { 1280, 720, 1360, 720 },
+    { 1920, 1080, 16, 1088 },
+};
+
+union InlineParameter
+{
+    struct pp_inline_parameter gen5;
+    struct gen7_pp_inline_parameter gen7;
+};
+
+/*
+ * Builds the MEDIA_OBJECT inline data of the post-processing kernels in a
+ * single band and in bands spread over a pool, and compares the commands
+ * byte for byte. No GPU is involved, only the block parameter callbacks.
+ */
+class PPWalkerTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        context = static_cast<struct i965_post_processing_context *>(
+            calloc(1, sizeof(*context)));
+        ASSERT_PTR(context);
+
+        memset(&static_parameter, 0, sizeof(static_parameter));
+        memset(&inline_parameter, 0, sizeof(inline_parameter));
+        context->pp_static_parameter = &static_parameter;
+        context->pp_inline_parameter = &inline_parameter;
+        context->block_horizontal_mask_left = 0xfff0;
+        context->block_horizontal_mask_right = 0x0fff;
+        context->block_vertical_mask_bottom = 0x3f;
+
+        ASSERT_EQ(1u, i965_thread_pool_init(&serial_pool, 1));
+        ASSERT_EQ(kPoolThreads, i965_thread_pool_init(&pool, kPoolThreads));
+    }
+
+    virtual void TearDown()
+    {
+        i965_thread_pool_terminate(&pool);
+        i965_thread_pool_terminate(&serial_pool);
+        free(context);
+    }
+
+    void walk(int x_steps, int y_steps, int header_dws, int param_size,
+        bool update_block_mask)
+    {
+        const size_t dws = x_steps * y_steps * (header_dws + param_size / 4);
+        const InlineParameter initial(inline_parameter);
+        std::vector<unsigned> serial(dws, 0xdeadbeef);
+        std::vector<unsigned> banded(dws, 0xdeadbeef);
+        unsigned *end;
+
+        end = i965_pp_gen_media_objects(&serial_pool, context,
+            x_steps, y_steps, header_dws, param_size, update_block_mask,
+            serial.data());
+        EXPECT_EQ(serial.data() + dws, end);
+
+        const InlineParameter last(inline_parameter);
+        inline_parameter = initial;
+
+        end = i965_pp_gen_media_objects(&pool, context,
+            x_steps, y_steps, header_dws, param_size, update_block_mask,
+            banded.data());
+        EXPECT_EQ(banded.data() + dws, end);
+
+        EXPECT_EQ(0, memcmp(serial.data(), banded.data(), dws * 4))
+            << x_steps << "x" << y_steps << " blocks";
+        EXPECT_EQ(0, memcmp(&last, &inline_parameter, param_size))
+            << x_steps << "x" << y_steps << " blocks";
+    }
+
+    struct i965_post_processing_context *context;
+    struct pp_static_parameter static_parameter;
+    InlineParameter inline_parameter;
+    I965ThreadPool serial_pool;
+    I965ThreadPool pool;
+};
+
+} // namespace
+
+TEST_F(PPWalkerTest, NV12Scaling)
+{
+    struct pp_scaling_context *scaling = &context->pp_scaling_context;
+
+    context->private_context = scaling;
+    context->pp_set_block_parameter = pp_scaling_set_block_parameter;
+
+    for (const Size& size : sizes) {
+        for (bool update_block_mask : { false, true }) {
+            scaling->dest_x = 0;
+            scaling->dest_y = 0;
+            scaling->dest_w = size.dest_w;
+            scaling->dest_h = size.dest_h;
+            scaling->src_normalized_x = 0.0;
+            scaling->src_normalized_y = 0.0;
+
+            static_parameter.grf1.r1_6.normalized_video_y_scaling_step =
+                1.0 / size.dest_h;
+            memset(&inline_parameter, 0, sizeof(inline_parameter));
+            inline_parameter.gen5.grf5.normalized_video_x_scaling_step =
+                1.0 / size.dest_w;
+            inline_parameter.gen5.grf5.block_count_x = size.dest_w / 16;
+            inline_parameter.gen5.grf5.number_blocks = size.dest_w / 16;
+
+            walk(size.dest_w / 16, size.dest_h / 8, 6,
+                sizeof(struct pp_inline_parameter), update_block_mask);
+        }
+    }
+}
+
+TEST_F(PPWalkerTest, AVS)
+{
+    struct pp_avs_context *avs = &context->pp_avs_context;
+
+    context->private_context = avs;
+    context->pp_set_block_parameter = pp_avs_set_block_parameter;
+
+    for (const Size& size : sizes) {
+        for (int nlas : { 0, 1 }) {
+            avs->dest_x = 0;
+            avs->dest_y = 0;
+            avs->dest_w = size.dest_w;
+            avs->dest_h = size.dest_h;
+            avs->src_normalized_x = 0.0;
+            avs->src_normalized_y = 0.0;
+            avs->src_w = size.src_w;
+            avs->src_h = size.src_h;
+
+            static_parameter.grf4.r4_2.avs.nlas = nlas;
+            static_parameter.grf1.r1_6.normalized_video_y_scaling_step =
+                1.0 / size.dest_h;
+            memset(&inline_parameter, 0, sizeof(inline_parameter));
+            inline_parameter.gen5.grf5.normalized_video_x_scaling_step =
+                1.0 / size.dest_w;
+            inline_parameter.gen5.grf5.block_count_x = 1;
+            inline_parameter.gen5.grf5.number_blocks = size.dest_h / 8;
+
+            /*
+             * The driver walks a single row of columns, walk 8-line rows
+             * instead so the non-linear state carried along each row is
+             * split over several bands
+             */
+            walk(size.dest_w / 16, 1, 4,
+                sizeof(struct pp_inline_parameter), false);
+            walk(size.dest_w / 16, size.dest_h / 8, 4,
+                sizeof(struct pp_inline_parameter), false);
+        }
+    }
+}
+
+TEST_F(PPWalkerTest, Gen7AVS)
+{
+    struct pp_avs_context *avs = &context->pp_avs_context;
+
+    context->private_context = avs;
+    context->pp_set_block_parameter = gen7_pp_avs_set_block_parameter;
+
+    for (const Size& size : sizes) {
+        avs->dest_x = 8;
+        avs->dest_y = 4;
+        avs->dest_w = size.dest_w;
+        avs->dest_h = size.dest_h;
+        avs->src_w = size.src_w;
+        avs->src_h = size.src_h;
+        avs->horiz_range = 1.0;
+
+        memset(&inline_parameter, 0, sizeof(inline_parameter));
+
+        walk(size.dest_w / 16, size.dest_h / 16, 6,
+            sizeof(struct gen7_pp_inline_parameter), false);
+    }
+}
+
+TEST_F(PPWalkerTest, DNDI)
+{
+    context->private_context = &context->pp_dndi_context;
+    context->pp_set_block_parameter = pp_dndi_set_block_parameter;
+
+    for (const Size& size : sizes) {
+        for (bool update_block_mask : { false, true }) {
+            memset(&inline_parameter, 0, sizeof(inline_parameter));
+            inline_parameter.gen5.grf5.block_count_x = size.dest_w / 16;
+            inline_parameter.gen5.grf5.number_blocks = size.dest_w / 16;
+            inline_parameter.gen5.grf5.block_vertical_mask = 0xff;
+            inline_parameter.gen5.grf5.block_horizontal_mask = 0xffff;
+
+            walk(size.dest_w / 16, size.dest_h / 4, 6,
+                sizeof(struct pp_inline_parameter), update_block_mask);
+        }
+    }
+}
+
+TEST_F(PPWalkerTest, Gen7DNDI)
+{
+    context->private_context = &context->pp_dndi_context;
+    context->pp_set_block_parameter = gen7_pp_dndi_set_block_parameter;
+
+    for (const Size& size : sizes) {
+        memset(&inline_parameter, 0, sizeof(inline_parameter));
+
+        walk(size.dest_w / 16, size.dest_h / 4, 6,
+            sizeof(struct gen7_pp_inline_parameter), false);
+    }
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "i965_test_environment.h"
+
+extern "C" {
+    #include "i965_slice_data_pool.h"
+}
+
+#include <cstring>
+
+namespace {
+
+class SliceDataPoolTest : public ::testing::Test
+{
+protected:
+    void SetUp()
+    {
+        I965TestEnvironment *env(I965TestEnvironment::instance());
+        ASSERT_PTR(env);
+
+        struct i965_driver_data *i965(*env);
+        ASSERT_PTR(i965);
+
+        i965_slice_data_pool_init(&pool, &i965->intel);
+    }
+
+    void TearDown()
+    {
+        i965_slice_data_pool_terminate(&pool);
+    }
+
+    I965SliceDataPool pool;
+};
+
+TEST_F(SliceDataPoolTest, Packing)
+{
+    I965SliceDataSlab *first, *second;
+    unsigned int first_offset, second_offset;
+
+    first = i965_slice_data_pool_alloc(&pool, 100, &first_offset);
+    ASSERT_PTR(first);
+    second = i965_slice_data_pool_alloc(&pool, 1000, &second_offset);
+    ASSERT_PTR(second);
+
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(0u, first_offset);
+    EXPECT_EQ(128u, second_offset);
+    EXPECT_EQ(0u, second_offset % I965_SLICE_DATA_ALIGNMENT);
+    EXPECT_EQ(1u, pool.num_slabs);
+
+    i965_slice_data_pool_free(first);
+    i965_slice_data_pool_free(second);
+}
+
+TEST_F(SliceDataPoolTest, ReadWrite)
+{
+    I965SliceDataSlab *slab[2];
+    unsigned int offset[2];
+    uint8_t data[256];
+
+    for (int i = 0; i < 2; i++) {
+        slab[i] = i965_slice_data_pool_alloc(&pool, sizeof(data), &offset[i]);
+        ASSERT_PTR(slab[i]);
+        memset(slab[i]->map + offset[i], i + 1, sizeof(data));
+    }
+
+    ASSERT_EQ(0, dri_bo_get_subdata(slab[0]->bo, offset[0], sizeof(data), data));
+    EXPECT_EQ(1u, data[0]);
+    EXPECT_EQ(1u, data[sizeof(data) - 1]);
+
+    ASSERT_EQ(0, dri_bo_get_subdata(slab[1]->bo, offset[1], sizeof(data), data));
+    EXPECT_EQ(2u, data[0]);
+    EXPECT_EQ(2u, data[sizeof(data) - 1]);
+
+    i965_slice_data_pool_free(slab[0]);
+    i965_slice_data_pool_free(slab[1]);
+}
+
+TEST_F(SliceDataPoolTest, TooLarge)
+{
+    struct i965_slice_data_pool_stats stats;
+    unsigned int offset;
+
+    EXPECT_FALSE(i965_slice_data_pool_alloc(&pool, I965_SLICE_DATA_SLAB_SIZE + 1, &offset));
+    EXPECT_EQ(0u, pool.num_slabs);
+
+    i965_slice_data_pool_get_stats(&pool, &stats);
+    EXPECT_EQ(0ul, stats.allocs);
+    EXPECT_EQ(1ul, stats.fallbacks);
+}
+
+TEST_F(SliceDataPoolTest, Rewind)
+{
+    I965SliceDataSlab *slab, *next;
+    unsigned int offset;
+
+    slab = i965_slice_data_pool_alloc(&pool, I965_SLICE_DATA_SLAB_SIZE / 2, &offset);
+    ASSERT_PTR(slab);
+    i965_slice_data_pool_free(slab);
+
+    /* Not enough room left, but nobody uses the slab anymore */
+    next = i965_slice_data_pool_alloc(&pool, I965_SLICE_DATA_SLAB_SIZE / 2 + 1, &offset);
+    EXPECT_EQ(slab, next);
+    EXPECT_EQ(0u, offset);
+    EXPECT_EQ(1u, pool.num_slabs);
+
+    i965_slice_data_pool_free(next);
+}
+
+TEST_F(SliceDataPoolTest, Growth)
+{
+    I965SliceDataSlab *slabs[I965_SLICE_DATA_MAX_SLABS + 1];
+    struct i965_slice_data_pool_stats stats;
+    unsigned int offset;
+    int i;
+
+    for (i = 0; i < I965_SLICE_DATA_MAX_SLABS; i++) {
+        slabs[i] = i965_slice_data_pool_alloc(&pool, I965_SLICE_DATA_SLAB_SIZE, &offset);
+        ASSERT_PTR(slabs[i]);
+        EXPECT_EQ(0u, offset);
+        EXPECT_EQ(unsigned(i + 1), pool.num_slabs);
+    }
+
+    /* All slabs in use, the caller falls back to a buffer object */
+    EXPECT_FALSE(i965_slice_data_pool_alloc(&pool, 64, &offset));
+
+    i965_slice_data_pool_free(slabs[0]);
+    slabs[i] = i965_slice_data_pool_alloc(&pool, 64, &offset);
+    EXPECT_EQ(slabs[0], slabs[i]);
+    EXPECT_EQ(unsigned(I965_SLICE_DATA_MAX_SLABS), pool.num_slabs);
+
+    for (i = 1; i <= I965_SLICE_DATA_MAX_SLABS; i++)
+        i965_slice_data_pool_free(slabs[i]);
+
+    i965_slice_data_pool_get_stats(&pool, &stats);
+    EXPECT_EQ((unsigned long)(I965_SLICE_DATA_MAX_SLABS + 1), stats.allocs);
+    EXPECT_EQ(1ul, stats.fallbacks);
+}
+
+} // namespace
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "i965_test_environment.h"
+#include "i965_test_fixture.h"
+
+extern "C" {
+    #include "i965_sync.h"
+#if HAVE_NULL_HW
+    #include "intel_null_hw.h"
+#endif
+}
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+namespace {
+
+unsigned long histogram_count(const struct i965_sync_histogram& hist)
+{
+    unsigned long count(0);
+
+    for (int i(0); i < I965_SYNC_HISTOGRAM_BUCKETS; ++i)
+        count += hist.buckets[i];
+    return count;
+}
+
+TEST(SyncHistogramTest, Buckets)
+{
+    struct i965_sync_histogram hist = {};
+
+    i965_sync_histogram_add(&hist, 0);
+    i965_sync_histogram_add(&hist, 999);
+    i965_sync_histogram_add(&hist, 1000);
+    i965_sync_histogram_add(&hist, 3000);
+    i965_sync_histogram_add(&hist, 4000);
+    i965_sync_histogram_add(&hist, 1000000000ull);
+
+    EXPECT_EQ(2ul, hist.buckets[0]);
+    EXPECT_EQ(1ul, hist.buckets[1]);
+    EXPECT_EQ(1ul, hist.buckets[2]);
+    EXPECT_EQ(1ul, hist.buckets[3]);
+    EXPECT_EQ(1ul, hist.buckets[I965_SYNC_HISTOGRAM_BUCKETS - 1]);
+}
+
+TEST(SyncHistogramTest, Print)
+{
+    struct i965_sync_histogram hist = {};
+    char str[256];
+
+    EXPECT_EQ(0, i965_sync_histogram_print(&hist, str, sizeof(str)));
+    EXPECT_STREQ("", str);
+
+    i965_sync_histogram_add(&hist, 0);
+    i965_sync_histogram_add(&hist, 50000);
+    i965_sync_histogram_add(&hist, 50000);
+    i965_sync_histogram_add(&hist, 1000000000ull);
+
+    const std::string expect("<1us:1 <64us:2 >=16384us:1");
+    EXPECT_EQ(int(expect.size()), i965_sync_histogram_print(&hist, str, sizeof(str)));
+    EXPECT_EQ(expect, str);
+
+    /* Truncated like snprintf() */
+    EXPECT_EQ(int(expect.size()), i965_sync_histogram_print(&hist, str, 8));
+    EXPECT_EQ(expect.substr(0, 7), str);
+
+    /* Truncated within the first bucket */
+    EXPECT_EQ(int(expect.size()), i965_sync_histogram_print(&hist, str, 3));
+    EXPECT_EQ(expect.substr(0, 2), str);
+}
+
+class SyncWaitTest : public ::testing::Test
+{
+protected:
+    void SetUp()
+    {
+        I965TestEnvironment *env(I965TestEnvironment::instance());
+        ASSERT_PTR(env);
+
+        struct i965_driver_data *i965(*env);
+        ASSERT_PTR(i965);
+
+        bufmgr = i965->intel.bufmgr;
+        i965_sync_init(&sync, I965_SYNC_SPIN_US);
+    }
+
+    dri_bufmgr *bufmgr;
+    struct i965_sync sync;
+};
+
+TEST_F(SyncWaitTest, Idle)
+{
+    dri_bo *bos[3] = {
+        dri_bo_alloc(bufmgr, "first", 4096, 4096),
+        NULL,
+        dri_bo_alloc(bufmgr, "second", 4096, 4096),
+    };
+    uint64_t waited_ns = ~0ull;
+
+    ASSERT_PTR(bos[0]);
+    ASSERT_PTR(bos[2]);
+
+    /* Nothing uses fresh buffers, there is no wait at all */
+    EXPECT_TRUE(i965_sync_wait(&sync, bos, 3, -1, &waited_ns));
+    EXPECT_EQ(0ull, waited_ns);
+    EXPECT_TRUE(i965_sync_wait(&sync, bos, 3, 0, NULL));
+    EXPECT_TRUE(i965_sync_wait(&sync, bos, 0, 0, NULL));
+
+    EXPECT_EQ(0ul, sync.polled);
+    EXPECT_EQ(0ul, sync.blocked);
+    EXPECT_EQ(unsigned(I965_SYNC_SPIN_US), sync.spin_us);
+
+    dri_bo_unreference(bos[0]);
+    dri_bo_unreference(bos[2]);
+}
+
+TEST_F(SyncWaitTest, NoSpin)
+{
+    dri_bo *bo = dri_bo_alloc(bufmgr, "bo", 4096, 4096);
+    ASSERT_PTR(bo);
+
+    i965_sync_init(&sync, 0);
+    EXPECT_TRUE(i965_sync_wait(&sync, &bo, 1, -1, NULL));
+    EXPECT_EQ(0u, sync.spin_us);
+
+    dri_bo_unreference(bo);
+}
+
+TEST_F(SyncWaitTest, PollsBusy)
+{
+#if HAVE_NULL_HW
+    dri_bo *bo = dri_bo_alloc(bufmgr, "bo", 4096, 4096);
+    ASSERT_PTR(bo);
+
+    /* The GPU is done well within the polling window */
+    i965_sync_init(&sync, 1000000);
+    intel_null_hw_bo_set_busy(bo, true);
+    std::thread gpu([bo] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        intel_null_hw_bo_set_busy(bo, false);
+    });
+    EXPECT_TRUE(i965_sync_wait(&sync, &bo, 1, -1, NULL));
+    gpu.join();
+
+    EXPECT_EQ(1ul, sync.polled);
+    EXPECT_EQ(0ul, sync.blocked);
+    EXPECT_EQ(1000000u, sync.spin_us);
+
+    /* Still busy when the timeout is over, neither polled nor blocked */
+    intel_null_hw_bo_set_busy(bo, true);
+    EXPECT_FALSE(i965_sync_wait(&sync, &bo, 1, 0, NULL));
+    EXPECT_EQ(1ul, sync.polled);
+    EXPECT_EQ(0ul, sync.blocked);
+
+    intel_null_hw_bo_set_busy(bo, false);
+    dri_bo_unreference(bo);
+#else
+    std::cout << "[  SKIPPED ] SyncWaitTest.PollsBusy needs the null"
+        " hardware backend to keep buffer objects busy" << std::endl;
+#endif
+}
+
+TEST_F(SyncWaitTest, BlockedAdapts)
+{
+#if HAVE_NULL_HW
+    dri_bo *bo = dri_bo_alloc(bufmgr, "bo", 4096, 4096);
+    uint64_t waited_ns = ~0ull;
+    ASSERT_PTR(bo);
+
+    /* Without a polling window, a busy buffer object blocks right away */
+    sync.spin_us = 0;
+    intel_null_hw_bo_set_busy(bo, true);
+    EXPECT_TRUE(i965_sync_wait(&sync, &bo, 1, -1, &waited_ns));
+    EXPECT_NE(~0ull, waited_ns);
+
+    EXPECT_EQ(0ul, sync.polled);
+    EXPECT_EQ(1ul, sync.blocked);
+
+    /* The null backend's wait returns at once, which reopens the window */
+    EXPECT_LE(1u, sync.spin_us);
+    EXPECT_GE(unsigned(I965_SYNC_SPIN_US), sync.spin_us);
+
+    intel_null_hw_bo_set_busy(bo, false);
+    dri_bo_unreference(bo);
+#else
+    std::cout << "[  SKIPPED ] SyncWaitTest.BlockedAdapts needs the null"
+        " hardware backend to keep buffer objects busy" << std::endl;
+#endif
+}
+
+class SyncSurfaceTest
+    : public I965TestFixture
+{
+};
+
+TEST_F(SyncSurfaceTest, BlockedWaitSampled)
+{
+#if HAVE_NULL_HW
+    struct i965_driver_data *i965(*this);
+    ASSERT_PTR(i965);
+
+    Surfaces surfaces = createSurfaces(64, 64, VA_RT_FORMAT_YUV420);
+    ASSERT_EQ(1u, surfaces.size());
+
+    struct object_surface *obj_surface = SURFACE(surfaces[0]);
+    ASSERT_PTR(obj_surface);
+    if (!obj_surface->bo)
+        ASSERT_STATUS(i965_check_alloc_surface_bo(*this, obj_surface, 1,
+                                                  VA_FOURCC_NV12,
+                                                  SUBSAMPLE_YUV420));
+
+    const unsigned int spin_us(i965->sync.spin_us);
+    const unsigned long blocked(i965->sync.blocked);
+    const unsigned long samples(histogram_count(i965->sync.latency));
+
+    i965->sync.spin_us = 0;
+    intel_null_hw_bo_set_busy(obj_surface->bo, true);
+    EXPECT_STATUS(i965_sync_surfaces(*this, &surfaces[0], 1, -1));
+
+    EXPECT_EQ(blocked + 1, i965->sync.blocked);
+    EXPECT_EQ(samples + 1, histogram_count(i965->sync.latency));
+
+    intel_null_hw_bo_set_busy(obj_surface->bo, false);
+    i965->sync.spin_us = spin_us;
+    destroySurfaces(surfaces);
+#else
+    std::cout << "[  SKIPPED ] SyncSurfaceTest.BlockedWaitSampled needs the"
+        " null hardware backend to keep buffer objects busy" << std::endl;
+#endif
+}
+
+} // namespace
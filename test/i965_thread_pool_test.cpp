@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test.h"
+
+extern "C" {
+    #include "i965_thread_pool.h"
+}
+
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Batch {
+    std::vector<std::atomic<int> > counts;
+    std::atomic<int> calls;
+
+    explicit Batch(unsigned n) : counts(n), calls(0)
+    {
+        for (auto& c : counts)
+            c = 0;
+    }
+};
+
+void count_job(void *arg, unsigned job_index)
+{
+    Batch *batch = static_cast<Batch *>(arg);
+
+    ++batch->counts[job_index];
+    ++batch->calls;
+}
+
+} // namespace
+
+TEST(ThreadPoolTest, SingleThread)
+{
+    I965ThreadPool pool;
+
+    EXPECT_EQ(1u, i965_thread_pool_init(&pool, 0));
+    EXPECT_EQ(1u, pool.num_threads);
+
+    Batch batch(10);
+    i965_thread_pool_run(&pool, count_job, &batch, 10);
+    EXPECT_EQ(10, batch.calls);
+    for (auto& c : batch.counts)
+        EXPECT_EQ(1, c);
+
+    i965_thread_pool_terminate(&pool);
+}
+
+TEST(ThreadPoolTest, EveryJobOnce)
+{
+    I965ThreadPool pool;
+
+    EXPECT_EQ(4u, i965_thread_pool_init(&pool, 4));
+
+    for (unsigned n : { 0u, 1u, 2u, 3u, 4u, 5u, 64u, 1000u }) {
+        for (int round(0); round < 10; ++round) {
+            Batch batch(n);
+            i965_thread_pool_run(&pool, count_job, &batch, n);
+            ASSERT_EQ(int(n), batch.calls);
+            for (auto& c : batch.counts)
+                ASSERT_EQ(1, c);
+        }
+    }
+
+    i965_thread_pool_terminate(&pool);
+}
+
+TEST(ThreadPoolTest, ConcurrentCallers)
+{
+    I965ThreadPool pool;
+    std::vector<std::thread> callers;
+    std::atomic<int> errors(0);
+
+    i965_thread_pool_init(&pool, 3);
+
+    for (int i(0); i < 4; ++i) {
+        callers.push_back(std::thread([&]{
+            for (int round(0); round < 100; ++round) {
+                Batch batch(17);
+                i965_thread_pool_run(&pool, count_job, &batch, 17);
+                for (auto& c : batch.counts)
+                    errors += (c != 1);
+            }
+        }));
+    }
+
+    for (auto& t : callers)
+        t.join();
+
+    EXPECT_EQ(0, errors);
+
+    i965_thread_pool_terminate(&pool);
+}
+
+TEST(ThreadPoolTest, EnvThreads)
+{
+    const char *name = "I965_THREAD_POOL_TEST_THREADS";
+
+    unsetenv(name);
+    EXPECT_EQ(1u, i965_thread_pool_get_env_threads(name, 1));
+    EXPECT_EQ(3u, i965_thread_pool_get_env_threads(name, 3));
+
+    setenv(name, "6", 1);
+    EXPECT_EQ(6u, i965_thread_pool_get_env_threads(name, 1));
+    setenv(name, "0", 1);
+    EXPECT_EQ(1u, i965_thread_pool_get_env_threads(name, 4));
+    setenv(name, "1000", 1);
+    EXPECT_EQ(unsigned(I965_THREAD_POOL_MAX_THREADS),
+              i965_thread_pool_get_env_threads(name, 1));
+    unsetenv(name);
+}
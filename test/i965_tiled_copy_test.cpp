@@ -0,0 +1,402 @@
+/*
+ * Copyright (C) 2018 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test.h"
+
+extern "C" {
+    #include <i915_drm.h>
+    #include "i965_tiled_copy.h"
+    #include "i965_thread_pool.h"
+}
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <vector>
+
+namespace {
+
+// Reference model of the tiled layouts, derived bit by bit from the
+// address swizzling description in the PRM rather than from tile sizes.
+size_t reference_offset(unsigned tiling, unsigned swizzle, unsigned pitch,
+                        unsigned x, unsigned y)
+{
+    size_t tile, offset;
+
+    if (tiling == I915_TILING_X) {
+        tile = (y >> 3) * (pitch >> 9) + (x >> 9);
+        offset = (tile << 12) | ((y & 7) << 9) | (x & 511);
+    } else if (tiling == I915_TILING_Y) {
+        tile = (y >> 5) * (pitch >> 7) + (x >> 7);
+        offset = (tile << 12) | (((x >> 4) & 7) << 9) | ((y & 31) << 4) | (x & 15);
+    } else {
+        return (size_t)y * pitch + x;
+    }
+
+    size_t bit6 = 0;
+    switch (swizzle) {
+    case I915_BIT_6_SWIZZLE_9:
+        bit6 = (offset >> 9) & 1;
+        break;
+    case I915_BIT_6_SWIZZLE_9_10:
+        bit6 = ((offset >> 9) ^ (offset >> 10)) & 1;
+        break;
+    case I915_BIT_6_SWIZZLE_9_11:
+        bit6 = ((offset >> 9) ^ (offset >> 11)) & 1;
+        break;
+    case I915_BIT_6_SWIZZLE_9_10_11:
+        bit6 = ((offset >> 9) ^ (offset >> 10) ^ (offset >> 11)) & 1;
+        break;
+    }
+    return offset ^ (bit6 << 6);
+}
+
+struct Layout {
+    unsigned tiling;
+    unsigned swizzle;
+};
+
+const Layout layouts[] = {
+    { I915_TILING_NONE, I915_BIT_6_SWIZZLE_NONE },
+    { I915_TILING_X, I915_BIT_6_SWIZZLE_NONE },
+    { I915_TILING_X, I915_BIT_6_SWIZZLE_9_10 },
+    { I915_TILING_X, I915_BIT_6_SWIZZLE_9_10_11 },
+    { I915_TILING_Y, I915_BIT_6_SWIZZLE_NONE },
+    { I915_TILING_Y, I915_BIT_6_SWIZZLE_9 },
+    { I915_TILING_Y, I915_BIT_6_SWIZZLE_9_11 },
+};
+
+const unsigned pitch = 1024;
+const unsigned rows = 64;
+
+std::vector<uint8_t> random_bytes(size_t size)
+{
+    std::vector<uint8_t> v(size);
+    for (size_t i(0); i < size; ++i)
+        v[i] = std::rand() & 0xff;
+    return v;
+}
+
+} // namespace
+
+TEST(TiledCopyTest, Supported)
+{
+    EXPECT_TRUE(i965_tiled_copy_supported(I915_TILING_NONE, I915_BIT_6_SWIZZLE_9_17, 100));
+    EXPECT_TRUE(i965_tiled_copy_supported(I915_TILING_Y, I915_BIT_6_SWIZZLE_9, 128));
+    EXPECT_FALSE(i965_tiled_copy_supported(I915_TILING_Y, I915_BIT_6_SWIZZLE_9, 64));
+    EXPECT_FALSE(i965_tiled_copy_supported(I915_TILING_X, I915_BIT_6_SWIZZLE_NONE, 128));
+    EXPECT_FALSE(i965_tiled_copy_supported(I915_TILING_X, I915_BIT_6_SWIZZLE_9_17, 512));
+    EXPECT_FALSE(i965_tiled_copy_supported(I915_TILING_Y, I915_BIT_6_SWIZZLE_UNKNOWN, 512));
+}
+
+TEST(TiledCopyTest, Offsets)
+{
+    for (const Layout& l : layouts) {
+        I965TiledSurface surface = { NULL, pitch, l.tiling, l.swizzle };
+        std::vector<bool> used(pitch * rows, false);
+
+        for (unsigned y(0); y < rows; ++y) {
+            for (unsigned x(0); x < pitch; ++x) {
+                size_t offset = i965_tiled_offset(&surface, x, y);
+                ASSERT_EQ(reference_offset(l.tiling, l.swizzle, pitch, x, y), offset);
+                ASSERT_FALSE(used[offset]);
+                used[offset] = true;
+            }
+        }
+    }
+}
+
+TEST(TiledCopyTest, CopyRectangles)
+{
+    for (const Layout& l : layouts) {
+        std::vector<uint8_t> tiled = random_bytes(pitch * rows);
+        I965TiledSurface surface = { tiled.data(), pitch, l.tiling, l.swizzle };
+
+        for (int i(0); i < 32; ++i) {
+            unsigned x = std::rand() % pitch, y = std::rand() % rows;
+            unsigned w = 1 + std::rand() % (pitch - x), h = 1 + std::rand() % (rows - y);
+            unsigned lin_pitch = w + std::rand() % 64;
+
+            SCOPED_TRACE(::testing::Message() << "tiling=" << l.tiling
+                << " swizzle=" << l.swizzle << " rect=" << x << "," << y
+                << " " << w << "x" << h);
+
+            std::vector<uint8_t> linear(lin_pitch * h);
+            i965_tiled_copy_to_linear(linear.data(), lin_pitch, &surface, x, y, w, h);
+
+            for (unsigned r(0); r < h; ++r)
+                for (unsigned c(0); c < w; ++c)
+                    ASSERT_EQ(tiled[reference_offset(l.tiling, l.swizzle, pitch, x + c, y + r)],
+                              linear[r * lin_pitch + c]);
+
+            std::vector<uint8_t> expect(tiled);
+            std::vector<uint8_t> src = random_bytes(lin_pitch * h);
+            for (unsigned r(0); r < h; ++r)
+                for (unsigned c(0); c < w; ++c)
+                    expect[reference_offset(l.tiling, l.swizzle, pitch, x + c, y + r)] =
+                        src[r * lin_pitch + c];
+
+            i965_tiled_copy_from_linear(&surface, x, y, src.data(), lin_pitch, w, h);
+            ASSERT_TRUE(expect == tiled);
+        }
+    }
+}
+
+TEST(TiledCopyTest, Interleave)
+{
+    for (const Layout& l : layouts) {
+        std::vector<uint8_t> tiled = random_bytes(pitch * rows);
+        I965TiledSurface surface = { tiled.data(), pitch, l.tiling, l.swizzle };
+
+        for (int i(0); i < 32; ++i) {
+            unsigned x = (std::rand() % pitch) & ~1, y = std::rand() % rows;
+            unsigned w = (2 + std::rand() % (pitch - x)) & ~1, h = 1 + std::rand() % (rows - y);
+            unsigned u_pitch = w / 2 + std::rand() % 32, v_pitch = w / 2 + std::rand() % 32;
+
+            SCOPED_TRACE(::testing::Message() << "tiling=" << l.tiling
+                << " swizzle=" << l.swizzle << " rect=" << x << "," << y
+                << " " << w << "x" << h);
+
+            std::vector<uint8_t> u(u_pitch * h), v(v_pitch * h);
+            i965_tiled_copy_deinterleave_to_linear(u.data(), u_pitch, v.data(), v_pitch,
+                                                   &surface, x, y, w, h);
+
+            for (unsigned r(0); r < h; ++r) {
+                for (unsigned c(0); c < w / 2; ++c) {
+                    ASSERT_EQ(tiled[reference_offset(l.tiling, l.swizzle, pitch, x + 2 * c, y + r)],
+                              u[r * u_pitch + c]);
+                    ASSERT_EQ(tiled[reference_offset(l.tiling, l.swizzle, pitch, x + 2 * c + 1, y + r)],
+                              v[r * v_pitch + c]);
+                }
+            }
+
+            u = random_bytes(u_pitch * h);
+            v = random_bytes(v_pitch * h);
+            std::vector<uint8_t> expect(tiled);
+            for (unsigned r(0); r < h; ++r) {
+                for (unsigned c(0); c < w / 2; ++c) {
+                    expect[reference_offset(l.tiling, l.swizzle, pitch, x + 2 * c, y + r)] =
+                        u[r * u_pitch + c];
+                    expect[reference_offset(l.tiling, l.swizzle, pitch, x + 2 * c + 1, y + r)] =
+                        v[r * v_pitch + c];
+                }
+            }
+
+            i965_tiled_copy_interleave_from_linear(&surface, x, y, u.data(), u_pitch,
+                                                   v.data(), v_pitch, w, h);
+            ASSERT_TRUE(expect == tiled);
+        }
+    }
+}
+
+TEST(TiledCopyTest, Benchmark)
+{
+    // 1080p NV12 luma plane in a Y-tiled surface
+    const unsigned width(1920), height(1088), surface_pitch(2048);
+    std::vector<uint8_t> tiled = random_bytes(surface_pitch * height);
+    std::vector<uint8_t> linear(width * height), u(width / 2 * height), v(u);
+    const int runs(20);
+
+    auto report = [&](const char *name, std::function<void()> copy) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i(0); i < runs; ++i)
+            copy();
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        std::cout << name << ": " << std::fixed << std::setprecision(1)
+            << (double(width) * height * runs / elapsed.count() / (1 << 20))
+            << " MB/s" << std::endl;
+    };
+
+    for (const Layout& l : layouts) {
+        if (l.swizzle != I915_BIT_6_SWIZZLE_NONE)
+            continue;
+
+        I965TiledSurface surface = { tiled.data(), surface_pitch, l.tiling, l.swizzle };
+        std::cout << "tiling " << l.tiling << std::endl;
+
+        report("  reference detile", [&]{
+            for (unsigned y(0); y < height; ++y)
+                for (unsigned x(0); x < width; ++x)
+                    linear[y * width + x] =
+                        tiled[reference_offset(l.tiling, l.swizzle, surface_pitch, x, y)];
+        });
+        report("  to linear", [&]{
+            i965_tiled_copy_to_linear(linear.data(), width, &surface, 0, 0, width, height);
+        });
+        report("  from linear", [&]{
+            i965_tiled_copy_from_linear(&surface, 0, 0, linear.data(), width, width, height);
+        });
+        report("  deinterleave", [&]{
+            i965_tiled_copy_deinterleave_to_linear(u.data(), width / 2, v.data(), width / 2,
+                                                   &surface, 0, 0, width, height);
+        });
+        report("  interleave", [&]{
+            i965_tiled_copy_interleave_from_linear(&surface, 0, 0, u.data(), width / 2,
+                                                   v.data(), width / 2, width, height);
+        });
+    }
+}
+
+TEST(TiledCopyTest, ExecuteBands)
+{
+    // Large enough to be split over all threads of the pool
+    const unsigned surface_pitch(4096), height(1024);
+    const unsigned x(6), y(3), w(4000), h(990);
+    std::vector<uint8_t> tiled = random_bytes(surface_pitch * height);
+    I965TiledSurface surface = { tiled.data(), surface_pitch, I915_TILING_Y,
+                                 I915_BIT_6_SWIZZLE_9 };
+    I965ThreadPool pool;
+
+    ASSERT_EQ(4u, i965_thread_pool_init(&pool, 4));
+
+    std::vector<uint8_t> expect(w * h), linear(w * h);
+    i965_tiled_copy_to_linear(expect.data(), w, &surface, x, y, w, h);
+
+    I965TiledCopyRect rect = {};
+    rect.op = I965_TILED_COPY_TO_LINEAR;
+    rect.surface = &surface;
+    rect.x = x;
+    rect.y = y;
+    rect.width = w;
+    rect.height = h;
+    rect.linear[0] = linear.data();
+    rect.linear_pitch[0] = w;
+    i965_tiled_copy_execute(&pool, &rect);
+    EXPECT_TRUE(expect == linear);
+    EXPECT_EQ(0u, rect.band_height % 32);
+    EXPECT_LT(rect.band_height, h);
+    EXPECT_EQ(y % 32, rect.band_skew);
+
+    std::vector<uint8_t> expect_u(w / 2 * h), expect_v(w / 2 * h);
+    std::vector<uint8_t> u(w / 2 * h), v(w / 2 * h);
+    i965_tiled_copy_deinterleave_to_linear(expect_u.data(), w / 2,
+                                           expect_v.data(), w / 2,
+                                           &surface, x, y, w, h);
+    rect.op = I965_TILED_COPY_DEINTERLEAVE;
+    rect.linear[0] = u.data();
+    rect.linear_pitch[0] = w / 2;
+    rect.linear[1] = v.data();
+    rect.linear_pitch[1] = w / 2;
+    i965_tiled_copy_execute(&pool, &rect);
+    EXPECT_TRUE(expect_u == u);
+    EXPECT_TRUE(expect_v == v);
+
+    std::vector<uint8_t> expect_tiled(tiled);
+    std::vector<uint8_t> src = random_bytes(w * h);
+    i965_tiled_copy_from_linear(&surface, x, y, src.data(), w, w, h);
+    expect_tiled.swap(tiled);
+    surface.base = tiled.data();
+    rect.op = I965_TILED_COPY_FROM_LINEAR;
+    rect.linear[0] = src.data();
+    rect.linear_pitch[0] = w;
+    rect.linear[1] = NULL;
+    i965_tiled_copy_execute(&pool, &rect);
+    EXPECT_TRUE(expect_tiled == tiled);
+
+    i965_thread_pool_terminate(&pool);
+}
+
+TEST(TiledCopyTest, ExecuteSmallCopyInline)
+{
+    std::vector<uint8_t> tiled = random_bytes(pitch * rows), linear(pitch * rows);
+    I965TiledSurface surface = { tiled.data(), pitch, I915_TILING_X,
+                                 I915_BIT_6_SWIZZLE_NONE };
+    I965ThreadPool pool;
+
+    i965_thread_pool_init(&pool, 4);
+
+    I965TiledCopyRect rect = {};
+    rect.op = I965_TILED_COPY_TO_LINEAR;
+    rect.surface = &surface;
+    rect.width = pitch;
+    rect.height = rows;
+    rect.linear[0] = linear.data();
+    rect.linear_pitch[0] = pitch;
+    i965_tiled_copy_execute(&pool, &rect);
+    EXPECT_EQ(rows, rect.band_height);
+
+    for (unsigned r(0); r < rows; ++r)
+        for (unsigned c(0); c < pitch; ++c)
+            ASSERT_EQ(tiled[reference_offset(I915_TILING_X, I915_BIT_6_SWIZZLE_NONE,
+                                             pitch, c, r)],
+                      linear[r * pitch + c]);
+
+    i965_thread_pool_terminate(&pool);
+}
+
+TEST(TiledCopyTest, ThreadScaling)
+{
+    // 4K NV12 in a Y-tiled surface, copied to an I420 image
+    const unsigned width(3840), height(2160), surface_pitch(3840);
+    const unsigned surface_height(2176);
+    std::vector<uint8_t> tiled = random_bytes(surface_pitch * surface_height * 3 / 2);
+    std::vector<uint8_t> image(width * height * 3 / 2);
+    I965TiledSurface surface = { tiled.data(), surface_pitch, I915_TILING_Y,
+                                 I915_BIT_6_SWIZZLE_NONE };
+    const int runs(10);
+    double base(0);
+
+    for (unsigned threads : { 1u, 2u, 4u, 8u }) {
+        I965ThreadPool pool;
+
+        i965_thread_pool_init(&pool, threads);
+
+        I965TiledCopyRect luma = {};
+        luma.op = I965_TILED_COPY_TO_LINEAR;
+        luma.surface = &surface;
+        luma.width = width;
+        luma.height = height;
+        luma.linear[0] = image.data();
+        luma.linear_pitch[0] = width;
+
+        I965TiledCopyRect chroma = {};
+        chroma.op = I965_TILED_COPY_DEINTERLEAVE;
+        chroma.surface = &surface;
+        chroma.y = surface_height;
+        chroma.width = width;
+        chroma.height = height / 2;
+        chroma.linear[0] = image.data() + width * height;
+        chroma.linear_pitch[0] = width / 2;
+        chroma.linear[1] = chroma.linear[0] + width * height / 4;
+        chroma.linear_pitch[1] = width / 2;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i(0); i < runs; ++i) {
+            i965_tiled_copy_execute(&pool, &luma);
+            i965_tiled_copy_execute(&pool, &chroma);
+        }
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        const double ms = elapsed.count() * 1000 / runs;
+        if (threads == 1)
+            base = ms;
+        std::cout << threads << " threads: " << std::fixed << std::setprecision(2)
+            << ms << " ms/frame, speedup " << base / ms << "x" << std::endl;
+
+        i965_thread_pool_terminate(&pool);
+    }
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test.h"
+
+extern "C" {
+    #include "i965_vc1_bitplane.h"
+}
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <vector>
+
+namespace {
+
+// the per macroblock conversion of the gen6+ MFD VC-1 decode_init before
+void legacy_convert(uint8_t *dst, int bitplane_width, const uint8_t *src,
+                    int width_in_mbs, int height_in_mbs, bool skipped)
+{
+    int src_w, src_h;
+
+    for (src_h = 0; src_h < height_in_mbs; src_h++) {
+        for (src_w = 0; src_w < width_in_mbs; src_w++) {
+            int src_index, dst_index;
+            int src_shift;
+            uint8_t src_value = 0x2;
+
+            if (!skipped) {
+                src_index = (src_h * width_in_mbs + src_w) / 2;
+                src_shift = !((src_h * width_in_mbs + src_w) & 1) * 4;
+                src_value = ((src[src_index] >> src_shift) & 0xf);
+            }
+
+            dst_index = src_w / 2;
+            dst[dst_index] = ((dst[dst_index] >> 4) | (src_value << 4));
+        }
+
+        if (src_w & 1)
+            dst[src_w / 2] >>= 4;
+
+        dst += bitplane_width;
+    }
+}
+
+std::vector<uint8_t> make_bitplane(int width_in_mbs, int height_in_mbs)
+{
+    std::vector<uint8_t> src((width_in_mbs * height_in_mbs + 1) / 2);
+
+    for (size_t i(0); i < src.size(); ++i)
+        src[i] = std::rand() & 0xff;
+    return src;
+}
+
+} // namespace
+
+TEST(VC1BitplaneTest, MatchesLegacy)
+{
+    std::srand(7);
+
+    for (int width(1); width < 80; width += 3) {
+        for (int height(1); height < 12; height += 2) {
+            const int pitch((width + 1) / 2);
+            std::vector<uint8_t> src = make_bitplane(width, height);
+            std::vector<uint8_t> expect(pitch * height, 0x55), actual(pitch * height, 0xaa);
+
+            SCOPED_TRACE(::testing::Message() << width << "x" << height);
+
+            legacy_convert(&expect[0], pitch, &src[0], width, height, false);
+            i965_vc1_bitplane_convert(&actual[0], pitch, &src[0], width, height);
+            EXPECT_EQ(expect, actual);
+
+            legacy_convert(&expect[0], pitch, NULL, width, height, true);
+            i965_vc1_bitplane_fill_skipped(&actual[0], pitch, width, height);
+            EXPECT_EQ(expect, actual);
+        }
+    }
+}
+
+TEST(VC1BitplaneTest, Benchmark)
+{
+    const struct {
+        const char *name;
+        int width_in_mbs;
+        int height_in_mbs;
+    } sizes[] = {
+        { "1080p", 120, 68 },
+        { "4K", 240, 135 },
+    };
+
+    for (const auto &size : sizes) {
+        const int pitch((size.width_in_mbs + 1) / 2);
+        std::vector<uint8_t> src = make_bitplane(size.width_in_mbs, size.height_in_mbs);
+        std::vector<uint8_t> dst(pitch * size.height_in_mbs);
+
+        auto bench = [&](const char *name, std::function<void()> convert) {
+            const int runs(1000);
+            auto start = std::chrono::steady_clock::now();
+            for (int i(0); i < runs; ++i)
+                convert();
+            std::chrono::duration<double, std::micro> elapsed =
+                std::chrono::steady_clock::now() - start;
+            std::cout << size.name << " " << name << ": " << std::fixed
+                << std::setprecision(2) << (elapsed.count() / runs)
+                << " us/picture" << std::endl;
+        };
+
+        bench("legacy conversion", [&]{
+            legacy_convert(&dst[0], pitch, &src[0], size.width_in_mbs, size.height_in_mbs, false);
+        });
+        bench("i965_vc1_bitplane_convert", [&]{
+            i965_vc1_bitplane_convert(&dst[0], pitch, &src[0], size.width_in_mbs, size.height_in_mbs);
+        });
+        bench("legacy skipped fill", [&]{
+            legacy_convert(&dst[0], pitch, NULL, size.width_in_mbs, size.height_in_mbs, true);
+        });
+        bench("i965_vc1_bitplane_fill_skipped", [&]{
+            i965_vc1_bitplane_fill_skipped(&dst[0], pitch, size.width_in_mbs, size.height_in_mbs);
+        });
+    }
+}
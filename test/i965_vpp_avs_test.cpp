@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "test.h"
+
+extern "C" {
+    #include <va/va.h>
+    #include "i965_vpp_avs.h"
+}
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+
+namespace {
+
+/* Same parameters as the gen8+ scaler */
+class AVSTest : public ::testing::Test
+{
+protected:
+    void SetUp()
+    {
+        memset(&config, 0, sizeof(config));
+        config.coeff_frac_bits = 6;
+        config.coeff_epsilon = 1.0f / (1U << 6);
+        config.num_phases = 16;
+        config.num_luma_coeffs = 8;
+        config.num_chroma_coeffs = 4;
+
+        AVSCoeffs& lower = config.coeff_range.lower_bound;
+        AVSCoeffs& upper = config.coeff_range.upper_bound;
+        for (int i = 0; i < AVS_MAX_LUMA_COEFFS; i++) {
+            lower.y_k_h[i] = lower.y_k_v[i] = -2;
+            upper.y_k_h[i] = upper.y_k_v[i] = 2;
+        }
+        const float uv_bound[] = { 1, 2, 2, 1 };
+        for (int i = 0; i < AVS_MAX_CHROMA_COEFFS; i++) {
+            lower.uv_k_h[i] = lower.uv_k_v[i] = -uv_bound[i];
+            upper.uv_k_h[i] = upper.uv_k_v[i] = uv_bound[i];
+        }
+    }
+
+    float sum(const float *coeffs, int num_coeffs) const
+    {
+        float s = 0.0f;
+
+        for (int i = 0; i < num_coeffs; i++)
+            s += coeffs[i];
+        return s;
+    }
+
+    AVSConfig config;
+};
+
+TEST_F(AVSTest, LanczosMatchesReference)
+{
+    const float factors[] = { 0.1f, 0.25f, 1.0f / 3, 0.5f, 2.0f / 3, 0.75f,
+                              0.9f, 1.0f, 1.5f, 4.0f };
+
+    for (float f : factors) {
+        for (int phase = 0; phase <= config.num_phases; phase++) {
+            for (int n : { 4, 8 }) {
+                float ref[AVS_MAX_LUMA_COEFFS], out[AVS_MAX_LUMA_COEFFS];
+
+                avs_gen_coeffs_lanczos_c(ref, n, phase, config.num_phases, f);
+                avs_gen_coeffs_lanczos(out, n, phase, config.num_phases, f);
+                for (int i = 0; i < n; i++)
+                    EXPECT_NEAR(ref[i], out[i], 1e-5f)
+                        << "f " << f << " phase " << phase << " tap " << i;
+            }
+        }
+    }
+}
+
+TEST_F(AVSTest, CoefficientsNormalized)
+{
+    AVSState avs;
+
+    avs_init_state(&avs, &config);
+    ASSERT_TRUE(avs_update_coefficients(&avs, 0.5f, 2.0f / 3,
+                                        VA_FILTER_SCALING_HQ));
+
+    for (int i = 0; i <= config.num_phases; i++) {
+        const AVSCoeffs& c = avs.coeffs[i];
+
+        EXPECT_FLOAT_EQ(1.0f, sum(c.y_k_h, config.num_luma_coeffs));
+        EXPECT_FLOAT_EQ(1.0f, sum(c.y_k_v, config.num_luma_coeffs));
+        EXPECT_FLOAT_EQ(1.0f, sum(c.uv_k_h, config.num_chroma_coeffs));
+        EXPECT_FLOAT_EQ(1.0f, sum(c.uv_k_v, config.num_chroma_coeffs));
+    }
+}
+
+TEST_F(AVSTest, SharedAcrossStates)
+{
+    AVSState avs1, avs2, avs3;
+    unsigned long hits, misses, hits2, misses2;
+
+    memset(&avs1, 0, sizeof(avs1));
+    memset(&avs2, 0, sizeof(avs2));
+    memset(&avs3, 0, sizeof(avs3));
+
+    avs_init_state(&avs1, &config);
+    avs_init_state(&avs2, &config);
+    avs_init_state(&avs3, &config);
+
+    ASSERT_TRUE(avs_update_coefficients(&avs1, 0.37f, 0.61f,
+                                        VA_FILTER_SCALING_HQ));
+    avs_get_cache_stats(&hits, &misses);
+    ASSERT_TRUE(avs_update_coefficients(&avs2, 0.37f, 0.61f,
+                                        VA_FILTER_SCALING_HQ));
+    avs_get_cache_stats(&hits2, &misses2);
+    EXPECT_EQ(misses, misses2);
+    EXPECT_EQ(hits + 2, hits2);
+    EXPECT_EQ(0, memcmp(avs1.coeffs, avs2.coeffs, sizeof(avs1.coeffs)));
+
+    /* Axes are cached separately, so swapping them still hits */
+    ASSERT_TRUE(avs_update_coefficients(&avs3, 0.61f, 0.37f,
+                                        VA_FILTER_SCALING_HQ));
+    avs_get_cache_stats(&hits, &misses);
+    EXPECT_EQ(misses2, misses);
+    for (int i = 0; i <= config.num_phases; i++) {
+        EXPECT_EQ(0, memcmp(avs1.coeffs[i].y_k_h, avs3.coeffs[i].y_k_v,
+                            sizeof(avs1.coeffs[i].y_k_h)));
+        EXPECT_EQ(0, memcmp(avs1.coeffs[i].uv_k_v, avs3.coeffs[i].uv_k_h,
+                            sizeof(avs1.coeffs[i].uv_k_v)));
+    }
+}
+
+TEST_F(AVSTest, CommonRatiosPrecomputed)
+{
+    AVSState avs;
+    unsigned long hits, misses, hits2, misses2;
+
+    avs_get_cache_stats(&hits, &misses);
+    avs_init_state(&avs, &config);
+    avs_get_cache_stats(&hits2, &misses2);
+
+    /* Contexts without HQ scaling don't pay for the tables */
+    EXPECT_EQ(hits, hits2);
+    EXPECT_EQ(misses, misses2);
+
+    /* 1920x1080 to 1280x720, the first HQ use generates the usual ratios */
+    ASSERT_TRUE(avs_update_coefficients(&avs, (float)1280 / 1920,
+                                        (float)720 / 1080,
+                                        VA_FILTER_SCALING_HQ));
+    avs_get_cache_stats(&hits2, &misses2);
+    EXPECT_EQ(misses, misses2);
+    EXPECT_EQ(hits + 2, hits2);
+
+    /* Upscaling uses the same tables as 1:1 */
+    ASSERT_TRUE(avs_update_coefficients(&avs, 2.0f, 1.5f,
+                                        VA_FILTER_SCALING_HQ));
+    avs_get_cache_stats(&hits, &misses);
+    EXPECT_EQ(misses2, misses);
+}
+
+TEST_F(AVSTest, LinearIgnoresFactor)
+{
+    AVSState avs1, avs2;
+
+    memset(&avs1, 0, sizeof(avs1));
+    memset(&avs2, 0, sizeof(avs2));
+    avs_init_state(&avs1, &config);
+    avs_init_state(&avs2, &config);
+    ASSERT_TRUE(avs_update_coefficients(&avs1, 0.3f, 0.7f,
+                                        VA_FILTER_SCALING_DEFAULT));
+    ASSERT_TRUE(avs_update_coefficients(&avs2, 0.5f, 2.0f,
+                                        VA_FILTER_SCALING_DEFAULT));
+    EXPECT_EQ(0, memcmp(avs1.coeffs, avs2.coeffs, sizeof(avs1.coeffs)));
+}
+
+TEST_F(AVSTest, Benchmark)
+{
+    typedef void (*GenFunc)(float *, int, int, int, float);
+    const int iterations = 2000;
+    float coeffs[AVS_MAX_LUMA_COEFFS];
+    volatile float sink = 0.0f;
+
+    auto time_gen = [&](GenFunc gen) {
+        const auto start = std::chrono::steady_clock::now();
+        for (int n = 0; n < iterations; n++) {
+            for (int i = 0; i <= config.num_phases; i++) {
+                gen(coeffs, config.num_luma_coeffs, i, config.num_phases,
+                    0.5f + n * 1e-4f);
+                sink = sink + coeffs[0];
+            }
+        }
+        return std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    };
+
+    const double c = time_gen(avs_gen_coeffs_lanczos_c);
+    const double best = time_gen(avs_gen_coeffs_lanczos);
+
+    AVSState avs;
+    avs_init_state(&avs, &config);
+    const auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++) {
+        /* Alternate between two ratios, so that every update looks them up */
+        ASSERT_TRUE(avs_update_coefficients(&avs, n & 1 ? 0.5f : 0.75f,
+                                            n & 1 ? 0.5f : 0.75f,
+                                            VA_FILTER_SCALING_HQ));
+    }
+    const double cached = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "lanczos tables: C " << iterations / c / 1e3
+              << " K/s, best " << iterations / best / 1e3
+              << " K/s, cached updates " << iterations / cached / 1e3
+              << " K/s" << std::endl;
+}
+
+} // namespace
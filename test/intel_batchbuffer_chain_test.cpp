@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "i965_test_environment.h"
+
+extern "C" {
+    #include "intel_batchbuffer.h"
+    #include "intel_batchbuffer_decode.h"
+    #include "i965_defines.h"
+}
+
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct Submission {
+    drm_intel_bo *bo;
+    int used;
+};
+
+std::vector<Submission> submissions;
+
+int record_run(drm_intel_bo *bo, int used, drm_clip_rect_t *cliprects,
+               int num_cliprects, int DR4, unsigned int ring_flag)
+{
+    submissions.push_back(Submission{bo, used});
+    return 0;
+}
+
+class ChainTest : public ::testing::TestWithParam<int>
+{
+protected:
+    void SetUp()
+    {
+        I965TestEnvironment *env(I965TestEnvironment::instance());
+        ASSERT_PTR(env);
+
+        struct i965_driver_data *i965(*env);
+        ASSERT_PTR(i965);
+
+        /* Only the encoding of the jump depends on the generation */
+        submissions.clear();
+        intel = i965->intel;
+        device_info = *intel.device_info;
+        device_info.gen = GetParam();
+        intel.device_info = &device_info;
+
+        batch = intel_batchbuffer_new(&intel, I915_EXEC_BSD, 0);
+        ASSERT_PTR(batch);
+        batch->run = record_run;
+    }
+
+    void TearDown()
+    {
+        intel_batchbuffer_free(batch);
+    }
+
+    void emitObjects(unsigned count)
+    {
+        for (unsigned i = 0; i < count; i++) {
+            BEGIN_BCS_BATCH(batch, 12);
+            OUT_BCS_BATCH(batch, MFC_AVC_PAK_OBJECT | (12 - 2));
+            for (unsigned j = 1; j < 12; j++)
+                OUT_BCS_BATCH(batch, i);
+            ADVANCE_BCS_BATCH(batch);
+        }
+    }
+
+    /* Enough PAK objects to overflow a default sized batch */
+    unsigned overflowCount() const
+    {
+        return BATCH_SIZE / (12 * 4) + 1;
+    }
+
+    struct intel_device_info device_info;
+    struct intel_driver_data intel;
+    struct intel_batchbuffer *batch;
+};
+
+TEST_P(ChainTest, AtomicOverflowChains)
+{
+    intel_batchbuffer_start_atomic_bcs(batch, 0x1000);
+    emitObjects(overflowCount());
+    intel_batchbuffer_end_atomic(batch);
+
+    EXPECT_TRUE(submissions.empty());
+    ASSERT_EQ(1u, batch->num_links);
+
+    dri_bo *head = batch->links[0];
+    unsigned jump = batch->head_used / 4 - (GetParam() >= 8 ? 4 : 2);
+    std::vector<unsigned> dw(batch->head_used / 4);
+
+    ASSERT_EQ(0, dri_bo_get_subdata(head, 0, batch->head_used, &dw[0]));
+
+    /* The jump follows the last complete object, padded to a QWord */
+    EXPECT_EQ(0u, batch->head_used % 8);
+    EXPECT_EQ(0u, jump % 12);
+    EXPECT_EQ(MFC_AVC_PAK_OBJECT | (12 - 2), dw[jump - 12]);
+    EXPECT_EQ(MI_BATCH_BUFFER_START, dw[jump] & 0xff800000);
+    EXPECT_EQ(MFC_AVC_PAK_OBJECT | (12 - 2),
+              *reinterpret_cast<const unsigned *>(batch->map));
+
+    intel_batchbuffer_flush(batch);
+    ASSERT_EQ(1u, submissions.size());
+    EXPECT_EQ(head, submissions[0].bo);
+    EXPECT_EQ(int(batch->head_used), submissions[0].used);
+    EXPECT_EQ(0u, batch->num_links);
+
+    /* The head of the chain is reused for the next batch */
+    EXPECT_EQ(head, batch->buffer);
+    EXPECT_EQ(1u, batch->num_ring);
+}
+
+TEST_P(ChainTest, FlushesOutsideAtomic)
+{
+    emitObjects(overflowCount());
+
+    EXPECT_EQ(0u, batch->num_links);
+    EXPECT_EQ(1u, submissions.size());
+}
+
+TEST_P(ChainTest, LinksAreReused)
+{
+    intel_batchbuffer_start_atomic_bcs(batch, 0x1000);
+    emitObjects(overflowCount());
+    intel_batchbuffer_end_atomic(batch);
+    intel_batchbuffer_flush(batch);
+    ASSERT_EQ(1u, batch->num_ring);
+
+    dri_bo *link = batch->ring[0];
+
+    intel_batchbuffer_start_atomic_bcs(batch, 0x1000);
+    emitObjects(overflowCount());
+    intel_batchbuffer_end_atomic(batch);
+
+    EXPECT_EQ(0u, batch->num_ring);
+    EXPECT_EQ(link, batch->buffer);
+}
+
+TEST_P(ChainTest, OversizedData)
+{
+    std::vector<unsigned> data(BATCH_SIZE / 2, MI_NOOP);
+
+    intel_batchbuffer_start_atomic_bcs(batch, 0x1000);
+    emitObjects(1);
+    intel_batchbuffer_data(batch, &data[0], data.size() * 4);
+    intel_batchbuffer_end_atomic(batch);
+
+    EXPECT_EQ(1u, batch->num_links);
+    EXPECT_LE(data.size() * 4, batch->size);
+    EXPECT_EQ(data.size() * 4, unsigned(batch->ptr - batch->map));
+}
+
+TEST_P(ChainTest, RecordsSecondLevelLinks)
+{
+    char path[] = "/tmp/i965_chain_trace_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(-1, fd);
+    close(fd);
+
+    intel.batch_recorder = intel_batch_recorder_open(path, 0x1912, GetParam());
+    ASSERT_PTR(intel.batch_recorder);
+
+    intel_batchbuffer_start_atomic_bcs(batch, 0x1000);
+    emitObjects(2 * overflowCount());
+    intel_batchbuffer_end_atomic(batch);
+    ASSERT_EQ(2u, batch->num_links);
+    intel_batchbuffer_flush(batch);
+
+    EXPECT_EQ(3u, intel.batch_recorder->num_batches);
+    EXPECT_EQ(0u, intel.batch_recorder->num_incomplete);
+    intel_batch_recorder_close(intel.batch_recorder);
+    intel.batch_recorder = NULL;
+
+    intel_batch_trace_reader reader;
+    ASSERT_EQ(0, intel_batch_trace_open(&reader, path));
+
+    /* Only the head of the chain is run by the kernel */
+    for (unsigned i = 0; i < 3; i++) {
+        ASSERT_EQ(INTEL_BATCH_TRACE_BATCH, intel_batch_trace_next(&reader));
+        EXPECT_EQ(unsigned(I915_EXEC_BSD), reader.record.ring_flag & I915_EXEC_RING_MASK);
+        EXPECT_EQ(i > 0, !!(reader.record.ring_flag & INTEL_BATCH_TRACE_SECOND_LEVEL));
+        EXPECT_FALSE(reader.record.ring_flag & INTEL_BATCH_TRACE_INCOMPLETE);
+    }
+    EXPECT_EQ(0, intel_batch_trace_next(&reader));
+
+    intel_batch_trace_close(&reader);
+    unlink(path);
+}
+
+INSTANTIATE_TEST_CASE_P(Gens, ChainTest, ::testing::Values(7, 9));
+
+} // namespace
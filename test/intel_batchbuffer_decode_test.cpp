@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test.h"
+
+extern "C" {
+    #include <i915_drm.h>
+    #include "i965_defines.h"
+    #include "intel_batchbuffer_decode.h"
+}
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+const uint32_t MI_FLUSH_DW_CMD = (0x26 << 23) | (4 - 2);
+const uint32_t MI_BATCH_BUFFER_END_CMD = 0x0a << 23;
+
+std::string decode_name(unsigned gen, unsigned ring, uint32_t dw)
+{
+    intel_batch_command_info info;
+
+    intel_batch_decode_command(gen, ring, &dw, 1, &info);
+    return info.name ? info.name : "";
+}
+
+// One HEVC decode picture worth of commands, padded with payload DWORDs
+std::vector<uint32_t> hevc_batch(unsigned slices)
+{
+    std::vector<uint32_t> batch;
+
+    auto emit = [&](uint32_t cmd, unsigned length) {
+        batch.push_back(cmd | (length - 2));
+        batch.insert(batch.end(), length - 1, 0xdeadbeef);
+    };
+
+    emit(HCP_PIPE_MODE_SELECT, 4);
+    emit(HCP_SURFACE_STATE, 3);
+    emit(HCP_PIPE_BUF_ADDR_STATE, 95);
+    emit(HCP_IND_OBJ_BASE_ADDR_STATE, 14);
+    emit(HCP_PIC_STATE, 19);
+    for (unsigned i(0); i < slices; ++i) {
+        emit(HCP_SLICE_STATE, 9);
+        emit(HCP_BSD_OBJECT, 3);
+    }
+    emit(VD_PIPELINE_FLUSH, 2);
+    emit(MI_FLUSH_DW_CMD & ~0x3f, 4);
+    batch.push_back(MI_BATCH_BUFFER_END_CMD);
+    return batch;
+}
+
+const intel_batch_command_stats *
+find(const intel_batch_decode_stats& stats, const char *name)
+{
+    for (unsigned i(0); i < stats.num_commands; ++i)
+        if (stats.commands[i].name && !strcmp(stats.commands[i].name, name))
+            return &stats.commands[i];
+    return NULL;
+}
+
+} // namespace
+
+TEST(BatchDecodeTest, CommandNames)
+{
+    EXPECT_EQ("MI_NOOP", decode_name(9, I915_EXEC_BSD, 0));
+    EXPECT_EQ("MI_BATCH_BUFFER_END", decode_name(9, I915_EXEC_BSD, MI_BATCH_BUFFER_END_CMD));
+    EXPECT_EQ("MFX_AVC_IMG_STATE", decode_name(8, I915_EXEC_BSD, MFX_AVC_IMG_STATE | 14));
+    EXPECT_EQ("HCP_PIC_STATE", decode_name(9, I915_EXEC_BSD, HCP_PIC_STATE | 29));
+    EXPECT_EQ("HUC_START", decode_name(9, I915_EXEC_BSD, HUC_START));
+    EXPECT_EQ("VDENC_WALKER_STATE", decode_name(9, I915_EXEC_BSD, VDENC_WALKER_STATE | 2));
+    EXPECT_EQ("CMD_MEDIA_OBJECT_WALKER", decode_name(8, I915_EXEC_RENDER, CMD_MEDIA_OBJECT_WALKER | 15));
+
+    // The same opcodes mean different commands on other rings or generations
+    EXPECT_EQ("VEB_SURFACE_STATE", decode_name(8, I915_EXEC_VEBOX, VEB_SURFACE_STATE | 4));
+    EXPECT_EQ("MFX_VP8_PIC_STATE", decode_name(8, I915_EXEC_BSD, MFX_VP8_PIC_STATE | 36));
+    EXPECT_EQ("CMD_AVC_BSD_IMG_STATE", decode_name(5, I915_EXEC_BSD, CMD_AVC_BSD_IMG_STATE | 4));
+    EXPECT_EQ("CMD_MEDIA_VFE_STATE", decode_name(7, I915_EXEC_RENDER, CMD_MEDIA_VFE_STATE | 6));
+    EXPECT_EQ("CMD_MEDIA_STATE_POINTERS", decode_name(5, I915_EXEC_RENDER, CMD_MEDIA_STATE_POINTERS));
+    EXPECT_EQ("MFX_PIPE_MODE_SELECT", decode_name(7, I915_EXEC_BSD, MFX_PIPE_MODE_SELECT | 3));
+}
+
+TEST(BatchDecodeTest, CommandLengths)
+{
+    intel_batch_command_info info;
+    uint32_t dw;
+
+    dw = MFX_AVC_IMG_STATE | (16 - 2);
+    EXPECT_EQ(16u, intel_batch_decode_command(8, I915_EXEC_BSD, &dw, 100, &info));
+
+    dw = MFX_WAIT;
+    EXPECT_EQ(1u, intel_batch_decode_command(8, I915_EXEC_BSD, &dw, 100, &info));
+
+    dw = CMD_PIPELINE_SELECT | 2;
+    EXPECT_EQ(1u, intel_batch_decode_command(8, I915_EXEC_RENDER, &dw, 100, &info));
+
+    // Clamped to the end of the batch
+    dw = HCP_PIPE_BUF_ADDR_STATE | (95 - 2);
+    EXPECT_EQ(10u, intel_batch_decode_command(9, I915_EXEC_BSD, &dw, 10, &info));
+
+    // Unknown commands follow the length rules of their type
+    dw = (3u << 29) | (2 << 27) | (6 << 24) | (3 << 16) | 7;
+    EXPECT_EQ(9u, intel_batch_decode_command(9, I915_EXEC_BSD, &dw, 100, &info));
+    EXPECT_TRUE(info.name == NULL);
+    EXPECT_EQ(dw & 0xffff0000, info.key);
+
+    dw = (0x3f << 23) | 5;
+    EXPECT_EQ(7u, intel_batch_decode_command(9, I915_EXEC_BSD, &dw, 100, &info));
+    EXPECT_TRUE(info.name == NULL);
+}
+
+TEST(BatchDecodeTest, BatchStats)
+{
+    intel_batch_decode_stats *stats = new intel_batch_decode_stats;
+    std::vector<uint32_t> batch = hevc_batch(3);
+
+    // Trailing garbage after MI_BATCH_BUFFER_END is ignored
+    batch.push_back(0xffffffff);
+
+    intel_batch_decode_stats_reset(stats);
+    intel_batch_decode_batch(9, I915_EXEC_BSD, batch.data(), batch.size(), stats);
+
+    EXPECT_EQ(1u, stats->num_batches);
+    EXPECT_EQ(batch.size() - 1, stats->num_dwords);
+    EXPECT_EQ(0u, stats->num_unknown);
+
+    const intel_batch_command_stats *slice = find(*stats, "HCP_SLICE_STATE");
+    ASSERT_PTR(slice);
+    EXPECT_EQ(3u, slice->count);
+    EXPECT_EQ(27u, slice->dwords);
+
+    intel_batch_decode_stats_sort(stats);
+    EXPECT_STREQ("HCP_PIPE_BUF_ADDR_STATE", stats->commands[0].name);
+    for (unsigned i(1); i < stats->num_commands; ++i)
+        EXPECT_GE(stats->commands[i - 1].dwords, stats->commands[i].dwords);
+
+    delete stats;
+}
+
+TEST(BatchDecodeTest, SecondLevelStats)
+{
+    intel_batch_decode_stats *stats = new intel_batch_decode_stats;
+    std::vector<uint32_t> batch = hevc_batch(2);
+
+    // The flag doesn't change how the batch decodes
+    intel_batch_decode_stats_reset(stats);
+    intel_batch_decode_batch(9, I915_EXEC_BSD | INTEL_BATCH_TRACE_SECOND_LEVEL,
+                             batch.data(), batch.size(), stats);
+    intel_batch_decode_batch(9, I915_EXEC_BSD, batch.data(), batch.size(), stats);
+
+    EXPECT_EQ(2u, stats->num_batches);
+    EXPECT_EQ(1u, stats->num_second_level);
+    EXPECT_EQ(0u, stats->num_unknown);
+    const intel_batch_command_stats *object = find(*stats, "HCP_BSD_OBJECT");
+    ASSERT_PTR(object);
+    EXPECT_EQ(4u, object->count);
+
+    delete stats;
+}
+
+TEST(BatchDecodeTest, RecordAndReplay)
+{
+    char path[] = "/tmp/i965_batch_trace_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(-1, fd);
+    close(fd);
+
+    intel_batch_recorder *recorder = intel_batch_recorder_open(path, 0x1912, 9);
+    ASSERT_PTR(recorder);
+
+    intel_batch_trace_reloc reloc = { 8, 0x100, 2, 2, 42, 4096 };
+    std::vector<uint32_t> frame0 = hevc_batch(1), frame1 = hevc_batch(4);
+
+    intel_batch_recorder_write_batch(recorder, I915_EXEC_BSD, frame0.data(),
+                                     frame0.size(), &reloc, 1);
+    intel_batch_recorder_write_frame(recorder);
+    intel_batch_recorder_write_batch(recorder, I915_EXEC_BSD, frame1.data(),
+                                     frame1.size(), NULL, 0);
+    intel_batch_recorder_write_batch(recorder, I915_EXEC_BSD, frame1.data(),
+                                     frame1.size(), NULL, 0);
+    intel_batch_recorder_write_frame(recorder);
+    EXPECT_EQ(3u, recorder->num_batches);
+    EXPECT_EQ(2u, recorder->num_frames);
+    intel_batch_recorder_close(recorder);
+
+    intel_batch_trace_reader reader;
+    ASSERT_EQ(0, intel_batch_trace_open(&reader, path));
+    EXPECT_EQ(0x1912u, reader.header.device_id);
+    EXPECT_EQ(9u, reader.header.gen);
+
+    ASSERT_EQ(INTEL_BATCH_TRACE_BATCH, intel_batch_trace_next(&reader));
+    EXPECT_EQ(unsigned(I915_EXEC_BSD), reader.record.ring_flag);
+    ASSERT_EQ(frame0.size(), reader.record.num_dwords);
+    EXPECT_EQ(0, memcmp(frame0.data(), reader.dwords, frame0.size() * 4));
+    ASSERT_EQ(1u, reader.record.num_relocs);
+    EXPECT_EQ(42u, reader.relocs[0].target_handle);
+    EXPECT_EQ(0x100u, reader.relocs[0].delta);
+
+    ASSERT_EQ(INTEL_BATCH_TRACE_FRAME, intel_batch_trace_next(&reader));
+
+    intel_batch_decode_stats *stats = new intel_batch_decode_stats;
+    intel_batch_decode_stats_reset(stats);
+    int type;
+    while ((type = intel_batch_trace_next(&reader)) == INTEL_BATCH_TRACE_BATCH)
+        intel_batch_decode_batch(reader.header.gen, reader.record.ring_flag,
+                                 reader.dwords, reader.record.num_dwords, stats);
+    EXPECT_EQ(INTEL_BATCH_TRACE_FRAME, type);
+    EXPECT_EQ(0, intel_batch_trace_next(&reader));
+
+    EXPECT_EQ(2u, stats->num_batches);
+    EXPECT_EQ(2 * frame1.size(), stats->num_dwords);
+    const intel_batch_command_stats *object = find(*stats, "HCP_BSD_OBJECT");
+    ASSERT_PTR(object);
+    EXPECT_EQ(8u, object->count);
+
+    delete stats;
+    intel_batch_trace_close(&reader);
+
+    // A truncated trace is reported as such
+    ASSERT_EQ(0, truncate(path, sizeof(intel_batch_trace_header) +
+                          sizeof(intel_batch_trace_record) + 8));
+    ASSERT_EQ(0, intel_batch_trace_open(&reader, path));
+    EXPECT_EQ(-1, intel_batch_trace_next(&reader));
+    intel_batch_trace_close(&reader);
+
+    unlink(path);
+}
+
+TEST(BatchDecodeTest, RejectsOtherFiles)
+{
+    char path[] = "/tmp/i965_batch_trace_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(-1, fd);
+    ASSERT_EQ(64, write(fd, std::string(64, 'x').data(), 64));
+    close(fd);
+
+    intel_batch_trace_reader reader;
+    EXPECT_EQ(-1, intel_batch_trace_open(&reader, path));
+    EXPECT_EQ(-1, intel_batch_trace_open(&reader, "/nonexistent/trace"));
+
+    unlink(path);
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "i965_test_environment.h"
+
+extern "C" {
+    #include "intel_batchbuffer.h"
+    #include "i965_defines.h"
+}
+
+namespace {
+
+int discard_run(drm_intel_bo *bo, int used, drm_clip_rect_t *cliprects,
+                int num_cliprects, int DR4, unsigned int ring_flag)
+{
+    return 0;
+}
+
+class BatchRingTest : public ::testing::Test
+{
+protected:
+    void SetUp()
+    {
+        I965TestEnvironment *env(I965TestEnvironment::instance());
+        ASSERT_PTR(env);
+
+        struct i965_driver_data *i965(*env);
+        ASSERT_PTR(i965);
+
+        intel = i965->intel;
+        intel.batch_ring_size = 2;
+        intel.batch_bo_allocs = 0;
+        intel.batch_bo_reuses = 0;
+        intel.batch_bo_stalls = 0;
+
+        batch = intel_batchbuffer_new(&intel, I915_EXEC_BSD, 0);
+        ASSERT_PTR(batch);
+        batch->run = discard_run;
+    }
+
+    void TearDown()
+    {
+        if (batch)
+            intel_batchbuffer_free(batch);
+    }
+
+    void emitFlush()
+    {
+        BEGIN_BCS_BATCH(batch, 4);
+        OUT_BCS_BATCH(batch, MI_FLUSH_DW);
+        OUT_BCS_BATCH(batch, 0);
+        OUT_BCS_BATCH(batch, 0);
+        OUT_BCS_BATCH(batch, 0);
+        ADVANCE_BCS_BATCH(batch);
+    }
+
+    struct intel_driver_data intel;
+    struct intel_batchbuffer *batch;
+};
+
+TEST_F(BatchRingTest, IdleBufferReused)
+{
+    dri_bo *first = batch->buffer;
+
+    /* Nothing is executed, so the buffer is idle right away */
+    for (int i = 0; i < 8; i++) {
+        emitFlush();
+        intel_batchbuffer_flush(batch);
+        EXPECT_EQ(first, batch->buffer);
+    }
+
+    EXPECT_EQ(1ul, batch->bo_allocs);
+    EXPECT_EQ(8ul, batch->bo_reuses);
+    EXPECT_EQ(0ul, batch->bo_stalls);
+}
+
+TEST_F(BatchRingTest, MappedOnce)
+{
+    unsigned char *map = batch->map;
+
+    emitFlush();
+    intel_batchbuffer_flush(batch);
+
+    if (intel.has_llc) {
+        EXPECT_TRUE(batch->persistent_map);
+        EXPECT_EQ(map, batch->map);
+    }
+
+    EXPECT_PTR(batch->map);
+    EXPECT_EQ(batch->map, batch->ptr);
+}
+
+TEST_F(BatchRingTest, Bounded)
+{
+    /* A chain of three buffers is more than the ring keeps */
+    intel_batchbuffer_start_atomic_bcs(batch, 0x1000);
+    for (unsigned i = 0; i < 2 * BATCH_SIZE / 16 + 1; i++)
+        emitFlush();
+    intel_batchbuffer_end_atomic(batch);
+
+    EXPECT_EQ(2u, batch->num_links);
+    EXPECT_EQ(3ul, batch->bo_allocs);
+
+    intel_batchbuffer_flush(batch);
+    EXPECT_EQ(1u, batch->num_ring);
+    EXPECT_EQ(1ul, batch->bo_reuses);
+}
+
+TEST_F(BatchRingTest, RelocationsCleared)
+{
+    dri_bo *first = batch->buffer;
+    dri_bo *target = dri_bo_alloc(intel.bufmgr, "target", 4096, 4096);
+    ASSERT_PTR(target);
+
+    BEGIN_BCS_BATCH(batch, 4);
+    OUT_BCS_BATCH(batch, MI_FLUSH_DW);
+    OUT_BCS_RELOC(batch, target, I915_GEM_DOMAIN_RENDER, 0, 0);
+    OUT_BCS_BATCH(batch, 0);
+    OUT_BCS_BATCH(batch, 0);
+    ADVANCE_BCS_BATCH(batch);
+    EXPECT_TRUE(drm_intel_bo_references(first, target));
+
+    intel_batchbuffer_flush(batch);
+    ASSERT_EQ(first, batch->buffer);
+    EXPECT_FALSE(drm_intel_bo_references(first, target));
+
+    dri_bo_unreference(target);
+}
+
+TEST_F(BatchRingTest, CountersSummedOnFree)
+{
+    emitFlush();
+    intel_batchbuffer_flush(batch);
+
+    intel_batchbuffer_free(batch);
+    batch = NULL;
+
+    EXPECT_EQ(1ul, intel.batch_bo_allocs);
+    EXPECT_EQ(1ul, intel.batch_bo_reuses);
+    EXPECT_EQ(0ul, intel.batch_bo_stalls);
+}
+
+} // namespace
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test.h"
+
+extern "C" {
+    #include "intel_batchbuffer.h"
+    #include "i965_defines.h"
+    #include "i965_thread_pool.h"
+}
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const unsigned kNumSlices = 12;
+
+/* Stands in for the PAK object generation of one slice */
+void emit_slice(struct intel_batchbuffer *batch, unsigned slice)
+{
+    unsigned num_objects = 50 + slice * 37;
+
+    BEGIN_BCS_BATCH(batch, 3);
+    OUT_BCS_BATCH(batch, MFX_AVC_SLICE_STATE | (3 - 2));
+    OUT_BCS_BATCH(batch, slice);
+    OUT_BCS_BATCH(batch, num_objects);
+    ADVANCE_BCS_BATCH(batch);
+
+    for (unsigned i = 0; i < num_objects; i++) {
+        BEGIN_BCS_BATCH(batch, 12);
+        OUT_BCS_BATCH(batch, MFC_AVC_PAK_OBJECT | (12 - 2));
+        for (unsigned j = 1; j < 12; j++)
+            OUT_BCS_BATCH(batch, (slice << 24) ^ (i << 8) ^ j);
+        ADVANCE_BCS_BATCH(batch);
+    }
+}
+
+struct SliceJob {
+    std::vector<struct intel_batchbuffer *> segments;
+};
+
+void slice_job(void *arg, unsigned job_index)
+{
+    SliceJob *job = static_cast<SliceJob *>(arg);
+
+    emit_slice(job->segments[job_index], job_index);
+}
+
+class SegmentTest : public ::testing::Test
+{
+protected:
+    void SetUp()
+    {
+        memset(&intel, 0, sizeof(intel));
+    }
+
+    size_t used(struct intel_batchbuffer *batch) const
+    {
+        return batch->ptr - batch->map;
+    }
+
+    struct intel_driver_data intel;
+};
+
+TEST_F(SegmentTest, Grows)
+{
+    struct intel_batchbuffer *segment =
+        intel_batchbuffer_new_segment(&intel, I915_EXEC_BSD, 0);
+
+    ASSERT_PTR(segment);
+    EXPECT_FALSE(segment->buffer);
+
+    unsigned initial_size = segment->size;
+    emit_slice(segment, kNumSlices);
+    EXPECT_LT(initial_size, segment->size);
+
+    const unsigned *dw = reinterpret_cast<const unsigned *>(segment->map);
+    EXPECT_EQ(MFX_AVC_SLICE_STATE | (3 - 2), dw[0]);
+    EXPECT_EQ(kNumSlices, dw[1]);
+    EXPECT_EQ((3 + dw[2] * 12) * 4, used(segment));
+
+    intel_batchbuffer_free(segment);
+}
+
+TEST_F(SegmentTest, ParallelMatchesSerial)
+{
+    struct intel_batchbuffer *serial =
+        intel_batchbuffer_new_segment(&intel, I915_EXEC_BSD, 0);
+    struct intel_batchbuffer *parallel =
+        intel_batchbuffer_new_segment(&intel, I915_EXEC_BSD, 0);
+    I965ThreadPool pool;
+    SliceJob job;
+
+    for (unsigned i = 0; i < kNumSlices; i++)
+        emit_slice(serial, i);
+
+    for (unsigned i = 0; i < kNumSlices; i++)
+        job.segments.push_back(intel_batchbuffer_new_segment(&intel, I915_EXEC_BSD, 0));
+
+    i965_thread_pool_init(&pool, 4);
+    i965_thread_pool_run(&pool, slice_job, &job, kNumSlices);
+    i965_thread_pool_terminate(&pool);
+
+    for (unsigned i = 0; i < kNumSlices; i++) {
+        intel_batchbuffer_append(parallel, job.segments[i]);
+        intel_batchbuffer_free(job.segments[i]);
+    }
+
+    ASSERT_EQ(used(serial), used(parallel));
+    EXPECT_EQ(0, memcmp(serial->map, parallel->map, used(serial)));
+
+    intel_batchbuffer_free(serial);
+    intel_batchbuffer_free(parallel);
+}
+
+TEST_F(SegmentTest, AppendResetsStateShadow)
+{
+    struct intel_batchbuffer *batch =
+        intel_batchbuffer_new_segment(&intel, I915_EXEC_BSD, 0);
+    struct intel_batchbuffer *segment =
+        intel_batchbuffer_new_segment(&intel, I915_EXEC_BSD, 0);
+
+    for (int i = 0; i < 2; i++) {
+        BEGIN_BCS_BATCH(batch, 3);
+        OUT_BCS_BATCH(batch, MFX_QM_STATE | (3 - 2));
+        OUT_BCS_BATCH(batch, 0);
+        OUT_BCS_BATCH(batch, 16);
+        ADVANCE_BCS_BATCH_STATE(batch, 0, 0);
+    }
+    EXPECT_EQ(12u, used(batch));
+
+    /* The segment may have changed the state behind the shadow's back */
+    emit_slice(segment, 0);
+    intel_batchbuffer_append(batch, segment);
+
+    BEGIN_BCS_BATCH(batch, 3);
+    OUT_BCS_BATCH(batch, MFX_QM_STATE | (3 - 2));
+    OUT_BCS_BATCH(batch, 0);
+    OUT_BCS_BATCH(batch, 16);
+    ADVANCE_BCS_BATCH_STATE(batch, 0, 0);
+    EXPECT_EQ(12u + used(segment) + 12u, used(batch));
+
+    intel_batchbuffer_free(segment);
+    intel_batchbuffer_free(batch);
+}
+
+} // namespace
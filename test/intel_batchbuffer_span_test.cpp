@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "test.h"
+
+extern "C" {
+    #include "intel_batchbuffer.h"
+    #include "i965_defines.h"
+}
+
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+const int kPakObjectLength = 12;
+
+/* Same layout as an AVC PAK object, once per emission path */
+void emit_pak_object(struct intel_batchbuffer *batch, unsigned mb, unsigned qp)
+{
+    BEGIN_BCS_BATCH(batch, kPakObjectLength);
+    OUT_BCS_BATCH(batch, MFC_AVC_PAK_OBJECT | (kPakObjectLength - 2));
+    OUT_BCS_BATCH(batch, 0);
+    OUT_BCS_BATCH(batch, 0);
+    OUT_BCS_BATCH(batch, (1 << 19) | (1 << 18) | (1 << 17) | mb);
+    OUT_BCS_BATCH(batch, (0xFFFF << 16) | mb);
+    OUT_BCS_BATCH(batch, 0x000F000F);
+    OUT_BCS_BATCH(batch, (mb & 1) << 26 | qp);
+    OUT_BCS_BATCH(batch, mb * 3);
+    OUT_BCS_BATCH(batch, mb * 5);
+    OUT_BCS_BATCH(batch, mb & 0xFF);
+    OUT_BCS_BATCH(batch, (32 << 24) | (24 << 16));
+    OUT_BCS_BATCH(batch, 0);
+    ADVANCE_BCS_BATCH(batch);
+}
+
+void emit_pak_object_span(struct intel_batchbuffer *batch, unsigned mb, unsigned qp)
+{
+    unsigned int *dw;
+
+    BEGIN_BCS_BATCH_SPAN(batch, kPakObjectLength, dw);
+    *dw++ = MFC_AVC_PAK_OBJECT | (kPakObjectLength - 2);
+    *dw++ = 0;
+    *dw++ = 0;
+    *dw++ = (1 << 19) | (1 << 18) | (1 << 17) | mb;
+    *dw++ = (0xFFFF << 16) | mb;
+    *dw++ = 0x000F000F;
+    *dw++ = (mb & 1) << 26 | qp;
+    *dw++ = mb * 3;
+    *dw++ = mb * 5;
+    *dw++ = mb & 0xFF;
+    *dw++ = (32 << 24) | (24 << 16);
+    *dw++ = 0;
+    ADVANCE_BCS_BATCH_SPAN(batch, dw);
+}
+
+class SpanTest : public ::testing::Test
+{
+protected:
+    void SetUp()
+    {
+        memset(&intel, 0, sizeof(intel));
+    }
+
+    size_t used(struct intel_batchbuffer *batch) const
+    {
+        return batch->ptr - batch->map;
+    }
+
+    struct intel_driver_data intel;
+};
+
+TEST_F(SpanTest, MatchesOutBatch)
+{
+    struct intel_batchbuffer *out =
+        intel_batchbuffer_new_segment(&intel, I915_EXEC_BSD, 0);
+    struct intel_batchbuffer *span =
+        intel_batchbuffer_new_segment(&intel, I915_EXEC_BSD, 0);
+
+    /* Enough objects to make both segments grow a few times */
+    for (unsigned mb = 0; mb < 1000; mb++) {
+        emit_pak_object(out, mb, 26);
+        emit_pak_object_span(span, mb, 26);
+    }
+
+    ASSERT_EQ(1000u * kPakObjectLength * 4, used(span));
+    ASSERT_EQ(used(out), used(span));
+    EXPECT_EQ(0, memcmp(out->map, span->map, used(out)));
+
+    intel_batchbuffer_free(out);
+    intel_batchbuffer_free(span);
+}
+
+TEST_F(SpanTest, StateShadowSeesSpans)
+{
+    struct intel_batchbuffer *batch =
+        intel_batchbuffer_new_segment(&intel, I915_EXEC_BSD, 0);
+    unsigned int *dw;
+
+    for (int i = 0; i < 2; i++) {
+        BEGIN_BCS_BATCH(batch, 3);
+        OUT_BCS_BATCH(batch, MFX_QM_STATE | (3 - 2));
+        OUT_BCS_BATCH(batch, 0);
+        OUT_BCS_BATCH(batch, 16);
+        ADVANCE_BCS_BATCH_STATE(batch, 0, 0);
+    }
+    EXPECT_EQ(12u, used(batch));
+
+    /* A pipeline change written through a span still drops the shadow */
+    BEGIN_BCS_BATCH_SPAN(batch, 2, dw);
+    *dw++ = MFX_PIPE_MODE_SELECT | (2 - 2);
+    *dw++ = 0;
+    ADVANCE_BCS_BATCH_SPAN(batch, dw);
+
+    BEGIN_BCS_BATCH(batch, 3);
+    OUT_BCS_BATCH(batch, MFX_QM_STATE | (3 - 2));
+    OUT_BCS_BATCH(batch, 0);
+    OUT_BCS_BATCH(batch, 16);
+    ADVANCE_BCS_BATCH_STATE(batch, 0, 0);
+    EXPECT_EQ(32u, used(batch));
+
+    intel_batchbuffer_free(batch);
+}
+
+#ifndef NDEBUG
+TEST_F(SpanTest, GuardCatchesOverrun)
+{
+    struct intel_batchbuffer *batch =
+        intel_batchbuffer_new_segment(&intel, I915_EXEC_BSD, 0);
+
+    EXPECT_DEATH({
+        unsigned int *dw;
+
+        BEGIN_BCS_BATCH_SPAN(batch, 2, dw);
+        dw[0] = MFX_PIPE_MODE_SELECT | (2 - 2);
+        dw[1] = 0;
+        dw[2] = 0;
+        ADVANCE_BCS_BATCH_SPAN(batch, dw + 2);
+    }, "");
+
+    EXPECT_DEATH({
+        unsigned int *dw;
+
+        BEGIN_BCS_BATCH_SPAN(batch, 2, dw);
+        *dw++ = MFX_PIPE_MODE_SELECT | (2 - 2);
+        ADVANCE_BCS_BATCH_SPAN(batch, dw);
+    }, "");
+
+    intel_batchbuffer_free(batch);
+}
+#endif
+
+TEST_F(SpanTest, Benchmark)
+{
+    const unsigned num_mbs = 8160;     /* 1080p */
+    const int runs(64);
+
+    auto bench = [&](const char *name,
+                     std::function<void(struct intel_batchbuffer *, unsigned, unsigned)> emit) {
+        struct intel_batchbuffer *batch =
+            intel_batchbuffer_new_segment(&intel, I915_EXEC_BSD,
+                                          num_mbs * kPakObjectLength * 4 + 4096);
+        auto start = std::chrono::steady_clock::now();
+        for (int i(0); i < runs; ++i) {
+            batch->ptr = batch->map;
+            for (unsigned mb(0); mb < num_mbs; ++mb)
+                emit(batch, mb, 26);
+        }
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        std::cout << name << ": " << std::fixed << std::setprecision(1)
+            << (double(num_mbs) * runs / elapsed.count() / 1e6)
+            << " M commands/s" << std::endl;
+        EXPECT_EQ(num_mbs * kPakObjectLength * 4, used(batch));
+        intel_batchbuffer_free(batch);
+    };
+
+    bench("OUT_BCS_BATCH", emit_pak_object);
+    bench("BEGIN_BCS_BATCH_SPAN", emit_pak_object_span);
+}
+
+} // namespace
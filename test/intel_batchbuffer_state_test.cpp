@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test.h"
+
+extern "C" {
+    #include "intel_batchbuffer.h"
+    #include "i965_defines.h"
+}
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+class StateShadowTest : public ::testing::Test
+{
+protected:
+    void SetUp()
+    {
+        storage.assign(4096, 0);
+        memset(&intel, 0, sizeof(intel));
+        memset(&shadow_batch, 0, sizeof(shadow_batch));
+        batch = &shadow_batch;
+        batch->intel = &intel;
+        batch->flag = I915_EXEC_RENDER;
+        batch->map = batch->ptr = reinterpret_cast<unsigned char *>(&storage[0]);
+        batch->size = storage.size() * 4;
+    }
+
+    size_t used() const
+    {
+        return (batch->ptr - batch->map) / 4;
+    }
+
+    void emitVfe(unsigned threads, unsigned flags = 0)
+    {
+        BEGIN_BATCH(batch, 3);
+        OUT_BATCH(batch, CMD_MEDIA_VFE_STATE | (3 - 2));
+        OUT_BATCH(batch, 0);
+        OUT_BATCH(batch, threads << 16);
+        ADVANCE_BATCH_STATE(batch, 0, flags);
+    }
+
+    void emitQm(unsigned type, unsigned value)
+    {
+        BEGIN_BATCH(batch, 3);
+        OUT_BATCH(batch, MFX_QM_STATE | (3 - 2));
+        OUT_BATCH(batch, type);
+        OUT_BATCH(batch, value);
+        ADVANCE_BATCH_STATE(batch, type, 0);
+    }
+
+    void emitPlain(unsigned cmd)
+    {
+        BEGIN_BATCH(batch, 2);
+        OUT_BATCH(batch, cmd);
+        OUT_BATCH(batch, 0);
+        ADVANCE_BATCH(batch);
+    }
+
+    std::vector<uint32_t> storage;
+    struct intel_driver_data intel;
+    struct intel_batchbuffer shadow_batch;
+    struct intel_batchbuffer *batch;
+};
+
+TEST_F(StateShadowTest, DuplicateSkipped)
+{
+    emitVfe(32);
+    EXPECT_EQ(3u, used());
+
+    emitPlain(CMD_MEDIA_OBJECT_WALKER);
+    emitVfe(32);
+    EXPECT_EQ(5u, used());
+    EXPECT_EQ(6ul, batch->state_dwords_emitted);
+    EXPECT_EQ(3ul, batch->state_dwords_saved);
+
+    emitVfe(64);
+    EXPECT_EQ(8u, used());
+    EXPECT_EQ(64u << 16, storage[7]);
+
+    /* Back to the first value, which is no longer the current state */
+    emitVfe(32);
+    EXPECT_EQ(11u, used());
+}
+
+TEST_F(StateShadowTest, KeySeparatesIndexedState)
+{
+    emitQm(MFX_QM_AVC_4X4_INTRA_MATRIX, 16);
+    emitQm(MFX_QM_AVC_4X4_INTER_MATRIX, 16);
+    EXPECT_EQ(6u, used());
+
+    emitQm(MFX_QM_AVC_4X4_INTRA_MATRIX, 16);
+    emitQm(MFX_QM_AVC_4X4_INTER_MATRIX, 16);
+    EXPECT_EQ(6u, used());
+    EXPECT_EQ(6ul, batch->state_dwords_saved);
+}
+
+TEST_F(StateShadowTest, BaseAddressInvalidatesRelative)
+{
+    emitVfe(32);
+    emitPlain(CMD_STATE_BASE_ADDRESS);
+    emitVfe(32);
+    EXPECT_EQ(5u, used());
+
+    intel_batchbuffer_invalidate_state(batch, 0);
+    emitVfe(32, INTEL_BATCH_STATE_BASE_RELATIVE);
+    emitVfe(32, INTEL_BATCH_STATE_BASE_RELATIVE);
+    EXPECT_EQ(8u, used());
+
+    emitPlain(CMD_STATE_BASE_ADDRESS);
+    emitVfe(32, INTEL_BATCH_STATE_BASE_RELATIVE);
+    EXPECT_EQ(13u, used());
+}
+
+TEST_F(StateShadowTest, PipelineChangeInvalidatesAll)
+{
+    emitVfe(32);
+    emitQm(MFX_QM_AVC_4X4_INTRA_MATRIX, 16);
+    EXPECT_EQ(6u, used());
+
+    emitPlain(MFX_PIPE_MODE_SELECT);
+    emitVfe(32);
+    emitQm(MFX_QM_AVC_4X4_INTRA_MATRIX, 16);
+    EXPECT_EQ(14u, used());
+
+    intel_batchbuffer_invalidate_state(batch, 0);
+    emitVfe(32);
+    EXPECT_EQ(17u, used());
+}
+
+TEST_F(StateShadowTest, RelocatedPacketKept)
+{
+    emitVfe(32);
+
+    BEGIN_BATCH(batch, 3);
+    OUT_BATCH(batch, CMD_MEDIA_VFE_STATE | (3 - 2));
+    batch->last_reloc = batch->ptr;
+    OUT_BATCH(batch, 0);
+    OUT_BATCH(batch, 32 << 16);
+    ADVANCE_BATCH_STATE(batch, 0, 0);
+
+    EXPECT_EQ(6u, used());
+    EXPECT_EQ(0ul, batch->state_dwords_saved);
+}
+
+TEST_F(StateShadowTest, PlainPacketOverridesShadow)
+{
+    emitVfe(32);
+
+    BEGIN_BATCH(batch, 3);
+    OUT_BATCH(batch, CMD_MEDIA_VFE_STATE | (3 - 2));
+    OUT_BATCH(batch, 0);
+    OUT_BATCH(batch, 64 << 16);
+    ADVANCE_BATCH(batch);
+
+    emitVfe(32);
+    EXPECT_EQ(9u, used());
+    EXPECT_EQ(0ul, batch->state_dwords_saved);
+}
+
+TEST_F(StateShadowTest, MultiPacketBlockInvalidatesAll)
+{
+    emitVfe(32);
+
+    BEGIN_BATCH(batch, 4);
+    OUT_BATCH(batch, CMD_MEDIA_OBJECT_WALKER | (2 - 2));
+    OUT_BATCH(batch, 0);
+    OUT_BATCH(batch, CMD_MEDIA_VFE_STATE | (2 - 2));
+    OUT_BATCH(batch, 0);
+    ADVANCE_BATCH(batch);
+
+    emitVfe(32);
+    EXPECT_EQ(10u, used());
+    EXPECT_EQ(0ul, batch->state_dwords_saved);
+}
+
+TEST_F(StateShadowTest, RawDwordInvalidatesAll)
+{
+    emitVfe(32);
+
+    OUT_BATCH(batch, CMD_PIPELINE_SELECT | PIPELINE_SELECT_MEDIA);
+
+    emitVfe(32);
+    EXPECT_EQ(7u, used());
+    EXPECT_EQ(0ul, batch->state_dwords_saved);
+}
+
+} // namespace
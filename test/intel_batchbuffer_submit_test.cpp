@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "i965_test_environment.h"
+
+extern "C" {
+    #include "intel_batchbuffer.h"
+    #include "i965_defines.h"
+}
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::mutex executed_mutex;
+std::vector<drm_intel_bo *> executed;
+
+int record_run(drm_intel_bo *bo, int used, drm_clip_rect_t *cliprects,
+               int num_cliprects, int DR4, unsigned int ring_flag)
+{
+    std::lock_guard<std::mutex> lock(executed_mutex);
+    executed.push_back(bo);
+    return 0;
+}
+
+size_t num_executed()
+{
+    std::lock_guard<std::mutex> lock(executed_mutex);
+    return executed.size();
+}
+
+class SubmitQueueTest : public ::testing::Test
+{
+protected:
+    void SetUp()
+    {
+        I965TestEnvironment *env(I965TestEnvironment::instance());
+        ASSERT_PTR(env);
+
+        struct i965_driver_data *i965(*env);
+        ASSERT_PTR(i965);
+
+        intel = i965->intel;
+        intel.submit_queue = NULL;
+        intel.submit_batches = 0;
+        intel.submit_execs = 0;
+        executed.clear();
+    }
+
+    void TearDown()
+    {
+        for (size_t i = 0; i < batches.size(); i++)
+            intel_batchbuffer_free(batches[i]);
+        intel_submit_queue_terminate(&intel);
+    }
+
+    void startQueue(unsigned threshold, unsigned delay_us = 1000000)
+    {
+        ASSERT_TRUE(intel_submit_queue_init(&intel, threshold, delay_us));
+    }
+
+    struct intel_batchbuffer *newBatch(int flag, bool deferred = true)
+    {
+        struct intel_batchbuffer *batch = intel_batchbuffer_new(&intel, flag, 0);
+
+        EXPECT_PTR(batch);
+        batch->run = record_run;
+        if (deferred)
+            intel_batchbuffer_defer_submit(batch);
+        batches.push_back(batch);
+        return batch;
+    }
+
+    void emitNoops(struct intel_batchbuffer *batch)
+    {
+        BEGIN_BATCH(batch, 2);
+        OUT_BATCH(batch, MI_NOOP);
+        OUT_BATCH(batch, MI_NOOP);
+        ADVANCE_BATCH(batch);
+    }
+
+    struct intel_driver_data intel;
+    std::vector<struct intel_batchbuffer *> batches;
+};
+
+TEST_F(SubmitQueueTest, SameRingCoalesced)
+{
+    startQueue(8);
+
+    struct intel_batchbuffer *first = newBatch(I915_EXEC_RENDER);
+    struct intel_batchbuffer *second = newBatch(I915_EXEC_RENDER);
+    dri_bo *head = first->buffer;
+
+    emitNoops(first);
+    intel_batchbuffer_flush(first);
+    emitNoops(second);
+    intel_batchbuffer_flush(second);
+
+    EXPECT_EQ(0u, num_executed());
+    EXPECT_TRUE(first->queued);
+    EXPECT_TRUE(intel_submit_queue_references(&intel, head));
+
+    intel_submit_queue_flush(&intel);
+    ASSERT_EQ(1u, num_executed());
+    EXPECT_EQ(head, executed[0]);
+    EXPECT_FALSE(first->queued);
+    EXPECT_FALSE(second->queued);
+    EXPECT_EQ(2ul, intel.submit_batches);
+    EXPECT_EQ(1ul, intel.submit_execs);
+
+    /* The end of the first batch became a jump to the second one */
+    uint32_t dwords[64];
+    bool jump = false, end = false;
+
+    dri_bo_get_subdata(head, 0, sizeof(dwords), dwords);
+    for (unsigned i = 0; i < 64; i++) {
+        jump |= (dwords[i] & 0xff800000) == MI_BATCH_BUFFER_START;
+        end |= dwords[i] == MI_BATCH_BUFFER_END;
+    }
+    EXPECT_TRUE(jump);
+    EXPECT_FALSE(end);
+}
+
+TEST_F(SubmitQueueTest, RingsNotLinked)
+{
+    startQueue(8);
+
+    struct intel_batchbuffer *render = newBatch(I915_EXEC_RENDER);
+    struct intel_batchbuffer *bsd = newBatch(I915_EXEC_BSD);
+
+    emitNoops(render);
+    intel_batchbuffer_flush(render);
+
+    BEGIN_BCS_BATCH(bsd, 2);
+    OUT_BCS_BATCH(bsd, MI_NOOP);
+    OUT_BCS_BATCH(bsd, MI_NOOP);
+    ADVANCE_BCS_BATCH(bsd);
+    intel_batchbuffer_flush(bsd);
+
+    intel_submit_queue_flush(&intel);
+    EXPECT_EQ(2u, num_executed());
+    EXPECT_EQ(2ul, intel.submit_execs);
+}
+
+TEST_F(SubmitQueueTest, Threshold)
+{
+    startQueue(2);
+
+    struct intel_batchbuffer *first = newBatch(I915_EXEC_RENDER);
+    struct intel_batchbuffer *second = newBatch(I915_EXEC_RENDER);
+
+    emitNoops(first);
+    intel_batchbuffer_flush(first);
+    EXPECT_EQ(0u, num_executed());
+
+    emitNoops(second);
+    intel_batchbuffer_flush(second);
+    EXPECT_EQ(1u, num_executed());
+    EXPECT_EQ(2ul, intel.submit_batches);
+}
+
+TEST_F(SubmitQueueTest, OneBatchPerContext)
+{
+    startQueue(8);
+
+    struct intel_batchbuffer *batch = newBatch(I915_EXEC_RENDER);
+    dri_bo *head = batch->buffer;
+
+    emitNoops(batch);
+    intel_batchbuffer_flush(batch);
+    emitNoops(batch);
+    intel_batchbuffer_flush(batch);
+
+    /* The first batch went out before the second one was queued */
+    ASSERT_EQ(1u, num_executed());
+    EXPECT_EQ(head, executed[0]);
+    EXPECT_TRUE(batch->queued);
+
+    intel_batchbuffer_sync_queued(batch);
+    EXPECT_EQ(2u, num_executed());
+    EXPECT_FALSE(batch->queued);
+}
+
+TEST_F(SubmitQueueTest, ImmediateFlushKeepsOrder)
+{
+    startQueue(8);
+
+    struct intel_batchbuffer *deferred = newBatch(I915_EXEC_RENDER);
+    struct intel_batchbuffer *immediate = newBatch(I915_EXEC_RENDER, false);
+    dri_bo *first = deferred->buffer;
+    dri_bo *second = immediate->buffer;
+
+    emitNoops(deferred);
+    intel_batchbuffer_flush(deferred);
+    emitNoops(immediate);
+    intel_batchbuffer_flush(immediate);
+
+    ASSERT_EQ(2u, num_executed());
+    EXPECT_EQ(first, executed[0]);
+    EXPECT_EQ(second, executed[1]);
+}
+
+TEST_F(SubmitQueueTest, Timer)
+{
+    startQueue(8, 1000);
+
+    struct intel_batchbuffer *batch = newBatch(I915_EXEC_RENDER);
+
+    emitNoops(batch);
+    intel_batchbuffer_flush(batch);
+
+    for (int i = 0; i < 1000 && !num_executed(); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_EQ(1u, num_executed());
+}
+
+TEST_F(SubmitQueueTest, References)
+{
+    startQueue(8);
+
+    struct intel_batchbuffer *batch = newBatch(I915_EXEC_RENDER);
+    dri_bo *target = dri_bo_alloc(intel.bufmgr, "target", 4096, 4096);
+    ASSERT_PTR(target);
+
+    BEGIN_BATCH(batch, 2);
+    OUT_BATCH(batch, MI_NOOP);
+    OUT_RELOC(batch, target, I915_GEM_DOMAIN_RENDER, 0, 0);
+    ADVANCE_BATCH(batch);
+    EXPECT_FALSE(intel_submit_queue_references(&intel, target));
+
+    intel_batchbuffer_flush(batch);
+    EXPECT_TRUE(intel_submit_queue_references(&intel, target));
+
+    intel_submit_queue_flush(&intel);
+    EXPECT_FALSE(intel_submit_queue_references(&intel, target));
+
+    dri_bo_unreference(target);
+}
+
+TEST_F(SubmitQueueTest, SubmittedOnFree)
+{
+    startQueue(8);
+
+    struct intel_batchbuffer *batch = newBatch(I915_EXEC_RENDER);
+
+    emitNoops(batch);
+    intel_batchbuffer_flush(batch);
+    EXPECT_EQ(0u, num_executed());
+
+    intel_batchbuffer_free(batch);
+    batches.clear();
+    EXPECT_EQ(1u, num_executed());
+}
+
+TEST_F(SubmitQueueTest, NotDeferredWithoutQueue)
+{
+    struct intel_batchbuffer *batch = newBatch(I915_EXEC_RENDER);
+
+    EXPECT_FALSE(batch->defer_submit);
+
+    emitNoops(batch);
+    intel_batchbuffer_flush(batch);
+    EXPECT_EQ(1u, num_executed());
+}
+
+} // namespace
@@ -29,9 +29,12 @@ extern "C" {
 }
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
 #include <ctime>
 #include <iomanip>
+#include <thread>
 #include <vector>
 
 TEST(ObjectHeapTest, Init)
@@ -41,16 +44,16 @@ TEST(ObjectHeapTest, Init)
         int i;
     };
 
-    struct object_heap heap = {
-        object_size: -1,
-        id_offset: -1,
-        next_free: -1,
-        heap_size: -1,
-        heap_increment: -1,
-        mutex: {},
-        bucket: NULL,
-        num_buckets: -1,
-    };
+    struct object_heap heap;
+
+    heap.object_size = -1;
+    heap.id_offset = -1;
+    heap.next_free = -1;
+    heap.heap_size = -1;
+    heap.heap_increment = -1;
+    heap.bucket = NULL;
+    heap.num_buckets = -1;
+    heap.max_buckets = -1;
 
     EXPECT_EQ(0, object_heap_init(&heap, sizeof(test_object), 0xffffffff));
 
@@ -60,7 +63,8 @@ TEST(ObjectHeapTest, Init)
     EXPECT_LE(1, heap.heap_increment);
     EXPECT_EQ(heap.heap_increment, heap.heap_size);
     EXPECT_PTR(heap.bucket);
-    EXPECT_LE(1, heap.num_buckets);
+    EXPECT_EQ(1, heap.num_buckets);
+    EXPECT_EQ(OBJECT_HEAP_MAX_OBJECTS, heap.max_buckets * heap.heap_increment);
 
     object_heap_destroy(&heap);
 
@@ -76,7 +80,8 @@ TEST(ObjectHeapTest, Init)
     EXPECT_LE(1, heap.heap_increment);
     EXPECT_EQ(heap.heap_increment, heap.heap_size);
     EXPECT_PTR(heap.bucket);
-    EXPECT_LE(1, heap.num_buckets);
+    EXPECT_EQ(1, heap.num_buckets);
+    EXPECT_EQ(OBJECT_HEAP_MAX_OBJECTS, heap.max_buckets * heap.heap_increment);
 
     object_heap_destroy(&heap);
 
@@ -246,3 +251,176 @@ TEST(ObjectHeapTest, OffsetID)
         object_heap_destroy(&heap);
     }
 }
+
+TEST(ObjectHeapTest, StaleID)
+{
+    struct object_heap heap = {};
+
+    ASSERT_EQ(0, object_heap_init(&heap, sizeof(object_base), 0x04000000));
+
+    int id = object_heap_allocate(&heap);
+    object_base_p obj = object_heap_lookup(&heap, id);
+    ASSERT_PTR(obj);
+
+    // recycle the same slot repeatedly, every old ID must be rejected
+    for (int i(0); i < 2 * (OBJECT_HEAP_GEN_MASK >> OBJECT_HEAP_GEN_SHIFT); ++i)
+    {
+        object_heap_free(&heap, obj);
+        EXPECT_PTR_NULL(object_heap_lookup(&heap, id));
+
+        int new_id = object_heap_allocate(&heap);
+        EXPECT_NE(id, new_id);
+        EXPECT_EQ(id & OBJECT_HEAP_INDEX_MASK, new_id & OBJECT_HEAP_INDEX_MASK);
+        EXPECT_EQ(id & OBJECT_HEAP_OFFSET_MASK, new_id & OBJECT_HEAP_OFFSET_MASK);
+
+        EXPECT_PTR_NULL(object_heap_lookup(&heap, id));
+        EXPECT_TRUE(obj == object_heap_lookup(&heap, new_id));
+        id = new_id;
+    }
+
+    // IDs from another heap, or beyond the heap size, are rejected
+    EXPECT_PTR_NULL(object_heap_lookup(&heap, (id & ~OBJECT_HEAP_OFFSET_MASK) | 0x08000000));
+    EXPECT_PTR_NULL(object_heap_lookup(&heap, 0x04000000 | heap.heap_size));
+    EXPECT_PTR_NULL(object_heap_lookup(&heap, -1));
+
+    object_heap_free(&heap, obj);
+    object_heap_destroy(&heap);
+}
+
+TEST(ObjectHeapTest, MultiThreaded)
+{
+    struct test_object {
+        struct object_base base;
+        int owner;
+        int serial;
+    };
+
+    typedef test_object *test_object_p;
+    struct object_heap heap = {};
+
+    ASSERT_EQ(0, object_heap_init(&heap, sizeof(test_object), 0x08000000));
+
+    const int nthreads(std::max(4u, std::thread::hardware_concurrency()));
+    const int iterations(20000);
+    std::atomic<int> errors(0);
+
+    auto worker = [&](int owner) {
+        std::vector<int> ids;
+        std::srand(owner);
+
+        for (int i(0); i < iterations; ++i) {
+            if (ids.empty() || (ids.size() < 64 && std::rand() % 2)) {
+                int id = object_heap_allocate(&heap);
+                test_object_p object = (test_object_p)object_heap_lookup(&heap, id);
+                if (!object) {
+                    ++errors;
+                    continue;
+                }
+                object->owner = owner;
+                object->serial = i;
+                ids.push_back(id);
+            } else {
+                size_t n = std::rand() % ids.size();
+                int id = ids[n];
+                test_object_p object = (test_object_p)object_heap_lookup(&heap, id);
+                if (!object || object->owner != owner || object->base.id != id) {
+                    ++errors;
+                    continue;
+                }
+                object_heap_free(&heap, &object->base);
+                if (object_heap_lookup(&heap, id))
+                    ++errors;
+                ids[n] = ids.back();
+                ids.pop_back();
+            }
+        }
+
+        for (int id : ids) {
+            object_base_p base = object_heap_lookup(&heap, id);
+            if (!base || ((test_object_p)base)->owner != owner)
+                ++errors;
+            object_heap_free(&heap, base);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i(0); i < nthreads; ++i)
+        threads.push_back(std::thread(worker, i));
+    std::for_each(threads.begin(), threads.end(),
+        [](std::thread& t){ t.join(); });
+
+    EXPECT_EQ(0, errors.load());
+
+    // all objects must be back on the free list exactly once
+    object_heap_iterator iter;
+    EXPECT_PTR_NULL(object_heap_first(&heap, &iter));
+
+    std::vector<bool> seen(heap.heap_size, false);
+    int count(0);
+    for (int index = heap.next_free; index >= 0; ++count) {
+        ASSERT_LT(index, heap.heap_size);
+        ASSERT_FALSE(seen[index]);
+        seen[index] = true;
+        object_base_p obj = (object_base_p)((char *)heap.bucket[index / heap.heap_increment]
+            + (index % heap.heap_increment) * heap.object_size);
+        index = obj->next_free;
+    }
+    EXPECT_EQ(heap.heap_size, count);
+
+    object_heap_destroy(&heap);
+}
+
+TEST(ObjectHeapTest, LookupThroughput)
+{
+    struct object_heap heap = {};
+
+    ASSERT_EQ(0, object_heap_init(&heap, sizeof(object_base), 0x04000000));
+
+    std::vector<int> ids(1024);
+    std::generate(ids.begin(), ids.end(),
+        [&]{ return object_heap_allocate(&heap); });
+
+    const int nthreads(std::max(1u, std::thread::hardware_concurrency()));
+    const int lookups(1 << 20);
+    std::atomic<int> misses(0);
+
+    auto worker = [&] {
+        int local_misses(0);
+        for (int i(0); i < lookups; ++i) {
+            if (!object_heap_lookup(&heap, ids[i % ids.size()]))
+                ++local_misses;
+        }
+        misses += local_misses;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i(0); i < nthreads; ++i)
+        threads.push_back(std::thread(worker));
+    std::for_each(threads.begin(), threads.end(),
+        [](std::thread& t){ t.join(); });
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(0, misses.load());
+
+    std::cout << "object_heap_lookup: " << nthreads << " threads, "
+        << std::fixed << std::setprecision(1)
+        << (double(lookups) * nthreads / elapsed.count() / 1e6)
+        << " Mlookups/s" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    for (int i(0); i < lookups / 16; ++i) {
+        object_heap_free(&heap, object_heap_lookup(&heap, ids[i % ids.size()]));
+        ids[i % ids.size()] = object_heap_allocate(&heap);
+    }
+    elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "object_heap_free+allocate: "
+        << (double(lookups / 16) / elapsed.count() / 1e6)
+        << " Mops/s" << std::endl;
+
+    std::for_each(ids.begin(), ids.end(),
+        [&](int id){ object_heap_free(&heap, object_heap_lookup(&heap, id)); });
+    object_heap_destroy(&heap);
+}